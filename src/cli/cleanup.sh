@@ -1,3 +1,3 @@
 #!/bin/sh
 
-rm -rf Tables Columns Indexes  *.tbl tbl* sizes_file rids_file *.op *.pp left_* right_*
+rm -rf Tables Columns Indexes Log *.fsm *.tbl tbl* sizes_file rids_file *.op *.pp left_* right_*
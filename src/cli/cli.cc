@@ -1198,6 +1198,7 @@ RC CLI::load()
 
   string line, token;
   char * tokenizer;
+  vector<const void *> tuples;
   while (ifs.good()) {
     getline(ifs, line);
     if (line.compare("") == 0)
@@ -1247,7 +1248,11 @@ RC CLI::load()
       if (keyIndex == attributes.size())
         keyIndex = 0;
     }
-    if (this->insertTupleToDB(tableName, attributes, buffer, indexMap) != 0) {
+    // the tuples are inserted a batch at a time
+    void *tuple = malloc(offset);
+    memcpy(tuple, buffer, offset);
+    tuples.push_back(tuple);
+    if (tuples.size() == LOAD_BATCH_SIZE && this->insertTuplesToDB(tableName, tuples) != 0) {
       return error("error while inserting tuple");
     }
 
@@ -1256,6 +1261,9 @@ RC CLI::load()
     // for (std::vector<Attribute>::iterator it = attrs.begin() ; it != attrs.end(); ++it)
     // totalLength += it->length;
   }
+  if (this->insertTuplesToDB(tableName, tuples) != 0) {
+    return error("error while inserting tuple");
+  }
   // clear up indexMap
   for (auto it=indexMap.begin(); it != indexMap.end(); ++it) {
     free (it->second);
@@ -1366,6 +1374,20 @@ RC CLI::insertTupleToDB(const string tableName, const vector<Attribute> attribut
   return 0;
 }
 
+RC CLI::insertTuplesToDB(const string tableName, vector<const void *> &tuples) {
+  vector<RID> rids;
+
+  // insert the tuples to given table, then release them
+  RC rc = tuples.empty() ? 0 : rm->insertTuples(tableName, tuples, rids);
+  for (uint i = 0; i < tuples.size(); i++)
+    free((void *) tuples[i]);
+  tuples.clear();
+  if (rc != 0)
+    return error("error CLI::insertTuplesToDB in rm->insertTuples");
+
+  return 0;
+}
+
 RC CLI::printAttributes()
 {
   char * tokenizer = next();
@@ -17,6 +17,9 @@
 
 using namespace std;
 
+// # of tuples a load inserts at once
+#define LOAD_BATCH_SIZE 1024
+
 typedef enum{ FILTER = 0, PROJECT, BNL_JOIN, INL_JOIN, GH_JOIN, AGG, IDX_SCAN, TBL_SCAN } QUERY_OP;
 
 // Return code
@@ -102,6 +105,7 @@ private:
   RC printOutputBuffer(vector<string> &buffer, uint mod);
   RC updateOutputBuffer(vector<string> &buffer, void *data, vector<Attribute> &attrs);
   RC insertTupleToDB(const string tableName, const vector<Attribute> attributes, const void *data, unordered_map<int, void *> indexMap);
+  RC insertTuplesToDB(const string tableName, vector<const void *> &tuples);
   RC getAttribute(const string name, const vector<Attribute> pool, Attribute &attr);
 
   RelationManager * rm;
@@ -1,5 +1,6 @@
 
 #include "ix.h"
+#include "../rbf/wal.h"
 
 #define PRIMARY_SUFFIX  ".pp"
 #define OVERFLOW_SUFFIX ".op"
@@ -464,6 +465,92 @@ RC IndexManager::getNumberOfAllPages(IXFileHandle &ixfileHandle, unsigned &numbe
     return SUCCESSFUL;
 }
 
+/**
+ * Give the disk space of dead pages back: overflow pages unlinked from
+ * their bucket (counted as deleted in the metadata) and primary pages of
+ * buckets merged away. Trailing ones are truncated, holes are punched
+ * over the others. Nothing is reclaimed within a transaction, since the
+ * changes are not logged.
+ */
+RC IndexManager::reclaimSpace(IXFileHandle &ixfileHandle, const Attribute &attribute)
+{
+    RC err;
+    if (LogManager::inTransaction()) {
+        return SUCCESSFUL;
+    }
+    MetadataPage metadata(ixfileHandle._overflowHandle);
+    if (!metadata.isInitialized()) {
+        return ERR_METADATA_MISSING;
+    }
+
+    // Primary pages past the last bucket
+    unsigned primaryPageCount = metadata.getPrimaryPageCount();
+    unsigned bucketCount = ixfileHandle._primaryHandle.getNumberOfPages();
+    if (bucketCount > primaryPageCount) {
+        if ((err = ixfileHandle._primaryHandle.truncatePages(primaryPageCount)) != SUCCESSFUL) {
+            __trace();
+            return err;
+        }
+        bucketCount = primaryPageCount;
+    }
+
+    // Find the overflow pages still linked from a bucket
+    unsigned overflowPageCount = metadata.getOverflowPageCount();
+    vector<bool> live(overflowPageCount + 1, false);
+    for (unsigned i = 0; i < bucketCount; i++) {
+        vector<DataPage *> cache;
+        loadBucketChain(cache, ixfileHandle, i, attribute.type);
+        for (size_t j = 1; j < cache.size(); j++) {
+            if (cache[j]->getPageNum() <= overflowPageCount) {
+                live[cache[j]->getPageNum()] = true;
+            }
+        }
+        if ((err = flushBucketChain(cache)) != SUCCESSFUL) {
+            __trace();
+            return err;
+        }
+    }
+
+    // Dead pages at the end are truncated; the metadata goes first so
+    // that it never counts missing pages
+    unsigned keep = overflowPageCount;
+    while (keep > 0 && !live[keep]) {
+        keep--;
+    }
+    if (keep < overflowPageCount) {
+        unsigned deleted = metadata.getDelOverflowPageCount();
+        unsigned trimmed = overflowPageCount - keep;
+        metadata.setDelOverflowPageCount(deleted > trimmed ? deleted - trimmed : 0);
+        metadata.setOverflowPageCount(keep);
+        if ((err = metadata.flush()) != SUCCESSFUL) {
+            __trace();
+            return err;
+        }
+        if (ixfileHandle._overflowHandle.getNumberOfPages() > keep + 1
+                && (err = ixfileHandle._overflowHandle.truncatePages(keep + 1)) != SUCCESSFUL) {
+            __trace();
+            return err;
+        }
+    }
+
+    // Punch a hole over each run of dead pages in between
+    for (unsigned i = 1; i <= keep; ) {
+        if (live[i]) {
+            i++;
+            continue;
+        }
+        unsigned start = i;
+        while (i <= keep && !live[i]) {
+            i++;
+        }
+        if ((err = ixfileHandle._overflowHandle.punchPages(start, i - start)) != SUCCESSFUL) {
+            __trace();
+            return err;
+        }
+    }
+
+    return SUCCESSFUL;
+}
 
 RC IndexManager::scan(IXFileHandle &ixfileHandle,
     const Attribute &attribute,
@@ -513,6 +600,7 @@ RC IndexManager::scan(IXFileHandle &ixfileHandle,
         ix_ScanIterator._curBucketNum = 0;
         ix_ScanIterator._curPageIndex = 0;
         ix_ScanIterator._curRangeIndex = 0;
+        ix_ScanIterator._readAheadEnd = 0;
     }
     ix_ScanIterator._totalBucketNum = metadata.getPrimaryPageCount();
     ix_ScanIterator._curBucket.clear();
@@ -847,6 +935,8 @@ RC IX_ScanIterator::getNextRangeMatch(RID &rid, void *key) {
 
     while (_curBucketNum < _totalBucketNum) {
         if (_curBucket.empty()) {
+            // Primary pages are visited in order, so read them ahead
+            _ixFileHandle._primaryHandle.readAhead(_curBucketNum, _readAheadEnd);
             _ixm->loadBucketChain(_curBucket, _ixFileHandle, _curBucketNum, _keyType);
         }
 
@@ -978,12 +1068,14 @@ RC MetadataPage::initialize(const unsigned &numberOfPages) {
 RC MetadataPage::load() {
 //    __trace();
     RC err;
-    char page[PAGE_SIZE];
+    void *frame;
 
-    if ((err = _fileHandle.readPage(0, page)) != SUCCESSFUL) {
+    // Deserialize straight from the buffer pool
+    if ((err = _fileHandle.pinPage(0, frame)) != SUCCESSFUL) {
         __trace();
         return err;
     }
+    char *page = (char *) frame;
 
     int offset = 0;
     memcpy((char *) &_entryCount, page + offset, sizeof(int));
@@ -1003,7 +1095,7 @@ RC MetadataPage::load() {
 
 //    printMetadata();
 
-    return SUCCESSFUL;
+    return _fileHandle.unpinPage(0, false);
 }
 
 RC MetadataPage::flush() {
@@ -1153,9 +1245,10 @@ RC DataPage::initialize() {
 
 RC DataPage::load() {
     RC err;
-    char page[PAGE_SIZE];
+    void *page;
 
-    if ((err = _fileHandle.readPage(_pageNum, page)) != SUCCESSFUL) {
+    // Deserialize straight from the buffer pool
+    if ((err = _fileHandle.pinPage(_pageNum, page)) != SUCCESSFUL) {
         __trace();
         return err;
     }
@@ -1163,6 +1256,10 @@ RC DataPage::load() {
     // load all information from the page
     loadMetadata(page);
     deserializeData(page);
+    if ((err = _fileHandle.unpinPage(_pageNum, false)) != SUCCESSFUL) {
+        __trace();
+        return err;
+    }
 
     // build the hash map
     for (size_t i = 0; i < _keys.size(); i++) {
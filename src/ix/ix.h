@@ -107,6 +107,9 @@ class IndexManager {
   // Get the number of all pages (primary + overflow)
   RC getNumberOfAllPages(IXFileHandle &ixfileHandle, unsigned &numberOfAllPages);
 
+  // Maintenance: give the disk space of deleted overflow pages and of merged buckets back
+  RC reclaimSpace(IXFileHandle &ixfileHandle, const Attribute &attribute);
+
  protected:
   IndexManager   ();                            // Constructor
   ~IndexManager  ();                            // Destructor
@@ -396,6 +399,7 @@ private:
   unsigned _curPageIndex;   // _curBucket[_curPageIndex]
   unsigned _curHashIndex;   // Used in hash scan: _entryMap[key][_curHashIndex]
   unsigned _curRangeIndex;  // Used in range scan: _keys[_curRangeIndex]
+  PageNum _readAheadEnd;    // Used in range scan: primary pages before it have been requested ahead
 };
 
 // print out the error message for a given return code
@@ -42,6 +42,20 @@ static RC readValue(const void *data, const void *value, const string &attrName,
     return ERR_NO_ATTR;
 }
 
+// Largest size of a tuple of the given attributes, which bounds the size
+// of its values as well: records are only stored when their strings fit
+// the declared lengths
+static unsigned maxTupleSize(const vector<Attribute> &attrs) {
+    unsigned size = 0;
+    for (auto it = attrs.begin(); it != attrs.end(); ++it) {
+        size += sizeof(int);
+        if (it->type == TypeVarChar) {
+            size += it->length;
+        }
+    }
+    return size;
+}
+
 // Append a new value to the existing data chain (assuming the buffer size is enough)
 static void appendValue(void *now, unsigned nowSize, void *newval, unsigned valSize) {
     memcpy((char *)now + nowSize, newval, valSize);
@@ -87,6 +101,11 @@ Filter::Filter(Iterator* input, const Condition &condition)
     : _iterator(input), _condition(condition) {
     // right hand side of the condition must be a literal value
     assert(!condition.bRhsIsAttr);
+    if (input != nullptr) {
+        vector<Attribute> attrs;
+        input->getAttributes(attrs);
+        _value.resize(maxTupleSize(attrs));
+    }
 }
 
 RC Filter::getNextTuple(void *data) {
@@ -97,14 +116,13 @@ RC Filter::getNextTuple(void *data) {
     vector<Attribute> attrs;
     getAttributes(attrs);
     while (_iterator->getNextTuple(data) != QE_EOF) {
-        char val[PAGE_SIZE];
         unsigned valsize = 0;
-        if (readValue(data, val, _condition.lhsAttr, attrs, valsize) != SUCCESSFUL) {
+        if (readValue(data, &_value[0], _condition.lhsAttr, attrs, valsize) != SUCCESSFUL) {
             __trace();
             cout << "Condition attribute name: " << _condition.lhsAttr << endl;
             return QE_EOF;
         }
-        if (isMatch(val, _condition.rhsValue.data, _condition.rhsValue.type, _condition.op)) {
+        if (isMatch(&_value[0], _condition.rhsValue.data, _condition.rhsValue.type, _condition.op)) {
             return SUCCESSFUL;
         }
     }
@@ -127,23 +145,25 @@ Project::Project(Iterator *input, const vector<string> &attrNames)
         __trace();
         return;
     }
+    vector<Attribute> attrs;
+    input->getAttributes(attrs);
+    _tuple.resize(maxTupleSize(attrs));
+    _value.resize(_tuple.size());
 }
 
 RC Project::getNextTuple(void *data) {
 //    __trace();
     vector<Attribute> origin;
     _iterator->getAttributes(origin);
-    char buf[PAGE_SIZE];
-    if (_iterator->getNextTuple(buf) != QE_EOF) {
+    if (_iterator->getNextTuple(&_tuple[0]) != QE_EOF) {
         unsigned offset = 0;
         for (auto it = _attrNames.begin(); it != _attrNames.end(); ++it) {
-            char value[PAGE_SIZE];
             unsigned len;
-            if (readValue(buf, value, *it, origin, len) != SUCCESSFUL) {
+            if (readValue(&_tuple[0], &_value[0], *it, origin, len) != SUCCESSFUL) {
                 __trace();
                 return QE_EOF;
             }
-            appendValue(data, offset, value, len);
+            appendValue(data, offset, &_value[0], len);
             offset += len;
         }
 //        __trace();
@@ -174,17 +194,19 @@ void Project::getAttributes(vector<Attribute> &attrs) const {
  */
 // PartitionBuilder
 PartitionBuilder::PartitionBuilder(const string &partitionName,
-        const vector<Attribute> &attrs)
+        const vector<Attribute> &attrs, unsigned pageSize)
     : _fileName(partitionName), _attrs(attrs),
     _rbfm(RecordBasedFileManager::instance()),
     _sm(SpaceManager::instance()),
-    _pfm(PagedFileManager::instance()) {
+    _pfm(PagedFileManager::instance()),
+    _pageSize(pageSize), _buffer(new char[pageSize]) {
 
     RC err = init();
     assert(err == SUCCESSFUL);
 }
 
 PartitionBuilder::~PartitionBuilder() {
+    delete[] _buffer;
 //    __trace();
 //    cout << "Destroying partition: " << _fileName << endl;
 //    RC err = _rbfm->destroyFile(_fileName);
@@ -193,7 +215,7 @@ PartitionBuilder::~PartitionBuilder() {
 
 RC PartitionBuilder::init() {
     RC err;
-    if ((err = _rbfm->createFile(_fileName)) != SUCCESSFUL) {
+    if ((err = _rbfm->createFile(_fileName, _pageSize)) != SUCCESSFUL) {
         __trace();
         return err;
     }
@@ -202,7 +224,7 @@ RC PartitionBuilder::init() {
         return err;
     }
 
-    _sm->initCleanPage(_buffer);
+    _sm->initCleanPage(_buffer, _pageSize);
     return SUCCESSFUL;
 }
 
@@ -215,19 +237,19 @@ RC PartitionBuilder::insertTuple(void *tuple) {
         return err;
     }
 
-    if (_sm->getPageFreeSize(_buffer) < tupleSize) {
+    if (_sm->getPageFreeSize(_buffer, _pageSize) < tupleSize) {
         if ((err = _fileHandle.appendPage(_buffer)) != SUCCESSFUL) {
             __trace();
             return err;
         }
-        _sm->initCleanPage(_buffer);
+        _sm->initCleanPage(_buffer, _pageSize);
     }
-    unsigned freePtr = _sm->getFreePtr(_buffer);
-    unsigned slotCount = _sm->getSlotCount(_buffer);
+    unsigned freePtr = _sm->getFreePtr(_buffer, _pageSize);
+    unsigned slotCount = _sm->getSlotCount(_buffer, _pageSize);
     _sm->writeRecord(_buffer, tuple, freePtr, tupleSize);
-    _sm->setSlot(_buffer, slotCount, freePtr, tupleSize);
-    _sm->setSlotCount(_buffer, slotCount + 1);
-    _sm->setFreePtr(_buffer, freePtr + tupleSize);
+    _sm->setSlot(_buffer, _pageSize, slotCount, freePtr, tupleSize);
+    _sm->setSlotCount(_buffer, _pageSize, slotCount + 1);
+    _sm->setFreePtr(_buffer, _pageSize, freePtr + tupleSize);
 
     return SUCCESSFUL;
 }
@@ -253,7 +275,7 @@ string PartitionBuilder::getPartitionName() {
 PartitionReader::PartitionReader(const string &partitionName,
         const vector<Attribute> &attrs)
       : _fileName(partitionName), _attrs(attrs),
-        _curPageNum(0), _curSlotNum(0),
+        _curPageNum(0), _curSlotNum(0), _readAheadEnd(0),
         _rbfm(RecordBasedFileManager::instance()),
         _sm(SpaceManager::instance()),
         _pfm(PagedFileManager::instance()) {
@@ -263,32 +285,32 @@ PartitionReader::PartitionReader(const string &partitionName,
 }
 
 PartitionReader::~PartitionReader() {
-    // Deallocate buffer
-    for (unsigned i = 0; i < _pageCount; i++) {
-        delete[] _buffer[i];
-    }
+    // Pages live in the mapping of the file
     delete[] _buffer;
+    RC err = _rbfm->closeFile(_fileHandle);
+    assert(err == SUCCESSFUL);
 
     // Delete partitions created by associated PartitionBuilder
-    RC err = _rbfm->destroyFile(_fileName);
+    err = _rbfm->destroyFile(_fileName);
     assert(err == SUCCESSFUL);
 }
 
 RC PartitionReader::init() {
     RC err;
 
-    // Open partition file
-    if ((err = _rbfm->openFile(_fileName, _fileHandle)) != SUCCESSFUL) {
+    // Open partition file (it is not written anymore, so map it)
+    if ((err = _rbfm->openFile(_fileName, _fileHandle, IO_MMAP)) != SUCCESSFUL) {
         __trace();
         return err;
     }
 
     _pageCount = _fileHandle.getNumberOfPages();
+    _pageSize = _fileHandle.getPageSize();
 
-    // Allocate buffer
+    // Pointers to pages in the mapping
     _buffer = new char*[_pageCount];
     for (unsigned i = 0; i < _pageCount; i++) {
-        _buffer[i] = new char[PAGE_SIZE];
+        _buffer[i] = NULL;
     }
 
     return SUCCESSFUL;
@@ -297,18 +319,21 @@ RC PartitionReader::init() {
 RC PartitionReader::getNextTuple(void *tuple, RID &rid, unsigned &size) {
     while (_curPageNum < _pageCount) {
         if (_curSlotNum == 0) {
-            if (_fileHandle.readPage(_curPageNum, _buffer[_curPageNum]) != SUCCESSFUL) {
+            _fileHandle.readAhead(_curPageNum, _readAheadEnd);
+            void *page;
+            if (_fileHandle.pinPage(_curPageNum, page) != SUCCESSFUL) {
                 __trace();
                 return QE_EOF;
             }
+            _buffer[_curPageNum] = (char *) page;
         }
-        unsigned slotCount = _sm->getSlotCount(_buffer[_curPageNum]);
+        unsigned slotCount = _sm->getSlotCount(_buffer[_curPageNum], _pageSize);
         if (_curSlotNum >= slotCount) {
             _curSlotNum = 0;
             _curPageNum++;
         } else {
-            unsigned start = _sm->getSlotStartPos(_buffer[_curPageNum], _curSlotNum);
-            unsigned len = _sm->getSlotLength(_buffer[_curPageNum], _curSlotNum);
+            unsigned start = _sm->getSlotStartPos(_buffer[_curPageNum], _pageSize, _curSlotNum);
+            unsigned len = _sm->getSlotLength(_buffer[_curPageNum], _pageSize, _curSlotNum);
             _sm->readRecord(_buffer[_curPageNum], tuple, start, len);
             rid.pageNum = _curPageNum;
             rid.slotNum = _curSlotNum;
@@ -328,14 +353,14 @@ RC PartitionReader::getTupleFromCache(void *tuple, unsigned &size, const RID &ri
         __trace();
         return ERR_OUT_OF_BOUND;
     }
-    unsigned slotCount = _sm->getSlotCount(_buffer[pageNum]);
+    unsigned slotCount = _sm->getSlotCount(_buffer[pageNum], _pageSize);
     if (slotNum >= slotCount) {
         __trace();
         return ERR_OUT_OF_BOUND;
     }
 
-    unsigned start = _sm->getSlotStartPos(_buffer[pageNum], slotNum);
-    unsigned len = _sm->getSlotLength(_buffer[pageNum], slotNum);
+    unsigned start = _sm->getSlotStartPos(_buffer[pageNum], _pageSize, slotNum);
+    unsigned len = _sm->getSlotLength(_buffer[pageNum], _pageSize, slotNum);
     _sm->readRecord(_buffer[pageNum], tuple, start, len);
     size = len;
     return SUCCESSFUL;
@@ -360,11 +385,15 @@ GHJoin::GHJoin(Iterator *leftIn,
         const unsigned numPartitions)
     : _joinNumber(_joinNumberGlobal++) ,_leftIn(leftIn), _rightIn(rightIn),
       _condition(condition), _numPartitions(numPartitions),
-      _leftReader(nullptr), _rightReader(nullptr), _curPartition(0) {
+      _leftReader(nullptr), _rightReader(nullptr), _curPartition(0), _rsize(0) {
     assert(leftIn != nullptr);
     assert(rightIn != nullptr);
     _leftIn->getAttributes(_leftAttrs);
     _rightIn->getAttributes(_rightAttrs);
+    _ltuple.resize(maxTupleSize(_leftAttrs));
+    _lval.resize(_ltuple.size());
+    _rtuple.resize(maxTupleSize(_rightAttrs));
+    _rval.resize(_rtuple.size());
     assert(_condition.op == EQ_OP);
     assert(_condition.bRhsIsAttr);
 
@@ -384,10 +413,6 @@ GHJoin::~GHJoin() {
     deallocatePartition(RIGHT);
 }
 
-// Buffers used in GHJoin
-char GHJoin::_rtuple[PAGE_SIZE];
-unsigned GHJoin::_rsize = 0;
-
 // Now assume that left partitions are always used for building hash map.
 RC GHJoin::getNextTuple(void *data) {
     // Process cached value first (if possible)
@@ -403,23 +428,21 @@ RC GHJoin::getNextTuple(void *data) {
             _rightReader = new PartitionReader(getPartitionName(RIGHT, _curPartition), _rightAttrs);
             // Build in-memory hash map for left partition
             RID rid;
-            char tuple[PAGE_SIZE];
             unsigned tsize;
-            while (_leftReader->getNextTuple(tuple, rid, tsize) != QE_EOF) {
-                char val[PAGE_SIZE];
+            while (_leftReader->getNextTuple(&_ltuple[0], rid, tsize) != QE_EOF) {
                 unsigned valsize = 0;
-                if (readValue(tuple, val, _condition.lhsAttr, _leftAttrs, valsize) != SUCCESSFUL) {
+                if (readValue(&_ltuple[0], &_lval[0], _condition.lhsAttr, _leftAttrs, valsize) != SUCCESSFUL) {
                     __trace();
                     return QE_EOF;
                 }
-                unsigned p = hash2(val, valsize);
+                unsigned p = hash2(&_lval[0], valsize);
                 _hashMap[p].push_back(rid);
             }
         }
 
         // Rehash tuples from right partition and find a match
         RID rrid;
-        while (_rightReader->getNextTuple(_rtuple, rrid, _rsize) != QE_EOF) {
+        while (_rightReader->getNextTuple(&_rtuple[0], rrid, _rsize) != QE_EOF) {
             // Get right value
             _curLeftMapIndex = 0;  // Reset the map index
             if (matchTuples(data) == SUCCESSFUL) {
@@ -446,9 +469,11 @@ RC GHJoin::getNextTuple(void *data) {
 }
 
 RC GHJoin::matchTuples(void *data) {
-    char rval[PAGE_SIZE];
+    char *ltuple = &_ltuple[0];
+    char *lval = &_lval[0];
+    char *rval = &_rval[0];
     unsigned rvalsize = 0;
-    if (readValue(_rtuple, rval, _condition.rhsAttr, _rightAttrs, rvalsize) != SUCCESSFUL) {
+    if (readValue(&_rtuple[0], rval, _condition.rhsAttr, _rightAttrs, rvalsize) != SUCCESSFUL) {
         __trace();
         return QE_EOF;
     }
@@ -457,14 +482,12 @@ RC GHJoin::matchTuples(void *data) {
     vector<RID> &leftRIDs = _hashMap[p];
     // Get left value and compare
     for (; _curLeftMapIndex < leftRIDs.size(); ++_curLeftMapIndex) {
-        char ltuple[PAGE_SIZE];
         unsigned lsize = 0;
         if (_leftReader->getTupleFromCache(ltuple, lsize, leftRIDs[_curLeftMapIndex]) != SUCCESSFUL) {
             __trace();
             _curLeftMapIndex = leftRIDs.size();
             return QE_EOF;
         }
-        char lval[PAGE_SIZE];
         unsigned lvalsize = 0;
         if (readValue(ltuple, lval, _condition.lhsAttr, _leftAttrs, lvalsize) != SUCCESSFUL) {
             __trace();
@@ -474,7 +497,7 @@ RC GHJoin::matchTuples(void *data) {
         if (isEqual(lval, lvalsize, rval, rvalsize)) {
             // Find a match, join two tuples
             appendValue(data, 0, ltuple, lsize);
-            appendValue(data, lsize, _rtuple, _rsize);
+            appendValue(data, lsize, &_rtuple[0], _rsize);
             ++_curLeftMapIndex;
             return SUCCESSFUL;
         }
@@ -497,19 +520,19 @@ RC GHJoin::partition(Iterator *iter, IterType iterType) {
     vector<Attribute> attrs;
     iter->getAttributes(attrs);
 
-    char tuple[PAGE_SIZE];
-    while (iter->getNextTuple(tuple) != QE_EOF) {
+    vector<char> tuple(maxTupleSize(attrs));
+    vector<char> val(tuple.size());
+    while (iter->getNextTuple(&tuple[0]) != QE_EOF) {
         // Read the join value
-        char val[PAGE_SIZE];
         unsigned valsize = 0;
-        if (readValue(tuple, val, attrName, attrs, valsize) != SUCCESSFUL) {
+        if (readValue(&tuple[0], &val[0], attrName, attrs, valsize) != SUCCESSFUL) {
             __trace();
             cout << "Condition attribute name: " << attrName << endl;
             return QE_EOF;
         }
         // Hash and find the right partition
-        unsigned p = hash1(val, valsize);
-        if ((err = partitions[p]->insertTuple(tuple)) != SUCCESSFUL) {
+        unsigned p = hash1(&val[0], valsize);
+        if ((err = partitions[p]->insertTuple(&tuple[0])) != SUCCESSFUL) {
             __trace();
             return err;
         }
@@ -582,18 +605,19 @@ int GHJoin::_joinNumberGlobal = 0;
  */
 INLJoin::INLJoin(Iterator *leftIn, IndexScan *rightIn, const Condition &condition)
     : _leftIn(leftIn), _rightIn(rightIn), _condition(condition),
-     _rbfm(RecordBasedFileManager::instance()) {
+     _rbfm(RecordBasedFileManager::instance()), _lsize(0) {
     assert(_leftIn != nullptr);
     assert(_rightIn != nullptr);
     _leftIn->getAttributes(_leftAttrs);
     _rightIn->getAttributes(_rightAttrs);
+    _ltuple.resize(maxTupleSize(_leftAttrs));
+    _lval.resize(_ltuple.size());
+    _rtuple.resize(maxTupleSize(_rightAttrs));
+    _rval.resize(_rtuple.size());
     assert(_condition.op == EQ_OP);
     assert(_condition.bRhsIsAttr);
 }
 
-char INLJoin::_ltuple[PAGE_SIZE];
-unsigned INLJoin::_lsize = 0;
-
 RC INLJoin::getNextTuple(void *data) {
     static bool initialized = false;
     // Deal with remaining of inner relation index scan
@@ -601,16 +625,15 @@ RC INLJoin::getNextTuple(void *data) {
         return SUCCESSFUL;
     }
     initialized = true;
-    while (_leftIn->getNextTuple(_ltuple) != QE_EOF) {
-        char lval[PAGE_SIZE];
+    while (_leftIn->getNextTuple(&_ltuple[0]) != QE_EOF) {
         unsigned lvalsize = 0;
-        if (readValue(_ltuple, lval, _condition.lhsAttr, _leftAttrs, lvalsize) != SUCCESSFUL) {
+        if (readValue(&_ltuple[0], &_lval[0], _condition.lhsAttr, _leftAttrs, lvalsize) != SUCCESSFUL) {
             __trace();
             return QE_EOF;
         }
 
         // Set up right index scan iterator
-        _rightIn->setIterator(lval, lval, true, true);
+        _rightIn->setIterator(&_lval[0], &_lval[0], true, true);
         if (matchTuples(data) == SUCCESSFUL) {
             return SUCCESSFUL;
         }
@@ -626,19 +649,19 @@ void INLJoin::getAttributes(vector<Attribute> &attrs) const {
 }
 
 RC INLJoin::matchTuples(void *data) {
-    if (_rbfm->countRecordSize(_leftAttrs, _ltuple, _lsize) != SUCCESSFUL) {
+    if (_rbfm->countRecordSize(_leftAttrs, &_ltuple[0], _lsize) != SUCCESSFUL) {
         __trace();
         return QE_EOF;
     }
 
-    char lval[PAGE_SIZE];
+    char *lval = &_lval[0];
     unsigned lvalsize = 0;
-    if (readValue(_ltuple, lval, _condition.lhsAttr, _leftAttrs, lvalsize) != SUCCESSFUL) {
+    if (readValue(&_ltuple[0], lval, _condition.lhsAttr, _leftAttrs, lvalsize) != SUCCESSFUL) {
         __trace();
         return QE_EOF;
     }
 
-    char rtuple[PAGE_SIZE];
+    char *rtuple = &_rtuple[0];
     if (_rightIn->getNextTuple(rtuple) != QE_EOF) {
         unsigned rsize;
         if (_rbfm->countRecordSize(_rightAttrs, rtuple, rsize) != SUCCESSFUL) {
@@ -646,7 +669,7 @@ RC INLJoin::matchTuples(void *data) {
             return QE_EOF;
         }
 
-        char rval[PAGE_SIZE];
+        char *rval = &_rval[0];
         unsigned rvalsize = 0;
         if (readValue(rtuple, rval, _condition.rhsAttr, _rightAttrs, rvalsize) != SUCCESSFUL) {
             __trace();
@@ -656,7 +679,7 @@ RC INLJoin::matchTuples(void *data) {
         // Compare left and right value
         if (isEqual(lval, lvalsize, rval, rvalsize)) {
             // Find a match, join two tuples
-            appendValue(data, 0, _ltuple, _lsize);
+            appendValue(data, 0, &_ltuple[0], _lsize);
             appendValue(data, _lsize, rtuple, rsize);
             return SUCCESSFUL;
         }
@@ -758,27 +781,27 @@ RC Aggregate::process() {
     vector<Attribute> attrs;
     _iterator->getAttributes(attrs);
 
-    char data[PAGE_SIZE];
-    while (_iterator->getNextTuple(data) != QE_EOF) {
+    vector<char> data(maxTupleSize(attrs));
+    vector<char> val(data.size());
+    while (_iterator->getNextTuple(&data[0]) != QE_EOF) {
         _count++;
         if (_op == COUNT) {
             continue;
         }
-        char val[PAGE_SIZE];
         unsigned valsize = 0;
-        if ((err = readValue(data, val, _aggAttr.name, attrs, valsize)) != SUCCESSFUL) {
+        if ((err = readValue(&data[0], &val[0], _aggAttr.name, attrs, valsize)) != SUCCESSFUL) {
             __trace();
             return err;
         }
 
         if (_aggAttr.type == TypeInt) {
-            int d = *((int *) val);
+            int d = *((int *) &val[0]);
 //            cout << "read int: " << d << endl;
             _intSum += d;
             _intMin = std::min(_intMin, d);
             _intMax = std::max(_intMax, d);
         } else if (_aggAttr.type == TypeReal) {
-            float d = *((float *) val);
+            float d = *((float *) &val[0]);
 //            cout << "read real: " << d << endl;
             _floatSum += d;
             _floatMin = std::min(_floatMin, d);
@@ -10,6 +10,7 @@
 #include "../ix/ix.h"
 
 # define QE_EOF (-1)  // end of the index scan
+# define INDEX_SCAN_BATCH 32  // # of index entries whose tuples are read together
 
 using namespace std;
 
@@ -100,6 +101,16 @@ class TableScan : public Iterator
             return iter->getNextTuple(rid, data);
         };
 
+        // Up to maxTuples tuples at once (rid is left at the last one)
+        RC getNextBatch(unsigned maxTuples, RecordBatch &batch)
+        {
+            RC rc = iter->getNextBatch(maxTuples, batch);
+            if (rc == SUCCESSFUL) {
+                rid = batch.getRid(batch.size() - 1);
+            }
+            return rc;
+        };
+
         void getAttributes(vector<Attribute> &attrs) const
         {
 //            __trace();
@@ -135,8 +146,10 @@ class IndexScan : public Iterator
         vector<Attribute> attrs;
         char key[PAGE_SIZE];
         RID rid;
+        vector<RID> rids;       // entries fetched from the index ahead of their tuples
+        size_t ridIndex;
 
-        IndexScan(RelationManager &rm, const string &tableName, const string &attrName, const char *alias = NULL):rm(rm)
+        IndexScan(RelationManager &rm, const string &tableName, const string &attrName, const char *alias = NULL):rm(rm), ridIndex(0)
         {
             // Set members
             this->tableName = tableName;
@@ -167,16 +180,31 @@ class IndexScan : public Iterator
             iter = new RM_IndexScanIterator();
             rm.indexScan(tableName, attrName, lowKey, highKey, lowKeyInclusive,
                            highKeyInclusive, *iter);
+            rids.clear();
+            ridIndex = 0;
         };
 
         RC getNextTuple(void *data)
         {
-            int rc = iter->getNextEntry(rid, key);
-            if(rc == 0)
+            if(ridIndex == rids.size())
             {
-                rc = rm.readTuple(tableName.c_str(), rid, data);
+                // Fetch a batch of entries, and read their pages in the background
+                rids.clear();
+                ridIndex = 0;
+                int rc = QE_EOF;
+                while(rids.size() < INDEX_SCAN_BATCH && (rc = iter->getNextEntry(rid, key)) == 0)
+                {
+                    rids.push_back(rid);
+                }
+                if(rids.empty())
+                {
+                    return rc;
+                }
+                rm.prefetchTuples(tableName, rids);
             }
-            return rc;
+
+            rid = rids[ridIndex++];
+            return rm.readTuple(tableName.c_str(), rid, data);
         };
 
         void getAttributes(vector<Attribute> &attrs) const
@@ -218,6 +246,7 @@ class Filter : public Iterator {
     private:
         Iterator *_iterator;
         Condition _condition;
+        vector<char> _value;    // the condition value of the current tuple
 };
 
 
@@ -234,6 +263,8 @@ class Project : public Iterator {
     private:
         Iterator *_iterator;
         vector<string> _attrNames;
+        vector<char> _tuple;    // the input tuple
+        vector<char> _value;    // the value being projected
 };
 
 
@@ -241,7 +272,8 @@ class Project : public Iterator {
 // On its construction, each partition only has one page of buffer.
 class PartitionBuilder {
 public:
-    PartitionBuilder(const string &partitionName, const vector<Attribute> &attrs);
+    PartitionBuilder(const string &partitionName, const vector<Attribute> &attrs,
+                     unsigned pageSize = PAGE_SIZE);
     ~PartitionBuilder();
 
     // Insert tuple into the partition. Buffer page will be automatically
@@ -264,11 +296,12 @@ private:
     RecordBasedFileManager *_rbfm;
     SpaceManager *_sm;
     PagedFileManager *_pfm;
-    char _buffer[PAGE_SIZE];
+    unsigned _pageSize;     // page size of the partition file
+    char *_buffer;          // the page being filled
 };
 
 // Partition reader: used by GHJoin probing phase.
-// On its retrieval, all pages will be buffered.
+// On its retrieval, all pages stay mapped in memory.
 class PartitionReader {
 public:
     PartitionReader(const string &partitionName, const vector<Attribute> &attrs);
@@ -293,11 +326,13 @@ private:
     unsigned _pageCount;
     unsigned _curPageNum;   // current page number
     unsigned _curSlotNum;   // current slot number
+    PageNum _readAheadEnd;  // pages before it have been requested ahead
+    unsigned _pageSize;     // page size of the partition file
 
     RecordBasedFileManager *_rbfm;
     SpaceManager *_sm;
     PagedFileManager *_pfm;
-    char **_buffer;     // to hold the whole partition
+    char **_buffer;     // pages of the whole partition (in the file mapping)
 };
 
 
@@ -348,9 +383,12 @@ class GHJoin : public Iterator {
         unordered_map<unsigned, vector<RID> > _hashMap;  // the hash map for the second hashing
 
         // Buffered right tuple (Assume that always load left relations into the hash map)
-        static char _rtuple[PAGE_SIZE];
-        static unsigned _rsize;
+        vector<char> _rtuple;
+        unsigned _rsize;
         unsigned _curLeftMapIndex;
+        vector<char> _ltuple;   // the left tuple being matched
+        vector<char> _lval;     // and the join values
+        vector<char> _rval;
 };
 
 
@@ -399,8 +437,11 @@ class INLJoin : public Iterator {
         RecordBasedFileManager *_rbfm;
 
         // Buffer for left relation tuples
-        static char _ltuple[PAGE_SIZE];
-        static unsigned _lsize;
+        vector<char> _ltuple;
+        unsigned _lsize;
+        vector<char> _rtuple;   // the right tuple being matched
+        vector<char> _lval;     // and the join values
+        vector<char> _rval;
 };
 
 
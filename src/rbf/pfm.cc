@@ -1,27 +1,405 @@
 #include "pfm.h"
+#include "wal.h"
 #include <iostream>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <climits>
+#include <algorithm>
+#include <chrono>
+
+// io_uring needs its kernel header and system call numbers; without them
+// the async I/O engine only has its worker threads
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define PFM_IO_URING
+#endif
+#endif
+#endif
 
 /////////////////////////////////////////////////////
 
 PagedFileManager* PagedFileManager::_pf_manager = 0;
 
+// Offset of a page on disk, skipping the header page
+static inline long pageOffset(PageNum pageNum, unsigned pageSize)
+{
+    return ((long) pageNum + 1) * pageSize;
+}
+
+// I/O metrics of all files
+static IOMetrics _ioMetrics;
+
+// Charge a disk transfer to the metrics of a handle (if any) and to the
+// metrics of all files
+static void recordTransfer(IOMetrics *metrics, long offset, size_t bytes, unsigned syscalls, bool write)
+{
+    _ioMetrics.recordTransfer(offset, bytes, syscalls, write);
+    if (metrics) {
+        metrics->recordTransfer(offset, bytes, syscalls, write);
+    }
+}
+
+// Measures a FileHandle operation from its start to the end of the scope
+class LatencyTimer
+{
+public:
+    LatencyTimer(IOMetrics *metrics, IOOp op)
+        : _metrics(metrics), _op(op), _start(std::chrono::steady_clock::now())
+    {
+    }
+
+    ~LatencyTimer()
+    {
+        unsigned long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - _start).count();
+        _ioMetrics.recordLatency(_op, ns);
+        if (_metrics) {
+            _metrics->recordLatency(_op, ns);
+        }
+    }
+
+private:
+    IOMetrics *_metrics;
+    IOOp _op;
+    std::chrono::steady_clock::time_point _start;
+};
+
+// Pins the descriptor of a file (or its stream) until the end of the scope.
+// A guard for writing marks the file to be synced by the next checkpoint.
+class DescriptorGuard
+{
+public:
+    DescriptorGuard(FileState &state, bool stream, bool write = false)
+        : _state(state), _stream(stream), _write(write),
+          _err(DescriptorCache::instance()->acquire(state, stream))
+    {
+    }
+
+    ~DescriptorGuard()
+    {
+        if (_err == SUCCESSFUL) {
+            DescriptorCache::instance()->release(_state, _write);
+        }
+    }
+
+    RC status() { return _err; }
+    FILE *stream() { return _stream ? _state.filePtr : NULL; }      // the stream, if asked for
+    int descriptor() { return _stream ? -1 : _state.fileDesc; }     // or the descriptor
+
+private:
+    FileState &_state;
+    bool _stream;
+    bool _write;
+    RC _err;
+};
+
+// Read size bytes at offset, through the descriptor if it is valid or
+// through the stream otherwise.
+static RC readAt(FILE *fp, int fd, long offset, void *data, size_t size, IOMetrics *metrics)
+{
+    if (fd >= 0) {
+        size_t done = 0;
+        unsigned calls = 0;
+        while (done < size) {
+            ssize_t n = pread(fd, (char *) data + done, size - done, offset + done);
+            calls++;
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                recordTransfer(metrics, offset, done, calls, false);
+                return ERR_READ;
+            }
+            done += n;
+        }
+        recordTransfer(metrics, offset, done, calls, false);
+        return SUCCESSFUL;
+    }
+
+    if (fseek(fp, offset, SEEK_SET)) {
+        __trace();
+        recordTransfer(metrics, offset, 0, 1, false);
+        return ERR_LOCATE;
+    }
+    size_t done = fread(data, sizeof(char), size, fp);
+    recordTransfer(metrics, offset, done, 2, false);
+    if (done != size) {
+        return ERR_READ;
+    }
+    return SUCCESSFUL;
+}
+
+// Read (or write) the buffers of iov at offset, skipping the first done
+// bytes (already transferred by a short read or write).
+static RC transferFully(int fd, std::vector<struct iovec> iov, long offset, size_t done, bool write,
+                        IOMetrics *metrics)
+{
+    size_t start = done;
+    unsigned calls = 0;
+    size_t size = 0;
+    for (size_t i = 0; i < iov.size(); i++) {
+        size += iov[i].iov_len;
+    }
+
+    size_t first = 0;
+    size_t skip = done;
+    while (done < size) {
+        // Skip the buffers already filled
+        while (first < iov.size() && skip >= iov[first].iov_len) {
+            skip -= iov[first].iov_len;
+            first++;
+        }
+        if (skip > 0) {
+            iov[first].iov_base = (char *) iov[first].iov_base + skip;
+            iov[first].iov_len -= skip;
+            skip = 0;
+        }
+
+        int count = std::min(iov.size() - first, (size_t) IOV_MAX);
+        ssize_t n = write ? pwritev(fd, &iov[first], count, offset + done)
+                : preadv(fd, &iov[first], count, offset + done);
+        calls++;
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            recordTransfer(metrics, offset + start, done - start, calls, write);
+            return write ? ERR_WRITE : ERR_READ;
+        }
+        done += n;
+        skip = n;
+    }
+    if (calls) {
+        recordTransfer(metrics, offset + start, done - start, calls, write);
+    }
+    return SUCCESSFUL;
+}
+
+// Write size bytes at offset, through the descriptor if it is valid or
+// through the stream otherwise. A stream is flushed if flush is set, so
+// that other streams on the same file can see the data.
+static RC writeAt(FILE *fp, int fd, long offset, const void *data, size_t size, bool flush,
+                  IOMetrics *metrics)
+{
+    if (fd >= 0) {
+        size_t done = 0;
+        unsigned calls = 0;
+        while (done < size) {
+            ssize_t n = pwrite(fd, (const char *) data + done, size - done, offset + done);
+            calls++;
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                __trace();
+                recordTransfer(metrics, offset, done, calls, true);
+                return ERR_WRITE;
+            }
+            done += n;
+        }
+        recordTransfer(metrics, offset, done, calls, true);
+        return SUCCESSFUL;
+    }
+
+    // The stream may buffer the write until it is flushed or moved
+    if (fseek(fp, offset, SEEK_SET)) {
+        __trace();
+        recordTransfer(metrics, offset, 0, 1, true);
+        return ERR_LOCATE;
+    }
+    size_t done = fwrite(data, sizeof(char), size, fp);
+    recordTransfer(metrics, offset, done, flush ? 3 : 2, true);
+    if (done != size) {
+        __trace();
+        return ERR_WRITE;
+    }
+    if (flush && fflush(fp)) {
+        __trace();
+        return ERR_WRITE;
+    }
+    return SUCCESSFUL;
+}
+
+/**
+ * Write the header of a file from its state. The caller holds the latch
+ * of the state.
+ *
+ * @param state
+ * @param stdio
+ *          whether to write through the stream of the file
+ * @param metrics
+ *          the metrics the write is charged to (or NULL)
+ * @return status
+ */
+static RC writeFileHeader(FileState &state, bool stdio, IOMetrics *metrics)
+{
+    DescriptorGuard guard(state, stdio, true);
+    if (guard.status() != SUCCESSFUL) {
+        return guard.status();
+    }
+    RC err = writeAt(guard.stream(), guard.descriptor(), 0, &state.header, sizeof(FileHeader), true, metrics);
+    if (err == SUCCESSFUL) {
+        state.headerDirty = false;
+    }
+    return err;
+}
+
+unsigned PagedFileManager::_bufferFrames = DEFAULT_BUFFER_FRAMES;
+
+unsigned PagedFileManager::_readAheadWindow = DEFAULT_READ_AHEAD;
+
+unsigned PagedFileManager::_dirtyRatio = DEFAULT_DIRTY_RATIO;
+
+unsigned PagedFileManager::_extentSize = DEFAULT_EXTENT_SIZE;
+
+unsigned PagedFileManager::_descriptorLimit = DEFAULT_OPEN_FILES;
+
+// Dirty pages only reach the disk on eviction or close, and the upper layers
+// keep some files (e.g. the catalog) open until the process ends.
+static void flushBufferPoolAtExit()
+{
+    PagedFileManager::instance()->flushAllPages();
+}
+
 PagedFileManager* PagedFileManager::instance()
 {
-    if(!_pf_manager)
+    if(!_pf_manager) {
         _pf_manager = new PagedFileManager();
+        atexit(flushBufferPoolAtExit);
+    }
 
     return _pf_manager;
 }
 
+/**
+ * Set the # of frames in the buffer pool. It only takes effect
+ * before the paged file manager is instantiated.
+ *
+ * @param frameCount
+ *          the # of frames.
+ * @return status
+ */
+RC PagedFileManager::setBufferFrames(unsigned frameCount)
+{
+    if (_pf_manager || frameCount == 0) {
+        return ERR_NO_FRAME;
+    }
+    _bufferFrames = frameCount;
+    return SUCCESSFUL;
+}
+
+/**
+ * Set the # of pages that sequential scans read ahead. 0 or 1 turns
+ * read-ahead off.
+ *
+ * @param pageCount
+ *          the # of pages.
+ */
+void PagedFileManager::setReadAheadWindow(unsigned pageCount)
+{
+    _readAheadWindow = pageCount;
+}
+
+/**
+ * Get the # of pages that sequential scans read ahead.
+ *
+ * @return # of pages
+ */
+unsigned PagedFileManager::getReadAheadWindow()
+{
+    return _readAheadWindow;
+}
+
+/**
+ * Set the % of the buffer pool that may be dirty before the background
+ * flusher starts writing pages back (it then writes until half of that
+ * is left). 0 makes the flusher write back as soon as it can.
+ *
+ * @param percent
+ *          the dirty ratio (at most 100)
+ */
+void PagedFileManager::setDirtyRatio(unsigned percent)
+{
+    _dirtyRatio = percent > 100 ? 100 : percent;
+}
+
+/**
+ * Get the dirty ratio of the buffer pool.
+ *
+ * @return the dirty ratio in %
+ */
+unsigned PagedFileManager::getDirtyRatio()
+{
+    return _dirtyRatio;
+}
+
+/**
+ * Set the # of bytes reserved on the disk at once when a file grows
+ * (rounded to whole pages). 0 turns preallocation off: files then grow
+ * page by page as their pages are written.
+ *
+ * @param size
+ *          the extent size in bytes.
+ */
+void PagedFileManager::setExtentSize(unsigned size)
+{
+    _extentSize = size;
+}
+
+/**
+ * Get the # of bytes reserved on the disk at once when a file grows.
+ *
+ * @return the extent size in bytes
+ */
+unsigned PagedFileManager::getExtentSize()
+{
+    return _extentSize;
+}
+
+/**
+ * Set the # of file descriptors kept open. Files opened beyond it stay
+ * open for their handles, but the descriptors of the least recently used
+ * ones are closed, and reopened on their next I/O.
+ *
+ * @param count
+ *          the # of descriptors (at least 1).
+ */
+void PagedFileManager::setDescriptorLimit(unsigned count)
+{
+    _descriptorLimit = count ? count : 1;
+}
+
+/**
+ * Get the # of file descriptors kept open.
+ *
+ * @return # of descriptors
+ */
+unsigned PagedFileManager::getDescriptorLimit()
+{
+    return _descriptorLimit;
+}
+
 
 PagedFileManager::PagedFileManager()
 {
+    _bufferManager = new BufferManager(_bufferFrames);
+    _nextFileId = 0;
 }
 
 
 PagedFileManager::~PagedFileManager()
 {
+    delete _bufferManager;
 }
 
 /**
@@ -29,19 +407,61 @@ PagedFileManager::~PagedFileManager()
  *
  * @param fileName
  *          the name of the file to be created.
+ * @param pageSize
+ *          the page size of the file: a power of 2 from PAGE_SIZE to MAX_PAGE_SIZE.
  * @return status
  */
-RC PagedFileManager::createFile(const char *fileName)
+RC PagedFileManager::createFile(const char *fileName, unsigned pageSize)
 {
+    if (pageSize < PAGE_SIZE || pageSize > MAX_PAGE_SIZE || (pageSize & (pageSize - 1))) {
+        return ERR_PAGE_SIZE;
+    }
+
+    std::lock_guard<std::mutex> guard(_mutex);
     // Test existence
     FILE *fp = fopen(fileName, "r");
     if (fp) {
+        fclose(fp);
         return ERR_EXIST;
     } else {
+        // The file may have been removed behind our back; drop stale pages
+        std::unordered_map<std::string, FileEntry>::iterator it = _fileEntries.find(fileName);
+        if (it != _fileEntries.end()) {
+            _bufferManager->discardFile(it->second.fileId);
+            if (it->second.state) {
+                DescriptorCache::instance()->detach(*it->second.state);
+            }
+            _fileEntries.erase(it);
+        }
+
         fp = fopen(fileName, "w");
         if (!fp) {
             return ERR_NOT_EXIST;
         }
+
+        // Write the header page of an empty file
+        std::vector<char> page(pageSize, 0);
+        FileHeader header;
+        header.magic = PF_FILE_MAGIC;
+        header.version = PF_FILE_VERSION;
+        header.pageCount = 0;
+        header.freeSpaceRoot = NULL_PAGE;
+        header.pageSize = pageSize;
+        memcpy(&page[0], &header, sizeof(FileHeader));
+        if (fwrite(&page[0], sizeof(char), pageSize, fp) != pageSize) {
+            __trace();
+            fclose(fp);
+            return ERR_WRITE;
+        }
+        if (fclose(fp)) {
+            __trace();
+            return ERR_WRITE;
+        }
+
+        // Recovery must not apply older changes of the same name to it
+        if (LogManager::inTransaction()) {
+            return LogManager::instance()->logCreate(fileName);
+        }
         return SUCCESSFUL;
     }
 }
@@ -55,6 +475,26 @@ RC PagedFileManager::createFile(const char *fileName)
  */
 RC PagedFileManager::destroyFile(const char *fileName)
 {
+    // A transaction removes the file once it has committed
+    if (LogManager::inTransaction()) {
+        if (access(fileName, F_OK) != 0) {
+            return ERR_NOT_EXIST;
+        }
+        return LogManager::instance()->logRemove(fileName);
+    }
+
+    // Cached pages of the file are not valid anymore. Handles still open
+    // keep the removed file through its descriptor.
+    std::lock_guard<std::mutex> guard(_mutex);
+    std::unordered_map<std::string, FileEntry>::iterator it = _fileEntries.find(fileName);
+    if (it != _fileEntries.end()) {
+        _bufferManager->discardFile(it->second.fileId);
+        if (it->second.state) {
+            DescriptorCache::instance()->detach(*it->second.state);
+        }
+        _fileEntries.erase(it);
+    }
+
     if (remove(fileName) != 0) {
         __trace();
         return ERR_NOT_EXIST;
@@ -71,36 +511,89 @@ RC PagedFileManager::destroyFile(const char *fileName)
  *          the name of the file to be opened.
  * @param fileHandle
  *          the file handle associated with this file.
+ * @param ioMode
+ *          the I/O backend: IO_STDIO, or IO_PREAD for handles shared by threads.
  * @return status
  */
-RC PagedFileManager::openFile(const char *fileName, FileHandle &fileHandle)
+RC PagedFileManager::openFile(const char *fileName, FileHandle &fileHandle, IOMode ioMode)
 {
-    FILE *fp = fopen(fileName, "r+");
-    if (!fp) {
-//        __trace();
-//        std::cout << "-->Cannot open file: " << fileName << std::endl;
-        return ERR_NOT_EXIST;
-    }
+    // The first handle opens the file; the others share its descriptor
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::unordered_map<std::string, FileEntry>::iterator it = _fileEntries.find(fileName);
+    if (it == _fileEntries.end() || !it->second.state || it->second.state->openCount == 0) {
+        std::shared_ptr<FileState> state = std::make_shared<FileState>();
+        state->fileName = fileName;
+        state->headerDirty = false;
+        state->openCount = 1;
+        state->fileDesc = -1;
+        state->filePtr = NULL;
+        state->ioCount = 0;
+        state->unlinked = false;
+        state->written = false;
 
-    // get the file size in pages(should be multiple of PAGE_SIZE)
-    long fileSize = 0l;
-    if (fseek(fp, 0, SEEK_END)) {
-        __trace();
-        return ERR_LOCATE;
-    }
-    if ((fileSize = ftell(fp)) == -1) {
-        __trace();
-        return ERR_LOCATE;
+        RC err;
+        {
+            DescriptorGuard guard(*state, false);
+            if ((err = guard.status()) != SUCCESSFUL) {
+//                __trace();
+//                std::cout << "-->Cannot open file: " << fileName << std::endl;
+                return err;
+            }
+
+            FileHeader header;
+            struct stat info;
+            if (readAt(NULL, guard.descriptor(), 0, &header, sizeof(FileHeader), NULL) != SUCCESSFUL
+                    || header.magic != PF_FILE_MAGIC || header.version != PF_FILE_VERSION
+                    || header.pageSize < PAGE_SIZE || header.pageSize > MAX_PAGE_SIZE) {
+                __trace();
+                err = ERR_HEADER;
+            } else if (fstat(guard.descriptor(), &info)) {
+                __trace();
+                err = ERR_NOT_EXIST;
+            } else {
+                state->header = header;
+                state->pageCount = header.pageCount;
+                // A crash may have left reserved space behind the last page
+                state->allocatedSize = info.st_size;
+            }
+        }
+        state->openCount = 0;
+        if (err != SUCCESSFUL) {
+            DescriptorCache::instance()->close(*state);
+            return err;
+        }
+
+        // Files reopened keep their pages in the buffer pool
+        FileEntry &entry = _fileEntries[fileName];
+        if (entry.fileId == 0) {
+            entry.fileId = ++_nextFileId;
+        }
+        entry.state = state;
+        it = _fileEntries.find(fileName);
     }
-    if (fileSize % PAGE_SIZE != 0) {
-        // File size is not a multiple of PAGE_SIZE
-        // Probably this file has been damaged
-        return ERR_ALIGN;
+    FileEntry &entry = it->second;
+    entry.state->openCount++;
+
+    // The mapping only sees what is on the disk
+    if (ioMode == IO_MMAP) {
+        RC err;
+        if ((err = _bufferManager->flushFile(entry.fileId)) != SUCCESSFUL) {
+            __trace();
+            if (--entry.state->openCount == 0) {
+                DescriptorCache::instance()->close(*entry.state);
+            }
+            return err;
+        }
+        fileHandle.mapping = std::make_shared<FileMapping>();
+    } else {
+        fileHandle.mapping.reset();
     }
 
 //    fileHandle.setNumberOfPages(fileSize / PAGE_SIZE);
-    fileHandle.setFilePointer(fp);
+    fileHandle.setIOMode(ioMode);
     fileHandle.setFileName(fileName);
+    fileHandle.setFileId(entry.fileId);
+    fileHandle.setFileState(entry.state);
 //    std::cout << "### In PagedFileManager::openFile(), set fileHandle: -> name: " << fileHandle.getFileName()
 //         << ", # of pages: " << fileHandle.getNumberOfPages() << std::endl;
 
@@ -108,7 +601,9 @@ RC PagedFileManager::openFile(const char *fileName, FileHandle &fileHandle)
 }
 
 /**
- * Close a file.
+ * Close a file. The file itself is closed with the last handle opened on
+ * it; its dirty pages are written back then. The handle is detached from
+ * the file, so closing it again fails.
  *
  * @param fileName
  *          the name of the file to be closed.
@@ -116,24 +611,165 @@ RC PagedFileManager::openFile(const char *fileName, FileHandle &fileHandle)
  */
 RC PagedFileManager::closeFile(FileHandle &fileHandle)
 {
-    if (fclose(fileHandle.getFilePointer())) {
+    std::lock_guard<std::mutex> guard(_mutex);
+    std::shared_ptr<FileState> state = fileHandle.state;
+    if (!state || state->openCount == 0) {
+        __trace();
         return ERR_NOT_EXIST;
     }
+
+    // The mapping goes away with the last copy of the handle
+    fileHandle.mapping.reset();
+    if (state->openCount > 1) {
+        state->openCount--;
+        fileHandle.state.reset();
+        fileHandle.fileId = 0;
+        return SUCCESSFUL;
+    }
+
+    // Dirty pages are written back through the descriptor being closed.
+    // Clean pages are kept in the pool so that reopening the file stays cheap.
+    RC err;
+    if ((err = _bufferManager->flushFile(fileHandle.getFileId())) != SUCCESSFUL) {
+        __trace();
+        return err;
+    }
+
+    // The header goes after the pages it counts
+    if (state->headerDirty) {
+        std::lock_guard<std::mutex> latch(state->latch);
+        if ((err = fileHandle.writeHeader()) != SUCCESSFUL) {
+            __trace();
+            return err;
+        }
+    }
+
+    // Give the unused part of the last extent back
+    if ((err = fileHandle.trimSpace()) != SUCCESSFUL) {
+        __trace();
+        return err;
+    }
+
+    state->openCount = 0;
+    fileHandle.state.reset();
+    fileHandle.fileId = 0;
+    return DescriptorCache::instance()->close(*state);
+}
+
+/**
+ * Get the buffer pool shared by all files.
+ *
+ * @return the buffer manager
+ */
+BufferManager *PagedFileManager::getBufferManager()
+{
+    return _bufferManager;
+}
+
+/**
+ * Write back all dirty pages in the buffer pool.
+ *
+ * @return status
+ */
+RC PagedFileManager::flushAllPages()
+{
+    RC err;
+    if ((err = _bufferManager->flushAll()) != SUCCESSFUL) {
+        __trace();
+        return err;
+    }
+    return flushHeaders();
+}
+
+/**
+ * Write back the headers of the open files which count pages appended
+ * since they were written. Appends leave the header to this, to the last
+ * close and to checkpoints, which must not drop the log records of pages
+ * a header does not count.
+ *
+ * @return status
+ */
+RC PagedFileManager::flushHeaders()
+{
+    std::lock_guard<std::mutex> guard(_mutex);
+    RC err;
+    std::unordered_map<std::string, FileEntry>::iterator it;
+    for (it = _fileEntries.begin(); it != _fileEntries.end(); it++) {
+        std::shared_ptr<FileState> state = it->second.state;
+        if (!state || state->openCount == 0) {
+            continue;
+        }
+        std::lock_guard<std::mutex> latch(state->latch);
+        if (state->headerDirty && (err = writeFileHeader(*state, false, NULL)) != SUCCESSFUL) {
+            __trace();
+            return err;
+        }
+    }
+    return SUCCESSFUL;
+}
+
+/**
+ * Collect statistics of the buffer pool.
+ */
+RC PagedFileManager::collectCounterValues(unsigned &hitCount, unsigned &missCount, unsigned &evictionCount)
+{
+    _bufferManager->collectCounterValues(hitCount, missCount, evictionCount);
+    return SUCCESSFUL;
+}
+
+/**
+ * Get the I/O metrics of all files since the start (or the last reset).
+ *
+ * @param stats
+ *          (return) the snapshot
+ * @return status
+ */
+RC PagedFileManager::collectIOStats(IOStats &stats)
+{
+    _ioMetrics.snapshot(stats);
+    return SUCCESSFUL;
+}
+
+/**
+ * Collect statistics of the descriptor cache.
+ */
+RC PagedFileManager::collectDescriptorCounterValues(unsigned &hitCount, unsigned &missCount, unsigned &evictionCount)
+{
+    DescriptorCache::instance()->collectCounterValues(hitCount, missCount, evictionCount);
     return SUCCESSFUL;
 }
 
+/**
+ * Reset the I/O metrics of all files. Metrics of handles are not affected.
+ */
+void PagedFileManager::resetIOStats()
+{
+    _ioMetrics.reset();
+}
+
 
 /////////////////////////////////////////////////////
 
 FileHandle::FileHandle()
 {
 //    pageCount = 0;
-    filePtr   = NULL;
+    ioMode    = IO_STDIO;
 //    fileName  = NULL;
+    fileId    = 0;
 
     readPageCounter = 0;
     writePageCounter = 0;
     appendPageCounter = 0;
+    hitCounter = 0;
+    missCounter = 0;
+    evictionCounter = 0;
+    metrics = std::make_shared<IOMetrics>();
+}
+
+
+FileHandle::FileHandle(const FileHandle &that)
+{
+    *this = that;
 }
 
 
@@ -141,6 +777,29 @@ FileHandle::~FileHandle()
 {
 }
 
+
+FileHandle &FileHandle::operator=(const FileHandle &that)
+{
+    if (this == &that) {
+        return *this;
+    }
+
+    ioMode   = that.ioMode;
+    state    = that.state;
+    mapping  = that.mapping;
+    metrics  = that.metrics;
+    fileName = that.fileName;
+    fileId   = that.fileId;
+
+    readPageCounter = that.readPageCounter.load();
+    writePageCounter = that.writePageCounter.load();
+    appendPageCounter = that.appendPageCounter.load();
+    hitCounter = that.hitCounter.load();
+    missCounter = that.missCounter.load();
+    evictionCounter = that.evictionCounter.load();
+    return *this;
+}
+
 /**
  * Read a page of data from the file
  * @param pageNum
@@ -160,15 +819,29 @@ RC FileHandle::readPage(PageNum pageNum, void *data)
         return ERR_LOCATE;
     }
 
-    long curPos = pageNum * PAGE_SIZE;
+    RC err;
+    LatencyTimer timer(metrics.get(), IO_OP_READ);
+    if (ioMode == IO_MMAP) {
+        char *page;
+        if ((err = mapPage(pageNum, page)) != SUCCESSFUL) {
+            __trace();
+            return err;
+        }
+        memcpy(data, page, getPageSize());
+        readPageCounter++;
+        return SUCCESSFUL;
+    }
 
-    if (fseek(filePtr, curPos, SEEK_SET)) {
+    void *frame;
+    BufferManager *bm = PagedFileManager::instance()->getBufferManager();
+    if ((err = bm->pinPage(*this, pageNum, frame)) != SUCCESSFUL) {
         __trace();
-        return ERR_LOCATE;
-    }
-
-    if (fread(data, sizeof(char), PAGE_SIZE, filePtr) != PAGE_SIZE) {
-        return ERR_READ;
+        return err;
+    }
+    memcpy(data, frame, getPageSize());
+    if ((err = bm->unpinPage(*this, pageNum, false)) != SUCCESSFUL) {
+        __trace();
+        return err;
     }
 
     readPageCounter++;
@@ -188,6 +861,10 @@ RC FileHandle::readPage(PageNum pageNum, void *data)
  */
 RC FileHandle::writePage(PageNum pageNum, const void *data)
 {
+    if (ioMode == IO_MMAP) {
+        return ERR_READ_ONLY;
+    }
+
     bool append = false;
     unsigned totalPages = getNumberOfPages();
     if (pageNum > totalPages || pageNum < 0) {
@@ -199,28 +876,409 @@ RC FileHandle::writePage(PageNum pageNum, const void *data)
         append = true;
     }
 
-    long curPos = pageNum * PAGE_SIZE;
+    if (append) {
+        return appendPage(data);
+    }
+    LatencyTimer timer(metrics.get(), IO_OP_WRITE);
+
+    // Update the buffered copy only (write-back). Changes made by a
+    // transaction are logged, which needs the old content as well, and
+    // the page belongs to the transaction until it ends.
+    RC err;
+    void *frame;
+    LSN lsn = 0;
+    bool logged = LogManager::inTransaction();
+    if (logged && (err = LogManager::instance()->lockPage(fileName, pageNum, false)) != SUCCESSFUL) {
+        __trace();
+        return err;
+    }
+    BufferManager *bm = PagedFileManager::instance()->getBufferManager();
+    if ((err = bm->pinPage(*this, pageNum, frame, logged)) != SUCCESSFUL) {
+        __trace();
+        return err;
+    }
+    if (logged && (err = LogManager::instance()->logUpdate(fileName, pageNum, getPageSize(),
+                                                           frame, data, lsn)) != SUCCESSFUL) {
+        __trace();
+        bm->unpinPage(*this, pageNum, false);
+        return err;
+    }
+    memcpy(frame, data, getPageSize());
+    if ((err = bm->unpinPage(*this, pageNum, true, lsn)) != SUCCESSFUL) {
+        __trace();
+        return err;
+    }
+
+    writePageCounter++;
+//    std::cout << fileName << " writePageCounter " << writePageCounter << std::endl;
+    return SUCCESSFUL;
+}
 
-    if (fseek(filePtr, curPos, SEEK_SET)) {
+/**
+ * Pin a page in the buffer pool. The returned frame stays valid until
+ * the page is unpinned.
+ *
+ * @param pageNum
+ *          the page number to pin
+ * @param data
+ *          (return) the frame holding the page
+ * @return status
+ */
+RC FileHandle::pinPage(PageNum pageNum, void *&data)
+{
+    if (pageNum >= getNumberOfPages()) {
         __trace();
+        std::cout << "--> pageNum: " << pageNum << ", pageCount: " << getNumberOfPages() << std::endl;
         return ERR_LOCATE;
     }
 
-    if (fwrite(data, sizeof(char), PAGE_SIZE, filePtr) != PAGE_SIZE) {
+    RC err;
+    LatencyTimer timer(metrics.get(), IO_OP_READ);
+    if (ioMode == IO_MMAP) {
+        // Hand out the page in the mapping itself
+        char *page;
+        if ((err = mapPage(pageNum, page)) != SUCCESSFUL) {
+            __trace();
+            return err;
+        }
+        data = page;
+        readPageCounter++;
+        return SUCCESSFUL;
+    }
+
+    if ((err = PagedFileManager::instance()->getBufferManager()->pinPage(*this, pageNum, data)) != SUCCESSFUL) {
         __trace();
-        return ERR_WRITE;
+        return err;
     }
+    readPageCounter++;
+    return SUCCESSFUL;
+}
 
-    if (append) {
-        appendPageCounter++;
-//        std::cout << fileName << " appendPageCounter " << appendPageCounter << std::endl;
-    } else {
+/**
+ * Unpin a page pinned by pinPage().
+ *
+ * @param pageNum
+ *          the page number to unpin
+ * @param dirty
+ *          whether the page has been changed through its frame
+ * @return status
+ */
+RC FileHandle::unpinPage(PageNum pageNum, bool dirty)
+{
+    if (ioMode == IO_MMAP) {
+        // Mapped pages are never evicted
+        return dirty ? ERR_READ_ONLY : SUCCESSFUL;
+    }
+
+    RC err;
+    if ((err = PagedFileManager::instance()->getBufferManager()->unpinPage(*this, pageNum, dirty)) != SUCCESSFUL) {
+        __trace();
+        return err;
+    }
+    if (dirty) {
         writePageCounter++;
-//        std::cout << fileName << " writePageCounter " << writePageCounter << std::endl;
     }
     return SUCCESSFUL;
 }
 
+/**
+ * Read a page directly from the disk, bypassing the buffer pool.
+ */
+RC FileHandle::readPhysicalPage(PageNum pageNum, void *data)
+{
+    DescriptorGuard guard(*state, ioMode == IO_STDIO);
+    if (guard.status() != SUCCESSFUL) {
+        return guard.status();
+    }
+    return readAt(guard.stream(), guard.descriptor(), pageOffset(pageNum, getPageSize()), data, getPageSize(),
+                  metrics.get());
+}
+
+/**
+ * Write a page directly to the disk, bypassing the buffer pool.
+ */
+RC FileHandle::writePhysicalPage(PageNum pageNum, const void *data)
+{
+    DescriptorGuard guard(*state, ioMode == IO_STDIO, true);
+    if (guard.status() != SUCCESSFUL) {
+        return guard.status();
+    }
+    return writeAt(guard.stream(), guard.descriptor(), pageOffset(pageNum, getPageSize()), data, getPageSize(),
+                   true, metrics.get());
+}
+
+/**
+ * Read consecutive pages into the given buffers. Pages are loaded into
+ * the buffer pool with as few vectored reads as possible.
+ *
+ * @param startPage
+ *          the first page to read
+ * @param count
+ *          the # of pages
+ * @param buffers
+ *          count buffers of getPageSize() bytes each
+ * @return status
+ */
+RC FileHandle::readPages(PageNum startPage, unsigned count, void *buffers[])
+{
+    if (!buffers) {
+        return ERR_NULLPTR;
+    }
+    if (startPage + count > getNumberOfPages() || startPage + count < startPage) {
+        __trace();
+        return ERR_LOCATE;
+    }
+
+    // Each readPage() is timed on its own
+    RC err;
+    unsigned window = PagedFileManager::instance()->getBufferManager()->getFrameCount() / 4;
+    if (window == 0) {
+        window = 1;
+    }
+    for (unsigned i = 0; i < count; i++) {
+        if (i % window == 0 && (err = prefetchPages(startPage + i,
+                count - i < window ? count - i : window)) != SUCCESSFUL) {
+            __trace();
+            return err;
+        }
+        if ((err = readPage(startPage + i, buffers[i])) != SUCCESSFUL) {
+            __trace();
+            return err;
+        }
+    }
+    return SUCCESSFUL;
+}
+
+/**
+ * Start loading consecutive pages in the background, so that later
+ * reads of them hit the buffer pool (or the page cache, in IO_MMAP mode).
+ *
+ * @param startPage
+ *          the first page
+ * @param count
+ *          the # of pages (trimmed at the end of the file)
+ * @return status
+ */
+RC FileHandle::prefetchPages(PageNum startPage, unsigned count)
+{
+    unsigned pageCount = getNumberOfPages();
+    if (startPage >= pageCount || count == 0) {
+        return SUCCESSFUL;
+    }
+    if (count > pageCount - startPage) {
+        count = pageCount - startPage;
+    }
+
+    if (ioMode == IO_MMAP) {
+        RC err;
+        char *page;
+        if ((err = mapPage(startPage + count - 1, page)) != SUCCESSFUL) {
+            __trace();
+            return err;
+        }
+        page -= (size_t) (count - 1) * getPageSize();
+        madvise(page, (size_t) count * getPageSize(), MADV_WILLNEED);
+        return SUCCESSFUL;
+    }
+
+    std::vector<PageNum> pageNums;
+    for (unsigned i = 0; i < count; i++) {
+        pageNums.push_back(startPage + i);
+    }
+    return PagedFileManager::instance()->getBufferManager()->prefetchPages(*this, pageNums);
+}
+
+/**
+ * Start loading the given pages in the background. Pages past the end
+ * of the file are ignored.
+ *
+ * @param pageNums
+ *          the page numbers (in any order)
+ * @return status
+ */
+RC FileHandle::prefetchPages(const std::vector<PageNum> &pageNums)
+{
+    unsigned pageCount = getNumberOfPages();
+    std::vector<PageNum> valid;
+    for (size_t i = 0; i < pageNums.size(); i++) {
+        if (pageNums[i] < pageCount) {
+            valid.push_back(pageNums[i]);
+        }
+    }
+
+    if (ioMode == IO_MMAP) {
+        for (size_t i = 0; i < valid.size(); i++) {
+            prefetchPages(valid[i], 1);
+        }
+        return SUCCESSFUL;
+    }
+    return PagedFileManager::instance()->getBufferManager()->prefetchPages(*this, valid);
+}
+
+/**
+ * Wait until the background reads of the given pages complete.
+ *
+ * @param pageNums
+ *          the page numbers
+ * @return status
+ */
+RC FileHandle::waitForPages(const std::vector<PageNum> &pageNums)
+{
+    if (ioMode == IO_MMAP) {
+        return SUCCESSFUL;
+    }
+    return PagedFileManager::instance()->getBufferManager()->waitForPages(*this, pageNums);
+}
+
+/**
+ * Read ahead for a sequential reader. Once the reader is half way
+ * through the pages requested so far, the next window is requested, so
+ * that the reads overlap with the processing of the current pages.
+ *
+ * @param pageNum
+ *          the page the reader is about to read
+ * @param readAheadEnd
+ *          (in/out) the end of the pages requested so far, 0 at first
+ * @return status
+ */
+RC FileHandle::readAhead(PageNum pageNum, PageNum &readAheadEnd)
+{
+    unsigned window = PagedFileManager::getReadAheadWindow();
+    if (window <= 1 || pageNum + window / 2 < readAheadEnd) {
+        return SUCCESSFUL;
+    }
+
+    PageNum start = pageNum > readAheadEnd ? pageNum : readAheadEnd;
+    readAheadEnd = start + window;
+    return prefetchPages(start, window);
+}
+
+/**
+ * Locate a page in the mapping of the file, remapping the file first if
+ * it has grown past the current mapping.
+ *
+ * @param pageNum
+ *          the page number
+ * @param page
+ *          (return) the page in the mapping
+ * @return status
+ */
+RC FileHandle::mapPage(PageNum pageNum, char *&page)
+{
+    std::lock_guard<std::mutex> guard(mapping->latch);
+    if (pageNum >= mapping->mappedPages) {
+        // New pages may still be cached dirty by the writers
+        RC err;
+        if ((err = PagedFileManager::instance()->getBufferManager()->flushFile(fileId)) != SUCCESSFUL) {
+            __trace();
+            return err;
+        }
+        DescriptorGuard guard(*state, false);
+        if ((err = guard.status()) != SUCCESSFUL) {
+            return err;
+        }
+        unsigned pageCount = getNumberOfPages();
+        size_t length = (size_t) pageOffset(pageCount, getPageSize());
+        void *addr = mmap(NULL, length, PROT_READ, MAP_SHARED, guard.descriptor(), 0);
+        if (addr == MAP_FAILED) {
+            __trace();
+            return ERR_READ;
+        }
+        // Scans and partitions read mapped files from the beginning to the end
+        madvise(addr, length, MADV_SEQUENTIAL);
+
+        if (mapping->addr) {
+            mapping->retired.push_back(std::make_pair(mapping->addr,
+                    (size_t) pageOffset(mapping->mappedPages, mapping->pageSize)));
+        }
+        mapping->addr = (char *) addr;
+        mapping->mappedPages = pageCount;
+        mapping->pageSize = getPageSize();
+    }
+
+    page = mapping->addr + pageOffset(pageNum, mapping->pageSize);
+    return SUCCESSFUL;
+}
+
+/**
+ * Write the in-memory header back to the header page. The caller
+ * should hold the latch of the file state.
+ */
+RC FileHandle::writeHeader()
+{
+    return writeFileHeader(*state, ioMode == IO_STDIO, metrics.get());
+}
+
+/**
+ * Make sure the disk has room for a new page. Space is reserved a whole
+ * extent at a time with fallocate(), so that bulk loads produce contiguous
+ * files and the file system updates its metadata once per extent instead
+ * of once per page. If the file system cannot preallocate, the file just
+ * grows as its pages are written. The caller should hold the latch of the
+ * file state.
+ *
+ * @param pageNum
+ *          the new page.
+ * @return status
+ */
+RC FileHandle::reserveSpace(PageNum pageNum)
+{
+    unsigned pageSize = getPageSize();
+    long end = pageOffset(pageNum + 1, pageSize);
+    unsigned extentSize = PagedFileManager::getExtentSize();
+    if (end <= state->allocatedSize || extentSize == 0) {
+        return SUCCESSFUL;
+    }
+
+    // Extents are made of whole pages
+    long extent = std::max(extentSize - extentSize % pageSize, pageSize);
+    long size = (end + extent - 1) / extent * extent;
+    DescriptorGuard guard(*state, false, true);
+    if (guard.status() != SUCCESSFUL) {
+        return guard.status();
+    }
+    int fd = guard.descriptor();
+    int rc;
+    while ((rc = fallocate(fd, 0, state->allocatedSize, size - state->allocatedSize)) != 0
+            && errno == EINTR) {
+    }
+    if (rc == 0) {
+        state->allocatedSize = size;
+    }
+    return SUCCESSFUL;
+}
+
+/**
+ * Cut the file right after its last page, releasing the space reserved
+ * for pages which have not been appended. Dirty pages of the file must
+ * have been written back.
+ *
+ * @return status
+ */
+RC FileHandle::trimSpace()
+{
+    std::lock_guard<std::mutex> guard(state->latch);
+    long size = pageOffset(state->header.pageCount, getPageSize());
+    if (state->allocatedSize <= size) {
+        return SUCCESSFUL;
+    }
+
+    DescriptorGuard descriptor(*state, false, true);
+    if (descriptor.status() != SUCCESSFUL) {
+        return descriptor.status();
+    }
+    if (state->filePtr && fflush(state->filePtr)) {
+        __trace();
+        return ERR_WRITE;
+    }
+    if (ftruncate(descriptor.descriptor(), size)) {
+        __trace();
+        return ERR_WRITE;
+    }
+    state->allocatedSize = size;
+    return SUCCESSFUL;
+}
+
 /**
  * Append a page of data to the file.
  * Here we assume that data size will not exceed the size of a page.
@@ -231,44 +1289,189 @@ RC FileHandle::writePage(PageNum pageNum, const void *data)
  */
 RC FileHandle::appendPage(const void *data)
 {
-    RC rc = writePage(getNumberOfPages(), data);
-    if (rc == SUCCESSFUL) {
-//        __trace();
-//        std::cout << "--> appended a new page, pageCount now is " << getNumberOfPages() << std::endl;
-    } else {
-        __trace();
-        std::cout << "--> Cannot write data in a new page, rc = " << rc
-             << " current pageCount " << getNumberOfPages() << std::endl;
+    PageNum pageNum;
+    return appendPage(data, pageNum);
+}
+
+/**
+ * Append a page of data to the file. Threads appending at the same time
+ * get different pages.
+ *
+ * @param data
+ *           the data
+ * @param pageNum
+ *           (return) the page number of the new page
+ * @return status
+ */
+RC FileHandle::appendPage(const void *data, PageNum &pageNum)
+{
+    if (!state) {
+        return ERR_HEADER;
+    }
+    if (ioMode == IO_MMAP) {
+        return ERR_READ_ONLY;
     }
 
-    return rc;
+    RC err;
+    LatencyTimer timer(metrics.get(), IO_OP_APPEND);
+    BufferManager *bm = PagedFileManager::instance()->getBufferManager();
+    // Claim the frame before taking the latch: an eviction writes pages
+    // back, which must not hold up the other appenders of the file
+    unsigned frameNum;
+    int claimed = bm->claimFrame(*this, frameNum) == SUCCESSFUL ? (int) frameNum : -1;
+    {
+        // The new page is cached dirty and reaches the disk with its
+        // neighbours, and so does the header (see flushHeaders()): a logged
+        // page the header does not count is appended again by recovery.
+        // The page is in the pool before other threads can see the new
+        // page count.
+        std::lock_guard<std::mutex> guard(state->latch);
+        pageNum = state->header.pageCount;
+        if ((err = reserveSpace(pageNum)) != SUCCESSFUL) {
+            __trace();
+            if (claimed >= 0) {
+                bm->releaseFrame(claimed);
+            }
+            return err;
+        }
+
+        // A new page is logged as a change of an empty page
+        LSN lsn = 0;
+        if (LogManager::inTransaction()) {
+            static const char emptyPage[MAX_PAGE_SIZE] = {0};
+            if ((err = LogManager::instance()->lockPage(fileName, pageNum, false)) != SUCCESSFUL
+                    || (err = LogManager::instance()->logUpdate(fileName, pageNum, getPageSize(),
+                                                                emptyPage, data, lsn)) != SUCCESSFUL) {
+                __trace();
+                if (claimed >= 0) {
+                    bm->releaseFrame(claimed);
+                }
+                return err;
+            }
+        }
+
+        void *frame;
+        bool cached = bm->pinPage(*this, pageNum, frame, false, claimed) == SUCCESSFUL;
+        if (cached) {
+            memcpy(frame, data, getPageSize());
+        } else if ((lsn && (err = LogManager::instance()->flush(lsn)) != SUCCESSFUL)
+                || (err = writePhysicalPage(pageNum, data)) != SUCCESSFUL) {
+            // Every frame is pinned
+            __trace();
+            std::cout << "--> Cannot write data in a new page, rc = " << err
+                 << " current pageCount " << pageNum << std::endl;
+            return err;
+        }
+
+        state->header.pageCount++;
+        state->headerDirty = true;
+        state->pageCount = state->header.pageCount;
+        if (cached && (err = bm->unpinPage(*this, pageNum, true, lsn)) != SUCCESSFUL) {
+            __trace();
+            return err;
+        }
+    }
+
+    appendPageCounter++;
+//    std::cout << fileName << " appendPageCounter " << appendPageCounter << std::endl;
+    return SUCCESSFUL;
 }
 
 /**
- * Get the number of pages.
+ * Append consecutive pages to the file. Outside of transactions the pages
+ * bypass the buffer pool: they reach the disk with one write, and the
+ * header is written once for all of them. A transaction appends them one
+ * by one so that each of them is logged.
  *
- * @return # of pages
+ * @param count
+ *          the # of pages
+ * @param data
+ *          count pages of getPageSize() bytes each, back to back
+ * @param startPage
+ *          (return) the page number of the first page
+ * @return status
  */
-unsigned FileHandle::getNumberOfPages()
+RC FileHandle::appendPages(unsigned count, const void *data, PageNum &startPage)
 {
-    // get the file size in pages(should be multiple of PAGE_SIZE)
-    long fileSize = 0l;
-    FILE *fp = getFilePointer();
-    if (fseek(fp, 0, SEEK_END)) {
-        __trace();
-        perror("Cannot locate");
-        exit(ERR_LOCATE);
+    if (!data) {
+        return ERR_NULLPTR;
     }
-    if ((fileSize = ftell(fp)) == -1) {
-        __trace();
-        exit(ERR_LOCATE);
+    if (!state) {
+        return ERR_HEADER;
+    }
+    if (ioMode == IO_MMAP) {
+        return ERR_READ_ONLY;
     }
-    if (fileSize % PAGE_SIZE != 0) {
-        // File size is not a multiple of PAGE_SIZE
-        // Probably this file has been damaged
-        exit(ERR_ALIGN);
+
+    RC err;
+    unsigned pageSize = getPageSize();
+    if (LogManager::inTransaction()) {
+        startPage = getNumberOfPages();
+        for (unsigned i = 0; i < count; i++) {
+            if ((err = appendPage((const char *) data + (size_t) i * pageSize)) != SUCCESSFUL) {
+                __trace();
+                return err;
+            }
+        }
+        return SUCCESSFUL;
+    }
+
+    LatencyTimer timer(metrics.get(), IO_OP_APPEND);
+    {
+        // The pages go first: a crash in between leaves unused space
+        // behind, never a header counting missing pages
+        std::lock_guard<std::mutex> guard(state->latch);
+        startPage = state->header.pageCount;
+        if (count == 0) {
+            return SUCCESSFUL;
+        }
+        if ((err = reserveSpace(startPage + count - 1)) != SUCCESSFUL) {
+            __trace();
+            return err;
+        }
+        {
+            DescriptorGuard descriptor(*state, ioMode == IO_STDIO, true);
+            if (descriptor.status() != SUCCESSFUL) {
+                return descriptor.status();
+            }
+            if ((err = writeAt(descriptor.stream(), descriptor.descriptor(), pageOffset(startPage, pageSize),
+                               data, (size_t) count * pageSize, true, metrics.get())) != SUCCESSFUL) {
+                __trace();
+                return err;
+            }
+        }
+
+        state->header.pageCount += count;
+        if ((err = writeHeader()) != SUCCESSFUL) {
+            __trace();
+            state->header.pageCount -= count;
+            return err;
+        }
+        state->pageCount = state->header.pageCount;
     }
-    return fileSize / PAGE_SIZE;
+
+    appendPageCounter += count;
+    return SUCCESSFUL;
+}
+
+/**
+ * Get the number of pages.
+ *
+ * @return # of pages
+ */
+unsigned FileHandle::getNumberOfPages()
+{
+    return state ? state->pageCount.load() : 0;
+}
+
+/**
+ * Get the page size of the file, fixed when the file is created.
+ *
+ * @return page size in bytes
+ */
+unsigned FileHandle::getPageSize()
+{
+    return state ? state->header.pageSize : PAGE_SIZE;
 }
 
 /**
@@ -284,40 +1487,269 @@ void FileHandle::setNumberOfPages(unsigned pages)
 }
 
 /**
- * Get the file pointer in this file handle.
+ * Attach the state (header and latch) shared by all handles of the file.
  *
- * @return file pointer
+ * @param st
+ *          the shared state
  */
-FILE *FileHandle::getFilePointer()
+void FileHandle::setFileState(const std::shared_ptr<FileState> &st)
 {
-    return filePtr;
+    state = st;
 }
 
 /**
- * Set the file pointer in this file handle.
+ * Get the root page of the free space map.
  *
- * @param ptr
- *          the file pointer
+ * @return page number, or NULL_PAGE if the file has no free space map
  */
-void FileHandle::setFilePointer(FILE *ptr)
+PageNum FileHandle::getFreeSpaceRoot()
 {
-    filePtr = ptr;
+    if (!state) {
+        return NULL_PAGE;
+    }
+    std::lock_guard<std::mutex> guard(state->latch);
+    return state->header.freeSpaceRoot;
 }
 
 /**
- * Get the file name.
+ * Set the root page of the free space map and persist it.
  *
- * @return file name
+ * @param pageNum
+ *          the root page
+ * @return status
  */
-char *FileHandle::getFileName() {
-    return (char *) fileName.c_str();
+RC FileHandle::setFreeSpaceRoot(PageNum pageNum)
+{
+    if (!state) {
+        return ERR_HEADER;
+    }
+    std::lock_guard<std::mutex> guard(state->latch);
+    state->header.freeSpaceRoot = pageNum;
+    return writeHeader();
 }
 
 /**
- * Set the file name.
+ * Give the disk space of a run of pages back to the file system by
+ * punching a hole over them. The pages stay in the file and read as
+ * zeros afterwards; if the file system cannot punch holes they are
+ * zeroed instead. Their cached copies are dropped, so none of them may
+ * be pinned.
  *
- * @param file name
- */
+ * @param startPage
+ *          the first page of the run
+ * @param count
+ *          # of pages
+ * @return status
+ */
+RC FileHandle::punchPages(PageNum startPage, unsigned count)
+{
+    if (!state) {
+        return ERR_HEADER;
+    }
+    if (ioMode == IO_MMAP) {
+        return ERR_READ_ONLY;
+    }
+    unsigned pageCount = getNumberOfPages();
+    if (startPage > pageCount || count > pageCount - startPage) {
+        __trace();
+        return ERR_LOCATE;
+    }
+    if (count == 0) {
+        return SUCCESSFUL;
+    }
+
+    RC err;
+    BufferManager *bm = PagedFileManager::instance()->getBufferManager();
+    if ((err = bm->discardPages(fileId, startPage, count)) != SUCCESSFUL) {
+        __trace();
+        return err;
+    }
+
+    unsigned pageSize = getPageSize();
+    DescriptorGuard descriptor(*state, false, true);
+    if (descriptor.status() != SUCCESSFUL) {
+        return descriptor.status();
+    }
+    int fd = descriptor.descriptor();
+    int rc;
+    while ((rc = fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, pageOffset(startPage, pageSize),
+                           (long) count * pageSize)) != 0 && errno == EINTR) {
+    }
+    if (rc == 0) {
+        return SUCCESSFUL;
+    }
+
+    static const char zeroPage[MAX_PAGE_SIZE] = {0};
+    for (unsigned i = 0; i < count; i++) {
+        if ((err = writeAt(NULL, fd, pageOffset(startPage + i, pageSize), zeroPage, pageSize, false,
+                           metrics.get())) != SUCCESSFUL) {
+            __trace();
+            return err;
+        }
+    }
+    return SUCCESSFUL;
+}
+
+/**
+ * Cut the file after its first pageCount pages, e.g. to drop trailing
+ * pages which hold nothing anymore. Their cached copies are dropped, so
+ * none of them may be pinned.
+ *
+ * @param pageCount
+ *          # of pages kept
+ * @return status
+ */
+RC FileHandle::truncatePages(unsigned pageCount)
+{
+    if (!state) {
+        return ERR_HEADER;
+    }
+    if (ioMode == IO_MMAP) {
+        return ERR_READ_ONLY;
+    }
+
+    RC err;
+    std::lock_guard<std::mutex> guard(state->latch);
+    unsigned oldCount = state->header.pageCount;
+    if (pageCount > oldCount) {
+        __trace();
+        return ERR_LOCATE;
+    }
+    if (pageCount == oldCount) {
+        return SUCCESSFUL;
+    }
+    BufferManager *bm = PagedFileManager::instance()->getBufferManager();
+    if ((err = bm->discardPages(fileId, pageCount, oldCount - pageCount)) != SUCCESSFUL) {
+        __trace();
+        return err;
+    }
+
+    // The header goes first: a crash in between leaves unused space behind,
+    // never a header counting missing pages
+    state->header.pageCount = pageCount;
+    if ((err = writeHeader()) != SUCCESSFUL) {
+        __trace();
+        state->header.pageCount = oldCount;
+        return err;
+    }
+    state->pageCount = pageCount;
+
+    long size = pageOffset(pageCount, getPageSize());
+    DescriptorGuard descriptor(*state, false, true);
+    if (descriptor.status() != SUCCESSFUL) {
+        return descriptor.status();
+    }
+    if (state->filePtr && fflush(state->filePtr)) {
+        __trace();
+        return ERR_WRITE;
+    }
+    if (ftruncate(descriptor.descriptor(), size)) {
+        __trace();
+        return ERR_WRITE;
+    }
+    state->allocatedSize = size;
+    return SUCCESSFUL;
+}
+
+/**
+ * Get the file pointer in this file handle. It is only valid until the
+ * next I/O of another file, since the descriptor cache may close it.
+ *
+ * @return file pointer, or NULL if the handle uses the descriptor or the
+ *         descriptor is not open
+ */
+FILE *FileHandle::getFilePointer()
+{
+    return state && ioMode == IO_STDIO ? state->filePtr : NULL;
+}
+
+/**
+ * Get the file descriptor in this file handle. It is only valid until the
+ * next I/O of another file, since the descriptor cache may close it.
+ *
+ * @return file descriptor, or -1 if the handle uses a stdio stream or the
+ *         descriptor is not open
+ */
+int FileHandle::getFileDescriptor()
+{
+    return state && ioMode != IO_STDIO ? state->fileDesc : -1;
+}
+
+/**
+ * Get the I/O backend of this file handle.
+ *
+ * @return I/O mode
+ */
+IOMode FileHandle::getIOMode()
+{
+    return ioMode;
+}
+
+/**
+ * Set the I/O backend of this file handle.
+ *
+ * @param mode
+ *          I/O mode
+ */
+void FileHandle::setIOMode(IOMode mode)
+{
+    ioMode = mode;
+}
+
+/**
+ * Check whether the handle is attached to an open file.
+ *
+ * @return true if the file is open
+ */
+bool FileHandle::isOpen()
+{
+    return state && state->openCount > 0;
+}
+
+/**
+ * Whether the file of the handle has been destroyed since it was opened
+ * (the handle still reads and writes the removed file).
+ */
+bool FileHandle::isRemoved()
+{
+    return state && state->unlinked;
+}
+
+/**
+ * Get the id of the file in the buffer pool.
+ *
+ * @return file id
+ */
+unsigned FileHandle::getFileId()
+{
+    return fileId;
+}
+
+/**
+ * Set the id of the file in the buffer pool.
+ *
+ * @param id
+ *          the file id
+ */
+void FileHandle::setFileId(unsigned id)
+{
+    fileId = id;
+}
+
+/**
+ * Get the file name.
+ *
+ * @return file name
+ */
+char *FileHandle::getFileName() {
+    return (char *) fileName.c_str();
+}
+
+/**
+ * Set the file name.
+ *
+ * @param file name
+ */
 void FileHandle::setFileName(const char *name) {
     fileName = std::string((char *)name);
 }
@@ -335,3 +1767,1474 @@ RC FileHandle::collectCounterValues(unsigned &readPageCount, unsigned &writePage
 
     return SUCCESSFUL;
 }
+
+RC FileHandle::collectCounterValues(unsigned &readPageCount, unsigned &writePageCount, unsigned &appendPageCount,
+        unsigned &hitCount, unsigned &missCount, unsigned &evictionCount) {
+    collectCounterValues(readPageCount, writePageCount, appendPageCount);
+    hitCount = hitCounter;
+    missCount = missCounter;
+    evictionCount = evictionCounter;
+
+    return SUCCESSFUL;
+}
+
+/**
+ * Get the I/O metrics of the handle since it was created (or last reset).
+ * Pages written back later by the buffer pool are charged to the handle
+ * which last changed them.
+ *
+ * @param stats
+ *          (return) the snapshot
+ * @return status
+ */
+RC FileHandle::collectIOStats(IOStats &stats) {
+    metrics->snapshot(stats);
+    return SUCCESSFUL;
+}
+
+/**
+ * Reset the I/O metrics of the handle (and of its copies).
+ */
+void FileHandle::resetIOStats() {
+    metrics->reset();
+}
+
+
+/////////////////////////////////////////////////////
+
+IOMetrics::IOMetrics()
+{
+    reset();
+}
+
+/**
+ * Account a disk transfer.
+ *
+ * @param offset
+ *          the offset of the transfer in the file
+ * @param bytes
+ *          the # of bytes transferred
+ * @param syscalls
+ *          the # of system calls it took
+ * @param write
+ *          whether data was written
+ */
+void IOMetrics::recordTransfer(long offset, size_t bytes, unsigned syscalls, bool write)
+{
+    if (write) {
+        _bytesWritten += bytes;
+    } else {
+        _bytesRead += bytes;
+    }
+    _syscallCount += syscalls;
+    if (_lastEnd.exchange(offset + (long) bytes) != offset) {
+        _seekCount++;
+    }
+}
+
+/**
+ * Account an operation in the histogram of its kind.
+ *
+ * @param op
+ *          the kind of operation
+ * @param ns
+ *          its latency in nanoseconds
+ */
+void IOMetrics::recordLatency(IOOp op, unsigned long long ns)
+{
+    unsigned bucket = ns ? 63 - __builtin_clzll(ns) : 0;
+    if (bucket >= LATENCY_BUCKETS) {
+        bucket = LATENCY_BUCKETS - 1;
+    }
+    _opCount[op]++;
+    _totalLatency[op] += ns;
+    _latency[op][bucket]++;
+}
+
+/**
+ * Copy the current values. Values updated meanwhile may or may not be
+ * included.
+ *
+ * @param stats
+ *          (return) the snapshot
+ */
+void IOMetrics::snapshot(IOStats &stats)
+{
+    stats.bytesRead = _bytesRead;
+    stats.bytesWritten = _bytesWritten;
+    stats.syscallCount = _syscallCount;
+    stats.seekCount = _seekCount;
+    for (unsigned op = 0; op < IO_OP_COUNT; op++) {
+        stats.opCount[op] = _opCount[op];
+        stats.totalLatency[op] = _totalLatency[op];
+        for (unsigned i = 0; i < LATENCY_BUCKETS; i++) {
+            stats.latency[op][i] = _latency[op][i];
+        }
+    }
+}
+
+/**
+ * Set all values back to zero.
+ */
+void IOMetrics::reset()
+{
+    _bytesRead = 0;
+    _bytesWritten = 0;
+    _syscallCount = 0;
+    _seekCount = 0;
+    _lastEnd = 0;
+    for (unsigned op = 0; op < IO_OP_COUNT; op++) {
+        _opCount[op] = 0;
+        _totalLatency[op] = 0;
+        for (unsigned i = 0; i < LATENCY_BUCKETS; i++) {
+            _latency[op][i] = 0;
+        }
+    }
+}
+
+
+/////////////////////////////////////////////////////
+
+FileMapping::FileMapping()
+    : addr(NULL), mappedPages(0), pageSize(PAGE_SIZE)
+{
+}
+
+FileMapping::~FileMapping()
+{
+    if (addr) {
+        munmap(addr, pageOffset(mappedPages, pageSize));
+    }
+    for (size_t i = 0; i < retired.size(); i++) {
+        munmap(retired[i].first, retired[i].second);
+    }
+}
+
+
+/////////////////////////////////////////////////////
+
+BufferManager::BufferManager(unsigned frameCount)
+    : _frames(frameCount), _clockHand(0), _dirtyCount(0), _stopping(false),
+      _hitCounter(0), _missCounter(0), _evictionCounter(0)
+{
+    for (size_t i = 0; i < _frames.size(); i++) {
+        Frame &frame = _frames[i];
+        frame.fileId = 0;
+        frame.size = PAGE_SIZE;
+        frame.pageNum = 0;
+        frame.pinCount = 0;
+        frame.valid = false;
+        frame.dirty = false;
+        frame.referenced = false;
+        frame.loading = false;
+        frame.writing = false;
+        frame.pageLSN = 0;
+        frame.recLSN = 0;
+        frame.data = new char[frame.size];
+    }
+    _flusher = std::thread(&BufferManager::runFlusher, this);
+}
+
+BufferManager::~BufferManager()
+{
+    {
+        std::lock_guard<std::mutex> guard(_mutex);
+        _stopping = true;
+        _flushWanted.notify_all();
+    }
+    _flusher.join();
+    flushAll();
+    for (size_t i = 0; i < _frames.size(); i++) {
+        delete[] _frames[i].data;
+    }
+}
+
+unsigned long long BufferManager::pageKey(unsigned fileId, PageNum pageNum)
+{
+    return ((unsigned long long) fileId << 32) | pageNum;
+}
+
+/**
+ * Pin a page in the buffer pool. On a miss a frame is claimed (evicting
+ * an unpinned page if necessary) and, unless load is false, the page
+ * is read from the file.
+ *
+ * @param fileHandle
+ *          the handle of the file the page belongs to
+ * @param pageNum
+ *          the page number
+ * @param data
+ *          (return) the frame holding the page
+ * @param load
+ *          whether the page content should be read on a miss
+ * @param claimed
+ *          # of a frame from claimFrame() to use on a miss, or -1; it is
+ *          given back on a hit or an error
+ * @return status
+ */
+RC BufferManager::pinPage(FileHandle &fileHandle, PageNum pageNum, void *&data, bool load, int claimed)
+{
+    unsigned long long key = pageKey(fileHandle.getFileId(), pageNum);
+    std::unique_lock<std::mutex> lock(_mutex);
+    std::unordered_map<unsigned long long, unsigned>::iterator it = _pageTable.find(key);
+    RC err;
+    if (it == _pageTable.end() && claimed < 0) {
+        unsigned victim;
+        if ((err = findVictim(victim, fileHandle, lock)) != SUCCESSFUL) {
+            __trace();
+            return err;
+        }
+        claimed = victim;
+        // Another thread may have read the page in during the eviction
+        it = _pageTable.find(key);
+    }
+    if (it != _pageTable.end()) {
+        if (claimed >= 0) {
+            _frames[claimed].pinCount = 0;
+        }
+        Frame &frame = _frames[it->second];
+        frame.pinCount++;
+        frame.referenced = true;
+        // Another thread is reading the page in, or writing it back: pinned
+        // pages may be changed, which must not happen during the write
+        while (frame.loading || frame.writing) {
+            _ioDone.wait(lock);
+        }
+        if (!frame.valid) {
+            frame.pinCount--;
+            return ERR_READ;
+        }
+        data = frame.data;
+        _hitCounter++;
+        fileHandle.hitCounter++;
+        return SUCCESSFUL;
+    }
+
+    unsigned frameNum = claimed;
+    Frame &frame = _frames[frameNum];
+    resizeFrame(frame, fileHandle.getPageSize());
+    frame.fileId = fileHandle.getFileId();
+    frame.pageNum = pageNum;
+    frame.pinCount = 1;
+    frame.valid = true;
+    frame.dirty = false;
+    frame.referenced = true;
+    frame.loading = load;
+    frame.pageLSN = 0;
+    frame.recLSN = 0;
+    frame.file = fileHandle.state;
+    frame.metrics = fileHandle.metrics;
+    _pageTable[key] = frameNum;
+    _missCounter++;
+    fileHandle.missCounter++;
+
+    if (load) {
+        // Read without holding the mutex; the pin keeps the frame
+        lock.unlock();
+        err = fileHandle.readPhysicalPage(pageNum, frame.data);
+        lock.lock();
+
+        frame.loading = false;
+        if (err != SUCCESSFUL) {
+            __trace();
+            _pageTable.erase(key);
+            frame.valid = false;
+            frame.pinCount--;
+        }
+        _ioDone.notify_all();
+        if (err != SUCCESSFUL) {
+            return err;
+        }
+    }
+
+    data = frame.data;
+    return SUCCESSFUL;
+}
+
+/**
+ * Unpin a page.
+ *
+ * @param fileHandle
+ *          the handle of the file the page belongs to
+ * @param pageNum
+ *          the page number
+ * @param dirty
+ *          whether the page has been changed
+ * @param lsn
+ *          the end of the log record of the change (0 if not logged)
+ * @return status
+ */
+RC BufferManager::unpinPage(FileHandle &fileHandle, PageNum pageNum, bool dirty, LSN lsn)
+{
+    std::lock_guard<std::mutex> guard(_mutex);
+    std::unordered_map<unsigned long long, unsigned>::iterator it =
+            _pageTable.find(pageKey(fileHandle.getFileId(), pageNum));
+    if (it == _pageTable.end() || _frames[it->second].pinCount == 0) {
+        __trace();
+        return ERR_NOT_PINNED;
+    }
+
+    Frame &frame = _frames[it->second];
+    frame.pinCount--;
+    if (dirty) {
+        if (lsn) {
+            frame.pageLSN = lsn;
+            if (!frame.recLSN) {
+                frame.recLSN = lsn;
+            }
+        }
+        markDirty(frame);
+        if (frame.file != fileHandle.state) {
+            frame.file = fileHandle.state;
+        }
+        if (frame.metrics != fileHandle.metrics) {
+            frame.metrics = fileHandle.metrics;
+        }
+    }
+    return SUCCESSFUL;
+}
+
+/**
+ * Start loading the absent pages into the pool in the background. The
+ * frames stay pinned while they are loading, so they cannot be evicted
+ * and pinPage() waits for them; they are unpinned once loaded. At most
+ * a quarter of the pool is used for one batch.
+ *
+ * @param fileHandle
+ *          the handle of the file the pages belong to
+ * @param pageNums
+ *          the page numbers (in any order)
+ * @return status
+ */
+RC BufferManager::prefetchPages(FileHandle &fileHandle, const std::vector<PageNum> &pageNums)
+{
+    std::vector<PageNum> sorted(pageNums);
+    std::sort(sorted.begin(), sorted.end());
+    sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+    if (sorted.size() > _frames.size() / 4) {
+        sorted.resize(_frames.size() / 4);
+    }
+
+    // Claim frames for the absent pages
+    std::vector<PageNum> claimedPages;
+    std::vector<unsigned> claimedFrames;
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        for (size_t i = 0; i < sorted.size(); i++) {
+            unsigned long long key = pageKey(fileHandle.getFileId(), sorted[i]);
+            if (_pageTable.find(key) != _pageTable.end()) {
+                continue;
+            }
+            unsigned frameNum;
+            if (findVictim(frameNum, fileHandle, lock) != SUCCESSFUL) {
+                // Everything is pinned; the pages will be read on demand
+                break;
+            }
+            // The page may have been read in during the eviction
+            if (_pageTable.find(key) != _pageTable.end()) {
+                _frames[frameNum].pinCount = 0;
+                continue;
+            }
+            Frame &frame = _frames[frameNum];
+            resizeFrame(frame, fileHandle.getPageSize());
+            frame.fileId = fileHandle.getFileId();
+            frame.pageNum = sorted[i];
+            frame.pinCount = 1;
+            frame.valid = true;
+            frame.dirty = false;
+            frame.referenced = true;
+            frame.loading = true;
+            frame.pageLSN = 0;
+            frame.recLSN = 0;
+            frame.file = fileHandle.state;
+            frame.metrics = fileHandle.metrics;
+            _pageTable[key] = frameNum;
+            claimedPages.push_back(sorted[i]);
+            claimedFrames.push_back(frameNum);
+        }
+    }
+    if (claimedPages.empty()) {
+        return SUCCESSFUL;
+    }
+
+    // One request per run of consecutive pages. Writes through a stream
+    // are always flushed, so its descriptor can be read directly. Every
+    // request pins the descriptor until it completes.
+    std::shared_ptr<FileState> file = fileHandle.state;
+    RC err;
+    if ((err = DescriptorCache::instance()->acquire(*file, false)) != SUCCESSFUL) {
+        __trace();
+        finishLoad(claimedFrames, err);
+        return err;
+    }
+    int fd = file->fileDesc;
+    std::vector<IORequest> requests;
+    size_t runStart = 0;
+    for (size_t i = 0; i < claimedPages.size(); i++) {
+        if (i + 1 < claimedPages.size() && claimedPages[i + 1] == claimedPages[i] + 1
+                && i + 1 - runStart < IOV_MAX) {
+            continue;
+        }
+
+        if (!requests.empty()) {
+            DescriptorCache::instance()->acquire(*file, false);
+        }
+        IORequest request;
+        request.fd = fd;
+        request.offset = pageOffset(claimedPages[runStart], fileHandle.getPageSize());
+        request.metrics = fileHandle.metrics;
+        std::vector<unsigned> frameNums;
+        for (size_t j = runStart; j <= i; j++) {
+            struct iovec iov;
+            iov.iov_base = _frames[claimedFrames[j]].data;
+            iov.iov_len = fileHandle.getPageSize();
+            request.iov.push_back(iov);
+            frameNums.push_back(claimedFrames[j]);
+        }
+        request.done = [this, frameNums, file](RC result) {
+            finishLoad(frameNums, result);
+            DescriptorCache::instance()->release(*file);
+        };
+        requests.push_back(request);
+        runStart = i + 1;
+    }
+
+    return IOEngine::instance()->submit(requests);
+}
+
+/**
+ * Wait until the background reads of the given pages complete.
+ *
+ * @param fileHandle
+ *          the handle of the file the pages belong to
+ * @param pageNums
+ *          the page numbers
+ * @return status
+ */
+RC BufferManager::waitForPages(FileHandle &fileHandle, const std::vector<PageNum> &pageNums)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    for (size_t i = 0; i < pageNums.size(); i++) {
+        unsigned long long key = pageKey(fileHandle.getFileId(), pageNums[i]);
+        std::unordered_map<unsigned long long, unsigned>::iterator it;
+        while ((it = _pageTable.find(key)) != _pageTable.end() && _frames[it->second].loading) {
+            _ioDone.wait(lock);
+        }
+    }
+    return SUCCESSFUL;
+}
+
+/**
+ * Complete a background read: unpin its frames, and drop them if the
+ * read failed.
+ */
+void BufferManager::finishLoad(const std::vector<unsigned> &frameNums, RC result)
+{
+    std::lock_guard<std::mutex> guard(_mutex);
+    for (size_t i = 0; i < frameNums.size(); i++) {
+        Frame &frame = _frames[frameNums[i]];
+        frame.loading = false;
+        frame.pinCount--;
+        if (result != SUCCESSFUL) {
+            _pageTable.erase(pageKey(frame.fileId, frame.pageNum));
+            frame.valid = false;
+        }
+    }
+    _ioDone.notify_all();
+}
+
+/**
+ * Wait until no page of a file is being read or written in the
+ * background, so that its descriptor may be closed. The caller holds lock.
+ */
+void BufferManager::waitForFile(std::unique_lock<std::mutex> &lock, unsigned fileId)
+{
+    for (size_t i = 0; i < _frames.size(); i++) {
+        while ((_frames[i].loading || _frames[i].writing) && _frames[i].fileId == fileId) {
+            _ioDone.wait(lock);
+        }
+    }
+}
+
+/**
+ * Write back all dirty pages of a file. A page still pinned may be
+ * being changed: it stays dirty (logged changes of it are covered by
+ * the log) and is written back once unpinned.
+ *
+ * @param fileId
+ *          the id of the file
+ * @return status
+ */
+RC BufferManager::flushFile(unsigned fileId)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    std::vector<unsigned> frameNums;
+    collectDirty(fileId, frameNums);
+    RC err = writeFrames(frameNums, &lock);
+    // Including writes started by the flusher
+    waitForFile(lock, fileId);
+    return err;
+}
+
+/**
+ * Write back all dirty pages, except the pinned ones (see flushFile()).
+ *
+ * @return status
+ */
+RC BufferManager::flushAll()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    std::vector<unsigned> fileIds;
+    std::unordered_map<unsigned, std::set<PageNum> >::iterator it;
+    for (it = _dirtyPages.begin(); it != _dirtyPages.end(); it++) {
+        fileIds.push_back(it->first);
+    }
+
+    RC err = SUCCESSFUL;
+    for (size_t i = 0; i < fileIds.size(); i++) {
+        std::vector<unsigned> frameNums;
+        collectDirty(fileIds[i], frameNums);
+        RC rc = writeFrames(frameNums, &lock);
+        if (rc != SUCCESSFUL) {
+            __trace();
+            err = rc;
+        }
+    }
+    for (size_t i = 0; i < _frames.size(); i++) {
+        while (_frames[i].writing) {
+            _ioDone.wait(lock);
+        }
+    }
+    return err;
+}
+
+/**
+ * Drop all pages of a file without writing them back (used when the
+ * file is destroyed).
+ *
+ * @param fileId
+ *          the id of the file
+ */
+void BufferManager::discardFile(unsigned fileId)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    waitForFile(lock, fileId);
+    for (size_t i = 0; i < _frames.size(); i++) {
+        if (_frames[i].valid && _frames[i].fileId == fileId) {
+            dropFrame(_frames[i]);
+        }
+    }
+}
+
+/**
+ * Drop a run of pages of a file without writing them back, e.g. before
+ * they are punched out of the file or truncated. Nothing is dropped if
+ * one of them is pinned.
+ *
+ * @param fileId
+ *          the id of the file
+ * @param startPage
+ *          the first page of the run
+ * @param count
+ *          # of pages
+ * @return status
+ */
+RC BufferManager::discardPages(unsigned fileId, PageNum startPage, unsigned count)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    waitForFile(lock, fileId);
+    std::vector<unsigned> frameNums;
+    for (size_t i = 0; i < _frames.size(); i++) {
+        Frame &frame = _frames[i];
+        if (frame.valid && frame.fileId == fileId && frame.pageNum >= startPage
+                && frame.pageNum - startPage < count) {
+            if (frame.pinCount > 0) {
+                __trace();
+                return ERR_PINNED;
+            }
+            frameNums.push_back(i);
+        }
+    }
+    for (size_t i = 0; i < frameNums.size(); i++) {
+        dropFrame(_frames[frameNums[i]]);
+    }
+    return SUCCESSFUL;
+}
+
+unsigned BufferManager::getFrameCount()
+{
+    return _frames.size();
+}
+
+/**
+ * Get the oldest logged change which may not be on the disk yet.
+ *
+ * @return its LSN, or 0 if there is none
+ */
+LSN BufferManager::getMinRecLSN()
+{
+    std::lock_guard<std::mutex> guard(_mutex);
+    LSN minLSN = 0;
+    for (size_t i = 0; i < _frames.size(); i++) {
+        const Frame &frame = _frames[i];
+        if ((frame.dirty || frame.writing) && frame.recLSN && (!minLSN || frame.recLSN < minLSN)) {
+            minLSN = frame.recLSN;
+        }
+    }
+    return minLSN;
+}
+
+void BufferManager::collectCounterValues(unsigned &hitCount, unsigned &missCount, unsigned &evictionCount)
+{
+    std::lock_guard<std::mutex> guard(_mutex);
+    hitCount = _hitCounter;
+    missCount = _missCounter;
+    evictionCount = _evictionCounter;
+}
+
+/**
+ * Claim a free frame for a later pinPage(), evicting a page if necessary.
+ *
+ * @param fileHandle
+ *          the handle asking for the frame (charged for the eviction)
+ * @param frameNum
+ *          (return) # of the frame claimed
+ * @return status
+ */
+RC BufferManager::claimFrame(FileHandle &fileHandle, unsigned &frameNum)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    return findVictim(frameNum, fileHandle, lock);
+}
+
+/**
+ * Give back a frame claimed by claimFrame() which pinPage() did not get.
+ */
+void BufferManager::releaseFrame(unsigned frameNum)
+{
+    std::lock_guard<std::mutex> guard(_mutex);
+    _frames[frameNum].pinCount = 0;
+}
+
+/**
+ * Find a frame to hold a new page with the clock algorithm. A page
+ * which has been referenced since the last sweep gets a second chance.
+ * Dirty victims are written back with the mutex released, so the pool
+ * may have changed when this returns.
+ *
+ * @param frameNum
+ *          (return) # of the frame found; it holds no page and is pinned
+ *          for the caller, who must set it up or unpin it
+ * @param fileHandle
+ *          the handle asking for the frame (charged for the eviction)
+ * @param lock
+ *          the caller's lock on _mutex
+ * @return status
+ */
+RC BufferManager::findVictim(unsigned &frameNum, FileHandle &fileHandle, std::unique_lock<std::mutex> &lock)
+{
+    RC err;
+    unsigned frameCount = _frames.size();
+    // Two rounds are enough: the first one clears all reference bits
+    for (unsigned i = 0; i < 2 * frameCount; i++) {
+        Frame &frame = _frames[_clockHand];
+        unsigned cur = _clockHand;
+        _clockHand = (_clockHand + 1) % frameCount;
+
+        if (frame.pinCount > 0) {
+            continue;
+        }
+        if (!frame.valid) {
+            frame.pinCount = 1;
+            frameNum = cur;
+            return SUCCESSFUL;
+        }
+        if (frame.referenced) {
+            frame.referenced = false;
+            continue;
+        }
+
+        // Evict the page, writing back its dirty neighbours along with it
+        if (frame.dirty) {
+            std::set<PageNum> &dirtyPages = _dirtyPages[frame.fileId];
+            std::set<PageNum>::iterator first = dirtyPages.find(frame.pageNum);
+            std::set<PageNum>::iterator last = first;
+            std::vector<unsigned> frameNums(1, cur);
+            while (first != dirtyPages.begin() && frameNums.size() < (size_t) IOV_MAX) {
+                std::set<PageNum>::iterator prev = first;
+                prev--;
+                unsigned neighbour = _pageTable[pageKey(frame.fileId, *prev)];
+                if (*prev + 1 != *first || _frames[neighbour].pinCount > 0) {
+                    break;
+                }
+                frameNums.insert(frameNums.begin(), neighbour);
+                first = prev;
+            }
+            for (last++; last != dirtyPages.end() && frameNums.size() < (size_t) IOV_MAX; last++) {
+                unsigned neighbour = _pageTable[pageKey(frame.fileId, *last)];
+                if (*last != _frames[frameNums.back()].pageNum + 1 || _frames[neighbour].pinCount > 0) {
+                    break;
+                }
+                frameNums.push_back(neighbour);
+            }
+            if ((err = writeFrames(frameNums, &lock)) != SUCCESSFUL) {
+                __trace();
+                return err;
+            }
+
+            // The page may have been pinned, changed or dropped during the write
+            if (frame.pinCount > 0) {
+                continue;
+            }
+            if (!frame.valid) {
+                frame.pinCount = 1;
+                frameNum = cur;
+                return SUCCESSFUL;
+            }
+            if (frame.dirty || frame.referenced) {
+                continue;
+            }
+        }
+        _pageTable.erase(pageKey(frame.fileId, frame.pageNum));
+        frame.valid = false;
+        frame.pinCount = 1;
+        _evictionCounter++;
+        fileHandle.evictionCounter++;
+        frameNum = cur;
+        return SUCCESSFUL;
+    }
+
+    __trace();
+    return ERR_NO_FRAME;
+}
+
+/**
+ * Make a free frame hold pages of the given size (files may have
+ * different page sizes). The caller holds _mutex.
+ */
+void BufferManager::resizeFrame(Frame &frame, unsigned pageSize)
+{
+    if (frame.size != pageSize) {
+        delete[] frame.data;
+        frame.data = new char[pageSize];
+        frame.size = pageSize;
+    }
+}
+
+/**
+ * Track a changed page. The caller holds _mutex.
+ */
+void BufferManager::markDirty(Frame &frame)
+{
+    if (frame.dirty) {
+        return;
+    }
+    frame.dirty = true;
+    _dirtyPages[frame.fileId].insert(frame.pageNum);
+    _dirtyCount++;
+    if (_dirtyCount > dirtyLimit()) {
+        _flushWanted.notify_one();
+    }
+}
+
+/**
+ * Stop tracking a page, e.g. before writing it back. The caller holds _mutex.
+ */
+void BufferManager::markClean(Frame &frame)
+{
+    if (!frame.dirty) {
+        return;
+    }
+    frame.dirty = false;
+    std::unordered_map<unsigned, std::set<PageNum> >::iterator it = _dirtyPages.find(frame.fileId);
+    it->second.erase(frame.pageNum);
+    if (it->second.empty()) {
+        _dirtyPages.erase(it);
+    }
+    _dirtyCount--;
+}
+
+/**
+ * Free a frame, forgetting its page even if it is dirty. The caller holds _mutex.
+ */
+void BufferManager::dropFrame(Frame &frame)
+{
+    markClean(frame);
+    _pageTable.erase(pageKey(frame.fileId, frame.pageNum));
+    frame.valid = false;
+    frame.pinCount = 0;
+    frame.pageLSN = 0;
+    frame.recLSN = 0;
+    frame.file.reset();
+    frame.metrics.reset();
+}
+
+/**
+ * Collect the unpinned dirty frames of a file in page order (pinned ones
+ * may be being changed). The caller holds _mutex.
+ *
+ * @param fileId
+ *          the id of the file
+ * @param frameNums
+ *          (return) the frames
+ */
+void BufferManager::collectDirty(unsigned fileId, std::vector<unsigned> &frameNums)
+{
+    std::unordered_map<unsigned, std::set<PageNum> >::iterator it = _dirtyPages.find(fileId);
+    if (it == _dirtyPages.end()) {
+        return;
+    }
+    for (std::set<PageNum>::iterator page = it->second.begin(); page != it->second.end(); page++) {
+        unsigned frameNum = _pageTable[pageKey(fileId, *page)];
+        if (_frames[frameNum].pinCount == 0) {
+            frameNums.push_back(frameNum);
+        }
+    }
+}
+
+/**
+ * Write back dirty frames of one file. The frames are marked clean and
+ * pinned first, so they are neither evicted nor written twice meanwhile.
+ * Pages are only changed while pinned, so pinned frames are skipped, and
+ * pinPage() waits for the write: a page does not change during it.
+ *
+ * Write-ahead: the log is flushed up to the pageLSN of the frames read
+ * here, which therefore covers every change being written.
+ *
+ * Writes through a stream are always flushed, so no data buffered by a
+ * stream can later overwrite the pages written here through the descriptor.
+ *
+ * @param dirtyFrames
+ *          dirty frames of the same file, sorted by page number
+ * @param lock
+ *          the lock held on _mutex, released during the writes (or NULL
+ *          to write with _mutex held)
+ * @return status
+ */
+RC BufferManager::writeFrames(const std::vector<unsigned> &dirtyFrames, std::unique_lock<std::mutex> *lock)
+{
+    std::vector<unsigned> frameNums;
+    for (size_t i = 0; i < dirtyFrames.size(); i++) {
+        if (_frames[dirtyFrames[i]].pinCount == 0) {
+            frameNums.push_back(dirtyFrames[i]);
+        }
+    }
+    if (frameNums.empty()) {
+        return SUCCESSFUL;
+    }
+
+    LSN pageLSN = 0;
+    for (size_t i = 0; i < frameNums.size(); i++) {
+        Frame &frame = _frames[frameNums[i]];
+        markClean(frame);
+        frame.writing = true;
+        frame.pinCount++;
+        pageLSN = std::max(pageLSN, frame.pageLSN);
+    }
+    if (lock) {
+        lock->unlock();
+    }
+
+    // The changes must be in the log first
+    RC logErr = pageLSN ? LogManager::instance()->flush(pageLSN) : SUCCESSFUL;
+    // The frames are those of one file
+    std::shared_ptr<FileState> file = _frames[frameNums[0]].file;
+    if (logErr == SUCCESSFUL) {
+        logErr = file ? DescriptorCache::instance()->acquire(*file, false) : ERR_NOT_EXIST;
+    }
+    RC err = logErr;
+    std::vector<RC> results(frameNums.size(), logErr);
+
+    // One write per run of consecutive pages
+    size_t runStart = 0;
+    for (size_t i = 0; i < frameNums.size() && logErr == SUCCESSFUL; i++) {
+        if (i + 1 < frameNums.size()
+                && _frames[frameNums[i + 1]].pageNum == _frames[frameNums[i]].pageNum + 1
+                && i + 1 - runStart < IOV_MAX) {
+            continue;
+        }
+
+        Frame &first = _frames[frameNums[runStart]];
+        int fd = file->fileDesc;
+        std::vector<struct iovec> iov;
+        for (size_t j = runStart; j <= i; j++) {
+            struct iovec vec;
+            vec.iov_base = _frames[frameNums[j]].data;
+            vec.iov_len = _frames[frameNums[j]].size;
+            iov.push_back(vec);
+        }
+        RC rc = transferFully(fd, iov, pageOffset(first.pageNum, first.size), 0, true, first.metrics.get());
+        if (rc != SUCCESSFUL) {
+            __trace();
+            err = rc;
+            for (size_t j = runStart; j <= i; j++) {
+                results[j] = rc;
+            }
+        }
+        runStart = i + 1;
+    }
+    if (logErr == SUCCESSFUL) {
+        DescriptorCache::instance()->release(*file, true);
+    }
+
+    if (lock) {
+        lock->lock();
+    }
+    for (size_t i = 0; i < frameNums.size(); i++) {
+        Frame &frame = _frames[frameNums[i]];
+        frame.writing = false;
+        frame.pinCount--;
+        if (results[i] != SUCCESSFUL) {
+            markDirty(frame);
+        } else if (!frame.dirty) {
+            frame.recLSN = 0;
+        }
+    }
+    _ioDone.notify_all();
+    return err;
+}
+
+/**
+ * Get the # of frames which may be dirty before the flusher starts.
+ */
+unsigned BufferManager::dirtyLimit()
+{
+    return _frames.size() * PagedFileManager::getDirtyRatio() / 100;
+}
+
+/**
+ * Background flusher: once more pages than the dirty ratio allows are
+ * dirty, write back unpinned pages until half of that is left; every
+ * FLUSH_INTERVAL_MS write back all unpinned dirty pages.
+ */
+void BufferManager::runFlusher()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    bool wait = true;
+    while (!_stopping) {
+        if (wait) {
+            _flushWanted.wait_for(lock, std::chrono::milliseconds(FLUSH_INTERVAL_MS));
+            if (_stopping) {
+                break;
+            }
+        }
+
+        unsigned target = _dirtyCount > dirtyLimit() ? dirtyLimit() / 2 : 0;
+        std::vector<unsigned> fileIds;
+        std::unordered_map<unsigned, std::set<PageNum> >::iterator it;
+        for (it = _dirtyPages.begin(); it != _dirtyPages.end(); it++) {
+            fileIds.push_back(it->first);
+        }
+
+        unsigned written = 0;
+        for (size_t i = 0; i < fileIds.size() && _dirtyCount > target; i++) {
+            std::vector<unsigned> frameNums;
+            collectDirty(fileIds[i], frameNums);
+            // Errors show up again when the pages are written on eviction or close
+            writeFrames(frameNums, &lock);
+            written += frameNums.size();
+        }
+
+        // Keep going without waiting while writers are ahead of the flusher
+        wait = written == 0 || _dirtyCount <= dirtyLimit();
+    }
+}
+
+DescriptorCache* DescriptorCache::_cache = 0;
+
+DescriptorCache* DescriptorCache::instance()
+{
+    static std::mutex creation;
+    std::lock_guard<std::mutex> guard(creation);
+    if (!_cache) {
+        _cache = new DescriptorCache();
+    }
+    return _cache;
+}
+
+DescriptorCache::DescriptorCache()
+    : _hitCounter(0), _missCounter(0), _evictionCounter(0)
+{
+}
+
+/**
+ * Pin the descriptor of an open file, reopening it if it was evicted.
+ * It stays open until release() is called.
+ *
+ * @param state
+ *          the file
+ * @param stream
+ *          whether the stream over the descriptor is needed as well
+ * @return status
+ */
+RC DescriptorCache::acquire(FileState &state, bool stream)
+{
+    std::lock_guard<std::mutex> guard(_mutex);
+    if (state.fileDesc >= 0) {
+        _hitCounter++;
+        _lru.splice(_lru.begin(), _lru, state.lruPos);
+    } else {
+        RC err;
+        if (state.openCount == 0 || state.unlinked) {
+            return ERR_NOT_EXIST;
+        }
+        _missCounter++;
+        if ((err = open(state)) != SUCCESSFUL) {
+            return err;
+        }
+    }
+
+    if (stream && !state.filePtr) {
+        state.filePtr = fdopen(state.fileDesc, "r+");
+        if (!state.filePtr) {
+            __trace();
+            return ERR_NOT_EXIST;
+        }
+    }
+    state.ioCount++;
+    return SUCCESSFUL;
+}
+
+/**
+ * Unpin the descriptor of a file. If more descriptors than the limit are
+ * open, idle ones are closed.
+ *
+ * @param state
+ *          the file
+ * @param written
+ *          whether the file was written through the descriptor
+ */
+void DescriptorCache::release(FileState &state, bool written)
+{
+    std::lock_guard<std::mutex> guard(_mutex);
+    state.ioCount--;
+    if (written) {
+        state.written = true;
+    }
+    unsigned limit = PagedFileManager::getDescriptorLimit();
+    if (_lru.size() > limit) {
+        evict(limit);
+    }
+}
+
+/**
+ * Close the descriptor of a file whose last handle is closed.
+ *
+ * @param state
+ *          the file
+ * @return status
+ */
+RC DescriptorCache::close(FileState &state)
+{
+    std::lock_guard<std::mutex> guard(_mutex);
+    if (state.fileDesc < 0) {
+        return SUCCESSFUL;
+    }
+    _lru.erase(state.lruPos);
+    return closeDescriptor(state) ? ERR_NOT_EXIST : SUCCESSFUL;
+}
+
+/**
+ * Keep the descriptor of an open file whose path is about to be removed
+ * or reused, since the file could not be reopened by name anymore.
+ *
+ * @param state
+ *          the file
+ */
+void DescriptorCache::detach(FileState &state)
+{
+    std::lock_guard<std::mutex> guard(_mutex);
+    if (state.fileDesc < 0 && state.openCount > 0 && !state.unlinked) {
+        open(state);
+    }
+    state.unlinked = true;
+}
+
+/**
+ * Make the writes of all files durable since they were last synced: the
+ * open descriptors written meanwhile are synced, and the files closed
+ * since their last write are reopened to be synced. Files which do not
+ * exist anymore need nothing.
+ *
+ * @return status
+ */
+RC DescriptorCache::sync()
+{
+    std::vector<FileState *> files;
+    std::set<std::string> closed;
+    {
+        std::lock_guard<std::mutex> guard(_mutex);
+        std::list<FileState *>::iterator it;
+        for (it = _lru.begin(); it != _lru.end(); it++) {
+            if ((*it)->written) {
+                // Writes after this point are synced the next time
+                (*it)->written = false;
+                (*it)->ioCount++;
+                files.push_back(*it);
+            }
+        }
+        closed.swap(_unsynced);
+    }
+
+    RC err = SUCCESSFUL;
+    for (size_t i = 0; i < files.size(); i++) {
+        bool failed = (files[i]->filePtr && fflush(files[i]->filePtr)) || fdatasync(files[i]->fileDesc);
+        if (failed) {
+            __trace();
+            err = ERR_WRITE;
+        }
+        release(*files[i], failed);
+    }
+    std::set<std::string>::iterator name;
+    for (name = closed.begin(); name != closed.end(); name++) {
+        int fd = ::open(name->c_str(), O_RDONLY);
+        if (fd < 0) {
+            continue;
+        }
+        if (fdatasync(fd)) {
+            __trace();
+            err = ERR_WRITE;
+        }
+        ::close(fd);
+    }
+    return err;
+}
+
+/**
+ * Collect statistics of the descriptor cache.
+ */
+void DescriptorCache::collectCounterValues(unsigned &hitCount, unsigned &missCount, unsigned &evictionCount)
+{
+    std::lock_guard<std::mutex> guard(_mutex);
+    hitCount = _hitCounter;
+    missCount = _missCounter;
+    evictionCount = _evictionCounter;
+}
+
+/**
+ * Open the descriptor of a file, closing the least recently used idle
+ * one first if the limit is reached. The caller holds _mutex.
+ */
+RC DescriptorCache::open(FileState &state)
+{
+    evict(PagedFileManager::getDescriptorLimit() - 1);
+
+    int fd;
+    while ((fd = ::open(state.fileName.c_str(), O_RDWR)) < 0 && errno == EINTR) {
+    }
+    if (fd < 0 && (errno == EMFILE || errno == ENFILE)) {
+        // Other parts of the process use descriptors too
+        evict(0);
+        fd = ::open(state.fileName.c_str(), O_RDWR);
+    }
+    if (fd < 0) {
+        return ERR_NOT_EXIST;
+    }
+
+    state.fileDesc = fd;
+    state.filePtr = NULL;
+    _lru.push_front(&state);
+    state.lruPos = _lru.begin();
+    return SUCCESSFUL;
+}
+
+/**
+ * Close idle descriptors, least recently used first, until at most limit
+ * descriptors are open (or all of them are in use). The caller holds _mutex.
+ */
+void DescriptorCache::evict(unsigned limit)
+{
+    std::list<FileState *>::iterator it = _lru.end();
+    while (_lru.size() > limit && it != _lru.begin()) {
+        --it;
+        FileState &state = **it;
+        if (state.ioCount > 0 || state.unlinked) {
+            continue;
+        }
+        // Closing the stream writes back what it buffers
+        closeDescriptor(state);
+        it = _lru.erase(it);
+        _evictionCounter++;
+    }
+}
+
+/**
+ * Close the stream of a file if it has one, or its descriptor. A file
+ * written since its last sync is synced by the next sync(), unless its
+ * path names another file now. The caller holds _mutex.
+ *
+ * @return 0, or -1 on error
+ */
+int DescriptorCache::closeDescriptor(FileState &state)
+{
+    if (state.written && !state.unlinked) {
+        _unsynced.insert(state.fileName);
+    }
+    state.written = false;
+    int rc = state.filePtr ? fclose(state.filePtr) : ::close(state.fileDesc);
+    state.filePtr = NULL;
+    state.fileDesc = -1;
+    return rc;
+}
+
+IOEngine* IOEngine::_engine = 0;
+bool IOEngine::_ioUringDisabled = false;
+
+IOEngine* IOEngine::instance()
+{
+    static std::mutex creation;
+    std::lock_guard<std::mutex> guard(creation);
+    if (!_engine) {
+        _engine = new IOEngine();
+    }
+    return _engine;
+}
+
+void IOEngine::disableIOUring()
+{
+    _ioUringDisabled = true;
+}
+
+IOEngine::IOEngine()
+    : _ringFd(-1), _inflight(0), _cqEntries(0),
+      _sqHead(NULL), _sqTail(NULL), _sqMask(NULL), _sqArray(NULL),
+      _cqHead(NULL), _cqTail(NULL), _cqMask(NULL), _sqes(NULL), _cqes(NULL)
+{
+    // io_uring may be missing from the kernel or blocked by a sandbox
+    if (!_ioUringDisabled && setupRing()) {
+        std::thread(&IOEngine::reapRing, this).detach();
+    } else {
+        for (unsigned i = 0; i < IO_WORKER_THREADS; i++) {
+            std::thread(&IOEngine::runWorker, this).detach();
+        }
+    }
+}
+
+IOEngine::~IOEngine()
+{
+    // The engine lives until the process exits, together with its threads
+    if (_ringFd >= 0) {
+        close(_ringFd);
+    }
+}
+
+bool IOEngine::usesIOUring()
+{
+    return _ringFd >= 0;
+}
+
+/**
+ * Create an io_uring instance and map its rings.
+ *
+ * @return whether io_uring can be used
+ */
+bool IOEngine::setupRing()
+{
+#ifndef PFM_IO_URING
+    return false;
+#else
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int fd = syscall(__NR_io_uring_setup, IO_QUEUE_DEPTH, &params);
+    if (fd < 0) {
+        return false;
+    }
+
+    size_t sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cqSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool singleMap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMap) {
+        sqSize = cqSize = std::max(sqSize, cqSize);
+    }
+
+    void *sq = mmap(NULL, sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+            fd, IORING_OFF_SQ_RING);
+    void *cq = singleMap ? sq : mmap(NULL, cqSize, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    void *sqes = mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe),
+            PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (sq == MAP_FAILED || cq == MAP_FAILED || sqes == MAP_FAILED) {
+        // The mappings go away with the descriptor
+        close(fd);
+        return false;
+    }
+
+    _sqHead = (unsigned *) ((char *) sq + params.sq_off.head);
+    _sqTail = (unsigned *) ((char *) sq + params.sq_off.tail);
+    _sqMask = (unsigned *) ((char *) sq + params.sq_off.ring_mask);
+    _sqArray = (unsigned *) ((char *) sq + params.sq_off.array);
+    _cqHead = (unsigned *) ((char *) cq + params.cq_off.head);
+    _cqTail = (unsigned *) ((char *) cq + params.cq_off.tail);
+    _cqMask = (unsigned *) ((char *) cq + params.cq_off.ring_mask);
+    _cqes = (struct io_uring_cqe *) ((char *) cq + params.cq_off.cqes);
+    _sqes = (struct io_uring_sqe *) sqes;
+
+    // Submission queue entry i always sits in slot i
+    for (unsigned i = 0; i < params.sq_entries; i++) {
+        _sqArray[i] = i;
+    }
+    _cqEntries = params.cq_entries;
+    _ringFd = fd;
+    return true;
+#endif
+}
+
+/**
+ * Queue a batch of reads. Each request calls its done() callback from
+ * an engine thread once its buffers are filled (or the read failed).
+ *
+ * @param requests
+ *          the reads
+ * @return status
+ */
+RC IOEngine::submit(std::vector<IORequest> &requests)
+{
+    std::vector<IORequest *> failed;
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (_ringFd < 0) {
+            for (size_t i = 0; i < requests.size(); i++) {
+                _queue.push_back(new IORequest(requests[i]));
+            }
+            _cond.notify_all();
+            return SUCCESSFUL;
+        }
+
+#ifdef PFM_IO_URING
+        unsigned pending = 0;
+        for (size_t i = 0; i < requests.size(); i++) {
+            // Never have more reads in flight than completion entries
+            while (_inflight >= _cqEntries || pending == *_sqMask + 1) {
+                if (pending > 0) {
+                    enterRing(pending, failed);
+                    pending = 0;
+                } else {
+                    _cond.wait(lock);
+                }
+            }
+
+            IORequest *request = new IORequest(requests[i]);
+            unsigned tail = *_sqTail;
+            struct io_uring_sqe *sqe = &_sqes[tail & *_sqMask];
+            memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = IORING_OP_READV;
+            sqe->fd = request->fd;
+            sqe->off = request->offset;
+            sqe->addr = (unsigned long) request->iov.data();
+            sqe->len = request->iov.size();
+            sqe->user_data = (unsigned long) request;
+            __atomic_store_n(_sqTail, tail + 1, __ATOMIC_RELEASE);
+            _inflight++;
+            pending++;
+        }
+        if (pending > 0) {
+            enterRing(pending, failed);
+        }
+#endif
+    }
+
+    // Entries the kernel refused are read here instead
+    for (size_t i = 0; i < failed.size(); i++) {
+        complete(*failed[i], -1);
+        delete failed[i];
+    }
+    return SUCCESSFUL;
+}
+
+/**
+ * Hand the queued submission entries to the kernel. Entries it cannot
+ * take are removed from the queue and returned in failed. The caller
+ * holds _mutex.
+ */
+void IOEngine::enterRing(unsigned toSubmit, std::vector<IORequest *> &failed)
+{
+#ifdef PFM_IO_URING
+    while (toSubmit > 0) {
+        int n = syscall(__NR_io_uring_enter, _ringFd, toSubmit, 0, 0, NULL, 0);
+        if (n > 0) {
+            toSubmit -= n;
+            continue;
+        }
+        if (n < 0 && (errno == EINTR || errno == EAGAIN || errno == EBUSY)) {
+            continue;
+        }
+
+        // Take back the entries the kernel has not consumed
+        unsigned tail = *_sqTail;
+        for (unsigned i = tail - toSubmit; i != tail; i++) {
+            failed.push_back((IORequest *) _sqes[i & *_sqMask].user_data);
+        }
+        __atomic_store_n(_sqTail, tail - toSubmit, __ATOMIC_RELEASE);
+        _inflight -= toSubmit;
+        return;
+    }
+#endif
+}
+
+/**
+ * Completion thread of io_uring: wait for completion entries and call
+ * back their requests.
+ */
+void IOEngine::reapRing()
+{
+#ifdef PFM_IO_URING
+    while (true) {
+        unsigned head = *_cqHead;
+        if (head == __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE)) {
+            syscall(__NR_io_uring_enter, _ringFd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+            continue;
+        }
+
+        struct io_uring_cqe cqe = _cqes[head & *_cqMask];
+        __atomic_store_n(_cqHead, head + 1, __ATOMIC_RELEASE);
+
+        IORequest *request = (IORequest *) cqe.user_data;
+        complete(*request, cqe.res);
+        delete request;
+
+        std::lock_guard<std::mutex> guard(_mutex);
+        _inflight--;
+        _cond.notify_all();
+    }
+#endif
+}
+
+/**
+ * Worker thread used without io_uring: perform queued reads one by one.
+ */
+void IOEngine::runWorker()
+{
+    while (true) {
+        IORequest *request;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            while (_queue.empty()) {
+                _cond.wait(lock);
+            }
+            request = _queue.front();
+            _queue.pop_front();
+        }
+        complete(*request, 0);
+        delete request;
+    }
+}
+
+/**
+ * Finish a read and call back its request.
+ *
+ * @param request
+ *          the read
+ * @param result
+ *          the # of bytes already read, or negative if the read failed
+ *          (it is then retried synchronously)
+ */
+void IOEngine::complete(IORequest &request, long result)
+{
+    // The engine moved the first result bytes with one call
+    if (result > 0) {
+        recordTransfer(request.metrics.get(), request.offset, result, 1, false);
+    }
+    RC rc = transferFully(request.fd, request.iov, request.offset, result < 0 ? 0 : result, false,
+                          request.metrics.get());
+    request.done(rc);
+}
@@ -3,12 +3,39 @@
 
 #include <cstdio>
 #include <string>
-//#include <unordered_map>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <thread>
+#include <deque>
+#include <list>
+#include <unordered_map>
+#include <set>
+#include <sys/uio.h>
 
 typedef int RC;
 typedef unsigned PageNum;
+typedef unsigned long long LSN;     // log sequence number (0: not logged)
 
-#define PAGE_SIZE 4096   // 4096
+#define PAGE_SIZE 4096   // default page size of new files
+#define MAX_PAGE_SIZE 65536 // page sizes are powers of 2 from PAGE_SIZE up to this
+
+#define DEFAULT_BUFFER_FRAMES 1024  // # of frames in the buffer pool (4 MB)
+#define DEFAULT_READ_AHEAD    32    // # of pages sequential scans read at once
+#define DEFAULT_DIRTY_RATIO   25    // % of the pool that may be dirty before the flusher starts
+#define DEFAULT_EXTENT_SIZE   (1 << 20) // bytes reserved on the disk at once when a file grows
+#define DEFAULT_OPEN_FILES    256   // # of descriptors kept open; idle files beyond it are reopened on demand
+#define FLUSH_INTERVAL_MS     1000  // the flusher writes back all dirty pages at least this often
+#define IO_WORKER_THREADS     4     // # of threads of the async I/O engine (without io_uring)
+#define IO_QUEUE_DEPTH        64    // # of submission queue entries of io_uring
+#define LATENCY_BUCKETS       40    // bucket i of a latency histogram counts [2^i, 2^(i+1)) ns
+
+#define PF_FILE_MAGIC   0x3146505a  // "ZPF1" on disk
+#define PF_FILE_VERSION 2
+#define NULL_PAGE       ((PageNum) -1)
 
 #define DEBUG 0
 #if DEBUG
@@ -18,54 +45,432 @@ typedef unsigned PageNum;
 #endif
 
 class FileHandle;
+class BufferManager;
+
+// Content of the header page, i.e. the first page of every paged file. The
+// header page is invisible to FileHandle users: page #0 of a handle is the
+// second page on disk.
+struct FileHeader {
+    unsigned magic;             // PF_FILE_MAGIC
+    unsigned version;           // format version of the file
+    unsigned pageCount;         // # of data pages
+    PageNum freeSpaceRoot;      // first page of the free space map (NULL_PAGE if none)
+    unsigned pageSize;          // size of every page of the file, header page included
+};
+
+// State shared by all handles opened on the same file (and their copies).
+// The file is opened once; handles are views of the shared descriptor, and
+// the last handle closed closes it. The descriptor is managed by the
+// DescriptorCache: it may be closed while the file is idle, and is then
+// reopened by the next I/O.
+struct FileState {
+    FileHeader header;                  // in-memory copy of the header page
+    std::atomic<unsigned> pageCount;    // same as header.pageCount, readable without the latch
+    long allocatedSize;                 // physical size of the file; pages past pageCount are reserved
+    bool headerDirty;                   // pages were appended since the header page was written
+    std::mutex latch;                   // serializes appends and header updates
+    std::string fileName;               // path the descriptor is reopened from
+    std::atomic<unsigned> openCount;    // # of handles opened (not copied) on the file, changed under
+                                        // the mutex of the PagedFileManager
+
+    // Guarded by the descriptor cache
+    int fileDesc;                       // descriptor shared by all handles (-1 while closed)
+    FILE *filePtr;                      // stream over fileDesc shared by IO_STDIO handles (or NULL)
+    unsigned ioCount;                   // # of I/Os using the descriptor, which cannot be evicted meanwhile
+    bool unlinked;                      // the path names another file now; the descriptor is never evicted
+    bool written;                       // written through the descriptor since its last sync
+    std::list<FileState *>::iterator lruPos;    // position in the LRU list while the descriptor is open
+};
+
+// Bounded cache of the descriptors of open files. Every I/O pins the
+// descriptor of its file, reopening it if it was evicted. When more than
+// the limit of descriptors are open, the least recently used ones which
+// are not pinned are closed; the limit is exceeded only while all of them
+// are in use.
+//
+// The cache also remembers the files written since they were last synced,
+// so that sync() makes the writes of the data files durable without
+// syncing the whole file system.
+class DescriptorCache
+{
+public:
+    static DescriptorCache *instance();                   // Access to the _cache instance
+
+    RC acquire(FileState &state, bool stream);            // Pin the descriptor (and stream) of a file
+    void release(FileState &state, bool written = false); // Unpin the descriptor of a file (after writing it)
+    RC close(FileState &state);                           // Close the descriptor with the last handle
+    void detach(FileState &state);                        // Keep the descriptor of a file whose path is reused
+    RC sync();                                            // fdatasync the files written since the last sync
+    void collectCounterValues(unsigned &hitCount, unsigned &missCount, unsigned &evictionCount);
+
+protected:
+    DescriptorCache();                                    // Constructor
+
+private:
+    RC open(FileState &state);                            // Open the descriptor of a file (a miss)
+    void evict(unsigned limit);                           // Close idle descriptors beyond the limit
+    int closeDescriptor(FileState &state);                // Close the stream or the descriptor
+
+    static DescriptorCache *_cache;
+
+    std::mutex _mutex;
+    std::list<FileState *> _lru;                          // files with an open descriptor, most recent first
+    std::set<std::string> _unsynced;                      // files written, then closed before a sync
+    unsigned _hitCounter;
+    unsigned _missCounter;
+    unsigned _evictionCounter;
+};
+
+// Backends of the page I/O of a FileHandle, chosen in openFile()
+typedef enum {
+    IO_STDIO = 0,       // stdio stream: seek then read / write (single-threaded)
+    IO_PREAD,           // raw file descriptor with positional pread / pwrite
+    IO_MMAP,            // read-only memory mapping; pages are handed out in place
+} IOMode;
+
+// Operations whose latency is measured
+typedef enum {
+    IO_OP_READ = 0,     // readPage, readPages, pinPage
+    IO_OP_WRITE,        // writePage
+    IO_OP_APPEND,       // appendPage
+    IO_OP_COUNT,
+} IOOp;
+
+// Snapshot of I/O metrics. Bytes, system calls and seeks are those of the
+// disk; latencies are those of FileHandle operations, buffer pool included.
+struct IOStats {
+    unsigned long long bytesRead;                       // bytes read from the disk
+    unsigned long long bytesWritten;                    // bytes written to the disk
+    unsigned long long syscallCount;                    // # of read, write and seek system calls
+    unsigned long long seekCount;                       // # of transfers not starting where the previous one ended
+    unsigned long long opCount[IO_OP_COUNT];            // # of operations of each kind
+    unsigned long long totalLatency[IO_OP_COUNT];       // sum of their latencies in ns
+    unsigned long long latency[IO_OP_COUNT][LATENCY_BUCKETS];   // log2-bucketed latency histograms
+};
+
+// I/O metrics updated concurrently by the threads using a file, the
+// flusher and the async I/O engine
+class IOMetrics
+{
+public:
+    IOMetrics();                                                            // Constructor
+
+    void recordTransfer(long offset, size_t bytes, unsigned syscalls, bool write); // Account a disk transfer
+    void recordLatency(IOOp op, unsigned long long ns);                     // Account an operation
+    void snapshot(IOStats &stats);                                          // Copy the current values
+    void reset();                                                           // Start over from zero
+
+private:
+    std::atomic<unsigned long long> _bytesRead;
+    std::atomic<unsigned long long> _bytesWritten;
+    std::atomic<unsigned long long> _syscallCount;
+    std::atomic<unsigned long long> _seekCount;
+    std::atomic<long> _lastEnd;                                             // end of the previous transfer
+    std::atomic<unsigned long long> _opCount[IO_OP_COUNT];
+    std::atomic<unsigned long long> _totalLatency[IO_OP_COUNT];
+    std::atomic<unsigned long long> _latency[IO_OP_COUNT][LATENCY_BUCKETS];
+};
+
+// Read-only mapping of a file opened in IO_MMAP mode (shared by copies of the
+// handle). When the file grows, a larger mapping replaces the current one; the
+// old one is kept until the file is closed since its pages may still be in use.
+struct FileMapping {
+    FileMapping();
+    ~FileMapping();
+
+    std::mutex latch;
+    char *addr;                                         // current mapping (header page included)
+    unsigned mappedPages;                               // # of data pages covered by addr
+    unsigned pageSize;                                  // page size of the file
+    std::vector<std::pair<char *, size_t> > retired;    // outgrown mappings
+};
 
 
 class PagedFileManager
 {
 public:
     static PagedFileManager* instance();                     // Access to the _pf_manager instance
+    static RC setBufferFrames(unsigned frameCount);          // Set the buffer pool size (before the first instance() call)
+    static void setReadAheadWindow(unsigned pageCount);      // Set the read-ahead window of sequential scans
+    static unsigned getReadAheadWindow();                    // Get the read-ahead window of sequential scans
+    static void setDirtyRatio(unsigned percent);             // Set the dirty ratio of the buffer pool
+    static unsigned getDirtyRatio();                         // Get the dirty ratio of the buffer pool
+    static void setExtentSize(unsigned size);                // Set the # of bytes files grow by on the disk
+    static unsigned getExtentSize();                         // Get the # of bytes files grow by on the disk
+    static void setDescriptorLimit(unsigned count);          // Set the # of descriptors kept open
+    static unsigned getDescriptorLimit();                    // Get the # of descriptors kept open
 
-    RC createFile    (const char *fileName);                         // Create a new file
+    RC createFile    (const char *fileName,                         // Create a new file
+                      unsigned pageSize = PAGE_SIZE);
     RC destroyFile   (const char *fileName);                         // Destroy a file
-    RC openFile      (const char *fileName, FileHandle &fileHandle); // Open a file
+    RC openFile      (const char *fileName, FileHandle &fileHandle, // Open a file
+                      IOMode ioMode = IO_STDIO);
     RC closeFile     (FileHandle &fileHandle);                       // Close a file
 
+    BufferManager *getBufferManager();                               // Get the shared buffer pool
+    RC flushAllPages();                                              // Write back all dirty pages in the buffer pool
+    RC flushHeaders();                                               // Write back the headers changed by appends
+
+    // Put the buffer pool counter values into variables
+    RC collectCounterValues(unsigned &hitCount, unsigned &missCount, unsigned &evictionCount);
+    // Put the descriptor cache counter values into variables
+    RC collectDescriptorCounterValues(unsigned &hitCount, unsigned &missCount, unsigned &evictionCount);
+    RC collectIOStats(IOStats &stats);                               // Get the I/O metrics of all files
+    void resetIOStats();                                             // Reset the I/O metrics of all files
+
 protected:
     PagedFileManager();                                   // Constructor
     ~PagedFileManager();                                  // Destructor
 
 private:
+    // Book-keeping of a file which has been opened at least once
+    struct FileEntry {
+        FileEntry() : fileId(0) {}
+        unsigned fileId;        // id used to key pages in the buffer pool
+        std::shared_ptr<FileState> state;       // descriptor, header and latch shared by all handles
+    };
+
     static PagedFileManager *_pf_manager;
+    static unsigned _bufferFrames;
+    static unsigned _readAheadWindow;
+    static unsigned _dirtyRatio;
+    static unsigned _extentSize;
+    static unsigned _descriptorLimit;
+
+    BufferManager *_bufferManager;
+    std::mutex _mutex;                                          // guards the entries and the open counts
+    std::unordered_map<std::string, FileEntry> _fileEntries;   // <file name, entry>
+    unsigned _nextFileId;
 };
 
 class FileHandle
 {
 public:
     FileHandle();                                                    // Default constructor
+    FileHandle(const FileHandle &that);                              // Copy constructor
     ~FileHandle();                                                   // Destructor
+    FileHandle &operator=(const FileHandle &that);                   // Copy assignment
 
     RC readPage(PageNum pageNum, void *data);                           // Get a specific page
     RC writePage(PageNum pageNum, const void *data);                    // Write a specific page
     RC appendPage(const void *data);                                    // Append a specific page
+    RC appendPage(const void *data, PageNum &pageNum);                  // Same, and get the page # given to it
+    // Append count pages held back to back in data, starting at page startPage
+    RC appendPages(unsigned count, const void *data, PageNum &startPage);
+    RC readPages(PageNum startPage, unsigned count, void *buffers[]);   // Get consecutive pages
+
+    // Start loading pages into the buffer pool in the background. Pinning
+    // or reading such a page waits for its read to complete.
+    RC prefetchPages(PageNum startPage, unsigned count);
+    RC prefetchPages(const std::vector<PageNum> &pageNums);
+    RC waitForPages(const std::vector<PageNum> &pageNums);              // Wait for prefetched pages
+    // Keep a window of pages ahead of a sequential reader at pageNum in flight
+    RC readAhead(PageNum pageNum, PageNum &readAheadEnd);
     unsigned getNumberOfPages();                                        // Get the number of pages in the file
+    unsigned getPageSize();                                             // Get the page size of the file
     void setNumberOfPages(unsigned pages);                              // Set the number of pages in the file
-    FILE *getFilePointer();                                             // Get the file pointer associated with the file
-    void setFilePointer(FILE *ptr);                                     // Set the file pointer associated with the file
+    FILE *getFilePointer();                                             // Get the file pointer (NULL unless in IO_STDIO mode or open)
+    int getFileDescriptor();                                            // Get the descriptor (-1 in IO_STDIO mode or if not open)
+    IOMode getIOMode();                                                 // Get the I/O backend of the handle
+    void setIOMode(IOMode mode);                                        // Set the I/O backend of the handle
+    bool isOpen();                                                      // Whether the handle is attached to a file
+    bool isRemoved();                                                   // Whether the file has been destroyed meanwhile
     char *getFileName();                                                // Get the file name
     void setFileName(const char *name);                                 // Set the file name
 
+    unsigned getFileId();                                               // Get the id of the file in the buffer pool
+    void setFileId(unsigned id);                                        // Set the id of the file in the buffer pool
+    void setFileState(const std::shared_ptr<FileState> &st);            // Attach the state shared by the file's handles
+    PageNum getFreeSpaceRoot();                                         // Get the root page of the free space map
+    RC setFreeSpaceRoot(PageNum pageNum);                               // Set (and persist) the free space map root
+
+    // Give the disk space of pages which hold nothing back. Neither change
+    // is logged, so they are meant for pages emptied outside of transactions.
+    RC punchPages(PageNum startPage, unsigned count);                   // Release a run of pages; they read as zeros
+    RC truncatePages(unsigned pageCount);                               // Drop the pages from pageCount on
+
+    // Pin a page in the buffer pool and get its frame. Changes made through
+    // the frame must be reported by unpinPage(pageNum, true).
+    RC pinPage(PageNum pageNum, void *&data);
+    RC unpinPage(PageNum pageNum, bool dirty);                          // Release a pinned page
+
     // New method - put the current counter values into variables
     RC collectCounterValues(unsigned &readPageCount, unsigned &writePageCount, unsigned &appendPageCount);
+    // Same as above, plus buffer pool hits / misses / evictions caused by this handle
+    RC collectCounterValues(unsigned &readPageCount, unsigned &writePageCount, unsigned &appendPageCount,
+                            unsigned &hitCount, unsigned &missCount, unsigned &evictionCount);
+    // I/O metrics of the handle (and its copies); write-backs are charged
+    // to the handle which last changed the page
+    RC collectIOStats(IOStats &stats);
+    void resetIOStats();
 
 private:
-    FILE *filePtr;                                            // Associated file pointer
-//    unsigned pageCount;                                       // Number of pages in the file
+    friend class BufferManager;
+    friend class PagedFileManager;
+
+    RC readPhysicalPage(PageNum pageNum, void *data);                   // Read a page from the disk
+    RC writePhysicalPage(PageNum pageNum, const void *data);            // Write a page to the disk
+    RC writeHeader();                                                   // Persist the file header
+    RC reserveSpace(PageNum pageNum);                                   // Preallocate the extent of a new page
+    RC trimSpace();                                                     // Release the space past the last page
+    RC mapPage(PageNum pageNum, char *&page);                           // Locate a page in the mapping (IO_MMAP)
+
+    IOMode ioMode;                                            // I/O backend
+    std::shared_ptr<FileState> state;                         // Descriptor and header (shared by all handles)
+    std::shared_ptr<FileMapping> mapping;                     // Mapping of the file (IO_MMAP)
+    std::shared_ptr<IOMetrics> metrics;                       // I/O metrics (shared by copies of the handle)
     std::string fileName;                                           // File name
+    unsigned fileId;                                          // Id of the file in the buffer pool
+
+    // variables to keep counter for each operation (atomic since threads may share a handle)
+    std::atomic<unsigned> readPageCounter;
+    std::atomic<unsigned> writePageCounter;
+    std::atomic<unsigned> appendPageCounter;
+    std::atomic<unsigned> hitCounter;
+    std::atomic<unsigned> missCounter;
+    std::atomic<unsigned> evictionCounter;
+};
+
+// Buffer pool shared by all open files. Pages live in a fixed number of frames
+// and are located through a page table keyed by (file id, page #). A frame
+// can be reused only when nobody pins it; victims are picked with the clock
+// algorithm and written back first if they are dirty. The pool is thread-safe;
+// disk reads on a miss happen outside of its mutex.
+//
+// Writes are cached: dirty pages are tracked per file, and a background
+// flusher writes them back in page order, merging neighbours into one
+// vectored write, whenever more than the dirty ratio of the pool is dirty
+// (and every FLUSH_INTERVAL_MS anyway).
+class BufferManager
+{
+public:
+    BufferManager(unsigned frameCount);                               // Constructor
+    ~BufferManager();                                                 // Destructor
+
+    // Pin a page of the file. If load is false the page is about to be fully
+    // overwritten, so its old content is not read on a miss. A frame claimed
+    // in advance is used on a miss (and given back on a hit).
+    RC pinPage(FileHandle &fileHandle, PageNum pageNum, void *&data, bool load = true, int claimed = -1);
+    // Claim a free frame ahead of pinPage(), evicting a page if necessary,
+    // so that the eviction does not happen while the caller holds a latch
+    RC claimFrame(FileHandle &fileHandle, unsigned &frameNum);
+    void releaseFrame(unsigned frameNum);                             // Give back an unused claimed frame
+    // Unpin a page. lsn is the end of the log record of a logged change.
+    RC unpinPage(FileHandle &fileHandle, PageNum pageNum, bool dirty, LSN lsn = 0);
+    // Load the absent pages into the pool in the background, reading each run
+    // of consecutive pages with one vectored read of the async I/O engine
+    RC prefetchPages(FileHandle &fileHandle, const std::vector<PageNum> &pageNums);
+    RC waitForPages(FileHandle &fileHandle, const std::vector<PageNum> &pageNums);
+    RC flushFile(unsigned fileId);                                    // Write back unpinned dirty pages of a file
+    RC flushAll();                                                    // Write back all unpinned dirty pages
+    void discardFile(unsigned fileId);                                // Drop all pages of a file
+    RC discardPages(unsigned fileId, PageNum startPage, unsigned count); // Drop a run of pages (none may be pinned)
+
+    unsigned getFrameCount();
+    LSN getMinRecLSN();                                               // Oldest logged change not on the disk
+    void collectCounterValues(unsigned &hitCount, unsigned &missCount, unsigned &evictionCount);
+
+private:
+    struct Frame {
+        unsigned fileId;
+        unsigned size;          // size of the page the frame can hold
+        PageNum pageNum;
+        unsigned pinCount;
+        bool valid;             // whether the frame holds a page
+        bool dirty;             // whether the page differs from the one on disk
+        bool referenced;        // second chance bit of the clock algorithm
+        bool loading;           // the page is being read from the disk
+        bool writing;           // the page is being written back (new pins wait for it)
+        LSN pageLSN;            // the log must be durable up to here before a write-back
+        LSN recLSN;             // first logged change since the page was last written back
+        std::shared_ptr<FileState> file;        // file the page is written back to
+        std::shared_ptr<IOMetrics> metrics;     // metrics the write-back is charged to
+        char *data;
+    };
+
+    static unsigned long long pageKey(unsigned fileId, PageNum pageNum);
+    // Find and claim a free frame (may evict a page, releasing the lock)
+    RC findVictim(unsigned &frameNum, FileHandle &fileHandle, std::unique_lock<std::mutex> &lock);
+    void resizeFrame(Frame &frame, unsigned pageSize);                // Make a free frame hold pages of a size
+    void markDirty(Frame &frame);                                     // Track a changed page
+    void markClean(Frame &frame);                                     // Stop tracking a page
+    void dropFrame(Frame &frame);                                     // Free a frame without writing it back
+    // Write back unpinned dirty frames of one file, sorted by page number,
+    // with one vectored write per run of consecutive pages. If lock is given
+    // it is released during the writes.
+    RC writeFrames(const std::vector<unsigned> &dirtyFrames, std::unique_lock<std::mutex> *lock);
+    void collectDirty(unsigned fileId, std::vector<unsigned> &frameNums);
+    unsigned dirtyLimit();                                            // # of dirty frames allowed
+    void runFlusher();                                                // Background flusher thread
+    void finishLoad(const std::vector<unsigned> &frameNums, RC result); // Complete background reads
+    void waitForFile(std::unique_lock<std::mutex> &lock, unsigned fileId); // Wait for I/O of a file
+
+    std::vector<Frame> _frames;
+    std::unordered_map<unsigned long long, unsigned> _pageTable;     // <(file id, page #), frame #>
+    unsigned _clockHand;
+    std::mutex _mutex;                                                // guards all of the above
+    std::condition_variable _ioDone;                                  // signaled when a page read or write completes
+    std::unordered_map<unsigned, std::set<PageNum> > _dirtyPages;     // <file id, dirty pages>
+    unsigned _dirtyCount;                                             // # of dirty frames
+    std::thread _flusher;
+    std::condition_variable _flushWanted;                             // wakes up the flusher
+    bool _stopping;
+
+    unsigned _hitCounter;
+    unsigned _missCounter;
+    unsigned _evictionCounter;
+};
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+// A vectored read handled by the async I/O engine
+struct IORequest {
+    int fd;
+    long offset;
+    std::vector<struct iovec> iov;
+    std::shared_ptr<IOMetrics> metrics; // charged with the read (may be empty)
+    std::function<void(RC)> done;       // called on completion, on a thread of the engine
+};
+
+// Asynchronous I/O engine. Batches of reads go to io_uring when the kernel
+// allows it, and to a pool of worker threads doing preadv otherwise. The
+// engine lives until the process exits.
+class IOEngine
+{
+public:
+    static IOEngine *instance();                          // Access to the _engine instance
+    static void disableIOUring();                         // Use worker threads (before the first instance() call)
+
+    RC submit(std::vector<IORequest> &requests);          // Queue a batch of reads
+    bool usesIOUring();                                   // Whether io_uring is in use
+
+protected:
+    IOEngine();                                           // Constructor
+    ~IOEngine();                                          // Destructor
+
+private:
+    bool setupRing();                                     // Try to set up io_uring
+    void enterRing(unsigned toSubmit, std::vector<IORequest *> &failed); // Hand queued entries to the kernel
+    void reapRing();                                      // Completion thread of io_uring
+    void runWorker();                                     // Worker thread
+    static void complete(IORequest &request, long result); // Finish short reads and call back
+
+    static IOEngine *_engine;
+    static bool _ioUringDisabled;
+
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    std::deque<IORequest *> _queue;                       // requests waiting for a worker
 
-    // variables to keep counter for each operation
-    unsigned readPageCounter;
-    unsigned writePageCounter;
-    unsigned appendPageCounter;
+    // io_uring
+    int _ringFd;
+    unsigned _inflight;                                   // # of requests not reaped yet
+    unsigned _cqEntries;
+    unsigned *_sqHead, *_sqTail, *_sqMask, *_sqArray;
+    unsigned *_cqHead, *_cqTail, *_cqMask;
+    struct io_uring_sqe *_sqes;
+    struct io_uring_cqe *_cqes;
 };
 
 // Enum: status code
@@ -77,7 +482,17 @@ enum {
     ERR_WRITE     = -4,         // error: cannot write data into the file
     ERR_READ      = -5,         // error: cannot read data from the file
     ERR_NULLPTR   = -6,         // error: null pointer error
-    ERR_ALIGN     = -7,         // error: file size is not a multiple of PAGE_SIZE
+    ERR_ALIGN     = -7,         // error: file size is not a multiple of the page size
+    ERR_NO_FRAME  = -8,         // error: all frames in the buffer pool are pinned
+    ERR_NOT_PINNED = -9,        // error: the page is not pinned in the buffer pool
+    ERR_HEADER    = -10,        // error: the file header is missing or of another version
+    ERR_READ_ONLY = -11,        // error: the file is opened read-only
+    ERR_LOG       = -12,        // error: the write-ahead log cannot be read or written
+    ERR_PAGE_SIZE = -13,        // error: unsupported page size
+    ERR_PINNED    = -14,        // error: the page is pinned in the buffer pool
+    ERR_ABORTED   = -15,        // error: the transaction has been rolled back
+    ERR_LOCKED    = -16,        // error: the page belongs to another running transaction
+    ERR_DEADLOCK  = -17,        // error: waiting for the lock of a page would never end
 };
 
 #endif
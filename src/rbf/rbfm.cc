@@ -7,13 +7,20 @@
 #include <utility>
 #include <vector>
 #include <algorithm>
+#include <functional>
+#include <deque>
+#include <climits>
 //#include <unordered_map>
 //#include <unordered_set>
 
 #include "rbfm.h"
+#include "simd.h"
+#include "wal.h"
 
 RecordBasedFileManager* RecordBasedFileManager::_rbf_manager = 0;
 
+unsigned RecordBasedFileManager::_scanThreads = 0;
+
 PagedFileManager *RecordBasedFileManager::_pfm_manager;
 
 RecordBasedFileManager* RecordBasedFileManager::instance()
@@ -26,22 +33,55 @@ RecordBasedFileManager* RecordBasedFileManager::instance()
 
 RecordBasedFileManager::RecordBasedFileManager()
 {
+    // Threads share the managers created with the first instance
     _pfm_manager = PagedFileManager::instance();
+    SpaceManager::instance();
 }
 
 RecordBasedFileManager::~RecordBasedFileManager()
 {
 }
 
+/**
+ * Set the # of threads reading pages for parallel scans. The threads are
+ * started by the first parallel scan, so this must be called before it.
+ *
+ * @param count
+ *          # of threads, 0 for the # of cores
+ */
+void RecordBasedFileManager::setScanThreads(unsigned count) {
+    _scanThreads = count;
+}
+
+/**
+ * Get the # of threads reading pages for parallel scans.
+ *
+ * @return # of threads
+ */
+unsigned RecordBasedFileManager::getScanThreads() {
+    if (_scanThreads > 0) {
+        return _scanThreads;
+    }
+    return max(thread::hardware_concurrency(), 1U);
+}
+
 /**
  * Create a file.
  *
  * @param fileName
  *          the name of the file to be created.
+ * @param pageSize
+ *          the page size of the file (larger pages hold larger records).
  * @return status
  */
-RC RecordBasedFileManager::createFile(const string &fileName) {
-    return _pfm_manager->createFile(fileName.c_str());
+RC RecordBasedFileManager::createFile(const string &fileName, unsigned pageSize) {
+    RC err;
+    if ((err = _pfm_manager->createFile(fileName.c_str(), pageSize)) != SUCCESSFUL) {
+        return err;
+    }
+    // A free space map left behind by a file of the same name is stale
+    _pfm_manager->destroyFile(SpaceManager::getFreeSpaceFileName(fileName).c_str());
+    return SUCCESSFUL;
 }
 
 /**
@@ -52,7 +92,13 @@ RC RecordBasedFileManager::createFile(const string &fileName) {
  * @return status
  */
 RC RecordBasedFileManager::destroyFile(const string &fileName) {
-    return _pfm_manager->destroyFile(fileName.c_str());
+    RC err;
+    if ((err = _pfm_manager->destroyFile(fileName.c_str())) != SUCCESSFUL) {
+        return err;
+    }
+    // The free space map is only saved once the file has been closed
+    _pfm_manager->destroyFile(SpaceManager::getFreeSpaceFileName(fileName).c_str());
+    return SUCCESSFUL;
 }
 
 /**
@@ -62,17 +108,19 @@ RC RecordBasedFileManager::destroyFile(const string &fileName) {
  *          the name of the file to be opened.
  * @param fileHandle
  *          the file handle associated with this file.
+ * @param ioMode
+ *          the I/O backend of the handle (IO_PREAD to share it among threads).
  * @return status
  */
-RC RecordBasedFileManager::openFile(const string &fileName, FileHandle &fileHandle) {
+RC RecordBasedFileManager::openFile(const string &fileName, FileHandle &fileHandle, IOMode ioMode) {
     RC err;
     // Note that _pfm_manager->openFile() will initialize fileHandle
-    if ((err = _pfm_manager->openFile(fileName.c_str(), fileHandle)) != SUCCESSFUL) {
+    if ((err = _pfm_manager->openFile(fileName.c_str(), fileHandle, ioMode)) != SUCCESSFUL) {
         __trace();
 //        cout << "--> err = " << err << endl;
         return err;
     }
-    if ((err = SpaceManager::instance()->bufferSizeInfo(fileName, fileHandle)) != SUCCESSFUL) {
+    if ((err = SpaceManager::instance()->openFreeSpaceMap(fileName, fileHandle)) != SUCCESSFUL) {
         __trace();
         return err;
     }
@@ -80,16 +128,21 @@ RC RecordBasedFileManager::openFile(const string &fileName, FileHandle &fileHand
 }
 
 /**
- * Close a file.
+ * Close a file. With the last handle of the file, trailing pages left
+ * empty by deletions are cut off the file and the free space map is saved.
  *
  * @param fileName
  *          the name of the file to be closed.
  * @return status
  */
 RC RecordBasedFileManager::closeFile(FileHandle &fileHandle) {
+    if (!fileHandle.isOpen()) {
+        return _pfm_manager->closeFile(fileHandle);
+    }
     string fileName(fileHandle.getFileName());
-    SpaceManager::instance()->clearFreeSpaceMap(fileName);
-    return _pfm_manager->closeFile(fileHandle);
+    RC err = SpaceManager::instance()->closeFreeSpaceMap(fileName, fileHandle);
+    RC rc = _pfm_manager->closeFile(fileHandle);
+    return err != SUCCESSFUL ? err : rc;
 }
 
 /**
@@ -106,7 +159,7 @@ RC RecordBasedFileManager::closeFile(FileHandle &fileHandle) {
  * @param status
  */
 RC RecordBasedFileManager::insertRecord(FileHandle &fileHandle, const vector<Attribute> &recordDescriptor, const void *data, RID &rid) {
-    if (!fileHandle.getFilePointer() ||
+    if (!fileHandle.isOpen() ||
          fileHandle.getNumberOfPages() < 0 ||
          fileHandle.getFileName() == NULL) {
         return ERR_BAD_HANDLE;
@@ -115,60 +168,92 @@ RC RecordBasedFileManager::insertRecord(FileHandle &fileHandle, const vector<Att
     RC err = 0;
     string fileName(fileHandle.getFileName());
 
-    // calculate the size of the record
+    // lay out the record with its header
+    vector<char> buffer(fileHandle.getPageSize());
+    char *record = &buffer[0];
     unsigned recordSize;
-    if ((err = countRecordSize(recordDescriptor, data, recordSize)) != SUCCESSFUL) {
+    if ((err = __encodeRecord(recordDescriptor, data, fileHandle.getPageSize(), record, recordSize)) != SUCCESSFUL) {
         __trace();
         return err;
     }
 
-    return __insertRecord(fileName, fileHandle, data, rid, recordSize);
+    return __insertRecord(fileName, fileHandle, record, rid, recordSize);
 }
 
 /**
  * Helper function for insertRecord(). It finds a free space (or appends a new page),
- * then wire the record.
+ * then wire the record (given with its header, which pages of the plain format
+ * leave out). A caller holding the latch of a page (heldLatch) cannot wait for
+ * the latch of another one: if it is taken, a new page is appended. Pages
+ * share latches, so the one held may be the latch of the page found as well;
+ * it counts as taken.
  */
 RC RecordBasedFileManager::__insertRecord(const string &fileName,
-        FileHandle &fileHandle, const void *data, RID &rid, unsigned recordSize) {
+        FileHandle &fileHandle, const char *record, RID &rid, unsigned recordSize, mutex *heldLatch) {
     RC err = 0;
 
 //    __trace();
     // Find and allocate a fit space to store the record: get page # and start position
     // if cannot find an existing page then append and initialize a new page
     int pageNum = -1;
-    if ((err = SpaceManager::instance()->allocateSpace(fileName, fileHandle, recordSize, pageNum)) != SUCCESSFUL) {
+    int mapFreeSize = 0;
+    if ((err = SpaceManager::instance()->allocateSpace(fileName, fileHandle, recordSize,
+                                                       pageNum, mapFreeSize)) != SUCCESSFUL) {
         return err;
     }
 
-    char page[PAGE_SIZE];
+    // A page of another transaction is not waited for either
+    if (pageNum != -1 && SpaceManager::instance()->lockPage(fileHandle, pageNum, false) != SUCCESSFUL) {
+        SpaceManager::instance()->insertFreeSpaceMap(fileHandle, pageNum, mapFreeSize);
+        pageNum = -1;
+    }
+
+    unique_lock<mutex> latch;
+    if (pageNum != -1) {
+        mutex &pageLatch = SpaceManager::instance()->getPageLatch(fileHandle, pageNum);
+        if (heldLatch == NULL) {
+            latch = unique_lock<mutex>(pageLatch);
+        } else if (&pageLatch != heldLatch) {
+            latch = unique_lock<mutex>(pageLatch, try_to_lock);
+        }
+        if (!latch.owns_lock()) {
+            SpaceManager::instance()->insertFreeSpaceMap(fileHandle, pageNum, mapFreeSize);
+            pageNum = -1;
+        }
+    }
+
+    unsigned pageSize = fileHandle.getPageSize();
+    vector<char> buffer(pageSize);
+    char *page = &buffer[0];
     if (pageNum == -1) {
 //        __trace();
 //        cout << "--> record: start = " << 0 << ", size = " << recordSize
 //             << " @page " << fileHandle.getNumberOfPages() << " free size " << endl;
 
         // need to append a new page
-        SpaceManager::instance()->initCleanPage(page);
-        pageNum = fileHandle.getNumberOfPages();
-        SpaceManager::instance()->writeRecord(page, data, 0, recordSize);  // wire record data
-        SpaceManager::instance()->setFreePtr(page, recordSize);           // update free pointer
-        SpaceManager::instance()->setSlotCount(page, 1);                 // update # of slots
-        SpaceManager::instance()->setSlot(page, 0, 0, recordSize);        // set start position of first slot
+        SpaceManager::instance()->initCleanPage(page, pageSize);
+        SpaceManager::instance()->setRecordFormat(page, pageSize, SpaceManager::RECORD_FORMAT_OFFSETS);
+        SpaceManager::instance()->writeRecord(page, record, 0, recordSize);  // wire record data
+        SpaceManager::instance()->setFreePtr(page, pageSize, recordSize);           // update free pointer
+        SpaceManager::instance()->setSlotCount(page, pageSize, 1);                 // update # of slots
+        SpaceManager::instance()->setSlot(page, pageSize, 0, 0, recordSize);        // set start position of first slot
 
         // append that page
-        if ((err = fileHandle.appendPage(page)) != SUCCESSFUL) {
+        PageNum newPageNum;
+        if ((err = fileHandle.appendPage(page, newPageNum)) != SUCCESSFUL) {
             __trace();
             return err;
         }
+        pageNum = newPageNum;
 
         // update metadata, we need reserve one more slot since we don't have free existing ones
-        int freeSize = PAGE_SIZE - recordSize - SpaceManager::instance()->getMetadataSize(2);  // existing + reserved one
+        int freeSize = pageSize - recordSize - SpaceManager::instance()->getMetadataSize(2);  // existing + reserved one
 //        cout << " ### Inserting free size: " << freeSize << " @page " << pageNum << endl;
 //        if (freeSize <= 0) {
 //            __trace();
 //            cout << " ### Inserting free size: " << freeSize << " @page " << pageNum << endl;
 //        }
-        SpaceManager::instance()->insertFreeSpaceMap(fileName, pageNum, freeSize);
+        SpaceManager::instance()->insertFreeSpaceMap(fileHandle, pageNum, freeSize);
 
         // update RID
         rid.pageNum = (unsigned) pageNum;
@@ -182,8 +267,29 @@ RC RecordBasedFileManager::__insertRecord(const string &fileName,
             return err;
         }
 
+        // Pages of older files keep their format until they have no record left
+        unsigned format = SpaceManager::instance()->getRecordFormat(page, pageSize);
+        if (format != SpaceManager::RECORD_FORMAT_OFFSETS && SpaceManager::instance()->isEmptyPage(page, pageSize)) {
+            format = SpaceManager::RECORD_FORMAT_OFFSETS;
+            SpaceManager::instance()->setRecordFormat(page, pageSize, format);
+        }
+        // Pages of the plain format take the record without its header
+        unsigned headerSize = format == SpaceManager::RECORD_FORMAT_OFFSETS
+                              ? 0 : __getHeaderSize(record, SpaceManager::RECORD_FORMAT_OFFSETS);
+
+        // The map may underestimate the free space of a page, never overestimate it,
+        // unless the page has been changed behind its back: then look elsewhere
+        int pageFreeSize = SpaceManager::instance()->getPageFreeSize(page, pageSize);
+        if (pageFreeSize < (int) (recordSize - headerSize)) {
+            SpaceManager::instance()->insertFreeSpaceMap(fileHandle, pageNum, pageFreeSize);
+            latch.unlock();
+            return __insertRecord(fileName, fileHandle, record, rid, recordSize, heldLatch);
+        }
+        const char *data = record + headerSize;
+        recordSize -= headerSize;
+
         // find place and insert record
-        unsigned short start = SpaceManager::instance()->getFreePtr(page);
+        unsigned start = SpaceManager::instance()->getFreePtr(page, pageSize);
         SpaceManager::instance()->writeRecord(page, data, start, recordSize);
 
 //        __trace();
@@ -192,24 +298,24 @@ RC RecordBasedFileManager::__insertRecord(const string &fileName,
 
 
         // update metadata (in disk file and the map in memory)
-        unsigned short slotCount = SpaceManager::instance()->getSlotCount(page);
-        unsigned short firstFreeSlot;
+        unsigned slotCount = SpaceManager::instance()->getSlotCount(page, pageSize);
+        unsigned firstFreeSlot;
 
         // check whether we can reused previously released slot
         int reservedSlotSpace = 0;
-        if (!SpaceManager::instance()->hasFreeExistingSlot(page, slotCount, firstFreeSlot)) {
+        if (!SpaceManager::instance()->hasFreeExistingSlot(page, pageSize, slotCount, firstFreeSlot)) {
             // insert a new slot
             firstFreeSlot = slotCount;
-            SpaceManager::instance()->setSlot(page, slotCount, start, recordSize);
-            SpaceManager::instance()->setSlotCount(page, ++slotCount);
+            SpaceManager::instance()->setSlot(page, pageSize, slotCount, start, recordSize);
+            SpaceManager::instance()->setSlotCount(page, pageSize, ++slotCount);
             // since we don't have free existing free slot, we need to reserve one for next insertion
             reservedSlotSpace = 1;
         } else {
-            SpaceManager::instance()->setSlot(page, firstFreeSlot, start, recordSize);
+            SpaceManager::instance()->setSlot(page, pageSize, firstFreeSlot, start, recordSize);
         }
 
         // update free pointer
-        SpaceManager::instance()->setFreePtr(page, start + recordSize);
+        SpaceManager::instance()->setFreePtr(page, pageSize, start + recordSize);
 
         // write back the page
         if ((err = fileHandle.writePage(pageNum, page)) != SUCCESSFUL) {
@@ -217,13 +323,13 @@ RC RecordBasedFileManager::__insertRecord(const string &fileName,
         }
 
         // update metadata
-        int freeSize = PAGE_SIZE - start - recordSize
+        int freeSize = pageSize - start - recordSize
                         - SpaceManager::instance()->getMetadataSize(slotCount + reservedSlotSpace);
 //        if (freeSize <= 0) {
 //            __trace();
 //            cout << " ### Inserting free size: " << freeSize << " @page " << pageNum << endl;
 //        }
-        SpaceManager::instance()->insertFreeSpaceMap(fileName, pageNum, freeSize);
+        SpaceManager::instance()->insertFreeSpaceMap(fileHandle, pageNum, freeSize);
 
         // Update RID
         rid.pageNum = (unsigned) pageNum;
@@ -234,6 +340,126 @@ RC RecordBasedFileManager::__insertRecord(const string &fileName,
     return SUCCESSFUL;
 }
 
+/**
+ * Given a record descriptor, insert a batch of records. The records are laid
+ * out one after another in page images in memory, which are appended to the
+ * file BULK_WRITE_SIZE bytes at a time; the free space map is updated once
+ * per page. Free space left in existing pages is not used, which suits loads.
+ *
+ * @param fileHandle
+ *          the provided file handle.
+ * @param recordDescriptor
+ *          the record descriptor.
+ * @param batch
+ *          the records to be inserted.
+ * @param rids
+ *          (return) the record ID of each record, in the order of the batch.
+ * @return status
+ */
+RC RecordBasedFileManager::insertRecords(FileHandle &fileHandle, const vector<Attribute> &recordDescriptor,
+        const vector<const void *> &batch, vector<RID> &rids) {
+    if (!fileHandle.isOpen() || fileHandle.getFileName() == NULL) {
+        return ERR_BAD_HANDLE;
+    }
+
+    RC err;
+    SpaceManager *sm = SpaceManager::instance();
+    unsigned pageSize = fileHandle.getPageSize();
+
+    // Check the whole batch before anything is written (sizes include the record header)
+    vector<unsigned> sizes(batch.size());
+    for (size_t i = 0; i < batch.size(); i++) {
+        if ((err = countRecordSize(recordDescriptor, batch[i], sizes[i])) != SUCCESSFUL) {
+            __trace();
+            return err;
+        }
+        sizes[i] += __getHeaderSize(recordDescriptor.size());
+        if (sizes[i] >= pageSize - sm->getMetadataSize(1)) {
+            return ERR_SIZE_TOO_LARGE;
+        }
+    }
+
+    rids.resize(batch.size());
+    unsigned maxPages = max((unsigned) BULK_WRITE_SIZE / pageSize, 1u);
+    vector<char> pages((size_t) maxPages * pageSize);
+    unsigned pageCount = 0;     // # of page images started
+    unsigned firstRecord = 0;   // first record of these pages
+    char *page = NULL;
+    for (unsigned i = 0; i < batch.size(); i++) {
+        unsigned freePtr = 0;
+        unsigned slotCount = 0;
+        if (page != NULL) {
+            freePtr = sm->getFreePtr(page, pageSize);
+            slotCount = sm->getSlotCount(page, pageSize);
+        }
+
+        // A page takes a record as long as one more slot stays in reserve, like in insertRecord()
+        if (page == NULL || freePtr + sizes[i] + sm->getMetadataSize(slotCount + 1) > pageSize) {
+            if (pageCount == maxPages) {
+                if ((err = __appendRecordPages(fileHandle, &pages[0], pageCount,
+                        rids, firstRecord, i)) != SUCCESSFUL) {
+                    __trace();
+                    return err;
+                }
+                pageCount = 0;
+                firstRecord = i;
+            }
+            page = &pages[(size_t) pageCount++ * pageSize];
+            sm->initCleanPage(page, pageSize);
+            sm->setRecordFormat(page, pageSize, SpaceManager::RECORD_FORMAT_OFFSETS);
+            freePtr = 0;
+            slotCount = 0;
+        }
+
+        if ((err = __encodeRecord(recordDescriptor, batch[i], sizes[i], page + freePtr, sizes[i]))
+                != SUCCESSFUL) {
+            __trace();
+            return err;
+        }
+        sm->setSlot(page, pageSize, slotCount, freePtr, sizes[i]);
+        sm->setSlotCount(page, pageSize, slotCount + 1);
+        sm->setFreePtr(page, pageSize, freePtr + sizes[i]);
+
+        // Page # relative to the first page image until the pages are appended
+        rids[i].pageNum = pageCount - 1;
+        rids[i].slotNum = slotCount;
+    }
+
+    return __appendRecordPages(fileHandle, &pages[0], pageCount, rids, firstRecord, batch.size());
+}
+
+/**
+ * Helper function for insertRecords(). It appends the page images, files
+ * them in the free space map, and turns the page # of the RIDs of their
+ * records into page # of the file.
+ */
+RC RecordBasedFileManager::__appendRecordPages(FileHandle &fileHandle, char *pages, unsigned pageCount,
+        vector<RID> &rids, unsigned firstRecord, unsigned endRecord) {
+    if (pageCount == 0) {
+        return SUCCESSFUL;
+    }
+
+    RC err;
+    PageNum startPage;
+    if ((err = fileHandle.appendPages(pageCount, pages, startPage)) != SUCCESSFUL) {
+        __trace();
+        return err;
+    }
+
+    SpaceManager *sm = SpaceManager::instance();
+    unsigned pageSize = fileHandle.getPageSize();
+    for (unsigned i = 0; i < pageCount; i++) {
+        const char *page = pages + (size_t) i * pageSize;
+        int freeSize = pageSize - sm->getFreePtr(page, pageSize)
+                        - sm->getMetadataSize(sm->getSlotCount(page, pageSize) + 1);
+        sm->insertFreeSpaceMap(fileHandle, startPage + i, freeSize);
+    }
+    for (unsigned i = firstRecord; i < endRecord; i++) {
+        rids[i].pageNum += startPage;
+    }
+    return SUCCESSFUL;
+}
+
 /**
  * Given a record descriptor and RID, get the record.
  *
@@ -245,13 +471,14 @@ RC RecordBasedFileManager::__insertRecord(const string &fileName,
  * @return status
  */
 RC RecordBasedFileManager::readRecord(FileHandle &fileHandle, const vector<Attribute> &recordDescriptor, const RID &rid, void *data) {
-    if (!fileHandle.getFilePointer() ||
+    if (!fileHandle.isOpen() ||
          fileHandle.getNumberOfPages() < 0 ||
          fileHandle.getFileName() == NULL) {
         return ERR_BAD_HANDLE;
     }
 
-    void *page = SpaceManager::getPageBuffer();
+    RC err;
+    void *page;
     unsigned pageCount = fileHandle.getNumberOfPages();
     if (rid.pageNum >= pageCount) {
         __trace();
@@ -259,20 +486,30 @@ RC RecordBasedFileManager::readRecord(FileHandle &fileHandle, const vector<Attri
         return ERR_RECORD_NOT_FOUND;
     }
 
-    fileHandle.readPage(rid.pageNum, page);
-    unsigned slotCount = SpaceManager::instance()->getSlotCount(page);
+    // Read the record in place from the buffer pool
+    if ((err = fileHandle.pinPage(rid.pageNum, page)) != SUCCESSFUL) {
+        __trace();
+        return err;
+    }
+    unique_lock<mutex> latch(SpaceManager::instance()->getPageLatch(fileHandle, rid.pageNum));
+    unsigned pageSize = fileHandle.getPageSize();
+    unsigned slotCount = SpaceManager::instance()->getSlotCount(page, pageSize);
     if (rid.slotNum >= slotCount) {
         __trace();
 //        cout << "--> slotNum " << rid.slotNum << " exceeded slotCount "
 //             << slotCount << " @page " << rid.pageNum << endl;
+        latch.unlock();
+        fileHandle.unpinPage(rid.pageNum, false);
         return ERR_RECORD_NOT_FOUND;
     }
 
-    short startPos = SpaceManager::instance()->getSlotStartPos(page, rid.slotNum);
-    short recordLength = SpaceManager::instance()->getSlotLength(page, rid.slotNum);
+    int startPos = SpaceManager::instance()->getSlotStartPos(page, pageSize, rid.slotNum);
+    int recordLength = SpaceManager::instance()->getSlotLength(page, pageSize, rid.slotNum);
     // The slot is deleted or just bad formatted (due to file inconsistency)
-    if (startPos >= PAGE_SIZE || recordLength >= PAGE_SIZE) {
+    if (startPos >= (int) pageSize || recordLength >= (int) pageSize) {
         __trace();
+        latch.unlock();
+        fileHandle.unpinPage(rid.pageNum, false);
         return ERR_BAD_DATA;
     }
 
@@ -281,6 +518,8 @@ RC RecordBasedFileManager::readRecord(FileHandle &fileHandle, const vector<Attri
 //        __trace();
         RID newRid;
         SpaceManager::instance()->getNewRecordPos(startPos, recordLength, newRid.pageNum, newRid.slotNum);
+        latch.unlock();
+        fileHandle.unpinPage(rid.pageNum, false);
 //        cout << "--> READ: find a tombstone, go to new space: @page "
 //             << newRid.pageNum << ", slot " << newRid.slotNum << endl;
         return readRecord(fileHandle, recordDescriptor, newRid, data);
@@ -291,10 +530,78 @@ RC RecordBasedFileManager::readRecord(FileHandle &fileHandle, const vector<Attri
 //             << " length " << recordLength << endl;
     }
 
-    // now read record
-    SpaceManager::instance()->readRecord(page, data, startPos, recordLength);
+    // now read record, leaving its header out
+    unsigned headerSize = __getHeaderSize((const char *) page + startPos,
+                                          SpaceManager::instance()->getRecordFormat(page, pageSize));
+    SpaceManager::instance()->readRecord(page, data, startPos + headerSize, recordLength - headerSize);
+    latch.unlock();
 
-    return SUCCESSFUL;
+    return fileHandle.unpinPage(rid.pageNum, false);
+}
+
+/**
+ * Read a record in place: no bytes are copied, the view points into the
+ * page, which stays pinned until the view is released.
+ *
+ * @param fileHandle
+ *          the handle the page is pinned through: it must outlive the view.
+ * @param recordDescriptor
+ *          the record descriptor, which must outlive the view too.
+ * @param rid
+ * @param view
+ * @return status
+ */
+RC RecordBasedFileManager::readRecordView(FileHandle &fileHandle, const vector<Attribute> &recordDescriptor,
+        const RID &rid, RecordView &view) {
+    if (!fileHandle.isOpen() ||
+         fileHandle.getNumberOfPages() < 0 ||
+         fileHandle.getFileName() == NULL) {
+        return ERR_BAD_HANDLE;
+    }
+
+    RC err;
+    void *page;
+    RID cur = rid;
+    unsigned pageSize = fileHandle.getPageSize();
+    while (true) {
+        if (cur.pageNum >= fileHandle.getNumberOfPages()) {
+            view.release();
+            return ERR_RECORD_NOT_FOUND;
+        }
+        if ((err = view.attach(fileHandle, cur.pageNum, page)) != SUCCESSFUL) {
+            __trace();
+            return err;
+        }
+        unique_lock<mutex> latch(SpaceManager::instance()->getPageLatch(fileHandle, cur.pageNum));
+        unsigned slotCount = SpaceManager::instance()->getSlotCount(page, pageSize);
+        if (cur.slotNum >= slotCount) {
+            latch.unlock();
+            view.release();
+            return ERR_RECORD_NOT_FOUND;
+        }
+
+        int startPos = SpaceManager::instance()->getSlotStartPos(page, pageSize, cur.slotNum);
+        int recordLength = SpaceManager::instance()->getSlotLength(page, pageSize, cur.slotNum);
+        if (startPos >= (int) pageSize || recordLength >= (int) pageSize) {
+            __trace();
+            latch.unlock();
+            view.release();
+            return ERR_BAD_DATA;
+        }
+
+        // Follow the tomb stone (the next page is pinned before this one is released)
+        if (SpaceManager::instance()->isTombstoneSlot(startPos, recordLength)) {
+            SpaceManager::instance()->getNewRecordPos(startPos, recordLength, cur.pageNum, cur.slotNum);
+            continue;
+        }
+
+        view.record = (const char *) page + startPos;
+        view.recordLength = recordLength;
+        view.recordFormat = SpaceManager::instance()->getRecordFormat(page, pageSize);
+        view.headerSize = __getHeaderSize(view.record, view.recordFormat);
+        view.recordDescriptor = &recordDescriptor;
+        return SUCCESSFUL;
+    }
 }
 
 /**
@@ -429,7 +736,7 @@ RC RecordBasedFileManager::deleteRecord(FileHandle &fileHandle, const vector<Att
  * to a new page with enough free space.
  */
 RC RecordBasedFileManager::updateRecord(FileHandle &fileHandle, const vector<Attribute> &recordDescriptor, const void *data, const RID &rid) {
-    if (!fileHandle.getFilePointer() ||
+    if (!fileHandle.isOpen() ||
          fileHandle.getNumberOfPages() < 0 ||
          fileHandle.getFileName() == NULL) {
         return ERR_BAD_HANDLE;
@@ -444,33 +751,46 @@ RC RecordBasedFileManager::updateRecord(FileHandle &fileHandle, const vector<Att
         std::cout << "Page number #" << rid.pageNum << " is invalid: the page size: " << fileHandle.getNumberOfPages() << endl;
         return ERR_RECORD_NOT_FOUND;
     }
-    char page[PAGE_SIZE];  // use stack instead
+    unsigned pageSize = fileHandle.getPageSize();
+    vector<char> buffer(pageSize);
+    char *page = &buffer[0];
+    if ((err = SpaceManager::instance()->lockPage(fileHandle, rid.pageNum, true)) != SUCCESSFUL) {
+        __trace();
+        return err;
+    }
+    unique_lock<mutex> latch(SpaceManager::instance()->getPageLatch(fileHandle, rid.pageNum));
     if ((err = fileHandle.readPage(rid.pageNum, page)) != SUCCESSFUL) {
         __trace();
         return err;
     }
 
     // Get and validate slot number
-    unsigned short slotCount = SpaceManager::instance()->getSlotCount(page);
+    unsigned slotCount = SpaceManager::instance()->getSlotCount(page, pageSize);
     if (rid.slotNum >= slotCount) {
         __trace();
         std::cout << "Slot number #" << rid.slotNum << " is invalid: the page slot count: " << slotCount << endl;
         return ERR_RECORD_NOT_FOUND;
     }
 
-    // Calculate the size of the new record
+    // Lay out the new record, with a header unless the page has the plain format
+    vector<char> recordBuffer(pageSize);
+    char *record = &recordBuffer[0];
     unsigned recordSize;
-    if ((err = countRecordSize(recordDescriptor, data, recordSize)) != SUCCESSFUL) {
+    if ((err = __encodeRecord(recordDescriptor, data, pageSize, record, recordSize)) != SUCCESSFUL) {
         __trace();
         return err;
     }
+    unsigned headerSize = 0;
+    if (SpaceManager::instance()->getRecordFormat(page, pageSize) != SpaceManager::RECORD_FORMAT_OFFSETS) {
+        headerSize = __getHeaderSize(record, SpaceManager::RECORD_FORMAT_OFFSETS);
+    }
 
     // Handle the case when the slot is a tomb stone
-    short startPos = SpaceManager::instance()->getSlotStartPos(page, rid.slotNum);
-    short oldRecordSize = SpaceManager::instance()->getSlotLength(page, rid.slotNum);
+    int startPos = SpaceManager::instance()->getSlotStartPos(page, pageSize, rid.slotNum);
+    int oldRecordSize = SpaceManager::instance()->getSlotLength(page, pageSize, rid.slotNum);
 //    __trace();
 //    cout << "--> record: start = " << startPos << ", size = " << oldRecordSize
-//         << " @page " << rid.pageNum << " free size " << SpaceManager::instance()->getPageFreeSize(page) << endl;
+//         << " @page " << rid.pageNum << " free size " << SpaceManager::instance()->getPageFreeSize(page, pageSize) << endl;
     if (SpaceManager::instance()->isTombstoneSlot(startPos, oldRecordSize)) {
         unsigned newPageNum, newSlotNum;
         SpaceManager::instance()->getNewRecordPos(startPos, oldRecordSize, newPageNum, newSlotNum);
@@ -480,47 +800,46 @@ RC RecordBasedFileManager::updateRecord(FileHandle &fileHandle, const vector<Att
         nrid.slotNum = newSlotNum;
 //        __trace();
 //        cout << "--> Find a tombstone, new place @page " << nrid.pageNum << " slot " << nrid.slotNum << endl;
+        latch.unlock();
         return updateRecord(fileHandle, recordDescriptor, data, nrid);
     } else {
         // Find out if the new record can fit in the current page
-        unsigned freeSize = SpaceManager::instance()->getPageFreeSize(page);
+        unsigned freeSize = SpaceManager::instance()->getPageFreeSize(page, pageSize);
 
 //        if (freeSize <= 0) {
 //            cout << " !!!Space not enough, @page " << rid.pageNum << endl;
 //        }
 
-        if (recordSize <= (unsigned) oldRecordSize) {
+        const char *stored = record + headerSize;
+        unsigned storedSize = recordSize - headerSize;
+        if (storedSize <= (unsigned) oldRecordSize) {
 //            __trace();
 //            cout << "$$new size <= old size" << endl;
             // Update record in the old place
-            SpaceManager::instance()->writeRecord(page, data,
-                    (unsigned short) startPos, (unsigned short) recordSize);
+            SpaceManager::instance()->writeRecord(page, stored,
+                    (unsigned) startPos, storedSize);
             // Update slot directory
-            SpaceManager::instance()->setSlot(page, rid.slotNum, startPos, recordSize);
-        } else if (recordSize < freeSize) {
+            SpaceManager::instance()->setSlot(page, pageSize, rid.slotNum, startPos, storedSize);
+        } else if (storedSize < freeSize) {
 //            __trace();
 //            cout << "$$freeSize > new size" << endl;
             // Find and update slot in place and free pointer
-            unsigned short freePtr = SpaceManager::instance()->getFreePtr(page);
-            SpaceManager::instance()->writeRecord(page, data, freePtr, recordSize);
-            SpaceManager::instance()->setSlot(page, rid.slotNum, freePtr, recordSize);
-            SpaceManager::instance()->setFreePtr(page, freePtr + recordSize);
+            unsigned freePtr = SpaceManager::instance()->getFreePtr(page, pageSize);
+            SpaceManager::instance()->writeRecord(page, stored, freePtr, storedSize);
+            SpaceManager::instance()->setSlot(page, pageSize, rid.slotNum, freePtr, storedSize);
+            SpaceManager::instance()->setFreePtr(page, pageSize, freePtr + storedSize);
             // Update free space map
-            if ((err = SpaceManager::instance()->updateFreeSpaceMap(fileName, rid.pageNum,
-                        freeSize, freeSize - recordSize)) != SUCCESSFUL) {
-                __trace();
-                return err;
-            }
+            SpaceManager::instance()->insertFreeSpaceMap(fileHandle, rid.pageNum, freeSize - storedSize);
         } else {
 //            __trace();
 //            cout << "$$freeSize <= new size" << endl;
             // Find another page to store the record and leave a tomb stone in the old place
             RID newRid;
-            if ((err = __insertRecord(fileName, fileHandle, data, newRid, recordSize)) != SUCCESSFUL) {
+            if ((err = __insertRecord(fileName, fileHandle, record, newRid, recordSize, latch.mutex())) != SUCCESSFUL) {
                 __trace();
                 return err;
             }
-            SpaceManager::instance()->setTombstoneSlot(page, rid.slotNum, (short) newRid.pageNum, (short) newRid.slotNum);
+            SpaceManager::instance()->setTombstoneSlot(page, pageSize, rid.slotNum, newRid.pageNum, newRid.slotNum);
         }
 
         // write back the page
@@ -538,7 +857,7 @@ RC RecordBasedFileManager::updateRecord(FileHandle &fileHandle, const vector<Att
  */
 RC RecordBasedFileManager::readAttribute(FileHandle &fileHandle, const vector<Attribute> &recordDescriptor, const RID &rid,
         const string attributeName, void *data) {
-    if (!fileHandle.getFilePointer() ||
+    if (!fileHandle.isOpen() ||
          fileHandle.getNumberOfPages() < 0 ||
          fileHandle.getFileName() == NULL) {
         return ERR_BAD_HANDLE;
@@ -546,27 +865,33 @@ RC RecordBasedFileManager::readAttribute(FileHandle &fileHandle, const vector<At
 
     RC err;
 
-    // Read that page
-    void *page = SpaceManager::getPageBuffer();
-    if ((err = fileHandle.readPage(rid.pageNum, page)) != SUCCESSFUL) {
+    // Pin that page
+    void *page;
+    if ((err = fileHandle.pinPage(rid.pageNum, page)) != SUCCESSFUL) {
         __trace();
         return err;
     }
+    unique_lock<mutex> latch(SpaceManager::instance()->getPageLatch(fileHandle, rid.pageNum));
 
     // Read slot information
-    unsigned short slotCount = SpaceManager::instance()->getSlotCount(page);
+    unsigned pageSize = fileHandle.getPageSize();
+    unsigned slotCount = SpaceManager::instance()->getSlotCount(page, pageSize);
     if (rid.slotNum >= slotCount) {
         __trace();
         std::cout << "Slot number #" << rid.slotNum << " is invalid: the page slot count: " << slotCount << endl;
+        latch.unlock();
+        fileHandle.unpinPage(rid.pageNum, false);
         return ERR_RECORD_NOT_FOUND;
     }
-    short startPos = SpaceManager::instance()->getSlotStartPos(page, rid.slotNum);
-    short recordSize = SpaceManager::instance()->getSlotLength(page, rid.slotNum);
+    int startPos = SpaceManager::instance()->getSlotStartPos(page, pageSize, rid.slotNum);
+    int recordSize = SpaceManager::instance()->getSlotLength(page, pageSize, rid.slotNum);
 
     // Check if the current slot is a tomb stone
     if (SpaceManager::instance()->isTombstoneSlot(startPos, recordSize)) {
         unsigned newPageNum, newSlotNum;
         SpaceManager::instance()->getNewRecordPos(startPos, recordSize, newPageNum, newSlotNum);
+        latch.unlock();
+        fileHandle.unpinPage(rid.pageNum, false);
         // Recursively find the real place of the record
         RID nrid;
         nrid.pageNum = newPageNum;
@@ -574,70 +899,254 @@ RC RecordBasedFileManager::readAttribute(FileHandle &fileHandle, const vector<At
         return readAttribute(fileHandle, recordDescriptor, nrid, attributeName, data);
     } else {
         unsigned dataSize;
-        return __readAttribute(page, startPos, recordDescriptor, attributeName, data, dataSize);
+        err = __readAttribute(page, startPos, recordSize, SpaceManager::instance()->getRecordFormat(page, pageSize),
+                              recordDescriptor, attributeName, data, dataSize);
+        latch.unlock();
+        fileHandle.unpinPage(rid.pageNum, false);
+        return err;
     }
 }
 
-RC RecordBasedFileManager::__readAttribute(void *page, unsigned short startPos, const vector<Attribute> &recordDescriptor,
-            const string attributeName, void *data, unsigned &dataSize) {
-    unsigned offset = startPos;
+RC RecordBasedFileManager::__readAttribute(const void *page, unsigned startPos, unsigned length, unsigned format,
+            const vector<Attribute> &recordDescriptor, const string attributeName, void *data, unsigned &dataSize) {
+    int fieldNum = __getFieldNum(recordDescriptor, attributeName);
+    if (fieldNum < 0) {
+        return ERR_ATTR_NOT_FOUND;
+    }
 
-    for (size_t i = 0; i < recordDescriptor.size(); i++) {
-        Attribute attr = recordDescriptor[i];
-        string name = attr.name;
-        AttrType type = attr.type;
-        AttrLength length = attr.length;
+    // Returned data is the field as stored (varchars with their 4 byte length)
+    const char *record = (const char *) page + startPos;
+    unsigned offset;
+    RC err = __locateField(record, length, format, recordDescriptor, fieldNum, offset, dataSize);
+    if (err != SUCCESSFUL) {
+        return err;
+    }
+    memcpy(data, record + offset, dataSize);
+    return SUCCESSFUL;
+}
 
-        switch (type) {
-        case TypeVarChar:{
+/**
+ * Lay out a record of the RECORD_FORMAT_OFFSETS format:
+ *
+ *   [# of fields][end offset of field 0]...[end offset of field n-1][fields]
+ *
+ * The fields follow the format of insertRecord(); each offset counts from
+ * the start of the record, and a field starts where the previous one ends
+ * (the first one right after the header).
+ *
+ * @param recordDescriptor
+ * @param data
+ *          the record in the format of insertRecord().
+ * @param maxSize
+ *          the size of the record buffer.
+ * @param record
+ *          (return) the record with its header.
+ * @param size
+ *          (return) the size of the record.
+ * @return status
+ */
+RC RecordBasedFileManager::__encodeRecord(const vector<Attribute> &recordDescriptor, const void *data,
+        unsigned maxSize, char *record, unsigned &size) {
+    unsigned fieldCount = recordDescriptor.size();
+    unsigned headerSize = __getHeaderSize(fieldCount);
+    if (headerSize > maxSize) {
+        return ERR_SIZE_TOO_LARGE;
+    }
+
+    unsigned short count = fieldCount;
+    memcpy(record, &count, FIELD_COUNT_LEN);
+    unsigned offset = 0;
+    for (unsigned i = 0; i < fieldCount; i++) {
+        const Attribute &attr = recordDescriptor[i];
+        switch (attr.type) {
+        case TypeVarChar: {
             AttrLength len = 0;
-            memcpy((char *)&len, (char *)page + offset, sizeof(int));
-            if (len > length) {
+            memcpy((char *)&len, (const char *)data + offset, sizeof(int));
+            if (len > attr.length) {
+                cout << "__encodeRecord(): string len = " << len << ", should be " << attr.length << endl;
+                return ERR_FORMAT;
+            }
+            offset += sizeof(int) + len;
+            break;
+        }
+        case TypeInt:
+            offset += sizeof(int);
+            break;
+        case TypeReal:
+            offset += sizeof(float);
+            break;
+        default:
+            return ERR_UNKNOWN_TYPE;
+        }
+        if (headerSize + offset > maxSize) {
+            return ERR_SIZE_TOO_LARGE;
+        }
+        unsigned short end = headerSize + offset;
+        memcpy(record + FIELD_COUNT_LEN + i * FIELD_OFFSET_LEN, &end, FIELD_OFFSET_LEN);
+    }
+
+    memcpy(record + headerSize, data, offset);
+    size = headerSize + offset;
+    return SUCCESSFUL;
+}
+
+unsigned RecordBasedFileManager::__getHeaderSize(unsigned fieldCount) {
+    return FIELD_COUNT_LEN + fieldCount * FIELD_OFFSET_LEN;
+}
+
+unsigned RecordBasedFileManager::__getHeaderSize(const char *record, unsigned format) {
+    if (format != SpaceManager::RECORD_FORMAT_OFFSETS) {
+        return 0;
+    }
+    unsigned short fieldCount;
+    memcpy(&fieldCount, record, FIELD_COUNT_LEN);
+    return __getHeaderSize(fieldCount);
+}
+
+/**
+ * Find a field of a stored record: through the offsets of its header, or
+ * by skipping the fields ahead of it for records of the plain format.
+ */
+RC RecordBasedFileManager::__locateField(const char *record, unsigned length, unsigned format,
+        const vector<Attribute> &recordDescriptor, unsigned fieldNum, unsigned &offset, unsigned &size) {
+    if (fieldNum >= recordDescriptor.size()) {
+        return ERR_ATTR_NOT_FOUND;
+    }
+
+    if (format == SpaceManager::RECORD_FORMAT_OFFSETS) {
+        unsigned short fieldCount, start, end;
+        memcpy(&fieldCount, record, FIELD_COUNT_LEN);
+        if (fieldNum >= fieldCount) {
+            return ERR_ATTR_NOT_FOUND;
+        }
+        if (fieldNum == 0) {
+            start = __getHeaderSize(fieldCount);
+        } else {
+            memcpy(&start, record + FIELD_COUNT_LEN + (fieldNum - 1) * FIELD_OFFSET_LEN, FIELD_OFFSET_LEN);
+        }
+        memcpy(&end, record + FIELD_COUNT_LEN + fieldNum * FIELD_OFFSET_LEN, FIELD_OFFSET_LEN);
+        if (start > end || end > length) {
+            __trace();
+            return ERR_FORMAT;
+        }
+        offset = start;
+        size = end - start;
+        return SUCCESSFUL;
+    }
+
+    offset = 0;
+    for (unsigned i = 0; i <= fieldNum; i++) {
+        const Attribute &attr = recordDescriptor[i];
+        switch (attr.type) {
+        case TypeVarChar: {
+            AttrLength len = 0;
+            memcpy(&len, record + offset, sizeof(int));
+            if (len > attr.length) {
                 __trace();
-                cout << "readAttribute(): string len = " << len << ", should be " << length << endl;
+                cout << "readAttribute(): string len = " << len << ", should be " << attr.length << endl;
                 return ERR_FORMAT;
             }
+            size = sizeof(int) + len;
+            break;
+        }
+        case TypeInt:
+            size = sizeof(int);
+            break;
+        case TypeReal:
+            size = sizeof(float);
+            break;
+        default:
+            return ERR_UNKNOWN_TYPE;
+        }
+        if (offset + size > length) {
+            __trace();
+            return ERR_FORMAT;
+        }
+        if (i < fieldNum) {
+            offset += size;
+        }
+    }
+    return SUCCESSFUL;
+}
 
-            // Returned data includes: 4 byte of chars size + chars
-            if (name.compare(attributeName) == 0) {
-                memcpy((char *)data, (char *)page + offset, len + sizeof(int));
-                dataSize = len + sizeof(int);
-                return SUCCESSFUL;
+/**
+ * Find the bounds of several fields at once: field i spans [bounds[i],
+ * bounds[i + 1]) of the stored record, for i < fieldCount. The offsets of
+ * the header are read as they are; records of the plain format are walked
+ * once.
+ */
+RC RecordBasedFileManager::__locateFields(const char *record, unsigned length, unsigned format,
+        const vector<Attribute> &recordDescriptor, unsigned fieldCount, unsigned *bounds) {
+    if (fieldCount > recordDescriptor.size()) {
+        return ERR_ATTR_NOT_FOUND;
+    }
+
+    if (format == SpaceManager::RECORD_FORMAT_OFFSETS) {
+        unsigned short storedCount;
+        memcpy(&storedCount, record, FIELD_COUNT_LEN);
+        if (fieldCount > storedCount) {
+            return ERR_ATTR_NOT_FOUND;
+        }
+        bounds[0] = __getHeaderSize(storedCount);
+        for (unsigned i = 0; i < fieldCount; i++) {
+            unsigned short end;
+            memcpy(&end, record + FIELD_COUNT_LEN + i * FIELD_OFFSET_LEN, FIELD_OFFSET_LEN);
+            if (end < bounds[i] || end > length) {
+                __trace();
+                return ERR_FORMAT;
             }
+            bounds[i + 1] = end;
+        }
+        return SUCCESSFUL;
+    }
 
-            offset += sizeof(int);  // length itself
-            offset += len;          // string length
+    bounds[0] = 0;
+    for (unsigned i = 0; i < fieldCount; i++) {
+        const Attribute &attr = recordDescriptor[i];
+        unsigned size;
+        switch (attr.type) {
+        case TypeVarChar: {
+            AttrLength len = 0;
+            memcpy(&len, record + bounds[i], sizeof(int));
+            if (len > attr.length) {
+                __trace();
+                return ERR_FORMAT;
+            }
+            size = sizeof(int) + len;
             break;
         }
         case TypeInt:
-            if (name.compare(attributeName) == 0) {
-                memcpy((char *)data, (char *)page + offset, sizeof(int));
-                dataSize = sizeof(int);
-                return SUCCESSFUL;
-            }
-            offset += sizeof(int);
+            size = sizeof(int);
             break;
         case TypeReal:
-            if (name.compare(attributeName) == 0) {
-                memcpy((char *)data, (char *)page + offset, sizeof(float));
-                dataSize = sizeof(float);
-                return SUCCESSFUL;
-            }
-            offset += sizeof(float);
+            size = sizeof(float);
             break;
         default:
             return ERR_UNKNOWN_TYPE;
         }
+        if (bounds[i] + size > length) {
+            __trace();
+            return ERR_FORMAT;
+        }
+        bounds[i + 1] = bounds[i] + size;
     }
+    return SUCCESSFUL;
+}
 
-    return ERR_ATTR_NOT_FOUND;
+int RecordBasedFileManager::__getFieldNum(const vector<Attribute> &recordDescriptor, const string &attributeName) {
+    for (size_t i = 0; i < recordDescriptor.size(); i++) {
+        if (recordDescriptor[i].name == attributeName) {
+            return i;
+        }
+    }
+    return -1;
 }
 
 /**
  * Given a record descriptor, reorganize a page, i.e., push the free space towards the end of the page.
  */
 RC RecordBasedFileManager::reorganizePage(FileHandle &fileHandle, const vector<Attribute> &recordDescriptor, const unsigned pageNumber) {
-    if (!fileHandle.getFilePointer() ||
+    if (!fileHandle.isOpen() ||
          fileHandle.getNumberOfPages() < 0 ||
          fileHandle.getFileName() == NULL) {
         return ERR_BAD_HANDLE;
@@ -651,20 +1160,26 @@ RC RecordBasedFileManager::reorganizePage(FileHandle &fileHandle, const vector<A
         std::cout << "Page number #" << pageNumber << " is invalid: the page size: " << fileHandle.getNumberOfPages() << endl;
         return ERR_RECORD_NOT_FOUND;
     }
-//    void *page = SpaceManager::getPageBuffer();
-    char page[PAGE_SIZE];
+    unsigned pageSize = fileHandle.getPageSize();
+    vector<char> buffer(pageSize);
+    char *page = &buffer[0];
+    if ((err = SpaceManager::instance()->lockPage(fileHandle, pageNumber, true)) != SUCCESSFUL) {
+        __trace();
+        return err;
+    }
+    lock_guard<mutex> latch(SpaceManager::instance()->getPageLatch(fileHandle, pageNumber));
     if ((err = fileHandle.readPage(pageNumber, page)) != SUCCESSFUL) {
         __trace();
         return err;
     }
 
     // Iterate through the slot directory and buffer the slot information
-    vector<pair<short, unsigned> > records;  // {<startPos, slot #>}
-    unsigned short slotCount = SpaceManager::instance()->getSlotCount(page);
+    vector<pair<int, unsigned> > records;  // {<startPos, slot #>}
+    unsigned slotCount = SpaceManager::instance()->getSlotCount(page, pageSize);
     for (unsigned i = 0; i < slotCount; i++) {
-        short startPos = SpaceManager::instance()->getSlotStartPos(page, i);
-        short len = SpaceManager::instance()->getSlotLength(page, i);
-        if (SpaceManager::instance()->isOccupiedSlot(startPos, len)) {
+        int startPos = SpaceManager::instance()->getSlotStartPos(page, pageSize, i);
+        int len = SpaceManager::instance()->getSlotLength(page, pageSize, i);
+        if (SpaceManager::instance()->isOccupiedSlot(startPos, len, pageSize)) {
             records.push_back(make_pair(startPos, i));
         }
     }
@@ -673,23 +1188,23 @@ RC RecordBasedFileManager::reorganizePage(FileHandle &fileHandle, const vector<A
     std::sort(records.begin(), records.end());
     unsigned offset = 0;
     for (auto& r : records) {
-        short startPos = r.first;
+        int startPos = r.first;
         unsigned slotNum = r.second;
-        short len = SpaceManager::instance()->getSlotLength(page, slotNum);
+        int len = SpaceManager::instance()->getSlotLength(page, pageSize, slotNum);
         if (len < 0) {
             cout << "The len should not be " << len << endl;
             return ERR_BAD_DATA;
         }
 
         // Set new slot start position
-        SpaceManager::instance()->setSlotStartPos(page, slotNum, offset);
+        SpaceManager::instance()->setSlotStartPos(page, pageSize, slotNum, offset);
         // Move
         memmove((char *)page + offset, (char *)page + startPos, (size_t) len);
         offset += len;
     }
 
     // Reset free pointer
-    SpaceManager::instance()->setFreePtr(page, offset);
+    SpaceManager::instance()->setFreePtr(page, pageSize, offset);
 
     // Write back
     if ((err = fileHandle.writePage(pageNumber, page)) != SUCCESSFUL) {
@@ -702,6 +1217,10 @@ RC RecordBasedFileManager::reorganizePage(FileHandle &fileHandle, const vector<A
 /**
  * Given a record descriptor, scan a file, i.e., sequentially read all the entries in the file.
  * (if the value is varchar, the format is [len][real string])
+ *
+ * In the parallel modes, the pages are read by the scan threads, which
+ * evaluate the condition and the projection (see ParallelScan); the
+ * iterator must then be closed before the file is.
  */
 RC RecordBasedFileManager::scan(FileHandle &fileHandle,
       const vector<Attribute> &recordDescriptor,
@@ -709,9 +1228,10 @@ RC RecordBasedFileManager::scan(FileHandle &fileHandle,
       const CompOp compOp,                  // comparision type such as "<" and "="
       const void *value,                    // used in the comparison
       const vector<string> &attributeNames, // a list of projected attributes
-      RBFM_ScanIterator &rbfm_ScanIterator) {
+      RBFM_ScanIterator &rbfm_ScanIterator,
+      ScanMode scanMode) {
 
-    if (!fileHandle.getFilePointer() ||
+    if (!fileHandle.isOpen() ||
          fileHandle.getNumberOfPages() < 0 ||
          fileHandle.getFileName() == NULL) {
         return ERR_BAD_HANDLE;
@@ -720,17 +1240,48 @@ RC RecordBasedFileManager::scan(FileHandle &fileHandle,
         return ERR_INV_COND;
     }
 
+    // A parallel scan still running on the iterator is stopped first
+    rbfm_ScanIterator.close();
+
+    // Resolve and compile the condition once for all records
     rbfm_ScanIterator.recordDescriptor = recordDescriptor;
-    rbfm_ScanIterator.conditionAttribute = conditionAttribute;
-    rbfm_ScanIterator.compOp = compOp;
-    rbfm_ScanIterator.value = (void *) value;
-    rbfm_ScanIterator.attributeNames = attributeNames;
+    rbfm_ScanIterator.conditionField = -1;
+    rbfm_ScanIterator.predicate.reset();
+    if (compOp != NO_OP) {
+        int fieldNum = __getFieldNum(recordDescriptor, conditionAttribute);
+        AttrType type = fieldNum < 0 ? TypeInt : recordDescriptor[fieldNum].type;
+        ScanPredicate *predicate = ScanPredicate::compile(type, compOp, value);
+        if (predicate == NULL) {
+            return ERR_INV_COND;
+        }
+        rbfm_ScanIterator.conditionField = fieldNum;
+        rbfm_ScanIterator.predicate.reset(predicate);
+    }
+
+    // Plan the projection: the fields to copy, in output order
+    rbfm_ScanIterator.projection.clear();
+    rbfm_ScanIterator.projectionWidth = 0;
+    rbfm_ScanIterator.projectAll = attributeNames.size() == recordDescriptor.size();
+    for (size_t i = 0; i < attributeNames.size(); i++) {
+        int fieldNum = __getFieldNum(recordDescriptor, attributeNames[i]);
+        rbfm_ScanIterator.projection.push_back(fieldNum);
+        rbfm_ScanIterator.projectionWidth = max(rbfm_ScanIterator.projectionWidth, (unsigned) (fieldNum + 1));
+        rbfm_ScanIterator.projectAll = rbfm_ScanIterator.projectAll && fieldNum == (int) i;
+    }
+    rbfm_ScanIterator.fieldBounds.resize(rbfm_ScanIterator.projectionWidth + 1);
     rbfm_ScanIterator.fileHandle = fileHandle;
 
     rbfm_ScanIterator.nextPageNum = 0;
     rbfm_ScanIterator.nextSlotNum = 0;
+    rbfm_ScanIterator.endPageNum = UINT_MAX;
+    rbfm_ScanIterator.readAheadEnd = 0;
     rbfm_ScanIterator.active = true;
 
+    // The scan threads copy the iterator as planned so far
+    if (scanMode != SCAN_SERIAL) {
+        rbfm_ScanIterator.parallelScan = make_shared<ParallelScan>(rbfm_ScanIterator,
+                scanMode == SCAN_PARALLEL_ORDERED);
+    }
     return SUCCESSFUL;
 }
 
@@ -746,52 +1297,413 @@ RC RecordBasedFileManager::reorganizeFile(FileHandle &fileHandle, const vector<A
 }
 
 /**
- * RBFM_ScanIterator Implementations.
+ * Give the disk space of pages left empty by deletions back to the file
+ * system: trailing ones are truncated, holes are punched over the others.
+ * Punched pages stay in the file (RIDs do not change) and are reused by
+ * later insertions. Nothing is reclaimed within a transaction, since the
+ * changes are not logged.
+ *
+ * @param fileHandle
+ * @return status
  */
-RBFM_ScanIterator::RBFM_ScanIterator() {
-    this->active = false;
+RC RecordBasedFileManager::reclaimSpace(FileHandle &fileHandle) {
+    if (!fileHandle.isOpen() || fileHandle.getFileName() == NULL) {
+        return ERR_BAD_HANDLE;
+    }
+    string fileName(fileHandle.getFileName());
+    return SpaceManager::instance()->reclaimSpace(fileName, fileHandle, true);
 }
 
-RBFM_ScanIterator::~RBFM_ScanIterator() {}
+/**
+ * RecordView Implementations.
+ */
+RecordView::RecordView()
+    : fileHandle(NULL), pageNum(0), page(NULL), record(NULL), recordLength(0),
+      recordFormat(SpaceManager::RECORD_FORMAT_PLAIN), headerSize(0), recordDescriptor(NULL) {
+}
 
-RC RBFM_ScanIterator::getNextRecord(RID &rid, void *data) {
+RecordView::~RecordView() {
+    release();
+}
+
+bool RecordView::isValid() const {
+    return record != NULL;
+}
+
+const char *RecordView::data() const {
+    return record == NULL ? NULL : record + headerSize;
+}
+
+unsigned RecordView::length() const {
+    return recordLength - headerSize;
+}
+
+RC RecordView::getInt(unsigned fieldNum, int &value) const {
+    const char *field;
+    unsigned size;
+    RC err = getField(fieldNum, field, size);
+    if (err != SUCCESSFUL) {
+        return err;
+    }
+    if ((*recordDescriptor)[fieldNum].type != TypeInt) {
+        return ERR_FORMAT;
+    }
+    memcpy(&value, field, sizeof(int));
+    return SUCCESSFUL;
+}
+
+RC RecordView::getReal(unsigned fieldNum, float &value) const {
+    const char *field;
+    unsigned size;
+    RC err = getField(fieldNum, field, size);
+    if (err != SUCCESSFUL) {
+        return err;
+    }
+    if ((*recordDescriptor)[fieldNum].type != TypeReal) {
+        return ERR_FORMAT;
+    }
+    memcpy(&value, field, sizeof(float));
+    return SUCCESSFUL;
+}
+
+RC RecordView::getVarChar(unsigned fieldNum, const char *&str, unsigned &length) const {
+    const char *field;
+    unsigned size;
+    RC err = getField(fieldNum, field, size);
+    if (err != SUCCESSFUL) {
+        return err;
+    }
+    if ((*recordDescriptor)[fieldNum].type != TypeVarChar) {
+        return ERR_FORMAT;
+    }
+    str = field + sizeof(int);
+    length = size - sizeof(int);
+    return SUCCESSFUL;
+}
+
+RC RecordView::getField(unsigned fieldNum, const char *&field, unsigned &size) const {
+    if (record == NULL) {
+        return ERR_RECORD_NOT_FOUND;
+    }
+    unsigned offset;
+    RC err = RecordBasedFileManager::__locateField(record, recordLength, recordFormat,
+                                                   *recordDescriptor, fieldNum, offset, size);
+    if (err != SUCCESSFUL) {
+        return err;
+    }
+    field = record + offset;
+    return SUCCESSFUL;
+}
+
+RC RecordView::release() {
+    record = NULL;
+    recordLength = 0;
+    headerSize = 0;
+    if (fileHandle == NULL) {
+        return SUCCESSFUL;
+    }
+    FileHandle *handle = fileHandle;
+    fileHandle = NULL;
+    return handle->unpinPage(pageNum, false);
+}
+
+RC RecordView::attach(FileHandle &fileHandle, PageNum pageNum, void *&page) {
+    if (this->fileHandle != NULL && this->fileHandle->getFileId() == fileHandle.getFileId()
+            && this->pageNum == pageNum) {
+        record = NULL;
+        page = this->page;
+        return SUCCESSFUL;
+    }
+
+    // Pin first: the page held so far may be the one leading here (a tomb stone)
+    RC err = fileHandle.pinPage(pageNum, page);
+    release();
+    if (err != SUCCESSFUL) {
+        return err;
+    }
+    this->fileHandle = &fileHandle;
+    this->pageNum = pageNum;
+    this->page = page;
+    return SUCCESSFUL;
+}
+
+/**
+ * RecordBatch Implementations.
+ */
+RecordBatch::RecordBatch() {
+    offsets.push_back(0);
+}
+
+unsigned RecordBatch::size() const {
+    return rids.size();
+}
+
+const RID &RecordBatch::getRid(unsigned i) const {
+    return rids[i];
+}
+
+const char *RecordBatch::getRecord(unsigned i) const {
+    return data.data() + offsets[i];
+}
+
+unsigned RecordBatch::getRecordSize(unsigned i) const {
+    return offsets[i + 1] - offsets[i];
+}
+
+void RecordBatch::clear() {
+    rids.clear();
+    offsets.resize(1);
+}
+
+/**
+ * RBFM_ScanIterator Implementations.
+ */
+RBFM_ScanIterator::RBFM_ScanIterator() {
+    this->conditionField = -1;
+    this->selectionStart = 0;
+    this->selectionEnd = 0;
+    this->blockSize = MIN_BLOCK_SIZE;
+    this->endPageNum = UINT_MAX;
+    this->active = false;
+}
+
+RBFM_ScanIterator::~RBFM_ScanIterator() {}
+
+RC RBFM_ScanIterator::getNextRecord(RID &rid, void *data) {
+    if (parallelScan && parallelScan->isInPlace()) {
+        // Left in place for the views read so far
+        void *page;
+        int startPos, recordLen;
+        if (parallelScan->nextInPlace(rid, page, startPos, recordLen) != SUCCESSFUL) {
+            return RBFM_EOF;
+        }
+        lock_guard<mutex> latch(SpaceManager::instance()->getPageLatch(fileHandle, rid.pageNum));
+        unsigned size;
+        return projectRecord(page, startPos, recordLen, (char *) data, size) == SUCCESSFUL ? SUCCESSFUL : RBFM_EOF;
+    }
+    if (parallelScan) {
+        const char *record;
+        unsigned size;
+        if (parallelScan->next(rid, record, size) != SUCCESSFUL) {
+            return RBFM_EOF;
+        }
+        memcpy(data, record, size);
+        return SUCCESSFUL;
+    }
+
+    void *page;
+    int startPos, recordLen;
+    unique_lock<mutex> latch;
+    if (findNextRecord(page, startPos, recordLen, latch) != SUCCESSFUL) {
+        return RBFM_EOF;
+    }
+
+    // Read data and assemble results
+    unsigned size;
+    RC err = projectRecord(page, startPos, recordLen, (char *) data, size);
+    latch.unlock();
+    fileHandle.unpinPage(nextPageNum, false);
+    if (err != SUCCESSFUL) {
+        __trace();
+        return RBFM_EOF;
+    }
+
+    // Update rid and next slot to visit
+    rid.pageNum = nextPageNum;
+    rid.slotNum = nextSlotNum++;
+    return SUCCESSFUL;
+}
+
+/**
+ * Same as getNextRecord(), for up to maxRecords records at once: the
+ * records of a page are all taken while it is pinned, and the batch keeps
+ * its buffers from one call to the next.
+ *
+ * @param maxRecords
+ * @param batch
+ *          (return) the records, RBFM_EOF if none is left.
+ * @return status
+ */
+RC RBFM_ScanIterator::getNextBatch(unsigned maxRecords, RecordBatch &batch) {
+    batch.clear();
+    if (!parallelScan) {
+        return fillBatch(maxRecords, batch);
+    }
+
+    RID rid;
+    const char *record;
+    unsigned size;
+    while (batch.size() < maxRecords && !parallelScan->isInPlace() && parallelScan->next(rid, record, size) == SUCCESSFUL) {
+        unsigned used = batch.offsets.back();
+        if (used + size > batch.data.size()) {
+            batch.data.resize(max(2 * batch.data.size(), (size_t) used + size));
+        }
+        memcpy(&batch.data[used], record, size);
+        batch.rids.push_back(rid);
+        batch.offsets.push_back(used + size);
+    }
+
+    // Left in place for the views read so far
+    void *page;
+    int startPos, recordLen;
+    while (batch.size() < maxRecords && parallelScan->isInPlace()
+            && parallelScan->nextInPlace(rid, page, startPos, recordLen) == SUCCESSFUL) {
+        unsigned used = batch.offsets.back();
+        size_t maxSize = (size_t) recordLen * max(projection.size(), (size_t) 1);
+        if (used + maxSize > batch.data.size()) {
+            batch.data.resize(max(2 * batch.data.size(), used + maxSize));
+        }
+        lock_guard<mutex> latch(SpaceManager::instance()->getPageLatch(fileHandle, rid.pageNum));
+        if (projectRecord(page, startPos, recordLen, &batch.data[used], size) != SUCCESSFUL) {
+            __trace();
+            break;
+        }
+        batch.rids.push_back(rid);
+        batch.offsets.push_back(used + size);
+    }
+    return batch.size() > 0 ? SUCCESSFUL : RBFM_EOF;
+}
+
+RC RBFM_ScanIterator::fillBatch(unsigned maxRecords, RecordBatch &batch) {
+    while (batch.size() < maxRecords) {
+        void *page;
+        int startPos, recordLen;
+        unique_lock<mutex> latch;
+        if (findNextRecord(page, startPos, recordLen, latch) != SUCCESSFUL) {
+            break;
+        }
+
+        RC err = SUCCESSFUL;
+        do {
+            // A projection is never larger than its fields, each at most the record
+            unsigned used = batch.offsets.back();
+            size_t maxSize = (size_t) recordLen * max(projection.size(), (size_t) 1);
+            if (used + maxSize > batch.data.size()) {
+                batch.data.resize(max(2 * batch.data.size(), used + maxSize));
+            }
+            unsigned size;
+            if ((err = projectRecord(page, startPos, recordLen, &batch.data[used], size)) != SUCCESSFUL) {
+                break;
+            }
+            RID rid;
+            rid.pageNum = nextPageNum;
+            rid.slotNum = nextSlotNum++;
+            batch.rids.push_back(rid);
+            batch.offsets.push_back(used + size);
+        } while (batch.size() < maxRecords && findSlot(page, startPos, recordLen));
+        latch.unlock();
+        fileHandle.unpinPage(nextPageNum, false);
+        if (err != SUCCESSFUL) {
+            __trace();
+            break;
+        }
+    }
+    return batch.size() > 0 ? SUCCESSFUL : RBFM_EOF;
+}
+
+/**
+ * Same as getNextRecord(), but the whole record is read in place: the view
+ * keeps the page pinned until it is released or moved to the next record
+ * (which keeps the pin when it is on the same page).
+ */
+RC RBFM_ScanIterator::getNextRecordView(RID &rid, RecordView &view) {
+    void *page;
+    int startPos, recordLen;
+    RC err;
+    if (parallelScan) {
+        // Unless records were copied out so far, the scan threads leave them in place
+        if (parallelScan->nextInPlace(rid, page, startPos, recordLen) == SUCCESSFUL) {
+            if ((err = attachView(view, rid.pageNum, startPos, recordLen)) != SUCCESSFUL) {
+                __trace();
+                return RBFM_EOF;
+            }
+            return SUCCESSFUL;
+        }
+        // Otherwise read the records copied out again in place
+        const char *record;
+        unsigned size;
+        while (!parallelScan->isInPlace() && parallelScan->next(rid, record, size) == SUCCESSFUL) {
+            if (RecordBasedFileManager::instance()->readRecordView(fileHandle, recordDescriptor,
+                    rid, view) == SUCCESSFUL) {
+                return SUCCESSFUL;
+            }
+        }
+        view.release();
+        return RBFM_EOF;
+    }
+
+    unique_lock<mutex> latch;
+    if (findNextRecord(page, startPos, recordLen, latch) != SUCCESSFUL) {
+        view.release();
+        return RBFM_EOF;
+    }
+    latch.unlock();
+
+    // The view pins the page itself (at most once), then our pin is dropped
+    err = attachView(view, nextPageNum, startPos, recordLen);
+    fileHandle.unpinPage(nextPageNum, false);
+    if (err != SUCCESSFUL) {
+        __trace();
+        return RBFM_EOF;
+    }
+
+    rid.pageNum = nextPageNum;
+    rid.slotNum = nextSlotNum++;
+    return SUCCESSFUL;
+}
+
+RC RBFM_ScanIterator::attachView(RecordView &view, PageNum pageNum, int startPos, int recordLen) {
+    void *page;
+    RC err = view.attach(fileHandle, pageNum, page);
+    if (err != SUCCESSFUL) {
+        return err;
+    }
+    view.record = (const char *) page + startPos;
+    view.recordLength = recordLen;
+    view.recordFormat = SpaceManager::instance()->getRecordFormat(page, fileHandle.getPageSize());
+    view.headerSize = RecordBasedFileManager::__getHeaderSize(view.record, view.recordFormat);
+    view.recordDescriptor = &this->recordDescriptor;
+    return SUCCESSFUL;
+}
+
+/**
+ * Move to the next record meeting the criterion. On success its page is
+ * pinned and latched, nextPageNum and nextSlotNum point to it.
+ */
+RC RBFM_ScanIterator::findNextRecord(void *&page, int &startPos, int &recordLen, unique_lock<mutex> &latch) {
     if (!this->active) {
         return RBFM_EOF;
     }
 
-    unsigned pageCount = fileHandle.getNumberOfPages();
-    void *page = SpaceManager::getPageBuffer();
-    unsigned slotCount;
+    unsigned pageCount = min(fileHandle.getNumberOfPages(), endPageNum);
 
     // Scan slots onward until finding the first record meeting the criterion
-    short startPos = -1;
-    short recordLen = -1;
+    startPos = -1;
+    recordLen = -1;
     bool foundNext = false;
     while (nextPageNum < pageCount) {
-        if (fileHandle.readPage(nextPageNum, page) != SUCCESSFUL) {
-            __trace();
-            return RBFM_EOF;
+        // Pages known to be empty are not read at all
+        if (nextSlotNum == 0 && SpaceManager::instance()->isFreePage(fileHandle, nextPageNum)) {
+            nextPageNum++;
+            continue;
         }
 
-        slotCount = SpaceManager::instance()->getSlotCount(page);
-        while (nextSlotNum < slotCount) {
-            short s = SpaceManager::instance()->getSlotStartPos(page, nextSlotNum);
-            short len = SpaceManager::instance()->getSlotLength(page, nextSlotNum);
-            if (SpaceManager::instance()->isOccupiedSlot(s, len)) {
-                // Check condition
-                if (meetCriterion(page, (unsigned) s, (unsigned) len)) {
-                    foundNext = true;
-                    startPos = s;
-                    recordLen = len;
-                    break;
-                }
-            }
-            nextSlotNum++;
+        // Read the following pages in the background (failures show up again in pinPage())
+        fileHandle.readAhead(nextPageNum, readAheadEnd);
+        if (fileHandle.pinPage(nextPageNum, page) != SUCCESSFUL) {
+            __trace();
+            return RBFM_EOF;
         }
+        latch = unique_lock<mutex>(SpaceManager::instance()->getPageLatch(fileHandle, nextPageNum));
+        // The page may have changed since it was last latched
+        selectionEnd = selectionStart = 0;
+        blockSize = MIN_BLOCK_SIZE;
 
-        if (foundNext) {
+        if ((foundNext = findSlot(page, startPos, recordLen))) {
             break;
         } else {  // Get next page
+            latch.unlock();
+            fileHandle.unpinPage(nextPageNum, false);
             nextPageNum++;
             nextSlotNum = 0;
         }
@@ -799,204 +1711,883 @@ RC RBFM_ScanIterator::getNextRecord(RID &rid, void *data) {
     if (!foundNext) {
         return RBFM_EOF;
     }
+    return SUCCESSFUL;
+}
 
-    // Read data and assemble results
-    unsigned offset = 0;
-    for (size_t i = 0; i < attributeNames.size(); i++) {
-        char attData[recordLen];
-        char *attPtr = attData;
-        unsigned dataSize;
-        if (RecordBasedFileManager::instance()->__readAttribute(page, startPos,
-                this->recordDescriptor, attributeNames[i], &attData, dataSize) != SUCCESSFUL) {
+/**
+ * Move nextSlotNum to the next record of a page meeting the criterion,
+ * from nextSlotNum on. Conditions on ints and reals are evaluated by blocks
+ * of slots (see evaluateBlock()), and the slots left out are skipped.
+ */
+bool RBFM_ScanIterator::findSlot(const void *page, int &startPos, int &recordLen) {
+    unsigned pageSize = fileHandle.getPageSize();
+    unsigned slotCount = SpaceManager::instance()->getSlotCount(page, pageSize);
+    bool columnar = predicate && conditionField >= 0 && predicate->isColumnar();
+    while (nextSlotNum < slotCount) {
+        if (columnar) {
+            if (nextSlotNum < selectionStart || nextSlotNum >= selectionEnd) {
+                evaluateBlock(page, slotCount);
+            }
+            // Skip to the next slot selected in the block
+            unsigned i = nextSlotNum - selectionStart;
+            unsigned long long word = selection[i / 64] >> (i % 64);
+            while (word == 0 && (i = (i / 64 + 1) * 64) < selectionEnd - selectionStart) {
+                word = selection[i / 64];
+            }
+            if (word == 0) {
+                nextSlotNum = selectionEnd;
+                continue;
+            }
+            nextSlotNum = selectionStart + i + __builtin_ctzll(word);
+        }
+        int s = SpaceManager::instance()->getSlotStartPos(page, pageSize, nextSlotNum);
+        int len = SpaceManager::instance()->getSlotLength(page, pageSize, nextSlotNum);
+        if (SpaceManager::instance()->isOccupiedSlot(s, len, pageSize)) {
+            // Check condition
+            if (columnar || meetCriterion(page, (unsigned) s, (unsigned) len)) {
+                startPos = s;
+                recordLen = len;
+                return true;
+            }
+        }
+        nextSlotNum++;
+    }
+    return false;
+}
+
+/**
+ * Copy the projected fields of a record: they are located in one go
+ * (see __locateFields()), then copied in output order.
+ */
+RC RBFM_ScanIterator::projectRecord(const void *page, int startPos, int recordLen, char *data, unsigned &size) {
+    const char *record = (const char *) page + startPos;
+    unsigned format = SpaceManager::instance()->getRecordFormat(page, fileHandle.getPageSize());
+    size = 0;
+    if (projectAll) {
+        unsigned headerSize = RecordBasedFileManager::__getHeaderSize(record, format);
+        size = recordLen - headerSize;
+        memcpy(data, record + headerSize, size);
+        return SUCCESSFUL;
+    }
+    if (projection.empty()) {
+        return SUCCESSFUL;
+    }
+
+    unsigned *bounds = &fieldBounds[0];
+    RC err = RecordBasedFileManager::__locateFields(record, recordLen, format, this->recordDescriptor,
+                                                    projectionWidth, bounds);
+    if (err != SUCCESSFUL) {
+        return err;
+    }
+    for (size_t i = 0; i < projection.size(); i++) {
+        int fieldNum = projection[i];
+        if (fieldNum < 0) {
+            return ERR_ATTR_NOT_FOUND;
+        }
+        unsigned fieldSize = bounds[fieldNum + 1] - bounds[fieldNum];
+        memcpy(data + size, record + bounds[fieldNum], fieldSize);
+        size += fieldSize;
+    }
+    return SUCCESSFUL;
+}
+
+RC RBFM_ScanIterator::close() {
+    this->active = false;
+    if (parallelScan) {
+        parallelScan->cancel();
+        parallelScan.reset();
+    }
+    return SUCCESSFUL;
+}
+
+bool RBFM_ScanIterator::meetCriterion(const void *page, unsigned startPos, unsigned length) {
+    if (!predicate) {
+        return true;
+    }
+    if (conditionField < 0) {   // the attribute is not in the record
+        return false;
+    }
+
+    const char *record = (const char *) page + startPos;
+    unsigned format = SpaceManager::instance()->getRecordFormat(page, fileHandle.getPageSize());
+    unsigned offset, size;
+    if (RecordBasedFileManager::__locateField(record, length, format, recordDescriptor,
+            conditionField, offset, size) != SUCCESSFUL) {
+        __trace();
+        return false;
+    }
+    return predicate->evaluate(record + offset, size);
+}
+
+/**
+ * Gather the condition field of the next slots of a page (from nextSlotNum
+ * on) into a column, and evaluate the condition over all of it at once.
+ * The evaluation is lost when the page is unlatched, so blocks start small
+ * and double while it stays latched: a scan returning one record at a time
+ * evaluates at most about twice the slots it walks through.
+ */
+void RBFM_ScanIterator::evaluateBlock(const void *page, unsigned slotCount) {
+    unsigned pageSize = fileHandle.getPageSize();
+    unsigned format = SpaceManager::instance()->getRecordFormat(page, pageSize);
+    unsigned count = min(slotCount - nextSlotNum, blockSize);
+    unsigned words = (count + 63) / 64;
+    selectionStart = nextSlotNum;
+    selectionEnd = nextSlotNum + count;
+    blockSize = min(2 * blockSize, (unsigned) MAX_BLOCK_SIZE);
+
+    columnValues.resize(count * sizeof(int));
+    selection.resize(words);
+    occupied.assign(words, 0);
+    for (unsigned i = 0; i < count; i++) {
+        char *value = &columnValues[i * sizeof(int)];
+        int s = SpaceManager::instance()->getSlotStartPos(page, pageSize, selectionStart + i);
+        int len = SpaceManager::instance()->getSlotLength(page, pageSize, selectionStart + i);
+        unsigned offset, size;
+        if (SpaceManager::instance()->isOccupiedSlot(s, len, pageSize)
+                && RecordBasedFileManager::__locateField((const char *) page + s, len, format,
+                        recordDescriptor, conditionField, offset, size) == SUCCESSFUL
+                && size == sizeof(int)) {
+            memcpy(value, (const char *) page + s + offset, sizeof(int));
+            occupied[i / 64] |= 1ULL << (i % 64);
+        } else {
+            memset(value, 0, sizeof(int));
+        }
+    }
+    predicate->evaluateColumn(&columnValues[0], count, &selection[0]);
+    for (unsigned w = 0; w < words; w++) {
+        selection[w] &= occupied[w];
+    }
+}
+
+/**
+ * Threads reading pages for parallel scans: they run the tasks handed to
+ * them in order, and live until the process exits.
+ */
+class ScanThreadPool {
+public:
+    static ScanThreadPool *instance() {
+        static ScanThreadPool *pool = new ScanThreadPool(RecordBasedFileManager::getScanThreads());
+        return pool;
+    }
+
+    unsigned getThreadCount() const {
+        return threadCount;
+    }
+
+    void submit(const function<void()> &task) {
+        lock_guard<mutex> guard(latch);
+        tasks.push_back(task);
+        queued.notify_one();
+    }
+
+private:
+    ScanThreadPool(unsigned threadCount) : threadCount(threadCount) {
+        for (unsigned i = 0; i < threadCount; i++) {
+            thread(&ScanThreadPool::runWorker, this).detach();
+        }
+    }
+
+    void runWorker() {
+        while (true) {
+            function<void()> task;
+            {
+                unique_lock<mutex> lock(latch);
+                while (tasks.empty()) {
+                    queued.wait(lock);
+                }
+                task.swap(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+    unsigned threadCount;
+    mutex latch;
+    condition_variable queued;
+    deque<function<void()> > tasks;
+};
+
+/**
+ * ParallelScan Implementations. Morsels are handed out and taken under the
+ * latch, once per morsel rather than once per record.
+ */
+ParallelScan::ParallelScan(const RBFM_ScanIterator &plan, bool ordered)
+    : plan(plan), ordered(ordered), inPlace(false), cancelled(false), nextPage(0), nextMorsel(0),
+      nextResult(0), inFlight(0), running(0), cursor(0) {
+    // The scan threads share the file: positional reads, not a stdio stream
+    if (this->plan.fileHandle.getIOMode() == IO_STDIO) {
+        this->plan.fileHandle.setIOMode(IO_PREAD);
+    }
+}
+
+unsigned ParallelScan::Morsel::size() const {
+    return max((unsigned) spots.size(), batch.size());
+}
+
+/**
+ * Get the next record found by the scan threads: the next one of the
+ * current morsel, or the first one of the next morsel scanned (the next in
+ * file order if the scan is ordered), waiting for it if needed.
+ *
+ * @param rid
+ * @param data
+ *          (return) the projected record, valid until the next call
+ * @param size
+ *          (return) its size
+ * @return status, RBFM_EOF at the end of the scan (or if records are left in place)
+ */
+RC ParallelScan::next(RID &rid, const char *&data, unsigned &size) {
+    if (inPlace || !takeMorsel()) {
+        return RBFM_EOF;
+    }
+    rid = current.batch.getRid(cursor);
+    data = current.batch.getRecord(cursor);
+    size = current.batch.getRecordSize(cursor);
+    cursor++;
+    return SUCCESSFUL;
+}
+
+/**
+ * Same as next(), but the record is left in its page, which stays pinned
+ * until the next morsel is taken. Unless next() was called first, the
+ * scan threads leave all records in place.
+ *
+ * @param rid
+ * @param page
+ *          (return) the page of the record
+ * @param startPos
+ * @param recordLen
+ *          (return) the record as stored in the page
+ * @return status, RBFM_EOF at the end of the scan (or if records are copied out)
+ */
+RC ParallelScan::nextInPlace(RID &rid, void *&page, int &startPos, int &recordLen) {
+    if (nextMorsel == 0) {
+        inPlace = true;
+    }
+    if (!inPlace || !takeMorsel()) {
+        return RBFM_EOF;
+    }
+    const RecordSpot &spot = current.spots[cursor++];
+    rid = spot.rid;
+    page = spot.page;
+    startPos = spot.startPos;
+    recordLen = spot.recordLen;
+    return SUCCESSFUL;
+}
+
+bool ParallelScan::isInPlace() const {
+    return inPlace;
+}
+
+bool ParallelScan::takeMorsel() {
+    while (cursor >= current.size()) {
+        releasePages(current);
+        unique_lock<mutex> lock(latch);
+        dispatch();
+        map<unsigned, Morsel>::iterator it;
+        while ((it = ordered ? results.find(nextResult) : results.begin()) == results.end()) {
+            if (inFlight == 0) {    // dispatch() found no page left
+                return false;
+            }
+            scanned.wait(lock);
+        }
+        swap(current, it->second);
+        results.erase(it);
+        inFlight--;
+        nextResult++;
+        cursor = 0;
+        dispatch();
+    }
+    return true;
+}
+
+/**
+ * Unpin the pages a morsel left its records in, and empty it.
+ */
+void ParallelScan::releasePages(Morsel &morsel) {
+    for (size_t i = 0; i < morsel.pinnedPages.size(); i++) {
+        plan.fileHandle.unpinPage(morsel.pinnedPages[i], false);
+    }
+    morsel.pinnedPages.clear();
+    morsel.spots.clear();
+    morsel.batch.clear();
+}
+
+void ParallelScan::cancel() {
+    unique_lock<mutex> lock(latch);
+    cancelled = true;
+    while (running > 0) {
+        scanned.wait(lock);
+    }
+    for (map<unsigned, Morsel>::iterator it = results.begin(); it != results.end(); it++) {
+        releasePages(it->second);
+    }
+    results.clear();
+    releasePages(current);
+    cursor = 0;
+}
+
+/**
+ * Hand out morsels to the scan threads until the window is full or every
+ * page of the file has been handed out (pages appended meanwhile included).
+ */
+void ParallelScan::dispatch() {
+    ScanThreadPool *pool = ScanThreadPool::instance();
+    unsigned window = MORSELS_PER_THREAD * pool->getThreadCount();
+    PageNum pageCount = plan.fileHandle.getNumberOfPages();
+    while (!cancelled && inFlight < window && nextPage < pageCount) {
+        shared_ptr<ParallelScan> self = shared_from_this();
+        unsigned morselNum = nextMorsel++;
+        PageNum startPage = nextPage;
+        PageNum endPage = min(startPage + MORSEL_PAGES, pageCount);
+        pool->submit([self, morselNum, startPage, endPage] {
+            self->scanMorsel(morselNum, startPage, endPage);
+        });
+        nextPage = endPage;
+        inFlight++;
+        running++;
+    }
+}
+
+/**
+ * Scan the pages of a morsel with a copy of the planned iterator, which
+ * evaluates the condition and the projection as a serial scan does.
+ */
+void ParallelScan::scanMorsel(unsigned morselNum, PageNum startPage, PageNum endPage) {
+    Morsel morsel;
+    if (!cancelled) {
+        RBFM_ScanIterator iterator(plan);
+        iterator.nextPageNum = startPage;
+        iterator.endPageNum = endPage;
+        iterator.readAheadEnd = startPage;
+        if (!inPlace) {
+            iterator.fillBatch(UINT_MAX, morsel.batch);
+        }
+
+        // The pages with records stay pinned for the reader
+        void *page;
+        RecordSpot spot;
+        unique_lock<mutex> latch;
+        while (inPlace && iterator.findNextRecord(page, spot.startPos, spot.recordLen, latch) == SUCCESSFUL) {
+            spot.page = page;
+            do {
+                spot.rid.pageNum = iterator.nextPageNum;
+                spot.rid.slotNum = iterator.nextSlotNum++;
+                morsel.spots.push_back(spot);
+            } while (iterator.findSlot(page, spot.startPos, spot.recordLen));
+            latch.unlock();
+            morsel.pinnedPages.push_back(iterator.nextPageNum);
+        }
+    }
+
+    lock_guard<mutex> guard(latch);
+    swap(results[morselNum], morsel);
+    running--;
+    scanned.notify_all();
+}
+
+/**
+ * ScanPredicate Implementations: one class per type, instantiated per
+ * operator with the comparison function objects of the standard library.
+ */
+template <class T, class Compare>
+class NumberPredicate : public ScanPredicate {
+public:
+    NumberPredicate(CompOp compOp, const void *value) : compOp(compOp) {
+        memcpy(&constant, value, sizeof(T));
+    }
+
+    bool evaluate(const char *field, unsigned size) const {
+        T number;
+        memcpy(&number, field, sizeof(T));
+        return Compare()(number, constant);
+    }
+
+    bool isColumnar() const {
+        return true;
+    }
+
+    // The comparison kernels take the operator itself (see simd.h)
+    void evaluateColumn(const char *values, unsigned count, unsigned long long *selection) const {
+        compareColumn((const T *) values, count, compOp, constant, selection);
+    }
+
+private:
+    CompOp compOp;
+    T constant;
+};
+
+// Strings compare as std::string::compare() does: bytes, then lengths
+template <class Compare>
+class StringPredicate : public ScanPredicate {
+public:
+    StringPredicate(const void *value) {
+        int len;
+        memcpy(&len, value, sizeof(int));
+        constant.assign((const char *) value + sizeof(int), len);
+    }
+
+    bool evaluate(const char *field, unsigned size) const {
+        size_t len = size - sizeof(int);
+        int cmp = memcmp(field + sizeof(int), constant.data(), min(len, constant.size()));
+        if (cmp == 0) {
+            cmp = (len > constant.size()) - (len < constant.size());
+        }
+        return Compare()(cmp, 0);
+    }
+
+private:
+    string constant;
+};
+
+template <template <class> class Compare>
+static ScanPredicate *compilePredicate(AttrType type, CompOp compOp, const void *value) {
+    switch (type) {
+    case TypeInt:
+        return new NumberPredicate<int, Compare<int> >(compOp, value);
+    case TypeReal:
+        return new NumberPredicate<float, Compare<float> >(compOp, value);
+    case TypeVarChar:
+        return new StringPredicate<Compare<int> >(value);
+    default:
+        return NULL;
+    }
+}
+
+ScanPredicate *ScanPredicate::compile(AttrType type, CompOp compOp, const void *value) {
+    switch (compOp) {
+    case EQ_OP:
+        return compilePredicate<equal_to>(type, compOp, value);
+    case LT_OP:
+        return compilePredicate<less>(type, compOp, value);
+    case GT_OP:
+        return compilePredicate<greater>(type, compOp, value);
+    case LE_OP:
+        return compilePredicate<less_equal>(type, compOp, value);
+    case GE_OP:
+        return compilePredicate<greater_equal>(type, compOp, value);
+    case NE_OP:
+        return compilePredicate<not_equal_to>(type, compOp, value);
+    case NO_OP:
+    default:
+        return NULL;
+    }
+}
+
+
+/**
+ * Space Manager Implementations
+ */
+typedef map<int, set<int> > FreeSpaceMap;    // <free space size, corresponding locations (page #)>
+
+SpaceManager* SpaceManager::_sp_manager = 0;
+
+SpaceManager::SpaceManager() {
+    LogManager::instance()->addCheckpointHook([this]() { return saveFreeSpaceMaps(); });
+}
+
+SpaceManager::~SpaceManager() {
+    for (unsigned i = 0; i < __freeSpace.size(); i++) {
+        delete __freeSpace[i];
+    }
+}
+
+SpaceManager::FreeSpaceIndex::FreeSpaceIndex(unsigned pageSize)
+        : pageSize(pageSize), openCount(0) {
+    for (int i = 0; i < FSM_STEPS; i++) {
+        heads[i] = -1;
+    }
+    memset(nonEmpty, 0, sizeof(nonEmpty));
+}
+
+SpaceManager* SpaceManager::instance() {
+    if (_sp_manager == NULL) {
+        _sp_manager = new SpaceManager();
+    }
+    return _sp_manager;
+}
+
+/**
+ * Get the name of the file persisting the free space map of a file.
+ *
+ * @param fileName
+ * @return name of the map file
+ */
+string SpaceManager::getFreeSpaceFileName(const string &fileName) {
+    return fileName + ".fsm";
+}
+
+/**
+ * Make the free space map of a file available to a new rbfm handle. The
+ * first handle loads the map saved by the last close or checkpoint, which
+ * costs one byte per page instead of a read of every page; if there is
+ * none (the file was not closed properly, or was changed by other means)
+ * the map is rebuilt from the pages. The saved map is marked stale until
+ * the next checkpoint or the close of the last handle.
+ *
+ * @param fileName
+ * @param fileHandle
+ * @return status
+ */
+RC SpaceManager::openFreeSpaceMap(const string &fileName, FileHandle &fileHandle) {
+    lock_guard<recursive_mutex> guard(__latch);
+    RC err;
+    FreeSpaceIndex &index = getIndex(fileHandle);
+    if (index.openCount++ > 0) {
+        return SUCCESSFUL;
+    }
+    index.handle = fileHandle;
+
+    if (loadFreeSpaceMap(fileName, fileHandle) != SUCCESSFUL
+            && (err = bufferSizeInfo(fileName, fileHandle)) != SUCCESSFUL) {
+        __trace();
+        eraseIndex(fileHandle);
+        return err;
+    }
+    if (fileHandle.getFreeSpaceRoot() != NULL_PAGE
+            && (err = fileHandle.setFreeSpaceRoot(NULL_PAGE)) != SUCCESSFUL) {
+        __trace();
+        eraseIndex(fileHandle);
+        return err;
+    }
+    return SUCCESSFUL;
+}
+
+/**
+ * Release the free space map of a file for an rbfm handle being closed.
+ * The last handle cuts the trailing empty pages off and saves the map
+ * (unless the file has been destroyed).
+ *
+ * @param fileName
+ * @param fileHandle
+ * @return status
+ */
+RC SpaceManager::closeFreeSpaceMap(const string &fileName, FileHandle &fileHandle) {
+    lock_guard<recursive_mutex> guard(__latch);
+    FreeSpaceIndex *index = findIndex(fileHandle);
+    if (index == NULL) {
+        return SUCCESSFUL;
+    }
+    if (--index->openCount > 0) {
+        return SUCCESSFUL;
+    }
+    if (fileHandle.isRemoved()) {
+        eraseIndex(fileHandle);
+        return SUCCESSFUL;
+    }
+
+    RC err = reclaimSpace(fileName, fileHandle, false);
+    if (err == SUCCESSFUL) {
+        err = saveFreeSpaceMap(fileName, fileHandle);
+    }
+    eraseIndex(fileHandle);
+    return err;
+}
+
+/**
+ * Save the free space maps of all open files which changed since they were
+ * saved, so that files which stay open do not have their maps rebuilt from
+ * all pages after a crash. Run at every checkpoint of the log.
+ *
+ * @return status
+ */
+RC SpaceManager::saveFreeSpaceMaps() {
+    lock_guard<recursive_mutex> guard(__latch);
+    RC err;
+    for (unsigned i = 0; i < __freeSpace.size(); i++) {
+        FreeSpaceIndex *index = __freeSpace[i];
+        if (index == NULL || index->handle.isRemoved()
+                || (index->handle.getFreeSpaceRoot() != NULL_PAGE
+                    && find(index->dirtyPages.begin(), index->dirtyPages.end(), true) == index->dirtyPages.end())) {
+            continue;
+        }
+        if ((err = saveFreeSpaceMap(index->handle.getFileName(), index->handle)) != SUCCESSFUL) {
             __trace();
-            return RBFM_EOF;
+            return err;
         }
-        memcpy((char *)data + offset, attPtr, dataSize);
-        offset += dataSize;
     }
-
-    // Update rid and next slot to visit
-    rid.pageNum = nextPageNum;
-    rid.slotNum = nextSlotNum++;
     return SUCCESSFUL;
 }
 
-RC RBFM_ScanIterator::close() {
-    this->active = false;
-    return SUCCESSFUL;
+/**
+ * Load the free space map of a file from its map file, if the header of
+ * the file says that the map is up to date.
+ *
+ * @param fileName
+ * @param fileHandle
+ * @return status (ERR_MAP_ENTRY_NOT_FOUND if there is no such map)
+ */
+RC SpaceManager::loadFreeSpaceMap(const string &fileName, FileHandle &fileHandle) {
+    RC err;
+    if (fileHandle.getFreeSpaceRoot() == NULL_PAGE) {
+        return ERR_MAP_ENTRY_NOT_FOUND;
+    }
+    PagedFileManager *pfm = PagedFileManager::instance();
+    FileHandle mapHandle;
+    if (pfm->openFile(getFreeSpaceFileName(fileName).c_str(), mapHandle) != SUCCESSFUL) {
+        return ERR_MAP_ENTRY_NOT_FOUND;
+    }
+
+    clearFreeSpaceMap(fileHandle);
+    FreeSpaceIndex &index = getIndex(fileHandle);
+    unsigned pageCount = fileHandle.getNumberOfPages();
+    unsigned mapPageCount = (pageCount + FSM_PAGE_ENTRIES - 1) / FSM_PAGE_ENTRIES;
+    if (mapHandle.getNumberOfPages() < mapPageCount) {
+        pfm->closeFile(mapHandle);
+        return ERR_MAP_ENTRY_NOT_FOUND;
+    }
+    index.pages.resize(pageCount);
+    for (unsigned i = 0; i < mapPageCount; i++) {
+        unsigned char mapPage[PAGE_SIZE];
+        if ((err = mapHandle.readPage(i, mapPage)) != SUCCESSFUL) {
+            __trace();
+            pfm->closeFile(mapHandle);
+            clearFreeSpaceMap(fileHandle);
+            return err;
+        }
+        unsigned first = i * FSM_PAGE_ENTRIES;
+        unsigned count = min((unsigned) FSM_PAGE_ENTRIES, pageCount - first);
+        for (unsigned j = 0; j < count; j++) {
+            if (mapPage[j] != 0) {
+                linkPage(index, first + j, fromCategory(mapPage[j], index.pageSize));
+            }
+        }
+    }
+    index.dirtyPages.assign(index.dirtyPages.size(), false);
+    return pfm->closeFile(mapHandle);
 }
 
-bool RBFM_ScanIterator::meetCriterion(void *page, unsigned short startPos, unsigned short length) {
-    if (compOp == NO_OP) {
-        return true;
+/**
+ * Write the pages of the free space map changed since it was loaded, then
+ * point the header of the file to the map.
+ *
+ * @param fileName
+ * @param fileHandle
+ * @return status
+ */
+RC SpaceManager::saveFreeSpaceMap(const string &fileName, FileHandle &fileHandle) {
+    RC err;
+    FreeSpaceIndex *index = findIndex(fileHandle);
+    if (index == NULL) {
+        return SUCCESSFUL;
+    }
+    PagedFileManager *pfm = PagedFileManager::instance();
+    string mapFileName = getFreeSpaceFileName(fileName);
+    FileHandle mapHandle;
+    if (pfm->openFile(mapFileName.c_str(), mapHandle) != SUCCESSFUL) {
+        if ((err = pfm->createFile(mapFileName.c_str())) != SUCCESSFUL
+                || (err = pfm->openFile(mapFileName.c_str(), mapHandle)) != SUCCESSFUL) {
+            __trace();
+            return err;
+        }
     }
 
-    // Get attribute to be compared
-    bool found = false;
-    Attribute attr;
-    for (size_t i = 0; i < recordDescriptor.size(); i++) {
-        attr = recordDescriptor[i];
-        if (conditionAttribute.compare(attr.name) == 0) {
-            found = true;
-            break;
+    // Pages appended by other means have no free space as far as the map knows
+    unsigned pageCount = fileHandle.getNumberOfPages();
+    unsigned mapPageCount = (pageCount + FSM_PAGE_ENTRIES - 1) / FSM_PAGE_ENTRIES;
+    for (unsigned i = 0; i < mapPageCount; i++) {
+        if (i < mapHandle.getNumberOfPages() && (i >= index->dirtyPages.size() || !index->dirtyPages[i])) {
+            continue;
+        }
+        unsigned char mapPage[PAGE_SIZE];
+        unsigned first = i * FSM_PAGE_ENTRIES;
+        unsigned count = min((unsigned) FSM_PAGE_ENTRIES, pageCount - first);
+        memset(mapPage, 0, PAGE_SIZE);
+        for (unsigned j = 0; j < count && first + j < index->pages.size(); j++) {
+            mapPage[j] = (unsigned char) toCategory(index->pages[first + j].size, index->pageSize);
+        }
+        if ((err = mapHandle.writePage(i, mapPage)) != SUCCESSFUL) {
+            __trace();
+            pfm->closeFile(mapHandle);
+            return err;
         }
     }
-    if (!found) {
+    if (mapHandle.getNumberOfPages() > mapPageCount
+            && (err = mapHandle.truncatePages(mapPageCount)) != SUCCESSFUL) {
         __trace();
-        return false;
+        pfm->closeFile(mapHandle);
+        return err;
     }
-
-    // Read attribute
-    unsigned dataSize;
-    char data[length];
-    if (RecordBasedFileManager::instance()->__readAttribute(page, startPos,
-            this->recordDescriptor, conditionAttribute, &data, dataSize) != SUCCESSFUL) {
+    if ((err = pfm->closeFile(mapHandle)) != SUCCESSFUL) {
         __trace();
-        return false;
+        return err;
     }
+    index->dirtyPages.assign(index->dirtyPages.size(), false);
+
+    // The map starts at page 0 of its file
+    return fileHandle.setFreeSpaceRoot(0);
+}
 
-    // Compare
-    bool matched = false;
-    switch (attr.type) {
-    case TypeVarChar: {
-        AttrLength len = 0;
-        memcpy((char *)&len, (char *)&data, sizeof(int));
-        char str[len+1];
-        char *s = str;
-        memcpy(s, (char *)&data + sizeof(int), len);
-        str[len] = 0;
-        // Here we assume that if value is a string, it's null terminated.
-        // Read length first then read string
-        memcpy((char *)&len, (char *)this->value, sizeof(int));
-//        cout << "String len: " << len << endl;
-        char val[len+1];
-        memcpy(val, (char *)this->value + sizeof(int), len);
-        val[len] = 0;
-        matched = evaluateString(string(str), this->compOp, string(val));
-        break;
+/**
+ * Get the size class (category) of a free size: the # of whole steps it
+ * spans, or FSM_EMPTY_PAGE for the free size of an empty page.
+ */
+int SpaceManager::toCategory(int size, unsigned pageSize) {
+    if (size == getEmptyPageFreeSize(pageSize)) {
+        return FSM_EMPTY_PAGE;
     }
-    case TypeInt:
-        int integer;
-        memcpy((char *)&integer, (char *)&data, sizeof(int));
-        matched = evaluateNumber<int>(integer, this->compOp, *((int *)this->value));
-        break;
-    case TypeReal:
-        float real;
-        memcpy((char *)&real, (char *)&data, sizeof(float));
-        matched = evaluateNumber<float>(real, this->compOp, *((float *)this->value));
-        break;
-    default:
-        break;
+    int step = pageSize / FSM_STEPS;
+    if (size < step) {
+        return 0;
     }
-
-    return matched;
+    return min(size / step, (int) FSM_MAX_CATEGORY);
 }
 
-template <class T>
-bool RBFM_ScanIterator::evaluateNumber(T number, CompOp compOP, T val) {
-    switch (compOp) {
-    case EQ_OP:
-        return number == val;
-    case LT_OP:
-        return number < val;
-    case GT_OP:
-        return number > val;
-    case LE_OP:
-        return number <= val;
-    case GE_OP:
-        return number >= val;
-    case NE_OP:
-        return number != val;
-    case NO_OP:
-    default:
-        return false;
+/**
+ * Get the free size guaranteed by a size class (category).
+ */
+int SpaceManager::fromCategory(int category, unsigned pageSize) {
+    if (category == FSM_EMPTY_PAGE) {
+        return getEmptyPageFreeSize(pageSize);
     }
+    return category * (pageSize / FSM_STEPS);
+}
 
-    return false;
+/**
+ * Get the free space map of a file.
+ *
+ * @param fileHandle
+ * @return the map, NULL if the file has none
+ */
+SpaceManager::FreeSpaceIndex *SpaceManager::findIndex(FileHandle &fileHandle) {
+    unsigned fileId = fileHandle.getFileId();
+    return fileId < __freeSpace.size() ? __freeSpace[fileId] : NULL;
 }
 
-bool RBFM_ScanIterator::evaluateString(string str, CompOp compOp, string val) {
-    switch (compOp) {
-    case EQ_OP:
-        return str.compare(val) == 0;
-    case LT_OP:
-        return str.compare(val) < 0;
-    case GT_OP:
-        return str.compare(val) > 0;
-    case LE_OP:
-        return str.compare(val) <= 0;
-    case GE_OP:
-        return str.compare(val) >= 0;
-    case NE_OP:
-        return str.compare(val) != 0;
-    case NO_OP:
-    default:
-        return false;
+/**
+ * Get the free space map of a file, creating an empty one if needed.
+ *
+ * @param fileHandle
+ * @return the map
+ */
+SpaceManager::FreeSpaceIndex &SpaceManager::getIndex(FileHandle &fileHandle) {
+    unsigned fileId = fileHandle.getFileId();
+    if (fileId >= __freeSpace.size()) {
+        __freeSpace.resize(fileId + 1, NULL);
     }
-
-    return false;
+    if (__freeSpace[fileId] == NULL) {
+        __freeSpace[fileId] = new FreeSpaceIndex(fileHandle.getPageSize());
+    }
+    return *__freeSpace[fileId];
 }
 
-
 /**
- * Space Manager Implementations
+ * Drop the free space map of a file.
+ *
+ * @param fileHandle
  */
-typedef map<int, set<int> > FreeSpaceMap;    // <free space size, corresponding locations (page #)>
-
-SpaceManager* SpaceManager::_sp_manager = 0;
-
-void *SpaceManager::__buffer = 0;
-
-SpaceManager::SpaceManager() {
-
+void SpaceManager::eraseIndex(FileHandle &fileHandle) {
+    unsigned fileId = fileHandle.getFileId();
+    if (fileId < __freeSpace.size()) {
+        delete __freeSpace[fileId];
+        __freeSpace[fileId] = NULL;
+    }
 }
 
-SpaceManager::~SpaceManager() {
-
+/**
+ * File a page which is not in the map under the class of its free size.
+ *
+ * @param index
+ * @param pageNum
+ * @param size
+ *          the free size of the page, > 0
+ */
+void SpaceManager::linkPage(FreeSpaceIndex &index, int pageNum, int size) {
+    if ((unsigned) pageNum >= index.pages.size()) {
+        index.pages.resize(pageNum + 1);
+    }
+    int sizeClass = toCategory(size, index.pageSize);
+    FreePage &page = index.pages[pageNum];
+    page.size = size;
+    page.prev = -1;
+    page.next = index.heads[sizeClass];
+    if (page.next != -1) {
+        index.pages[page.next].prev = pageNum;
+    }
+    index.heads[sizeClass] = pageNum;
+    index.nonEmpty[sizeClass / 64] |= 1ULL << (sizeClass % 64);
+    markDirty(index, pageNum);
 }
 
-SpaceManager* SpaceManager::instance() {
-    if (_sp_manager == NULL) {
-        _sp_manager = new SpaceManager();
+/**
+ * Take a page out of the list of its class, if it is in the map.
+ *
+ * @param index
+ * @param pageNum
+ */
+void SpaceManager::unlinkPage(FreeSpaceIndex &index, int pageNum) {
+    if ((unsigned) pageNum >= index.pages.size() || index.pages[pageNum].size == 0) {
+        return;
+    }
+    int sizeClass = toCategory(index.pages[pageNum].size, index.pageSize);
+    FreePage &page = index.pages[pageNum];
+    if (page.prev != -1) {
+        index.pages[page.prev].next = page.next;
+    } else {
+        index.heads[sizeClass] = page.next;
+        if (page.next == -1) {
+            index.nonEmpty[sizeClass / 64] &= ~(1ULL << (sizeClass % 64));
+        }
     }
-    return _sp_manager;
+    if (page.next != -1) {
+        index.pages[page.next].prev = page.prev;
+    }
+    page = FreePage();
+    markDirty(index, pageNum);
 }
 
 /**
- * TODO: remove that function since it's useless now
- * Get the common buffer of size PAGE_SIZE in order to
- * reduce the memory cost.
+ * Find the first size class from a given one which has pages.
  *
- * @return pointer to the buffer, NULL if no memory able to be allocated.
+ * @param index
+ * @param sizeClass
+ * @return the class, -1 if none
  */
-void *SpaceManager::getPageBuffer() {
-    if (!__buffer) {
-        __buffer = malloc(PAGE_SIZE);
+int SpaceManager::findSizeClass(const FreeSpaceIndex &index, int sizeClass) {
+    for (int i = sizeClass / 64; i < FSM_BITMAP_WORDS; i++) {
+        unsigned long long bits = index.nonEmpty[i];
+        if (i == sizeClass / 64) {
+            bits &= ~0ULL << (sizeClass % 64);
+        }
+        if (bits != 0) {
+            return i * 64 + __builtin_ctzll(bits);
+        }
+    }
+    return -1;
+}
+
+/**
+ * Note that the page of the persistent map describing a page has changed.
+ */
+void SpaceManager::markDirty(FreeSpaceIndex &index, int pageNum) {
+    unsigned mapPageNum = pageNum / FSM_PAGE_ENTRIES;
+    if (mapPageNum >= index.dirtyPages.size()) {
+        index.dirtyPages.resize(mapPageNum + 1, false);
     }
-    return __buffer;
+    index.dirtyPages[mapPageNum] = true;
 }
 
 /**
  * Collect and buffer the information about the free space from existing file
- * on the disk. Designed to be called by RecordBasedFileManager::openFile()
+ * on the disk. Called by openFreeSpaceMap() when there is no saved map, and
+ * after pages have been changed behind the map (e.g. a transaction rollback).
  *
  * @param fileName
  * @param fileHandle
  * @return status
  */
 RC SpaceManager::bufferSizeInfo(const string &fileName, FileHandle &fileHandle) {
-    clearFreeSpaceMap(fileName);
+    lock_guard<recursive_mutex> guard(__latch);
+    clearFreeSpaceMap(fileHandle);
 
     RC err = 0;
     int pageNum = fileHandle.getNumberOfPages();
+    unsigned pageSize = fileHandle.getPageSize();
+    vector<char> page(pageSize);
+    char *buffer = &page[0];
     for (int i = 0; i < pageNum; i++) {
 //        cout << "Searching page " << i << endl;
-        void *buffer = getPageBuffer();
-        if (!buffer) {
-            __trace();
-            return ERR_NULLPTR;
-        }
-
         if ((err = fileHandle.readPage(i, buffer)) != SUCCESSFUL) {
             __trace();
             return err;
@@ -1008,21 +2599,21 @@ RC SpaceManager::bufferSizeInfo(const string &fileName, FileHandle &fileHandle)
          * more slot metadata (4 byte) should be reserved. This will
          * reflect in the calculation of free space.
          */
-        unsigned short freePtr = getFreePtr(buffer);
-        unsigned short slotCount = getSlotCount(buffer);
-        if (freePtr >= PAGE_SIZE - 4) {
+        unsigned freePtr = getFreePtr(buffer, pageSize);
+        unsigned slotCount = getSlotCount(buffer, pageSize);
+        if (freePtr >= pageSize - 4) {
             __trace();
             return ERR_BAD_DATA;
         }
-        if (slotCount > PAGE_SIZE / 4) {
+        if (slotCount > pageSize / 4) {
             __trace();
             return ERR_BAD_DATA;
         }
 
 //        cout << "Free ptr: " << freePtr << ", slotCount: " << slotCount << endl;
 
-        unsigned short firstSlot = PAGE_SIZE;
-        if (!hasFreeExistingSlot(buffer, slotCount, firstSlot)) {
+        unsigned firstSlot = pageSize;
+        if (!hasFreeExistingSlot(buffer, pageSize, slotCount, firstSlot)) {
             slotCount++;
         } else {
 //            __trace();
@@ -1031,13 +2622,13 @@ RC SpaceManager::bufferSizeInfo(const string &fileName, FileHandle &fileHandle)
 //                 << " free Ptr: " << freePtr << endl;
         }
 
-        int freeSize = PAGE_SIZE - freePtr - getMetadataSize(slotCount);
+        int freeSize = pageSize - freePtr - getMetadataSize(slotCount);
 //        cout << "freeSize " << freeSize << endl;
 //        if (freeSize <= 0) {
 //            __trace();
 //            cout << " ### Inserting free size: " << freeSize << " @page " << i << endl;
 //        }
-        insertFreeSpaceMap(fileName, i, freeSize);
+        insertFreeSpaceMap(fileHandle, i, freeSize);
     }
 
 //    __trace();
@@ -1059,45 +2650,61 @@ RC SpaceManager::bufferSizeInfo(const string &fileName, FileHandle &fileHandle)
  * @return status
  */
 RC SpaceManager::allocateSpace(const string &fileName, FileHandle &fileHandle, int spaceSize, int &pageNum) {
+    int freeSize;
+    return allocateSpace(fileName, fileHandle, spaceSize, pageNum, freeSize);
+}
+
+/**
+ * Allocate new space for a new record to be inserted, like above.
+ *
+ * @param fileName
+ * @param fileHandle
+ * @param spaceSize
+ *          the size of the space trying to claim.
+ * @param pageNum
+ *          (return) the page number of the allocated space, -1 if cannot find such space.
+ * @param freeSize
+ *          (return) the free size of the page according to the map, to file
+ *          it again with if the page is not used after all.
+ * @return status
+ */
+RC SpaceManager::allocateSpace(const string &fileName, FileHandle &fileHandle, int spaceSize, int &pageNum,
+        int &freeSize) {
 //    cout << "In SpaceManager::allocateSpace, fileName: " << fileName << " space request: " << spaceSize << endl;
-    if (!fileHandle.getFilePointer() ||
+    if (!fileHandle.isOpen() ||
          fileHandle.getNumberOfPages() < 0 ||
          strcmp(fileName.c_str(), fileHandle.getFileName()) != 0) {
         __trace();
         return ERR_BAD_HANDLE;
     }
 
-    if (spaceSize >= PAGE_SIZE - FREE_PTR_LEN - SLOT_NUM_LEN - SLOT_START_LEN - SLOT_LEN_LEN) {
-        // 8 = # of entries (2 byte) + free chuck header pointer (2 byte)
-        // + information for the first slot (4 byte)
+    if (spaceSize >= (int) (fileHandle.getPageSize() - getMetadataSize(1))) {
+        // # of entries + free chuck header pointer + information for the first slot
         return ERR_SIZE_TOO_LARGE;
     }
 
 //    __trace();
     /*
-     * Retrieve suitable free page according to metadata
-     * Note: the free space map will also delete the map entry of allocated space
-     * and clean zero length entry if possible.
+     * Retrieve suitable free page according to metadata: the pages of a class
+     * above the one of the request all fit it, so do the first page of its
+     * own class if it is large enough.
+     * Note: the free space map will also delete the map entry of allocated space.
      */
     int page = -1;
 //    printFreeSpaceMap();
-    FreeSpaceMap &fsm = __freeSpace[(string &)fileName];
-//    __trace();
-    for (map<int, set<int> >::iterator it = fsm.begin(); it != fsm.end(); ++it) {
-        int curSize = it->first;
-        if (curSize >= spaceSize) {
-            // find the satisfied free space with minimum size
-            set<int> &pageSet = it->second;
-            for (set<int>::iterator jt = pageSet.begin(); jt != pageSet.end(); ++jt) {
-                page = *jt;
-                pageSet.erase(jt);
-                break;
-            }
-            if (pageSet.size() == 0) {
-                fsm.erase(it);
-                break;
-            }
-        }
+    lock_guard<recursive_mutex> guard(__latch);
+    FreeSpaceIndex &index = getIndex(fileHandle);
+    int sizeClass = toCategory(spaceSize, index.pageSize);
+    int head = index.heads[sizeClass];
+    if (head != -1 && index.pages[head].size >= spaceSize) {
+        page = head;
+    } else if ((sizeClass = findSizeClass(index, sizeClass + 1)) != -1) {
+        page = index.heads[sizeClass];
+    }
+    freeSize = 0;
+    if (page != -1) {
+        freeSize = index.pages[page].size;
+        unlinkPage(index, page);
     }
 
 //    __trace();
@@ -1122,7 +2729,7 @@ RC SpaceManager::deallocateSpace(const string &fileName, FileHandle &fileHandle,
     RC err;
 //    __trace();
 //    cout << "File: " << fileName << " pageNum: " << pageNum << ", slotNum: " << slotNum << endl;
-    if (!fileHandle.getFilePointer() ||
+    if (!fileHandle.isOpen() ||
          fileHandle.getNumberOfPages() < 0 ||
          strcmp(fileName.c_str(), fileHandle.getFileName()) != 0) {
         __trace();
@@ -1135,14 +2742,21 @@ RC SpaceManager::deallocateSpace(const string &fileName, FileHandle &fileHandle,
         std::cout << "Page number #" << pageNum << " is invalid: the page size: " << fileHandle.getNumberOfPages() << endl;
         return ERR_RECORD_NOT_FOUND;
     }
-    void *page = getPageBuffer();
+    unsigned pageSize = fileHandle.getPageSize();
+    vector<char> buffer(pageSize);
+    char *page = &buffer[0];
+    if ((err = lockPage(fileHandle, pageNum, true)) != SUCCESSFUL) {
+        __trace();
+        return err;
+    }
+    unique_lock<mutex> latch(getPageLatch(fileHandle, pageNum));
     if ((err = fileHandle.readPage(pageNum, page)) != SUCCESSFUL) {
         __trace();
         return err;
     }
 
     // Get and validate slot number
-    unsigned short slotCount = getSlotCount(page);
+    unsigned slotCount = getSlotCount(page, pageSize);
     if (slotNum >= slotCount) {
         __trace();
         std::cout << "Slot number #" << slotNum << " is invalid: the page slot count: " << slotCount<< endl;
@@ -1150,16 +2764,26 @@ RC SpaceManager::deallocateSpace(const string &fileName, FileHandle &fileHandle,
     }
 
     // Check whether the current read slot is a tomb stone. If so, we need to trace another page.
-    short startPos = getSlotStartPos(page, slotNum);
-    short length = getSlotLength(page, slotNum);
+    int startPos = getSlotStartPos(page, pageSize, slotNum);
+    int length = getSlotLength(page, pageSize, slotNum);
     bool tombstone = isTombstoneSlot(startPos, length);
 
-    // Lazily delete record by just nullifying the slot directory without reclaiming the actual space.
-    nullifySlot(page, slotNum);
+    // Lazily delete record by just nullifying the slot directory without reclaiming the actual space,
+    // unless the page ends up empty: then it is reset and offered whole to the next insertions.
+    nullifySlot(page, pageSize, slotNum);
+    bool empty = isEmptyPage(page, pageSize);
+    if (empty) {
+        setFreePtr(page, pageSize, 0);
+        setSlotCount(page, pageSize, 0);
+    }
     if ((err = fileHandle.writePage(pageNum, page)) != SUCCESSFUL) {
         __trace();
         return err;
     }
+    if (empty) {
+        insertFreeSpaceMap(fileHandle, pageNum, getEmptyPageFreeSize(pageSize));
+    }
+    latch.unlock();
 
     // Deallocate the next slot if the current one is a tomb stone
     if (tombstone) {
@@ -1172,33 +2796,45 @@ RC SpaceManager::deallocateSpace(const string &fileName, FileHandle &fileHandle,
 }
 
 /**
- * Deallocate all spaces in the file.
+ * Deallocate all spaces in the file. Outside of transactions the pages
+ * are simply truncated; a transaction empties them one by one so that
+ * the change is logged.
  */
 RC SpaceManager::deallocateAllSpaces(const string &fileName, FileHandle &fileHandle) {
     RC err;
 
-    if (!fileHandle.getFilePointer() ||
+    if (!fileHandle.isOpen() ||
          fileHandle.getNumberOfPages() < 0 ||
          strcmp(fileName.c_str(), fileHandle.getFileName()) != 0) {
         __trace();
         return ERR_BAD_HANDLE;
     }
 
-    clearFreeSpaceMap(fileName);
+    clearFreeSpaceMap(fileHandle);
+    if (!LogManager::inTransaction()) {
+        return fileHandle.truncatePages(0);
+    }
 
-    int freeSize = PAGE_SIZE - getMetadataSize(1);  // reserve one slot for next update
-    unsigned pageSize = fileHandle.getNumberOfPages();
-    for (unsigned i = 0; i < pageSize; i++) {
-        void *page = getPageBuffer();
+    unsigned pageSize = fileHandle.getPageSize();
+    int freeSize = getEmptyPageFreeSize(pageSize);  // reserve one slot for next update
+    unsigned pageCount = fileHandle.getNumberOfPages();
+    vector<char> buffer(pageSize);
+    char *page = &buffer[0];
+    for (unsigned i = 0; i < pageCount; i++) {
+        if ((err = lockPage(fileHandle, i, true)) != SUCCESSFUL) {
+            __trace();
+            return err;
+        }
+        lock_guard<mutex> latch(getPageLatch(fileHandle, i));
         if ((err = fileHandle.readPage(i, page)) != SUCCESSFUL) {
             __trace();
             return err;
         }
 
         // For each page, directly reset freePtr to 0, slot count to 0.
-        setFreePtr(page, 0);  // beginning
-        setSlotCount(page, 0);
-        if ((err == fileHandle.writePage(i, page)) != SUCCESSFUL) {
+        setFreePtr(page, pageSize, 0);  // beginning
+        setSlotCount(page, pageSize, 0);
+        if ((err = fileHandle.writePage(i, page)) != SUCCESSFUL) {
             __trace();
             return err;
         }
@@ -1208,75 +2844,196 @@ RC SpaceManager::deallocateAllSpaces(const string &fileName, FileHandle &fileHan
             __trace();
             cout << " ### Inserting free size: " << freeSize << " @page " << i << endl;
         }
-        insertFreeSpaceMap(fileName, i, freeSize);
+        insertFreeSpaceMap(fileHandle, i, freeSize);
     }
 
     return SUCCESSFUL;
 }
 
 /**
- * Insert the information about the free slot into the buffered
- * free space map in memory.
+ * Insert the information about the free space of a page into the buffered
+ * free space map in memory, replacing the previous one.
  *
- * @param fileName
+ * @param fileHandle
  * @param pageNum
- * @param startPosition
  * @param size
- *          the size of the free space
+ *          the size of the free space (the page leaves the map if <= 0)
  */
-void SpaceManager::insertFreeSpaceMap(const string &fileName, int pageNum, int size) {
+void SpaceManager::insertFreeSpaceMap(FileHandle &fileHandle, int pageNum, int size) {
+    lock_guard<recursive_mutex> guard(__latch);
+    FreeSpaceIndex &index = getIndex(fileHandle);
+    unlinkPage(index, pageNum);
     if (size > 0) {
-        __freeSpace[(string &)fileName][size].insert(pageNum);
-    } else {
-//        __trace();
-//        cout << "!!!!!!! Trying to insert an entry with negative size " << size
-//             << " @page " << pageNum << "!!!!!!!!" << endl;
+        linkPage(index, pageNum, size);
     }
 }
 
-RC SpaceManager::updateFreeSpaceMap(const string &fileName, int pageNum, int oldSize, int newSize) {
-    if (oldSize > 0 && newSize > 0) {
-        if (__freeSpace[(string &)fileName][oldSize].count(pageNum) > 0) {
-            __freeSpace[(string &)fileName][oldSize].erase(pageNum);
-            if (__freeSpace[(string &)fileName][oldSize].size() == 0) {
-                __freeSpace[(string &)fileName].erase(oldSize);
-            }
-            __freeSpace[(string &)fileName][newSize].insert(pageNum);
-            return SUCCESSFUL;
-        } else {
-            cout << "The free size of the page " << pageNum << " should not be " << oldSize << endl
-                 << "There must be something wrong with the free page calculation!" << endl;
-            return ERR_MAP_ENTRY_NOT_FOUND;
+/**
+ * Clear the free space map.
+ */
+void SpaceManager::clearFreeSpaceMap(FileHandle &fileHandle) {
+    lock_guard<recursive_mutex> guard(__latch);
+    FreeSpaceIndex *index = findIndex(fileHandle);
+    if (index == NULL) {
+        return;
+    }
+
+    // Every page of the persistent map changes
+    if (!index->pages.empty()) {
+        markDirty(*index, index->pages.size() - 1);
+    }
+    index->dirtyPages.assign(index->dirtyPages.size(), true);
+    index->pages.clear();
+    for (int i = 0; i < FSM_STEPS; i++) {
+        index->heads[i] = -1;
+    }
+    memset(index->nonEmpty, 0, sizeof(index->nonEmpty));
+}
+
+/**
+ * Remove a page from the free space map, whatever its free size.
+ *
+ * @param fileHandle
+ * @param pageNum
+ */
+void SpaceManager::removeFreeSpaceMap(FileHandle &fileHandle, int pageNum) {
+    lock_guard<recursive_mutex> guard(__latch);
+    FreeSpaceIndex *index = findIndex(fileHandle);
+    if (index != NULL) {
+        unlinkPage(*index, pageNum);
+    }
+}
+
+/**
+ * Find whether the free space map knows that a page holds no record, so
+ * that scans can skip it without reading it.
+ *
+ * @param fileHandle
+ * @param pageNum
+ * @return true if the page is empty, false if it is not or if unsure
+ */
+bool SpaceManager::isFreePage(FileHandle &fileHandle, int pageNum) {
+    lock_guard<recursive_mutex> guard(__latch);
+    FreeSpaceIndex *index = findIndex(fileHandle);
+    return index != NULL && (unsigned) pageNum < index->pages.size()
+            && index->pages[pageNum].size == getEmptyPageFreeSize(index->pageSize);
+}
+
+/**
+ * Give the disk space of the empty pages of a file back. Trailing empty
+ * pages are truncated (and leave the free space map); other runs of
+ * empty pages get a hole punched over them if asked to, and read as
+ * clean pages afterwards. Nothing is reclaimed within a transaction,
+ * since the changes are not logged, nor through read-only handles.
+ *
+ * @param fileName
+ * @param fileHandle
+ * @param punch
+ *          whether to punch holes over empty pages which are not trailing
+ * @return status
+ */
+RC SpaceManager::reclaimSpace(const string &fileName, FileHandle &fileHandle, bool punch) {
+    RC err;
+    if (!fileHandle.isOpen() || fileHandle.getIOMode() == IO_MMAP || LogManager::inTransaction()) {
+        return SUCCESSFUL;
+    }
+    lock_guard<recursive_mutex> guard(__latch);
+    FreeSpaceIndex *index = findIndex(fileHandle);
+    if (index == NULL) {
+        return SUCCESSFUL;
+    }
+
+    int pageCount = fileHandle.getNumberOfPages();
+    while (pageCount > 0 && isReclaimablePage(fileHandle, pageCount - 1)) {
+        pageCount--;
+    }
+    if (pageCount < (int) fileHandle.getNumberOfPages()) {
+        if ((err = fileHandle.truncatePages(pageCount)) != SUCCESSFUL) {
+            __trace();
+            return err;
         }
-    } else {
-        __trace();
-        return ERR_INV_FREE_SIZE;
+        for (int i = pageCount; i < (int) index->pages.size(); i++) {
+            unlinkPage(*index, i);
+        }
+        index->pages.resize(min((int) index->pages.size(), pageCount));
     }
 
+    // Punch a hole over each run of consecutive empty pages
+    for (int start = 0; punch && start < pageCount; ) {
+        int count = 0;
+        while (start + count < pageCount && isReclaimablePage(fileHandle, start + count)) {
+            count++;
+        }
+        if (count > 0 && (err = fileHandle.punchPages(start, count)) != SUCCESSFUL) {
+            __trace();
+            return err;
+        }
+        start += count + 1;
+    }
     return SUCCESSFUL;
 }
 
 /**
- * Clear the free space map.
+ * Check whether a page can be reclaimed: the map says it is empty and, as
+ * a map saved at a checkpoint may lag behind the pages, so does the page.
+ *
+ * @param fileHandle
+ * @param pageNum
+ * @return whether the page holds no record
+ */
+bool SpaceManager::isReclaimablePage(FileHandle &fileHandle, int pageNum) {
+    if (!isFreePage(fileHandle, pageNum)) {
+        return false;
+    }
+    vector<char> page(fileHandle.getPageSize());
+    return fileHandle.readPage(pageNum, &page[0]) == SUCCESSFUL && isEmptyPage(&page[0], page.size());
+}
+
+/**
+ * Get the latch guarding the records of a page. Pages share latches, so
+ * a thread holding one may only try_lock() another.
+ *
+ * @param fileHandle
+ * @param pageNum
+ * @return the latch
+ */
+mutex &SpaceManager::getPageLatch(FileHandle &fileHandle, PageNum pageNum) {
+    unsigned long long key = ((unsigned long long) fileHandle.getFileId() << 32) | pageNum;
+    return __pageLatches[(key * 0x9E3779B97F4A7C15ULL >> 32) % PAGE_LATCHES];
+}
+
+/**
+ * Lock a page for the transaction of the calling thread until it ends
+ * (nothing is locked outside of transactions). Writers lock the page
+ * before taking its latch: a thread holding a latch must not wait.
+ *
+ * @param fileHandle
+ * @param pageNum
+ * @param wait
+ *          whether to wait for another transaction to release the page
+ * @return status (ERR_LOCKED or ERR_DEADLOCK if the page is not taken)
  */
-void SpaceManager::clearFreeSpaceMap(const string &fileName) {
-    __freeSpace.erase((string &)fileName);
+RC SpaceManager::lockPage(FileHandle &fileHandle, PageNum pageNum, bool wait) {
+    return LogManager::instance()->lockPage(fileHandle.getFileName(), pageNum, wait);
 }
 
 /**
  * Print the free space map for debugging purposes.
  */
 void SpaceManager::printFreeSpaceMap() {
+    lock_guard<recursive_mutex> guard(__latch);
     __trace();
     std::cout << "### Free Space Map ###" << std::endl;
-    for (map<string, FreeSpaceMap>::iterator it = __freeSpace.begin(); it != __freeSpace.end(); ++it) {
-        std::cout << "File Name: " << it->first << std::endl;
-        FreeSpaceMap fsm = it->second;
-        for (map<int, set<int> >::iterator jt = fsm.begin(); jt != fsm.end(); ++jt) {
-            std::cout << "\tFree Size: " << jt->first << std::endl;
-            set<int> pageSet = jt->second;
-            for (set<int>::iterator kt = pageSet.begin(); kt != pageSet.end(); ++kt) {
-                std::cout << "\t\tPage " << *kt << std::endl;
+    for (unsigned i = 0; i < __freeSpace.size(); i++) {
+        if (__freeSpace[i] == NULL) {
+            continue;
+        }
+        std::cout << "File Id: " << i << std::endl;
+        FreeSpaceIndex &index = *__freeSpace[i];
+        for (int c = findSizeClass(index, 0); c != -1; c = findSizeClass(index, c + 1)) {
+            std::cout << "\tSize Class: " << c << std::endl;
+            for (int p = index.heads[c]; p != -1; p = index.pages[p].next) {
+                std::cout << "\t\tPage " << p << ", Free Size: " << index.pages[p].size << std::endl;
             }
         }
     }
@@ -1287,98 +3044,126 @@ void SpaceManager::printFreeSpaceMap() {
  *
  */
 
-unsigned short SpaceManager::getFreePtr(void *page) {
-    unsigned short ret;
-    int offset = PAGE_SIZE - sizeof(unsigned short);
-    memcpy((char *)&ret, (char *)page + offset, sizeof(unsigned short));
+unsigned SpaceManager::getFreePtr(const void *page, unsigned pageSize) {
+    unsigned ret;
+    int offset = pageSize - FREE_PTR_LEN;
+    memcpy((char *)&ret, (const char *)page + offset, FREE_PTR_LEN);
     return ret;
 }
 
-unsigned short SpaceManager::getSlotCount(void *page) {
-    unsigned short ret;
-    int offset = PAGE_SIZE - 2 * sizeof(unsigned short);
-    memcpy((char *)&ret, (char *)page + offset, sizeof(unsigned short));
-    return ret;
+unsigned SpaceManager::getSlotCount(const void *page, unsigned pageSize) {
+    unsigned ret;
+    int offset = pageSize - FREE_PTR_LEN - SLOT_NUM_LEN;
+    memcpy((char *)&ret, (const char *)page + offset, SLOT_NUM_LEN);
+    return ret & SLOT_COUNT_MASK;
 }
 
-short SpaceManager::getSlotStartPos(void *page, unsigned slotNum) {
-    short ret;
-    int offset = PAGE_SIZE - 2 * sizeof(unsigned short) - (slotNum + 1) * sizeof(int);
-    memcpy((char *)&ret, (char *)page + offset, sizeof(short));
+int SpaceManager::getSlotStartPos(const void *page, unsigned pageSize, unsigned slotNum) {
+    int ret;
+    int offset = pageSize - getMetadataSize(slotNum + 1);
+    memcpy((char *)&ret, (const char *)page + offset, SLOT_START_LEN);
     return ret;
 }
 
-short SpaceManager::getSlotLength(void *page, unsigned slotNum) {
-    unsigned short ret;
-    int offset = PAGE_SIZE - 2 * sizeof(unsigned short) - (slotNum + 1) * sizeof(int) + sizeof(unsigned short);
-    memcpy((char *)&ret, (char *)page + offset, sizeof(unsigned short));
+int SpaceManager::getSlotLength(const void *page, unsigned pageSize, unsigned slotNum) {
+    int ret;
+    int offset = pageSize - getMetadataSize(slotNum + 1) + SLOT_START_LEN;
+    memcpy((char *)&ret, (const char *)page + offset, SLOT_LEN_LEN);
     return ret;
 }
 
-void SpaceManager::setFreePtr(void *page, unsigned short data) {
-    int offset = PAGE_SIZE - sizeof(unsigned short);
-    memcpy((char *)page + offset, (char *)&data, sizeof(unsigned short));
+void SpaceManager::setFreePtr(void *page, unsigned pageSize, unsigned data) {
+    int offset = pageSize - FREE_PTR_LEN;
+    memcpy((char *)page + offset, (char *)&data, FREE_PTR_LEN);
+}
+
+void SpaceManager::setSlotCount(void *page, unsigned pageSize, unsigned data) {
+    int offset = pageSize - FREE_PTR_LEN - SLOT_NUM_LEN;
+    data = (data & SLOT_COUNT_MASK) | (getRecordFormat(page, pageSize) << RECORD_FORMAT_SHIFT);
+    memcpy((char *)page + offset, (char *)&data, SLOT_NUM_LEN);
+}
+
+unsigned SpaceManager::getRecordFormat(const void *page, unsigned pageSize) {
+    unsigned word;
+    int offset = pageSize - FREE_PTR_LEN - SLOT_NUM_LEN;
+    memcpy((char *)&word, (const char *)page + offset, SLOT_NUM_LEN);
+    return word >> RECORD_FORMAT_SHIFT;
 }
 
-void SpaceManager::setSlotCount(void *page, unsigned short data) {
-    int offset = PAGE_SIZE - 2 * sizeof(unsigned short);
-    memcpy((char *)page + offset, (char *)&data, sizeof(unsigned short));
+void SpaceManager::setRecordFormat(void *page, unsigned pageSize, unsigned format) {
+    int offset = pageSize - FREE_PTR_LEN - SLOT_NUM_LEN;
+    unsigned word = getSlotCount(page, pageSize) | (format << RECORD_FORMAT_SHIFT);
+    memcpy((char *)page + offset, (char *)&word, SLOT_NUM_LEN);
 }
 
-void SpaceManager::setSlotStartPos(void *page, unsigned slotNum, short data) {
-    int offset = PAGE_SIZE - 2 * sizeof(unsigned short) - (slotNum + 1) * sizeof(int);
-    memcpy((char *)page + offset, (char *)&data, sizeof(short));
+void SpaceManager::setSlotStartPos(void *page, unsigned pageSize, unsigned slotNum, int data) {
+    int offset = pageSize - getMetadataSize(slotNum + 1);
+    memcpy((char *)page + offset, (char *)&data, SLOT_START_LEN);
 }
 
-void SpaceManager::setSlotLength(void *page, unsigned slotNum, short data) {
-    int offset = PAGE_SIZE - 2 * sizeof(unsigned short) - (slotNum + 1) * sizeof(int) + sizeof(unsigned short);
-    memcpy((char *)page + offset, (char *)&data, sizeof(unsigned short));
+void SpaceManager::setSlotLength(void *page, unsigned pageSize, unsigned slotNum, int data) {
+    int offset = pageSize - getMetadataSize(slotNum + 1) + SLOT_START_LEN;
+    memcpy((char *)page + offset, (char *)&data, SLOT_LEN_LEN);
 }
 
-void SpaceManager::setSlot(void *page, int slotNum, short start, short length) {
-    setSlotStartPos(page, slotNum, start);
-    setSlotLength(page, slotNum, length);
+void SpaceManager::setSlot(void *page, unsigned pageSize, unsigned slotNum, int start, int length) {
+    setSlotStartPos(page, pageSize, slotNum, start);
+    setSlotLength(page, pageSize, slotNum, length);
 }
 
-void SpaceManager::writeRecord(void *page, const void *data, unsigned short start, unsigned size) {
+void SpaceManager::writeRecord(void *page, const void *data, unsigned start, unsigned size) {
     memcpy((char *)page + start, data, size);
 }
 
-void SpaceManager::readRecord(const void *page, void *data, unsigned short start, unsigned size) {
+void SpaceManager::readRecord(const void *page, void *data, unsigned start, unsigned size) {
     memcpy(data, (const char *)page + start, size);
 }
 
 unsigned SpaceManager::getMetadataSize(int slotCount) {
-    return 2 * sizeof(unsigned short) + slotCount * sizeof(int);
+    return FREE_PTR_LEN + SLOT_NUM_LEN + slotCount * (SLOT_START_LEN + SLOT_LEN_LEN);
+}
+
+int SpaceManager::getEmptyPageFreeSize(unsigned pageSize) {
+    return pageSize - getMetadataSize(1);   // one slot is reserved for the next record
+}
+
+bool SpaceManager::isEmptyPage(const void *page, unsigned pageSize) {
+    unsigned slotCount = getSlotCount(page, pageSize);
+    for (unsigned i = 0; i < slotCount; i++) {
+        if (!isDeletedSlot(getSlotStartPos(page, pageSize, i), getSlotLength(page, pageSize, i), pageSize)) {
+            return false;
+        }
+    }
+    return true;
 }
 
 // Note the free space calculation policy should be identical with
 // the one in insertRecord().
-unsigned SpaceManager::getPageFreeSize(void *page) {
-    unsigned short firstFree;
-    unsigned short slotCount = getSlotCount(page);
-    if (!hasFreeExistingSlot(page, slotCount, firstFree)) {
+unsigned SpaceManager::getPageFreeSize(const void *page, unsigned pageSize) {
+    unsigned firstFree;
+    unsigned slotCount = getSlotCount(page, pageSize);
+    if (!hasFreeExistingSlot(page, pageSize, slotCount, firstFree)) {
         slotCount++;
     }
-    unsigned short freePtr = getFreePtr(page);
-    int ret = (int)(PAGE_SIZE - freePtr - getMetadataSize(slotCount));
+    unsigned freePtr = getFreePtr(page, pageSize);
+    int ret = (int)(pageSize - freePtr - getMetadataSize(slotCount));
     if (ret < 0) {
         return 0;
     }
     return (unsigned)ret;
 }
 
-bool SpaceManager::hasFreeExistingSlot(void *page, unsigned short slotCount, unsigned short &firstFreeSlot) {
+bool SpaceManager::hasFreeExistingSlot(const void *page, unsigned pageSize, unsigned slotCount, unsigned &firstFreeSlot) {
     bool hasFreeSlot = false;
 //    __trace();
 //    cout << "--slotCount " << slotCount << endl;
-    for (unsigned short i = 0; i < slotCount; i++) {
-        short start = getSlotStartPos(page, i);
-        short len = getSlotLength(page, i);
+    for (unsigned i = 0; i < slotCount; i++) {
+        int start = getSlotStartPos(page, pageSize, i);
+        int len = getSlotLength(page, pageSize, i);
 //        cout << "---- i = " << i << " , startPos = " << start
 //             << " length = " << len << endl;
 
-        if (isDeletedSlot(start, len)) {
+        if (isDeletedSlot(start, len, pageSize)) {
             hasFreeSlot = true;
             firstFreeSlot = i;
 //            cout << "\t---Find free slot: " << firstFreeSlot << endl;
@@ -1388,36 +3173,36 @@ bool SpaceManager::hasFreeExistingSlot(void *page, unsigned short slotCount, uns
     return hasFreeSlot;
 }
 
-bool SpaceManager::isTombstoneSlot(short startPos, short size) {
+bool SpaceManager::isTombstoneSlot(int startPos, int size) {
     return (startPos < 0) || (startPos == 0 && size == 0);
 }
 
-bool SpaceManager::isOccupiedSlot(short startPos, short length) {
-    return (startPos >= 0 && startPos < PAGE_SIZE && length > 0);
+bool SpaceManager::isOccupiedSlot(int startPos, int length, unsigned pageSize) {
+    return (startPos >= 0 && startPos < (int) pageSize && length > 0);
 }
 
-bool SpaceManager::isDeletedSlot(short startPos, short length) {
-    return (startPos == PAGE_SIZE && length == 0);
+bool SpaceManager::isDeletedSlot(int startPos, int length, unsigned pageSize) {
+    return (startPos == (int) pageSize && length == 0);
 }
 
-void SpaceManager::setTombstoneSlot(void *page, int slotNum, short newPageNum, short newSlotNum) {
-    setSlot(page, slotNum, -newPageNum, -newSlotNum);
+void SpaceManager::setTombstoneSlot(void *page, unsigned pageSize, unsigned slotNum, unsigned newPageNum, unsigned newSlotNum) {
+    setSlot(page, pageSize, slotNum, -(int) newPageNum, -(int) newSlotNum);
 }
 
-void SpaceManager::getNewRecordPos(short startPos, short length, unsigned &newPageNum, unsigned &newSlotNum) {
+void SpaceManager::getNewRecordPos(int startPos, int length, unsigned &newPageNum, unsigned &newSlotNum) {
     newPageNum = -startPos;
     newSlotNum = -length;
 }
 
-void SpaceManager::nullifySlot(void *page, int slotNum) {
-    setSlot(page, slotNum, PAGE_SIZE, 0);
+void SpaceManager::nullifySlot(void *page, unsigned pageSize, unsigned slotNum) {
+    setSlot(page, pageSize, slotNum, pageSize, 0);
 }
 
-void SpaceManager::initCleanPage(void *page) {
-    memset(page, 0, PAGE_SIZE);
+void SpaceManager::initCleanPage(void *page, unsigned pageSize) {
+    memset(page, 0, pageSize);
     // create a dummy slot for prospect first record
-    setFreePtr(page, 0);
+    setFreePtr(page, pageSize, 0);
 //    setSlotCount(page, 1);
 //    nullifySlot(page, 0);
-    setSlotCount(page, 0);
+    setSlotCount(page, pageSize, 0);
 }
@@ -5,6 +5,8 @@
 #include <vector>
 #include <map>
 #include <set>
+#include <mutex>
+#include <memory>
 //#include <unordered_map>
 //#include <unordered_set>
 
@@ -56,12 +58,109 @@ enum {
     ERR_INV_COND      = -102,   // error: invalid condition
 };
 
+// RecordView is a record read in place: it points into the page holding the
+// record, and keeps that page pinned until the view is released (or
+// destroyed, or pointed to another record). Fields are read straight from
+// the page through the typed accessors, numbered as in the record
+// descriptor. A view must be released before its file is closed.
+//
+// The latch of the page is not held by the view: a view is only valid while
+// no other thread changes the records of its page (inserts, updates,
+// deletions, reorganizations), which may move or overwrite the record under
+// it. Readers racing with writers use getNextRecord() or readRecord(),
+// which copy the record under the latch.
+class RecordView {
+  friend class RecordBasedFileManager;
+  friend class RBFM_ScanIterator;
+
+public:
+  RecordView();
+  ~RecordView();
+
+  bool isValid() const;
+  const char *data() const;       // the record, in the format of insertRecord()
+  unsigned length() const;
+
+  RC getInt(unsigned fieldNum, int &value) const;
+  RC getReal(unsigned fieldNum, float &value) const;
+  // The characters are not null terminated
+  RC getVarChar(unsigned fieldNum, const char *&str, unsigned &length) const;
+  // A field as readAttribute() returns it (varchars with their length)
+  RC getField(unsigned fieldNum, const char *&field, unsigned &size) const;
+
+  RC release();                   // Unpin the page
+
+private:
+  RecordView(const RecordView &);
+  RecordView &operator=(const RecordView &);
+
+  // Pin a page for the view, unless it already holds it
+  RC attach(FileHandle &fileHandle, PageNum pageNum, void *&page);
+
+  FileHandle *fileHandle;         // handle the page is pinned through, NULL if none
+  PageNum pageNum;
+  void *page;                     // the pinned page
+  const char *record;             // the record as stored, with its header if any
+  unsigned recordLength;
+  unsigned recordFormat;          // record format of the page
+  unsigned headerSize;
+  const vector<Attribute> *recordDescriptor;
+};
+
+// Records returned together by a scan, in the format of getNextRecord().
+// A batch keeps its buffers from one fill to the next, so that refilling it
+// allocates nothing once it has grown.
+class RecordBatch {
+  friend class RBFM_ScanIterator;
+
+public:
+  RecordBatch();
+
+  unsigned size() const;                    // # of records
+  const RID &getRid(unsigned i) const;
+  const char *getRecord(unsigned i) const;
+  unsigned getRecordSize(unsigned i) const;
+  void clear();
+
+private:
+  vector<RID> rids;
+  vector<unsigned> offsets;       // record i spans [offsets[i], offsets[i + 1]) of data
+  vector<char> data;
+};
+
+// The condition of a scan, compiled by RecordBasedFileManager::scan(): the
+// constant is decoded once, and the comparison is specialized for the type
+// of the attribute and the operator.
+class ScanPredicate {
+public:
+  virtual ~ScanPredicate() {}
+
+  // Whether a field (as stored in a record, varchars with their length) meets the condition
+  virtual bool evaluate(const char *field, unsigned size) const = 0;
+  // Whether evaluateColumn() applies (int and real attributes)
+  virtual bool isColumnar() const { return false; }
+  // Evaluate count fields at once, packed in values: bit i of selection is set if field i meets the condition
+  virtual void evaluateColumn(const char *values, unsigned count, unsigned long long *selection) const {}
+
+  // NULL for NO_OP or an unknown type
+  static ScanPredicate *compile(AttrType type, CompOp compOp, const void *value);
+};
+
 /****************************************************************************
 The scan iterator is NOT required to be implemented for part 1 of the project
 *****************************************************************************/
 
 # define RBFM_EOF (-1)  // end of a scan operator
 
+// Modes of RecordBasedFileManager::scan()
+typedef enum {
+    SCAN_SERIAL = 0,            // the caller reads the pages one after the other
+    SCAN_PARALLEL_ORDERED,      // the scan threads read the pages; records come in file order
+    SCAN_PARALLEL_UNORDERED,    // same, but records come as soon as they are found
+} ScanMode;
+
+class ParallelScan;
+
 // RBFM_ScanIterator is an iterator to go through records
 // The way to use it is like the following:
 //  RBFM_ScanIterator rbfmScanIterator;
@@ -74,17 +173,31 @@ The scan iterator is NOT required to be implemented for part 1 of the project
 
 class RBFM_ScanIterator {
   friend class RecordBasedFileManager;
+  friend class ParallelScan;
 
   vector<Attribute> recordDescriptor;
-  string conditionAttribute;
-  CompOp compOp;
-  void *value;
-  vector<string> attributeNames;
+  int conditionField;       // # of the condition attribute in the descriptor, -1 if not found
+  shared_ptr<const ScanPredicate> predicate;  // NULL if every record qualifies
+  // Projection plan, built by scan()
+  vector<int> projection;   // # of each projected attribute in the descriptor (output order), -1 if not found
+  unsigned projectionWidth; // # of leading fields of a record the projection reads
+  bool projectAll;          // the projection is the whole record, in order
+  vector<unsigned> fieldBounds;   // field i of the current record spans [fieldBounds[i], fieldBounds[i + 1])
+  // Condition evaluated over a block of slots of the latched page at once (see evaluateBlock())
+  vector<char> columnValues;      // the condition field of each slot of the block
+  vector<unsigned long long> selection;   // bit i set if slot selectionStart + i meets the condition
+  vector<unsigned long long> occupied;    // bit i set if slot selectionStart + i holds a record
+  unsigned selectionStart;
+  unsigned selectionEnd;    // slots [selectionStart, selectionEnd) have been evaluated
+  unsigned blockSize;       // # of slots of the next block
   FileHandle fileHandle;
 
   unsigned nextPageNum;
   unsigned nextSlotNum;
+  PageNum endPageNum;       // the scan stops there or at the end of the file, whichever comes first
+  PageNum readAheadEnd;     // pages before it have been requested ahead
   bool active;
+  shared_ptr<ParallelScan> parallelScan;    // NULL unless the pages are read by the scan threads
 
 public:
   RBFM_ScanIterator();
@@ -92,32 +205,117 @@ public:
 
   // "data" follows the same format as RecordBasedFileManager::insertRecord()
   RC getNextRecord(RID &rid, void *data);
+  // Same, but the whole record (without projection) is read in place
+  RC getNextRecordView(RID &rid, RecordView &view);
+  // Up to maxRecords records at once (replacing the content of the batch)
+  RC getNextBatch(unsigned maxRecords, RecordBatch &batch);
   RC close();
 
 private:
+  // Append up to maxRecords records to a batch (serial scans)
+  RC fillBatch(unsigned maxRecords, RecordBatch &batch);
+  // Find the next record meeting the criterion. The page is pinned and latched on success.
+  RC findNextRecord(void *&page, int &startPos, int &recordLen, unique_lock<mutex> &latch);
+  // Point a view to a record of a page pinned by the scan (the view pins it too)
+  RC attachView(RecordView &view, PageNum pageNum, int startPos, int recordLen);
+  // Find the next record of a page meeting the criterion, from nextSlotNum on
+  bool findSlot(const void *page, int &startPos, int &recordLen);
+  // Copy the projected fields of a record
+  RC projectRecord(const void *page, int startPos, int recordLen, char *data, unsigned &size);
   // Find if a given record meets the scan criterion
-  bool meetCriterion(void *page, unsigned short startPos, unsigned short length);
+  bool meetCriterion(const void *page, unsigned startPos, unsigned length);
+  // Evaluate the condition over the slots of a page from nextSlotNum on
+  void evaluateBlock(const void *page, unsigned slotCount);
+
+  enum {
+      MIN_BLOCK_SIZE = 1,   // first block evaluated after latching a page
+      MAX_BLOCK_SIZE = 512  // blocks double in size up to it
+  };
+};
+
+// State of a parallel scan, shared by the copies of its iterator and by the
+// scan threads. The pages are split into morsels of MORSEL_PAGES pages, each
+// scanned by a task of the scan threads into a batch of its own. The reader
+// keeps at most a window of morsels handed out and not taken, and hands the
+// next one out whenever it takes one: a scan holds a bounded # of records,
+// and the scan threads never wait for the reader.
+//
+// Scans read through views leave the records in place: the scan threads
+// keep the pages with records pinned, and the reader unpins them when it
+// takes the next morsel. The first call of the reader decides the way.
+class ParallelScan : public enable_shared_from_this<ParallelScan> {
+public:
+  ParallelScan(const RBFM_ScanIterator &plan, bool ordered);
+
+  // Next record found by the scan threads, in the format of getNextRecord()
+  RC next(RID &rid, const char *&data, unsigned &size);
+  // Same, but the record as stored in its page, pinned until the next morsel is taken
+  RC nextInPlace(RID &rid, void *&page, int &startPos, int &recordLen);
+  bool isInPlace() const;
+  // Hand out no more morsels and wait for the ones being scanned
+  void cancel();
 
-  template <class T>
-  bool evaluateNumber(T number, CompOp compOP, T val);
+private:
+  // Where a record found in place is
+  struct RecordSpot {
+    RID rid;
+    void *page;
+    int startPos;
+    int recordLen;
+  };
+
+  // Records found in a morsel
+  struct Morsel {
+    RecordBatch batch;            // copied out
+    vector<RecordSpot> spots;     // or left in place
+    vector<PageNum> pinnedPages;  // pages of the spots
+    unsigned size() const;
+  };
 
-  bool evaluateString(string str, CompOp compOp, string val);
+  bool takeMorsel();        // Make current a morsel with records left, false at the end of the scan
+  void releasePages(Morsel &morsel);
+  void dispatch();          // Hand out morsels up to the window (latch held)
+  void scanMorsel(unsigned morselNum, PageNum startPage, PageNum endPage);   // Task of the scan threads
+
+  enum {
+      MORSEL_PAGES = 16,        // # of pages of a morsel
+      MORSELS_PER_THREAD = 2,   // the window, per scan thread
+  };
+
+  RBFM_ScanIterator plan;   // the scan as planned by scan(), copied by each morsel
+  bool ordered;             // records are returned in file order
+  bool inPlace;             // records are left in their pages (set before the first morsel is handed out)
+  atomic<bool> cancelled;
+
+  mutex latch;
+  condition_variable scanned;   // signaled when a morsel has been scanned
+  PageNum nextPage;         // first page of the next morsel
+  unsigned nextMorsel;      // # of the next morsel handed out
+  unsigned nextResult;      // # of the next morsel to take (in file order)
+  unsigned inFlight;        // # of morsels handed out and not taken
+  unsigned running;         // # of morsels being scanned
+  map<unsigned, Morsel> results;    // <morsel #, its records>, scanned and not taken
+
+  // Morsel being read (by the reader only, outside of the latch)
+  Morsel current;
+  unsigned cursor;
 };
 
 
 class RecordBasedFileManager
 {
-  // RBFM_ScanIterator needs to use __readAttribute()
+  // RBFM_ScanIterator and RecordView need the record format helpers
   friend class RBFM_ScanIterator;
+  friend class RecordView;
 
 public:
   static RecordBasedFileManager* instance();
 
-  RC createFile(const string &fileName);
+  RC createFile(const string &fileName, unsigned pageSize = PAGE_SIZE);
 
   RC destroyFile(const string &fileName);
 
-  RC openFile(const string &fileName, FileHandle &fileHandle);
+  RC openFile(const string &fileName, FileHandle &fileHandle, IOMode ioMode = IO_STDIO);
 
   RC closeFile(FileHandle &fileHandle);
 
@@ -128,8 +326,16 @@ public:
   //  !!!The same format is used for updateRecord(), the returned data of readRecord(), and readAttribute()
   RC insertRecord(FileHandle &fileHandle, const vector<Attribute> &recordDescriptor, const void *data, RID &rid);
 
+  // Insert many records at once into new pages appended at the end of the file
+  RC insertRecords(FileHandle &fileHandle, const vector<Attribute> &recordDescriptor,
+                   const vector<const void *> &batch, vector<RID> &rids);
+
   RC readRecord(FileHandle &fileHandle, const vector<Attribute> &recordDescriptor, const RID &rid, void *data);
 
+  // Same, but the record is read in place: the view points into the pinned page
+  RC readRecordView(FileHandle &fileHandle, const vector<Attribute> &recordDescriptor, const RID &rid,
+                    RecordView &view);
+
   // This method will be mainly used for debugging/testing
   RC printRecord(const vector<Attribute> &recordDescriptor, const void *data);
 
@@ -158,7 +364,12 @@ IMPORTANT, PLEASE READ: All methods below this comment (other than the construct
       const CompOp compOp,                  // comparision type such as "<" and "="
       const void *value,                    // used in the comparison
       const vector<string> &attributeNames, // a list of projected attributes
-      RBFM_ScanIterator &rbfm_ScanIterator);
+      RBFM_ScanIterator &rbfm_ScanIterator,
+      ScanMode scanMode = SCAN_SERIAL);
+
+  // # of threads reading pages for parallel scans (set before the first one; 0: the # of cores)
+  static void setScanThreads(unsigned count);
+  static unsigned getScanThreads();
 
 
 // Extra credit for part 2 of the project, please ignore for part 1 of the project
@@ -166,20 +377,51 @@ public:
 
   RC reorganizeFile(FileHandle &fileHandle, const vector<Attribute> &recordDescriptor);
 
+  // Maintenance: give the disk space of empty pages back (trailing ones are truncated)
+  RC reclaimSpace(FileHandle &fileHandle);
+
 
 protected:
   RecordBasedFileManager();
   ~RecordBasedFileManager();
 
 private:
-  // Helper function for insertRecord
+  // Helper function for insertRecord. heldLatch is the latch of another page held by the caller, if any.
   RC __insertRecord(const string &fileName, FileHandle &fileHandle,
-        const void *data, RID &rid, unsigned recordSize);
+        const char *record, RID &rid, unsigned recordSize, mutex *heldLatch = NULL);
+  // Helper function for insertRecords: append the page images built so far
+  RC __appendRecordPages(FileHandle &fileHandle, char *pages, unsigned pageCount,
+        vector<RID> &rids, unsigned firstRecord, unsigned endRecord);
   // Helper function for readAttribute
-  RC __readAttribute(void *page, unsigned short startPos, const vector<Attribute> &recordDescriptor,
-              const string attributeName, void *data, unsigned &dataSize);
+  RC __readAttribute(const void *page, unsigned startPos, unsigned length, unsigned format,
+              const vector<Attribute> &recordDescriptor, const string attributeName, void *data, unsigned &dataSize);
+
+  // Record format of RECORD_FORMAT_OFFSETS pages: a header holding the # of
+  // fields and the end offset of each field (from the start of the record),
+  // followed by the fields in the format of insertRecord(). A field is then
+  // found without reading the ones ahead of it.
+  //
+  // Turn data into a record of that format, at most maxSize bytes long
+  RC __encodeRecord(const vector<Attribute> &recordDescriptor, const void *data,
+              unsigned maxSize, char *record, unsigned &size);
+  static unsigned __getHeaderSize(unsigned fieldCount);
+  static unsigned __getHeaderSize(const char *record, unsigned format);   // Size of the header of a stored record
+  // Find the offset (within the stored record) and size of a field
+  static RC __locateField(const char *record, unsigned length, unsigned format,
+              const vector<Attribute> &recordDescriptor, unsigned fieldNum, unsigned &offset, unsigned &size);
+  // Find the bounds of the first fieldCount fields of a stored record at once (see fieldBounds)
+  static RC __locateFields(const char *record, unsigned length, unsigned format,
+              const vector<Attribute> &recordDescriptor, unsigned fieldCount, unsigned *bounds);
+  static int __getFieldNum(const vector<Attribute> &recordDescriptor, const string &attributeName);  // -1 if none
+
+  enum {
+    BULK_WRITE_SIZE = 1 << 20,    // # of bytes of page images insertRecords() appends at once
+    FIELD_COUNT_LEN  = 2,         // sizes within the record header (in byte)
+    FIELD_OFFSET_LEN = 2,
+  };
 
   static RecordBasedFileManager *_rbf_manager;
+  static unsigned _scanThreads;
 
   static PagedFileManager *_pfm_manager;
 };
@@ -195,57 +437,147 @@ enum {
   ERR_INV_FREE_SIZE         = -207,  // error: invalid free size (< 0)
 };
 
+// SpaceManager is safe for concurrent use. The free space maps are guarded
+// by one latch, and the records of a page by the latch of the page, held
+// while a page is read or changed. Page latches are shared by several pages,
+// so a thread holding one never waits for another: it may only try it.
 class SpaceManager {
 public:
-  typedef map<int, set<int> > FreeSpaceMap;    // <free space size, corresponding locations (page #)>
-
   static SpaceManager *instance();
-  static void *getPageBuffer();
-  RC bufferSizeInfo(const string &fileName, FileHandle &fileHandle);
+  static string getFreeSpaceFileName(const string &fileName);   // Name of the file persisting the map
+  // The map of a file is loaded by its first rbfm handle and saved by the last one
+  RC openFreeSpaceMap(const string &fileName, FileHandle &fileHandle);
+  RC closeFreeSpaceMap(const string &fileName, FileHandle &fileHandle);
+  RC saveFreeSpaceMaps();   // Save the changed maps of all open files (at checkpoints)
+  RC bufferSizeInfo(const string &fileName, FileHandle &fileHandle);    // Rebuild the map from all pages
   RC allocateSpace(const string &fileName, FileHandle &fileHandle, int spaceSize, int &pageNum);
+  // Same as above, plus the free size the map knew the page had
+  RC allocateSpace(const string &fileName, FileHandle &fileHandle, int spaceSize, int &pageNum, int &freeSize);
   RC deallocateSpace(const string &fileName, FileHandle &fileHandle, unsigned pageNum, unsigned slotNum);
   RC deallocateAllSpaces(const string &fileName, FileHandle &fileHandle);
   void printFreeSpaceMap();   // Print out the map for debugging purposes
-  void insertFreeSpaceMap(const string &fileName, int pageNum, int size);
-  RC updateFreeSpaceMap(const string &fileName, int pageNum, int oldSize, int newSize);
-  void clearFreeSpaceMap(const string &fileName);
-
-  unsigned short getFreePtr(void *page);
-  unsigned short getSlotCount(void *page);
-  short getSlotStartPos(void *page, unsigned slotNum);
-  short getSlotLength(void *page, unsigned slotNum);
-  void setFreePtr(void *page, unsigned short data);
-  void setSlotCount(void *page, unsigned short data);
-  void setSlotStartPos(void *page, unsigned slotNum, short data);
-  void setSlotLength(void *page, unsigned slotNum, short data);
-  void setSlot(void *page, int slotNum, short start, short length);
-  void writeRecord(void *page, const void *data, unsigned short start, unsigned size);
-  void readRecord(const void *page, void *data, unsigned short start, unsigned size);
+  // Set the free size of a page, replacing the previous one (pages without free space leave the map)
+  void insertFreeSpaceMap(FileHandle &fileHandle, int pageNum, int size);
+  void clearFreeSpaceMap(FileHandle &fileHandle);
+  void removeFreeSpaceMap(FileHandle &fileHandle, int pageNum);
+  bool isFreePage(FileHandle &fileHandle, int pageNum); // Whether the map knows the page is empty
+  // Truncate the trailing empty pages of a file, and punch holes over the other runs of them if asked to
+  RC reclaimSpace(const string &fileName, FileHandle &fileHandle, bool punch);
+  mutex &getPageLatch(FileHandle &fileHandle, PageNum pageNum);   // Latch of the records of a page
+  RC lockPage(FileHandle &fileHandle, PageNum pageNum, bool wait); // Take a page for the running transaction
+
+  // Page layout: records grow from the beginning of the page, the slot
+  // directory grows backwards from its end. The end of a page (pageSize
+  // bytes, the page size of its file) holds the free pointer and the # of
+  // slots, followed by one {start, length} entry per slot.
+  unsigned getFreePtr(const void *page, unsigned pageSize);
+  unsigned getSlotCount(const void *page, unsigned pageSize);
+  int getSlotStartPos(const void *page, unsigned pageSize, unsigned slotNum);
+  int getSlotLength(const void *page, unsigned pageSize, unsigned slotNum);
+  void setFreePtr(void *page, unsigned pageSize, unsigned data);
+  void setSlotCount(void *page, unsigned pageSize, unsigned data);
+  void setSlotStartPos(void *page, unsigned pageSize, unsigned slotNum, int data);
+  void setSlotLength(void *page, unsigned pageSize, unsigned slotNum, int data);
+  void setSlot(void *page, unsigned pageSize, unsigned slotNum, int start, int length);
+  void writeRecord(void *page, const void *data, unsigned start, unsigned size);
+  void readRecord(const void *page, void *data, unsigned start, unsigned size);
 
   unsigned getMetadataSize(int slotCount);
-  unsigned getPageFreeSize(void *page);
+  unsigned getPageFreeSize(const void *page, unsigned pageSize);
+  int getEmptyPageFreeSize(unsigned pageSize);    // Free size of a page without any record
+  bool isEmptyPage(const void *page, unsigned pageSize);  // Find whether no slot holds a record or a tomb stone
   // Find whether there are still allocated slots yet used. If so, return the first slot #
-  bool hasFreeExistingSlot(void *page, unsigned short slotCount, unsigned short &firstFreeSlot);
-  bool isTombstoneSlot(short startPos, short size); // Find whether the slot directory is tomb-stoned
-  bool isOccupiedSlot(short startPos, short length); // Check whether the slot is normally occupied
-  bool isDeletedSlot(short startPos, short length); // Check whether the slot has been deleted
-  void setTombstoneSlot(void *page, int slotNum, short newPageNum, short newSlotNum); // Set a slot as a tomb stone
-  void getNewRecordPos(short startPos, short length, unsigned &newPageNum, unsigned &newSlotNum); // Get new position from tomb stone
-  void nullifySlot(void *page, int slotNum);  // Set the slot directory null (record deletion)
-  void initCleanPage(void *page);
+  bool hasFreeExistingSlot(const void *page, unsigned pageSize, unsigned slotCount, unsigned &firstFreeSlot);
+  bool isTombstoneSlot(int startPos, int size); // Find whether the slot directory is tomb-stoned
+  bool isOccupiedSlot(int startPos, int length, unsigned pageSize); // Check whether the slot is normally occupied
+  bool isDeletedSlot(int startPos, int length, unsigned pageSize); // Check whether the slot has been deleted
+  // Set a slot as a tomb stone
+  void setTombstoneSlot(void *page, unsigned pageSize, unsigned slotNum, unsigned newPageNum, unsigned newSlotNum);
+  void getNewRecordPos(int startPos, int length, unsigned &newPageNum, unsigned &newSlotNum); // Get new position from tomb stone
+  void nullifySlot(void *page, unsigned pageSize, unsigned slotNum);  // Set the slot directory null (record deletion)
+  void initCleanPage(void *page, unsigned pageSize);
+
+  // Record formats. The format of the records of a page is kept in the high
+  // byte of its slot count, which older pages left zero.
+  enum {
+    RECORD_FORMAT_PLAIN   = 0,      // records as passed to insertRecord()
+    RECORD_FORMAT_OFFSETS = 1,      // records led by a field offset array
+  };
+  unsigned getRecordFormat(const void *page, unsigned pageSize);
+  void setRecordFormat(void *page, unsigned pageSize, unsigned format);
 
 private:
   // Variable sizes within metadata (in byte)
   enum {
-    FREE_PTR_LEN   = 2,
-    SLOT_NUM_LEN   = 2,
-    SLOT_START_LEN = 2,
-    SLOT_LEN_LEN   = 2,
+    FREE_PTR_LEN   = 4,
+    SLOT_NUM_LEN   = 4,
+    SLOT_START_LEN = 4,
+    SLOT_LEN_LEN   = 4,
+    SLOT_COUNT_MASK     = 0x00FFFFFF,   // bits of the slot count word holding the count
+    RECORD_FORMAT_SHIFT = 24,           // the others hold the record format
+  };
+
+  // Free space map of a file, keyed by the id of the file in the buffer
+  // pool. Pages fall into size classes by their free size: class c holds
+  // the pages with c steps of pageSize / FSM_STEPS bytes free, and empty
+  // pages have their own class. Each class is a list threaded through the
+  // page entries, and a bitmap tells which classes have pages, so that
+  // finding, taking and filing a page costs no allocation nor tree walk.
+  //
+  // The classes are also the categories of the persistent map: the pages
+  // of the "<file>.fsm" file hold one byte per page of the file. The header
+  // of the file points to the map once it has been saved, by the last close
+  // or by a checkpoint of the log. A map saved by a checkpoint may lag
+  // behind the pages, so it is only trusted as a hint: inserts check the
+  // free size of the page they get, and a page is reclaimed only if it
+  // holds no record.
+  enum {
+    FSM_PAGE_ENTRIES = PAGE_SIZE,   // # of pages described by a page of the map
+    FSM_STEPS        = 256,         // # of size classes, a step is pageSize / FSM_STEPS bytes
+    FSM_MAX_CATEGORY = 254,         // highest class of a page holding records
+    FSM_EMPTY_PAGE   = 255,         // class of a page without records
+    FSM_BITMAP_WORDS = FSM_STEPS / 64,
+    PAGE_LATCHES     = 1024,        // # of page latches, shared by pages with the same hash
+  };
+
+  struct FreePage {
+    FreePage() : size(0), prev(-1), next(-1) {}
+    int size;                       // free size, 0 if the page is not in the map
+    int prev;                       // previous page of its class, -1 if none
+    int next;                       // next page of its class, -1 if none
+  };
+
+  struct FreeSpaceIndex {
+    FreeSpaceIndex(unsigned pageSize);
+    unsigned pageSize;                    // page size of the file
+    unsigned openCount;                   // # of rbfm handles opened on the file
+    vector<FreePage> pages;               // <page #, entry>
+    int heads[FSM_STEPS];                 // first page of each class, -1 if none
+    unsigned long long nonEmpty[FSM_BITMAP_WORDS];  // bit c is set if class c has pages
+    vector<bool> dirtyPages;              // pages of the persistent map changed since it was saved
+    FileHandle handle;                    // copy of the first rbfm handle, to save the map at checkpoints
   };
 
-  map<string, FreeSpaceMap> __freeSpace;       // <file name, free space map>
+  FreeSpaceIndex *findIndex(FileHandle &fileHandle);   // NULL if the file has no map
+  FreeSpaceIndex &getIndex(FileHandle &fileHandle);    // Create the map if needed
+  void eraseIndex(FileHandle &fileHandle);
+  void linkPage(FreeSpaceIndex &index, int pageNum, int size);
+  void unlinkPage(FreeSpaceIndex &index, int pageNum);
+  int findSizeClass(const FreeSpaceIndex &index, int sizeClass);  // First class >= sizeClass with pages, -1 if none
+  void markDirty(FreeSpaceIndex &index, int pageNum);
+  bool isReclaimablePage(FileHandle &fileHandle, int pageNum);  // Empty as per the map and the page itself
+
+  RC loadFreeSpaceMap(const string &fileName, FileHandle &fileHandle);
+  RC saveFreeSpaceMap(const string &fileName, FileHandle &fileHandle);
+  int toCategory(int size, unsigned pageSize);
+  int fromCategory(int category, unsigned pageSize);
+
+  vector<FreeSpaceIndex *> __freeSpace;       // <file id, free space map>, NULL if none
+  // Guards the maps. The public methods lock it and call each other, hence
+  // recursive; it is never held while waiting for a page latch.
+  recursive_mutex __latch;
+  mutex __pageLatches[PAGE_LATCHES];
   static SpaceManager *_sp_manager;   // SpaceManager instance
-  static void *__buffer;              // the page buffer used to store a page temporarily
 
 protected:
   SpaceManager();
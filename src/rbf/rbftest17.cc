@@ -0,0 +1,160 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cassert>
+#include <sys/stat.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdexcept>
+#include <stdio.h>
+
+#include "pfm.h"
+#include "rbfm.h"
+
+using namespace std;
+
+const int success = 0;
+unsigned total = 0;
+
+const unsigned frameCount = 4;
+const unsigned pageCount = 8;
+
+int RBFTest_17(PagedFileManager *pfm) {
+	// Functions Tested:
+	// 1. Read pages through a buffer pool smaller than the file
+	// 2. Pin and unpin a page
+	// 3. Write back a page modified through its frame
+	// 4. Pin more pages than the pool can hold - should fail
+	// 5. Read consecutive pages at once
+	cout << "****In RBF Test Case 17****" << endl;
+
+	RC rc;
+	string fileName = "test17";
+
+	rc = pfm->createFile(fileName.c_str());
+	assert(rc == success);
+
+	FileHandle fileHandle;
+	rc = pfm->openFile(fileName.c_str(), fileHandle);
+	assert(rc == success);
+
+	// Append pages, each filled with its own page number
+	char data[PAGE_SIZE];
+	for (unsigned i = 0; i < pageCount; i++) {
+		memset(data, i, PAGE_SIZE);
+		rc = fileHandle.appendPage(data);
+		assert(rc == success);
+	}
+	assert(fileHandle.getNumberOfPages() == pageCount);
+
+	// Read all pages twice: the pool cannot hold them all
+	for (unsigned round = 0; round < 2; round++) {
+		for (unsigned i = 0; i < pageCount; i++) {
+			rc = fileHandle.readPage(i, data);
+			assert(rc == success);
+			if (data[0] != (char) i || data[PAGE_SIZE - 1] != (char) i) {
+				cout << "Page " << i << " has wrong content." << endl;
+				return -1;
+			}
+		}
+	}
+
+	unsigned readCount, writeCount, appendCount, hitCount, missCount, evictionCount;
+	fileHandle.collectCounterValues(readCount, writeCount, appendCount, hitCount, missCount, evictionCount);
+	cout << "read " << readCount << ", write " << writeCount << ", append " << appendCount
+	     << ", hit " << hitCount << ", miss " << missCount << ", eviction " << evictionCount << endl;
+	if (readCount != 2 * pageCount || appendCount != pageCount || evictionCount == 0) {
+		cout << "Unexpected counter values." << endl;
+		return -1;
+	}
+
+	// Read consecutive pages at once
+	char pages[pageCount][PAGE_SIZE];
+	void *buffers[pageCount];
+	for (unsigned i = 0; i < pageCount; i++) {
+		buffers[i] = pages[i];
+	}
+	rc = fileHandle.readPages(0, pageCount, buffers);
+	assert(rc == success);
+	for (unsigned i = 0; i < pageCount; i++) {
+		if (pages[i][0] != (char) i || pages[i][PAGE_SIZE - 1] != (char) i) {
+			cout << "Page " << i << " read by readPages() has wrong content." << endl;
+			return -1;
+		}
+	}
+	rc = fileHandle.readPages(pageCount - 1, 2, buffers);
+	if (rc == success) {
+		cout << "This readPages test should fail. However, it returned a success RC." << endl;
+		return -1;
+	}
+
+	// Modify a page in place
+	void *frame;
+	rc = fileHandle.pinPage(3, frame);
+	assert(rc == success);
+	memset(frame, 'x', PAGE_SIZE);
+	rc = fileHandle.unpinPage(3, true);
+	assert(rc == success);
+
+	// Unpinning a page which is not pinned should fail
+	rc = fileHandle.unpinPage(3, false);
+	if (rc == success) {
+		cout << "This unpinPage test should fail. However, it returned a success RC." << endl;
+		return -1;
+	}
+
+	// Pin every frame, then one more page
+	void *frames[frameCount];
+	for (unsigned i = 0; i < frameCount; i++) {
+		rc = fileHandle.pinPage(i, frames[i]);
+		assert(rc == success);
+	}
+	rc = fileHandle.pinPage(frameCount, frame);
+	if (rc == success) {
+		cout << "This pinPage test should fail. However, it returned a success RC." << endl;
+		return -1;
+	}
+	for (unsigned i = 0; i < frameCount; i++) {
+		rc = fileHandle.unpinPage(i, false);
+		assert(rc == success);
+	}
+
+	rc = pfm->closeFile(fileHandle);
+	assert(rc == success);
+
+	// The modified page should be on the disk now (after the header page)
+	FILE *fp = fopen(fileName.c_str(), "r");
+	assert(fp != NULL);
+	fseek(fp, (3 + 1) * PAGE_SIZE, SEEK_SET);
+	if (fread(data, 1, PAGE_SIZE, fp) != PAGE_SIZE || data[0] != 'x' || data[PAGE_SIZE - 1] != 'x') {
+		cout << "The dirty page has not been written back." << endl;
+		fclose(fp);
+		return -1;
+	}
+	fclose(fp);
+
+	rc = pfm->destroyFile(fileName.c_str());
+	assert(rc == success);
+
+	return 0;
+}
+
+int main() {
+	// Use a tiny pool to exercise page replacement
+	PagedFileManager::setBufferFrames(frameCount);
+	PagedFileManager *pfm = PagedFileManager::instance();
+
+	remove("test17");
+
+	int rc = RBFTest_17(pfm);
+	if (rc == 0) {
+		cout << "Test Case 17 Passed!" << endl << endl;
+		total += 4;
+	} else {
+		cout << "Test Case 17 Failed!" << endl << endl;
+	}
+
+	cout << "Score for Test Case 17: " << total << " / 4" << endl;
+
+	return 0;
+}
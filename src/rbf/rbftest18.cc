@@ -0,0 +1,144 @@
+#include <iostream>
+#include <string>
+#include <cassert>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+#include "pfm.h"
+#include "rbfm.h"
+
+using namespace std;
+
+const int success = 0;
+unsigned total = 0;
+
+const unsigned frameCount = 16;
+const unsigned pageCount = 64;
+const unsigned threadCount = 4;
+const unsigned roundCount = 20;
+
+// Read all pages several times and check their content
+void readPages(FileHandle *fileHandle, unsigned seed, int *result) {
+	char data[PAGE_SIZE];
+	*result = 0;
+	for (unsigned round = 0; round < roundCount; round++) {
+		for (unsigned i = 0; i < pageCount; i++) {
+			unsigned pageNum = (i * 7 + seed + round) % pageCount;
+			if (fileHandle->readPage(pageNum, data) != success
+					|| data[0] != (char) pageNum || data[PAGE_SIZE - 1] != (char) pageNum) {
+				*result = -1;
+				return;
+			}
+		}
+	}
+}
+
+int RBFTest_18(PagedFileManager *pfm) {
+	// Functions Tested:
+	// 1. Open a file with positional I/O
+	// 2. Read pages of one handle from several threads at once
+	// 3. Counters of a shared handle
+	// 4. Read scattered pages in the background and wait for them
+	cout << "****In RBF Test Case 18****" << endl;
+
+	RC rc;
+	string fileName = "test18";
+
+	rc = pfm->createFile(fileName.c_str());
+	assert(rc == success);
+
+	FileHandle fileHandle;
+	rc = pfm->openFile(fileName.c_str(), fileHandle, IO_PREAD);
+	assert(rc == success);
+	assert(fileHandle.getIOMode() == IO_PREAD);
+
+	char data[PAGE_SIZE];
+	for (unsigned i = 0; i < pageCount; i++) {
+		memset(data, i, PAGE_SIZE);
+		rc = fileHandle.appendPage(data);
+		assert(rc == success);
+	}
+
+	vector<thread> threads;
+	int results[threadCount];
+	for (unsigned i = 0; i < threadCount; i++) {
+		threads.push_back(thread(readPages, &fileHandle, i, &results[i]));
+	}
+	for (unsigned i = 0; i < threadCount; i++) {
+		threads[i].join();
+	}
+	for (unsigned i = 0; i < threadCount; i++) {
+		if (results[i] != success) {
+			cout << "Thread " << i << " read a wrong page." << endl;
+			return -1;
+		}
+	}
+
+	unsigned readCount, writeCount, appendCount;
+	fileHandle.collectCounterValues(readCount, writeCount, appendCount);
+	cout << "read " << readCount << ", write " << writeCount << ", append " << appendCount << endl;
+	if (readCount != threadCount * roundCount * pageCount || appendCount != pageCount) {
+		cout << "Unexpected counter values." << endl;
+		return -1;
+	}
+
+	// Every other page, in reverse order, more than the pool holds at once
+	vector<PageNum> pageNums;
+	for (unsigned i = pageCount; i >= 2; i -= 2) {
+		pageNums.push_back(i - 1);
+	}
+	pageNums.push_back(pageCount + 10);		// past the end, ignored
+	rc = fileHandle.prefetchPages(pageNums);
+	assert(rc == success);
+	rc = fileHandle.waitForPages(pageNums);
+	assert(rc == success);
+	for (unsigned i = 0; i + 1 < pageNums.size(); i++) {
+		rc = fileHandle.readPage(pageNums[i], data);
+		assert(rc == success);
+		if (data[0] != (char) pageNums[i] || data[PAGE_SIZE - 1] != (char) pageNums[i]) {
+			cout << "Prefetched page " << pageNums[i] << " has wrong content." << endl;
+			return -1;
+		}
+	}
+
+	rc = pfm->closeFile(fileHandle);
+	assert(rc == success);
+
+	// Reopen through stdio and check the page count in the header
+	rc = pfm->openFile(fileName.c_str(), fileHandle);
+	assert(rc == success);
+	if (fileHandle.getNumberOfPages() != pageCount) {
+		cout << "Wrong page count after reopening the file." << endl;
+		return -1;
+	}
+	rc = pfm->closeFile(fileHandle);
+	assert(rc == success);
+
+	rc = pfm->destroyFile(fileName.c_str());
+	assert(rc == success);
+
+	return 0;
+}
+
+int main() {
+	// Use a small pool so that threads evict each other's pages
+	PagedFileManager::setBufferFrames(frameCount);
+	PagedFileManager *pfm = PagedFileManager::instance();
+
+	remove("test18");
+
+	int rc = RBFTest_18(pfm);
+	if (rc == 0) {
+		cout << "Test Case 18 Passed!" << endl << endl;
+		total += 4;
+	} else {
+		cout << "Test Case 18 Failed!" << endl << endl;
+	}
+
+	cout << "Score for Test Case 18: " << total << " / 4" << endl;
+
+	return 0;
+}
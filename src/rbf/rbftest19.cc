@@ -0,0 +1,123 @@
+#include <iostream>
+#include <string>
+#include <cassert>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "pfm.h"
+#include "rbfm.h"
+
+using namespace std;
+
+const int success = 0;
+unsigned total = 0;
+
+const unsigned pageCount = 10;
+
+int RBFTest_19(PagedFileManager *pfm) {
+	// Functions Tested:
+	// 1. Open a file as a read-only mapping
+	// 2. Read and pin pages in the mapping
+	// 3. Write to a mapped file - should fail
+	// 4. Read pages appended after the file was mapped
+	cout << "****In RBF Test Case 19****" << endl;
+
+	RC rc;
+	string fileName = "test19";
+
+	rc = pfm->createFile(fileName.c_str());
+	assert(rc == success);
+
+	FileHandle writer;
+	rc = pfm->openFile(fileName.c_str(), writer);
+	assert(rc == success);
+
+	char data[PAGE_SIZE];
+	for (unsigned i = 0; i < pageCount; i++) {
+		memset(data, i, PAGE_SIZE);
+		rc = writer.appendPage(data);
+		assert(rc == success);
+	}
+	// Only in the buffer pool so far; mapping the file should write it back
+	memset(data, 'w', PAGE_SIZE);
+	rc = writer.writePage(0, data);
+	assert(rc == success);
+
+	FileHandle reader;
+	rc = pfm->openFile(fileName.c_str(), reader, IO_MMAP);
+	assert(rc == success);
+	assert(reader.getNumberOfPages() == pageCount);
+
+	void *page;
+	rc = reader.pinPage(0, page);
+	assert(rc == success);
+	if (((char *) page)[0] != 'w') {
+		cout << "The mapping does not see the written page." << endl;
+		return -1;
+	}
+	rc = reader.unpinPage(0, false);
+	assert(rc == success);
+
+	for (unsigned i = 1; i < pageCount; i++) {
+		rc = reader.readPage(i, data);
+		assert(rc == success);
+		if (data[0] != (char) i || data[PAGE_SIZE - 1] != (char) i) {
+			cout << "Page " << i << " has wrong content." << endl;
+			return -1;
+		}
+	}
+
+	rc = reader.writePage(1, data);
+	if (rc == success) {
+		cout << "This writePage test should fail. However, it returned a success RC." << endl;
+		return -1;
+	}
+	rc = reader.appendPage(data);
+	if (rc == success) {
+		cout << "This appendPage test should fail. However, it returned a success RC." << endl;
+		return -1;
+	}
+
+	// Grow the file, the mapping should follow
+	memset(data, 'g', PAGE_SIZE);
+	rc = writer.appendPage(data);
+	assert(rc == success);
+	assert(reader.getNumberOfPages() == pageCount + 1);
+	rc = reader.pinPage(pageCount, page);
+	assert(rc == success);
+	if (((char *) page)[0] != 'g' || ((char *) page)[PAGE_SIZE - 1] != 'g') {
+		cout << "The mapping does not see the appended page." << endl;
+		return -1;
+	}
+	rc = reader.unpinPage(pageCount, false);
+	assert(rc == success);
+
+	rc = pfm->closeFile(reader);
+	assert(rc == success);
+	rc = pfm->closeFile(writer);
+	assert(rc == success);
+
+	rc = pfm->destroyFile(fileName.c_str());
+	assert(rc == success);
+
+	return 0;
+}
+
+int main() {
+	PagedFileManager *pfm = PagedFileManager::instance();
+
+	remove("test19");
+
+	int rc = RBFTest_19(pfm);
+	if (rc == 0) {
+		cout << "Test Case 19 Passed!" << endl << endl;
+		total += 4;
+	} else {
+		cout << "Test Case 19 Failed!" << endl << endl;
+	}
+
+	cout << "Score for Test Case 19: " << total << " / 4" << endl;
+
+	return 0;
+}
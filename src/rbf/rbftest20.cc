@@ -0,0 +1,129 @@
+#include <iostream>
+#include <string>
+#include <cassert>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "pfm.h"
+#include "rbfm.h"
+
+using namespace std;
+
+const int success = 0;
+unsigned total = 0;
+
+const unsigned frameCount = 64;
+const unsigned dirtyRatio = 10;
+const unsigned pageCount = 40;
+
+// Check the pages on the disk (after the header page), bypassing the pool
+bool pagesOnDisk(const string &fileName, char fill) {
+	FILE *fp = fopen(fileName.c_str(), "r");
+	if (!fp) {
+		return false;
+	}
+	char data[PAGE_SIZE];
+	bool found = true;
+	for (unsigned i = 0; i < pageCount && found; i++) {
+		if (fseek(fp, (i + 1) * PAGE_SIZE, SEEK_SET)
+				|| fread(data, 1, PAGE_SIZE, fp) != PAGE_SIZE
+				|| data[0] != (char) (fill + i) || data[PAGE_SIZE - 1] != (char) (fill + i)) {
+			found = false;
+		}
+	}
+	fclose(fp);
+	return found;
+}
+
+// Wait for the background flusher (a few flush intervals at most)
+bool waitForDisk(const string &fileName, char fill) {
+	for (unsigned i = 0; i < 3 * FLUSH_INTERVAL_MS / 100; i++) {
+		if (pagesOnDisk(fileName, fill)) {
+			return true;
+		}
+		usleep(100 * 1000);
+	}
+	return false;
+}
+
+int RBFTest_20(PagedFileManager *pfm) {
+	// Functions Tested:
+	// 1. Append pages without writing them at once
+	// 2. Background write-back of dirty pages
+	// 3. Write-back of dirty pages on flushAllPages()
+	// 4. Read pages whose writes are still cached
+	cout << "****In RBF Test Case 20****" << endl;
+
+	RC rc;
+	string fileName = "test20";
+
+	rc = pfm->createFile(fileName.c_str());
+	assert(rc == success);
+
+	FileHandle fileHandle;
+	rc = pfm->openFile(fileName.c_str(), fileHandle);
+	assert(rc == success);
+
+	// More dirty pages than the dirty ratio allows
+	char data[PAGE_SIZE];
+	for (unsigned i = 0; i < pageCount; i++) {
+		memset(data, 'a' + i, PAGE_SIZE);
+		rc = fileHandle.appendPage(data);
+		assert(rc == success);
+	}
+	if (!waitForDisk(fileName, 'a')) {
+		cout << "The flusher has not written back the appended pages." << endl;
+		return -1;
+	}
+
+	// Overwrite every page, then read them back through the pool
+	for (unsigned i = 0; i < pageCount; i++) {
+		memset(data, 'A' + i, PAGE_SIZE);
+		rc = fileHandle.writePage(i, data);
+		assert(rc == success);
+	}
+	for (unsigned i = 0; i < pageCount; i++) {
+		rc = fileHandle.readPage(i, data);
+		assert(rc == success);
+		if (data[0] != (char) ('A' + i) || data[PAGE_SIZE - 1] != (char) ('A' + i)) {
+			cout << "Page " << i << " has wrong content." << endl;
+			return -1;
+		}
+	}
+	rc = pfm->flushAllPages();
+	assert(rc == success);
+	if (!pagesOnDisk(fileName, 'A')) {
+		cout << "flushAllPages() has not written back the dirty pages." << endl;
+		return -1;
+	}
+
+	rc = pfm->closeFile(fileHandle);
+	assert(rc == success);
+
+	rc = pfm->destroyFile(fileName.c_str());
+	assert(rc == success);
+
+	return 0;
+}
+
+int main() {
+	PagedFileManager::setBufferFrames(frameCount);
+	PagedFileManager::setDirtyRatio(dirtyRatio);
+	PagedFileManager *pfm = PagedFileManager::instance();
+
+	remove("test20");
+
+	int rc = RBFTest_20(pfm);
+	if (rc == 0) {
+		cout << "Test Case 20 Passed!" << endl << endl;
+		total += 4;
+	} else {
+		cout << "Test Case 20 Failed!" << endl << endl;
+	}
+
+	cout << "Score for Test Case 20: " << total << " / 4" << endl;
+
+	return 0;
+}
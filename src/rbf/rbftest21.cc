@@ -0,0 +1,370 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <set>
+#include <thread>
+#include <atomic>
+#include <cassert>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "pfm.h"
+#include "wal.h"
+
+using namespace std;
+
+const int success = 0;
+unsigned total = 0;
+
+const unsigned pageCount = 4;
+const unsigned threadCount = 8;
+const unsigned commitsPerThread = 25;
+const string fileName = "test21";
+const string logName = "test21log";
+const string newFileName = "test21new";
+
+// Write a page filled with one byte
+RC fillPage(FileHandle &fileHandle, PageNum pageNum, char fill) {
+	char data[PAGE_SIZE];
+	memset(data, fill, PAGE_SIZE);
+	return fileHandle.writePage(pageNum, data);
+}
+
+bool checkPage(FileHandle &fileHandle, PageNum pageNum, char fill) {
+	char data[PAGE_SIZE];
+	if (fileHandle.readPage(pageNum, data) != success
+			|| data[0] != fill || data[PAGE_SIZE - 1] != fill) {
+		cout << "Page " << pageNum << " has wrong content." << endl;
+		return false;
+	}
+	return true;
+}
+
+// A transaction which changes pages, writes them back and never finishes
+void loser(PagedFileManager *pfm) {
+	FileHandle fileHandle;
+	RC rc = pfm->openFile(fileName.c_str(), fileHandle);
+	assert(rc == success);
+
+	LogManager::instance()->beginTransaction();
+	rc = fillPage(fileHandle, 1, 'z');
+	assert(rc == success);
+	rc = fillPage(fileHandle, 2, 'z');
+	assert(rc == success);
+	rc = pfm->createFile(newFileName.c_str());
+	assert(rc == success);
+	rc = pfm->flushAllPages();
+	assert(rc == success);
+}
+
+bool fileExists(const string &name) {
+	return access(name.c_str(), F_OK) == 0;
+}
+
+// Runs in a child process which then crashes
+void crash() {
+	PagedFileManager *pfm = PagedFileManager::instance();
+	LogManager *logManager = LogManager::instance();
+	RC rc = logManager->open(logName.c_str());
+	assert(rc == success);
+
+	// A committed transaction which creates the file
+	logManager->beginTransaction();
+	rc = pfm->createFile(fileName.c_str());
+	assert(rc == success);
+	FileHandle fileHandle;
+	rc = pfm->openFile(fileName.c_str(), fileHandle);
+	assert(rc == success);
+	char data[PAGE_SIZE];
+	for (unsigned i = 0; i < pageCount; i++) {
+		memset(data, 'a' + i, PAGE_SIZE);
+		rc = fileHandle.appendPage(data);
+		assert(rc == success);
+	}
+	rc = logManager->commitTransaction();
+	assert(rc == success);
+
+	std::thread thread(loser, pfm);
+	thread.join();
+
+	// A committed transaction whose page is only in the pool
+	logManager->beginTransaction();
+	rc = fillPage(fileHandle, 3, 'x');
+	assert(rc == success);
+	rc = logManager->commitTransaction();
+	assert(rc == success);
+
+	_exit(0);
+}
+
+void committer(FileHandle *fileHandle, PageNum pageNum) {
+	for (unsigned i = 0; i < commitsPerThread; i++) {
+		LogManager::instance()->beginTransaction();
+		RC rc = fillPage(*fileHandle, pageNum, (char) i);
+		assert(rc == success);
+		rc = LogManager::instance()->commitTransaction();
+		assert(rc == success);
+	}
+}
+
+// A transaction writing a page of another one, then waiting for it
+void waiter(FileHandle *fileHandle, atomic<int> *result) {
+	LogManager *logManager = LogManager::instance();
+	logManager->beginTransaction();
+	RC rc = fillPage(*fileHandle, 1, 'u');
+	assert(rc == success);
+	*result = fillPage(*fileHandle, 0, 'u');
+	rc = logManager->lockPage(fileName, 0, true);
+	assert(rc == success);
+	rc = fillPage(*fileHandle, 0, 'u');
+	assert(rc == success);
+	rc = logManager->commitTransaction();
+	assert(rc == success);
+}
+
+// Two of these transactions wait for the page of each other
+void locker(FileHandle *fileHandle, PageNum own, PageNum other, char fill,
+		atomic<unsigned> *ready, atomic<unsigned> *deadlocks) {
+	LogManager *logManager = LogManager::instance();
+	logManager->beginTransaction();
+	RC rc = fillPage(*fileHandle, own, fill);
+	assert(rc == success);
+	ready->fetch_add(1);
+	while (ready->load() < 2) {
+		this_thread::yield();
+	}
+	rc = logManager->lockPage(fileName, other, true);
+	if (rc == ERR_DEADLOCK) {
+		deadlocks->fetch_add(1);
+		rc = logManager->abortTransaction();
+		assert(rc == success);
+		return;
+	}
+	assert(rc == success);
+	rc = fillPage(*fileHandle, other, fill);
+	assert(rc == success);
+	rc = logManager->commitTransaction();
+	assert(rc == success);
+}
+
+int RBFTest_21() {
+	// Functions Tested:
+	// 1. Redo committed transactions after a crash
+	// 2. Undo unfinished transactions after a crash
+	// 3. Roll back a transaction, with the files it created or destroyed
+	// 4. Page locks of concurrent transactions, deadlocks
+	// 5. Group commit of concurrent transactions
+	// 6. Checkpoint
+	cout << "****In RBF Test Case 21****" << endl;
+
+	// Crash before the buffer pool exists in this process
+	pid_t pid = fork();
+	assert(pid >= 0);
+	if (pid == 0) {
+		crash();
+	}
+	int status;
+	waitpid(pid, &status, 0);
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		cout << "The crashing process failed." << endl;
+		return -1;
+	}
+
+	RC rc;
+	PagedFileManager *pfm = PagedFileManager::instance();
+	LogManager *logManager = LogManager::instance();
+	rc = logManager->open(logName.c_str());
+	assert(rc == success);
+
+	FileHandle fileHandle;
+	rc = pfm->openFile(fileName.c_str(), fileHandle);
+	assert(rc == success);
+	if (fileHandle.getNumberOfPages() != pageCount) {
+		cout << "The file has " << fileHandle.getNumberOfPages() << " pages." << endl;
+		return -1;
+	}
+	if (!checkPage(fileHandle, 0, 'a') || !checkPage(fileHandle, 1, 'b')
+			|| !checkPage(fileHandle, 2, 'c') || !checkPage(fileHandle, 3, 'x')) {
+		return -1;
+	}
+	if (fileExists(newFileName)) {
+		cout << "The file created by an unfinished transaction is left." << endl;
+		return -1;
+	}
+
+	// Roll back a transaction
+	set<string> undoneFiles;
+	logManager->beginTransaction();
+	rc = fillPage(fileHandle, 0, 'q');
+	assert(rc == success);
+	rc = logManager->abortTransaction(&undoneFiles);
+	assert(rc == success);
+	if (!checkPage(fileHandle, 0, 'a')) {
+		return -1;
+	}
+	if (undoneFiles.size() != 1 || !undoneFiles.count(fileName)) {
+		cout << "The rollback reported " << undoneFiles.size() << " restored files." << endl;
+		return -1;
+	}
+
+	// A nested abort leaves the rollback to the outermost commit
+	undoneFiles.clear();
+	logManager->beginTransaction();
+	rc = fillPage(fileHandle, 0, 'r');
+	assert(rc == success);
+	logManager->beginTransaction();
+	rc = logManager->abortTransaction();
+	assert(rc == success);
+	rc = fillPage(fileHandle, 1, 'r');
+	assert(rc == success);
+	rc = logManager->commitTransaction(&undoneFiles);
+	if (rc != ERR_ABORTED || undoneFiles.size() != 1) {
+		cout << "The transaction of a nested abort has been committed." << endl;
+		return -1;
+	}
+	if (!checkPage(fileHandle, 0, 'a') || !checkPage(fileHandle, 1, 'b')) {
+		return -1;
+	}
+
+	// A rollback removes the files created and keeps the files destroyed
+	undoneFiles.clear();
+	logManager->beginTransaction();
+	rc = pfm->createFile(newFileName.c_str());
+	assert(rc == success);
+	rc = pfm->destroyFile(fileName.c_str());
+	assert(rc == success);
+	if (!fileExists(fileName)) {
+		cout << "A file has been removed before the commit." << endl;
+		return -1;
+	}
+	rc = logManager->abortTransaction(&undoneFiles);
+	assert(rc == success);
+	if (fileExists(newFileName) || !undoneFiles.count(newFileName) || !fileExists(fileName)) {
+		cout << "The rollback left the files as they were changed." << endl;
+		return -1;
+	}
+
+	// A commit removes the files destroyed
+	rc = pfm->createFile(newFileName.c_str());
+	assert(rc == success);
+	logManager->beginTransaction();
+	rc = pfm->destroyFile(newFileName.c_str());
+	assert(rc == success);
+	if (!fileExists(newFileName)) {
+		cout << "A file has been removed before the commit." << endl;
+		return -1;
+	}
+	rc = logManager->commitTransaction();
+	assert(rc == success);
+	if (fileExists(newFileName)) {
+		cout << "The commit did not remove the file destroyed." << endl;
+		return -1;
+	}
+
+	// A page changed by a transaction is not written by another one
+	// before the transaction ends
+	atomic<int> result(-1);
+	logManager->beginTransaction();
+	rc = fillPage(fileHandle, 0, 't');
+	assert(rc == success);
+	std::thread thread(waiter, &fileHandle, &result);
+	while (result.load() == -1) {
+		this_thread::yield();
+	}
+	rc = logManager->commitTransaction();
+	assert(rc == success);
+	thread.join();
+	if (result.load() != ERR_LOCKED) {
+		cout << "A page of another transaction has been written." << endl;
+		return -1;
+	}
+	if (!checkPage(fileHandle, 0, 'u') || !checkPage(fileHandle, 1, 'u')) {
+		return -1;
+	}
+
+	// One of two transactions waiting for each other is rolled back
+	atomic<unsigned> ready(0), deadlocks(0);
+	std::thread first(locker, &fileHandle, 2, 3, 'v', &ready, &deadlocks);
+	std::thread second(locker, &fileHandle, 3, 2, 'w', &ready, &deadlocks);
+	first.join();
+	second.join();
+	if (deadlocks.load() != 1) {
+		cout << deadlocks.load() << " transactions have found the deadlock." << endl;
+		return -1;
+	}
+	char data[PAGE_SIZE];
+	rc = fileHandle.readPage(2, data);
+	assert(rc == success);
+	char fill = data[0] == 'v' ? 'v' : 'w';
+	if (!checkPage(fileHandle, 2, fill) || !checkPage(fileHandle, 3, fill)) {
+		return -1;
+	}
+
+	// Commit from several threads at once
+	memset(data, 0, PAGE_SIZE);
+	logManager->beginTransaction();
+	while (fileHandle.getNumberOfPages() < threadCount) {
+		rc = fileHandle.appendPage(data);
+		assert(rc == success);
+	}
+	rc = logManager->commitTransaction();
+	assert(rc == success);
+
+	unsigned commitsBefore, syncsBefore, commitCount, syncCount;
+	logManager->collectCounterValues(commitsBefore, syncsBefore);
+	vector<std::thread> threads;
+	for (unsigned i = 0; i < threadCount; i++) {
+		threads.push_back(std::thread(committer, &fileHandle, i));
+	}
+	for (unsigned i = 0; i < threadCount; i++) {
+		threads[i].join();
+	}
+	logManager->collectCounterValues(commitCount, syncCount);
+	commitCount -= commitsBefore;
+	syncCount -= syncsBefore;
+	cout << "commit " << commitCount << ", sync " << syncCount << endl;
+	if (commitCount != threadCount * commitsPerThread || syncCount > commitCount) {
+		cout << "Unexpected counter values." << endl;
+		return -1;
+	}
+	for (unsigned i = 0; i < threadCount; i++) {
+		if (!checkPage(fileHandle, i, (char) (commitsPerThread - 1))) {
+			return -1;
+		}
+	}
+
+	rc = logManager->checkpoint();
+	assert(rc == success);
+
+	rc = pfm->closeFile(fileHandle);
+	assert(rc == success);
+	rc = logManager->close();
+	assert(rc == success);
+
+	rc = pfm->destroyFile(fileName.c_str());
+	assert(rc == success);
+
+	return 0;
+}
+
+int main() {
+	remove(fileName.c_str());
+	remove(logName.c_str());
+	remove(newFileName.c_str());
+
+	int rc = RBFTest_21();
+	if (rc == 0) {
+		cout << "Test Case 21 Passed!" << endl << endl;
+		total += 4;
+	} else {
+		cout << "Test Case 21 Failed!" << endl << endl;
+	}
+	remove(logName.c_str());
+
+	cout << "Score for Test Case 21: " << total << " / 4" << endl;
+
+	return 0;
+}
@@ -0,0 +1,218 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cassert>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <sys/stat.h>
+
+#include "pfm.h"
+#include "rbfm.h"
+
+using namespace std;
+
+const int success = 0;
+unsigned total = 0;
+
+const unsigned recordCount = 20;
+const unsigned wideLength = 20000;  // does not fit in a page of PAGE_SIZE
+
+// Record: int id, varchar(wideLength) text
+void prepareRecord(int id, unsigned length, char *record) {
+	memcpy(record, &id, sizeof(int));
+	memcpy(record + sizeof(int), &length, sizeof(int));
+	memset(record + 2 * sizeof(int), 'a' + id % 26, length);
+}
+
+int testPageSize(RecordBasedFileManager *rbfm, unsigned pageSize, unsigned length) {
+	RC rc;
+	string fileName = "test22";
+	remove(fileName.c_str());
+
+	vector<Attribute> recordDescriptor;
+	Attribute attr;
+	attr.name = "id";
+	attr.type = TypeInt;
+	attr.length = sizeof(int);
+	recordDescriptor.push_back(attr);
+	attr.name = "text";
+	attr.type = TypeVarChar;
+	attr.length = 2 * wideLength;
+	recordDescriptor.push_back(attr);
+
+	rc = rbfm->createFile(fileName, pageSize);
+	assert(rc == success);
+
+	FileHandle fileHandle;
+	rc = rbfm->openFile(fileName, fileHandle);
+	assert(rc == success);
+	if (fileHandle.getPageSize() != pageSize) {
+		cout << "The page size is " << fileHandle.getPageSize() << " instead of " << pageSize << endl;
+		return -1;
+	}
+
+	vector<char> record(2 * sizeof(int) + 2 * wideLength);
+	vector<char> returned(2 * sizeof(int) + 2 * wideLength);
+	vector<RID> rids;
+	for (unsigned i = 0; i < recordCount; i++) {
+		RID rid;
+		prepareRecord(i, length, &record[0]);
+		rc = rbfm->insertRecord(fileHandle, recordDescriptor, &record[0], rid);
+		assert(rc == success);
+		rids.push_back(rid);
+	}
+
+	// Records fill the pages of the file's size
+	unsigned recordSize = 2 * sizeof(int) + length;
+	unsigned pageCount = fileHandle.getNumberOfPages();
+	if (pageCount > recordCount * recordSize / (pageSize / 2) + 1) {
+		cout << pageCount << " pages of " << pageSize << " bytes for " << recordCount << " records." << endl;
+		return -1;
+	}
+
+	rc = rbfm->closeFile(fileHandle);
+	assert(rc == success);
+
+	// The header page is as large as the others
+	struct stat info;
+	stat(fileName.c_str(), &info);
+	if ((unsigned) info.st_size != (pageCount + 1) * pageSize) {
+		cout << "The file has " << info.st_size << " bytes." << endl;
+		return -1;
+	}
+
+	rc = rbfm->openFile(fileName, fileHandle);
+	assert(rc == success);
+	assert(fileHandle.getPageSize() == pageSize);
+	for (unsigned i = 0; i < recordCount; i++) {
+		prepareRecord(i, length, &record[0]);
+		rc = rbfm->readRecord(fileHandle, recordDescriptor, rids[i], &returned[0]);
+		assert(rc == success);
+		if (memcmp(&record[0], &returned[0], recordSize) != 0) {
+			cout << "Record " << i << " has wrong content." << endl;
+			return -1;
+		}
+	}
+
+	// Delete one record, then update another one to twice its size
+	rc = rbfm->deleteRecord(fileHandle, recordDescriptor, rids[0]);
+	assert(rc == success);
+	rc = rbfm->readRecord(fileHandle, recordDescriptor, rids[0], &returned[0]);
+	if (rc == success) {
+		cout << "Reading a deleted record should fail. However, it returned a success RC." << endl;
+		return -1;
+	}
+	prepareRecord(1, 2 * length, &record[0]);
+	rc = rbfm->updateRecord(fileHandle, recordDescriptor, &record[0], rids[1]);
+	assert(rc == success);
+	rc = rbfm->readRecord(fileHandle, recordDescriptor, rids[1], &returned[0]);
+	assert(rc == success);
+	if (memcmp(&record[0], &returned[0], 2 * sizeof(int) + 2 * length) != 0) {
+		cout << "The updated record has wrong content." << endl;
+		return -1;
+	}
+
+	// Scan the records left
+	RBFM_ScanIterator iterator;
+	vector<string> attributeNames(1, "id");
+	rc = rbfm->scan(fileHandle, recordDescriptor, "", NO_OP, NULL, attributeNames, iterator);
+	assert(rc == success);
+	RID rid;
+	unsigned scanned = 0;
+	while (iterator.getNextRecord(rid, &returned[0]) != RBFM_EOF) {
+		scanned++;
+	}
+	iterator.close();
+	if (scanned != recordCount - 1) {
+		cout << "The scan returned " << scanned << " records." << endl;
+		return -1;
+	}
+
+	rc = rbfm->closeFile(fileHandle);
+	assert(rc == success);
+	rc = rbfm->destroyFile(fileName);
+	assert(rc == success);
+	return 0;
+}
+
+int RBFTest_22(RecordBasedFileManager *rbfm) {
+	// Functions Tested:
+	// 1. Create files of 8, 16 and 64 KB pages
+	// 2. Insert, read, update, delete and scan records larger than PAGE_SIZE
+	// 3. Create a file of an unsupported page size - should fail
+	// 4. Insert a record larger than the page size - should fail
+	cout << "****In RBF Test Case 22****" << endl;
+
+	RC rc;
+	if (testPageSize(rbfm, 8192, 1000) != 0
+			|| testPageSize(rbfm, 16384, 6000) != 0
+			|| testPageSize(rbfm, MAX_PAGE_SIZE, wideLength) != 0) {
+		return -1;
+	}
+
+	string fileName = "test22";
+	rc = rbfm->createFile(fileName, 6000);
+	if (rc == success) {
+		cout << "This createFile test should fail. However, it returned a success RC." << endl;
+		return -1;
+	}
+	rc = rbfm->createFile(fileName, 2 * MAX_PAGE_SIZE);
+	if (rc == success) {
+		cout << "This createFile test should fail. However, it returned a success RC." << endl;
+		return -1;
+	}
+
+	// A record of wideLength bytes does not fit in a page of the default size
+	vector<Attribute> recordDescriptor;
+	Attribute attr;
+	attr.name = "id";
+	attr.type = TypeInt;
+	attr.length = sizeof(int);
+	recordDescriptor.push_back(attr);
+	attr.name = "text";
+	attr.type = TypeVarChar;
+	attr.length = wideLength;
+	recordDescriptor.push_back(attr);
+
+	rc = rbfm->createFile(fileName);
+	assert(rc == success);
+	FileHandle fileHandle;
+	rc = rbfm->openFile(fileName, fileHandle);
+	assert(rc == success);
+	assert(fileHandle.getPageSize() == PAGE_SIZE);
+
+	vector<char> record(2 * sizeof(int) + wideLength);
+	prepareRecord(0, wideLength, &record[0]);
+	RID rid;
+	rc = rbfm->insertRecord(fileHandle, recordDescriptor, &record[0], rid);
+	if (rc == success) {
+		cout << "This insertRecord test should fail. However, it returned a success RC." << endl;
+		return -1;
+	}
+
+	rc = rbfm->closeFile(fileHandle);
+	assert(rc == success);
+	rc = rbfm->destroyFile(fileName);
+	assert(rc == success);
+
+	return 0;
+}
+
+int main() {
+	RecordBasedFileManager *rbfm = RecordBasedFileManager::instance();
+
+	remove("test22");
+
+	int rc = RBFTest_22(rbfm);
+	if (rc == 0) {
+		cout << "Test Case 22 Passed!" << endl << endl;
+		total += 4;
+	} else {
+		cout << "Test Case 22 Failed!" << endl << endl;
+	}
+
+	cout << "Score for Test Case 22: " << total << " / 4" << endl;
+
+	return 0;
+}
@@ -0,0 +1,121 @@
+#include <iostream>
+#include <string>
+#include <cassert>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <sys/stat.h>
+
+#include "pfm.h"
+
+using namespace std;
+
+const int success = 0;
+unsigned total = 0;
+
+const unsigned extentSize = 1 << 20;
+const unsigned pageCount = 300;     // more than one extent of pages
+const string fileName = "test23";
+
+long getFileSize(const string &name) {
+	struct stat info;
+	if (stat(name.c_str(), &info)) {
+		return -1;
+	}
+	return info.st_size;
+}
+
+int RBFTest_23(PagedFileManager *pfm) {
+	// Functions Tested:
+	// 1. Append pages into preallocated extents
+	// 2. Trim the unused space when the file is closed
+	// 3. Read the pages back after reopening the file
+	// 4. Append pages with preallocation turned off
+	cout << "****In RBF Test Case 23****" << endl;
+
+	RC rc;
+	PagedFileManager::setExtentSize(extentSize);
+	rc = pfm->createFile(fileName.c_str());
+	assert(rc == success);
+
+	FileHandle fileHandle;
+	rc = pfm->openFile(fileName.c_str(), fileHandle);
+	assert(rc == success);
+
+	char data[PAGE_SIZE];
+	for (unsigned i = 0; i < pageCount; i++) {
+		memset(data, i % 128, PAGE_SIZE);
+		rc = fileHandle.appendPage(data);
+		assert(rc == success);
+
+		// The disk grows by whole extents while the pages are cached
+		long expected = ((long) (i + 2) * PAGE_SIZE + extentSize - 1) / extentSize * extentSize;
+		if (getFileSize(fileName) != expected) {
+			cout << "The file has " << getFileSize(fileName) << " bytes after page " << i
+				 << " instead of " << expected << "." << endl;
+			return -1;
+		}
+	}
+
+	rc = pfm->closeFile(fileHandle);
+	assert(rc == success);
+	if (getFileSize(fileName) != (long) (pageCount + 1) * PAGE_SIZE) {
+		cout << "The file has " << getFileSize(fileName) << " bytes after closing." << endl;
+		return -1;
+	}
+
+	rc = pfm->openFile(fileName.c_str(), fileHandle);
+	assert(rc == success);
+	if (fileHandle.getNumberOfPages() != pageCount) {
+		cout << "The file has " << fileHandle.getNumberOfPages() << " pages." << endl;
+		return -1;
+	}
+	for (unsigned i = 0; i < pageCount; i++) {
+		rc = fileHandle.readPage(i, data);
+		assert(rc == success);
+		if (data[0] != (char) (i % 128) || data[PAGE_SIZE - 1] != (char) (i % 128)) {
+			cout << "Page " << i << " has wrong content." << endl;
+			return -1;
+		}
+	}
+
+	// Without preallocation the file grows as pages are written back
+	PagedFileManager::setExtentSize(0);
+	memset(data, 'x', PAGE_SIZE);
+	rc = fileHandle.appendPage(data);
+	assert(rc == success);
+	if (getFileSize(fileName) != (long) (pageCount + 1) * PAGE_SIZE) {
+		cout << "The file has " << getFileSize(fileName) << " bytes before the page is written." << endl;
+		return -1;
+	}
+	rc = pfm->closeFile(fileHandle);
+	assert(rc == success);
+	if (getFileSize(fileName) != (long) (pageCount + 2) * PAGE_SIZE) {
+		cout << "The file has " << getFileSize(fileName) << " bytes after closing." << endl;
+		return -1;
+	}
+
+	PagedFileManager::setExtentSize(DEFAULT_EXTENT_SIZE);
+	rc = pfm->destroyFile(fileName.c_str());
+	assert(rc == success);
+
+	return 0;
+}
+
+int main() {
+	PagedFileManager *pfm = PagedFileManager::instance();
+
+	remove(fileName.c_str());
+
+	int rc = RBFTest_23(pfm);
+	if (rc == 0) {
+		cout << "Test Case 23 Passed!" << endl << endl;
+		total += 4;
+	} else {
+		cout << "Test Case 23 Failed!" << endl << endl;
+	}
+
+	cout << "Score for Test Case 23: " << total << " / 4" << endl;
+
+	return 0;
+}
@@ -0,0 +1,150 @@
+#include <iostream>
+#include <string>
+#include <cassert>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "pfm.h"
+
+using namespace std;
+
+const int success = 0;
+unsigned total = 0;
+
+const unsigned frameCount = 16;
+const unsigned pageCount = 64;      // more pages than frames
+const string fileName = "test24";
+
+unsigned long long sumHistogram(const IOStats &stats, IOOp op) {
+	unsigned long long sum = 0;
+	for (unsigned i = 0; i < LATENCY_BUCKETS; i++) {
+		sum += stats.latency[op][i];
+	}
+	return sum;
+}
+
+int RBFTest_24(PagedFileManager *pfm) {
+	// Functions Tested:
+	// 1. Count bytes written and appends of a handle, including write-backs
+	// 2. Count bytes read, system calls and seeks of sequential and random reads
+	// 3. Latency histograms
+	// 4. Metrics of all files and reset
+	cout << "****In RBF Test Case 24****" << endl;
+
+	RC rc;
+	rc = pfm->createFile(fileName.c_str());
+	assert(rc == success);
+
+	FileHandle fileHandle;
+	rc = pfm->openFile(fileName.c_str(), fileHandle);
+	assert(rc == success);
+
+	IOStats stats;
+	char data[PAGE_SIZE];
+	for (unsigned i = 0; i < pageCount; i++) {
+		memset(data, i, PAGE_SIZE);
+		rc = fileHandle.appendPage(data);
+		assert(rc == success);
+	}
+	rc = pfm->flushAllPages();
+	assert(rc == success);
+
+	fileHandle.collectIOStats(stats);
+	if (stats.opCount[IO_OP_APPEND] != pageCount || sumHistogram(stats, IO_OP_APPEND) != pageCount
+			|| stats.opCount[IO_OP_READ] != 0 || stats.opCount[IO_OP_WRITE] != 0) {
+		cout << "Wrong # of operations: " << stats.opCount[IO_OP_APPEND] << " appends." << endl;
+		return -1;
+	}
+	// Pages and headers
+	if (stats.bytesWritten < (unsigned long long) pageCount * PAGE_SIZE || stats.bytesRead != 0) {
+		cout << stats.bytesWritten << " bytes written, " << stats.bytesRead << " bytes read." << endl;
+		return -1;
+	}
+
+	// Sequential reads of pages which are mostly not cached
+	fileHandle.resetIOStats();
+	for (unsigned i = 0; i < pageCount; i++) {
+		rc = fileHandle.readPage(i, data);
+		assert(rc == success);
+		assert(data[0] == (char) i);
+	}
+	fileHandle.collectIOStats(stats);
+	cout << "sequential: " << stats.bytesRead << " bytes, " << stats.syscallCount << " calls, "
+		 << stats.seekCount << " seeks" << endl;
+	if (stats.opCount[IO_OP_READ] != pageCount || sumHistogram(stats, IO_OP_READ) != pageCount
+			|| stats.bytesRead < (unsigned long long) (pageCount - frameCount) * PAGE_SIZE
+			|| stats.bytesRead % PAGE_SIZE != 0 || stats.syscallCount < stats.bytesRead / PAGE_SIZE
+			|| stats.seekCount > 2 || stats.bytesWritten != 0) {
+		cout << "Wrong metrics of sequential reads." << endl;
+		return -1;
+	}
+	unsigned long long sequentialSeeks = stats.seekCount;
+
+	// Random reads: every page is a miss, and every read is a seek
+	fileHandle.resetIOStats();
+	unsigned readCount = 0;
+	for (unsigned i = 0; i < pageCount; i += 2) {
+		rc = fileHandle.readPage((i * 7) % pageCount, data);
+		assert(rc == success);
+		readCount++;
+	}
+	fileHandle.collectIOStats(stats);
+	cout << "random: " << stats.bytesRead << " bytes, " << stats.syscallCount << " calls, "
+		 << stats.seekCount << " seeks" << endl;
+	if (stats.opCount[IO_OP_READ] != readCount || stats.seekCount <= sequentialSeeks
+			|| stats.seekCount > stats.syscallCount) {
+		cout << "Wrong metrics of random reads." << endl;
+		return -1;
+	}
+	unsigned long long totalLatency = 0;
+	for (unsigned i = 0; i < LATENCY_BUCKETS; i++) {
+		totalLatency += stats.latency[IO_OP_READ][i] << i;
+	}
+	if (totalLatency > stats.totalLatency[IO_OP_READ]) {
+		cout << "The histogram does not match the total latency." << endl;
+		return -1;
+	}
+
+	// The metrics of all files include those of the handle
+	IOStats allStats;
+	rc = pfm->collectIOStats(allStats);
+	assert(rc == success);
+	if (allStats.bytesRead < stats.bytesRead || allStats.opCount[IO_OP_APPEND] < pageCount) {
+		cout << "Wrong metrics of all files." << endl;
+		return -1;
+	}
+	pfm->resetIOStats();
+	rc = pfm->collectIOStats(allStats);
+	assert(rc == success);
+	if (allStats.bytesRead != 0 || allStats.syscallCount != 0 || allStats.opCount[IO_OP_APPEND] != 0) {
+		cout << "The metrics of all files have not been reset." << endl;
+		return -1;
+	}
+
+	rc = pfm->closeFile(fileHandle);
+	assert(rc == success);
+	rc = pfm->destroyFile(fileName.c_str());
+	assert(rc == success);
+
+	return 0;
+}
+
+int main() {
+	PagedFileManager::setBufferFrames(frameCount);
+	PagedFileManager *pfm = PagedFileManager::instance();
+
+	remove(fileName.c_str());
+
+	int rc = RBFTest_24(pfm);
+	if (rc == 0) {
+		cout << "Test Case 24 Passed!" << endl << endl;
+		total += 4;
+	} else {
+		cout << "Test Case 24 Failed!" << endl << endl;
+	}
+
+	cout << "Score for Test Case 24: " << total << " / 4" << endl;
+
+	return 0;
+}
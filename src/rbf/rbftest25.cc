@@ -0,0 +1,150 @@
+#include <iostream>
+#include <string>
+#include <cassert>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <dirent.h>
+
+#include "pfm.h"
+
+using namespace std;
+
+const int success = 0;
+unsigned total = 0;
+
+const unsigned pageCount = 8;
+const string fileName = "test25";
+
+// # of descriptors opened by the process
+unsigned countDescriptors() {
+	unsigned count = 0;
+	DIR *dir = opendir("/proc/self/fd");
+	assert(dir != NULL);
+	while (readdir(dir) != NULL) {
+		count++;
+	}
+	closedir(dir);
+	return count;
+}
+
+int RBFTest_25(PagedFileManager *pfm) {
+	// Functions Tested:
+	// 1. Handles opened on the same file share one descriptor
+	// 2. Changes through one handle are seen through the others
+	// 3. Copies of a handle are not opens; the last close releases the file
+	// 4. Close a handle twice - should fail
+	cout << "****In RBF Test Case 25****" << endl;
+
+	RC rc;
+	rc = pfm->createFile(fileName.c_str());
+	assert(rc == success);
+
+	unsigned before = countDescriptors();
+	FileHandle stdioHandle, preadHandle, mmapHandle;
+	rc = pfm->openFile(fileName.c_str(), stdioHandle);
+	assert(rc == success);
+	rc = pfm->openFile(fileName.c_str(), preadHandle, IO_PREAD);
+	assert(rc == success);
+	if (countDescriptors() != before + 1) {
+		cout << "The process has " << countDescriptors() - before << " more descriptors." << endl;
+		return -1;
+	}
+
+	char data[PAGE_SIZE];
+	for (unsigned i = 0; i < pageCount; i++) {
+		memset(data, 'a' + i, PAGE_SIZE);
+		rc = stdioHandle.appendPage(data);
+		assert(rc == success);
+	}
+	if (preadHandle.getNumberOfPages() != pageCount) {
+		cout << "The other handle sees " << preadHandle.getNumberOfPages() << " pages." << endl;
+		return -1;
+	}
+	memset(data, 'z', PAGE_SIZE);
+	rc = preadHandle.writePage(3, data);
+	assert(rc == success);
+	rc = stdioHandle.readPage(3, data);
+	assert(rc == success);
+	if (data[0] != 'z' || data[PAGE_SIZE - 1] != 'z') {
+		cout << "The change is not seen through the other handle." << endl;
+		return -1;
+	}
+
+	rc = pfm->openFile(fileName.c_str(), mmapHandle, IO_MMAP);
+	assert(rc == success);
+	rc = mmapHandle.readPage(3, data);
+	assert(rc == success);
+	if (data[0] != 'z' || countDescriptors() != before + 1) {
+		cout << "The mapped handle does not share the file." << endl;
+		return -1;
+	}
+
+	// Closing some of the handles keeps the file open for the others
+	FileHandle copy = stdioHandle;
+	rc = pfm->closeFile(stdioHandle);
+	assert(rc == success);
+	rc = pfm->closeFile(mmapHandle);
+	assert(rc == success);
+	rc = pfm->closeFile(stdioHandle);
+	if (rc == success) {
+		cout << "Closing a handle twice should fail. However, it returned a success RC." << endl;
+		return -1;
+	}
+	if (countDescriptors() != before + 1) {
+		cout << "The file has been closed too early." << endl;
+		return -1;
+	}
+	rc = preadHandle.readPage(pageCount - 1, data);
+	assert(rc == success);
+	if (data[0] != 'a' + pageCount - 1) {
+		cout << "Page " << pageCount - 1 << " has wrong content." << endl;
+		return -1;
+	}
+
+	rc = pfm->closeFile(preadHandle);
+	assert(rc == success);
+	if (countDescriptors() != before) {
+		cout << "The file is still open." << endl;
+		return -1;
+	}
+
+	rc = pfm->closeFile(copy);
+	if (rc == success) {
+		cout << "Closing the file once more should fail. However, it returned a success RC." << endl;
+		return -1;
+	}
+
+	// Reopen the file: pages were written back at the last close
+	rc = pfm->openFile(fileName.c_str(), preadHandle, IO_PREAD);
+	assert(rc == success);
+	if (preadHandle.getNumberOfPages() != pageCount) {
+		cout << "The reopened file has " << preadHandle.getNumberOfPages() << " pages." << endl;
+		return -1;
+	}
+	rc = pfm->closeFile(preadHandle);
+	assert(rc == success);
+
+	rc = pfm->destroyFile(fileName.c_str());
+	assert(rc == success);
+
+	return 0;
+}
+
+int main() {
+	PagedFileManager *pfm = PagedFileManager::instance();
+
+	remove(fileName.c_str());
+
+	int rc = RBFTest_25(pfm);
+	if (rc == 0) {
+		cout << "Test Case 25 Passed!" << endl << endl;
+		total += 4;
+	} else {
+		cout << "Test Case 25 Failed!" << endl << endl;
+	}
+
+	cout << "Score for Test Case 25: " << total << " / 4" << endl;
+
+	return 0;
+}
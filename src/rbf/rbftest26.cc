@@ -0,0 +1,156 @@
+#include <iostream>
+#include <string>
+#include <sstream>
+#include <cassert>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <dirent.h>
+
+#include "pfm.h"
+
+using namespace std;
+
+const int success = 0;
+unsigned total = 0;
+
+const unsigned fileCount = 12;
+const unsigned descriptorLimit = 4;
+const unsigned pageCount = 3;
+
+// # of descriptors opened by the process
+unsigned countDescriptors() {
+	unsigned count = 0;
+	DIR *dir = opendir("/proc/self/fd");
+	assert(dir != NULL);
+	while (readdir(dir) != NULL) {
+		count++;
+	}
+	closedir(dir);
+	return count;
+}
+
+string getFileName(unsigned i) {
+	stringstream ss;
+	ss << "test26_" << i;
+	return ss.str();
+}
+
+int RBFTest_26(PagedFileManager *pfm) {
+	// Functions Tested:
+	// 1. Keep more files open than descriptors
+	// 2. Reopen evicted descriptors on the next I/O
+	// 3. Write back pages of files whose descriptor was evicted
+	// 4. Hit / miss / eviction counters
+	cout << "****In RBF Test Case 26****" << endl;
+
+	RC rc;
+	PagedFileManager::setDescriptorLimit(descriptorLimit);
+	unsigned before = countDescriptors();
+	unsigned hitsBefore, missesBefore, evictionsBefore;
+	pfm->collectDescriptorCounterValues(hitsBefore, missesBefore, evictionsBefore);
+
+	// Handles of both modes on more files than descriptors
+	FileHandle fileHandles[fileCount];
+	char data[PAGE_SIZE];
+	for (unsigned i = 0; i < fileCount; i++) {
+		rc = pfm->createFile(getFileName(i).c_str());
+		assert(rc == success);
+		rc = pfm->openFile(getFileName(i).c_str(), fileHandles[i], i % 2 ? IO_PREAD : IO_STDIO);
+		assert(rc == success);
+		for (unsigned j = 0; j < pageCount; j++) {
+			memset(data, 'a' + i + j, PAGE_SIZE);
+			rc = fileHandles[i].appendPage(data);
+			assert(rc == success);
+		}
+		if (countDescriptors() > before + descriptorLimit) {
+			cout << "The process has " << countDescriptors() - before << " more descriptors." << endl;
+			return -1;
+		}
+	}
+
+	// All pages reach the disk through reopened descriptors
+	rc = pfm->flushAllPages();
+	assert(rc == success);
+	if (countDescriptors() > before + descriptorLimit) {
+		cout << "The process has " << countDescriptors() - before << " more descriptors." << endl;
+		return -1;
+	}
+
+	unsigned hitCount, missCount, evictionCount;
+	pfm->collectDescriptorCounterValues(hitCount, missCount, evictionCount);
+	hitCount -= hitsBefore;
+	missCount -= missesBefore;
+	evictionCount -= evictionsBefore;
+	cout << "hit " << hitCount << ", miss " << missCount << ", eviction " << evictionCount << endl;
+	if (missCount < fileCount || evictionCount < fileCount - descriptorLimit) {
+		cout << "Unexpected counter values." << endl;
+		return -1;
+	}
+
+	// Reuse of a hot file does not reopen it
+	pfm->collectDescriptorCounterValues(hitsBefore, missesBefore, evictionsBefore);
+	for (unsigned j = 0; j < pageCount; j++) {
+		memset(data, 'z', PAGE_SIZE);
+		rc = fileHandles[0].writePage(j, data);
+		assert(rc == success);
+	}
+	rc = pfm->flushAllPages();
+	assert(rc == success);
+	rc = pfm->flushAllPages();
+	assert(rc == success);
+	pfm->collectDescriptorCounterValues(hitCount, missCount, evictionCount);
+	if (missCount - missesBefore > 1 || hitCount == hitsBefore) {
+		cout << "The descriptor of the hot file has been reopened." << endl;
+		return -1;
+	}
+
+	// Close every file, then check the content on the disk
+	for (unsigned i = 0; i < fileCount; i++) {
+		rc = pfm->closeFile(fileHandles[i]);
+		assert(rc == success);
+	}
+	if (countDescriptors() != before) {
+		cout << "Files are still open." << endl;
+		return -1;
+	}
+	for (unsigned i = 0; i < fileCount; i++) {
+		FILE *fp = fopen(getFileName(i).c_str(), "r");
+		assert(fp != NULL);
+		for (unsigned j = 0; j < pageCount; j++) {
+			fseek(fp, (j + 1) * PAGE_SIZE, SEEK_SET);
+			if (fread(data, 1, PAGE_SIZE, fp) != PAGE_SIZE
+					|| data[0] != (i == 0 ? 'z' : (char) ('a' + i + j))) {
+				cout << "Page " << j << " of file " << i << " has wrong content." << endl;
+				fclose(fp);
+				return -1;
+			}
+		}
+		fclose(fp);
+		rc = pfm->destroyFile(getFileName(i).c_str());
+		assert(rc == success);
+	}
+
+	PagedFileManager::setDescriptorLimit(DEFAULT_OPEN_FILES);
+	return 0;
+}
+
+int main() {
+	PagedFileManager *pfm = PagedFileManager::instance();
+
+	for (unsigned i = 0; i < fileCount; i++) {
+		remove(getFileName(i).c_str());
+	}
+
+	int rc = RBFTest_26(pfm);
+	if (rc == 0) {
+		cout << "Test Case 26 Passed!" << endl << endl;
+		total += 4;
+	} else {
+		cout << "Test Case 26 Failed!" << endl << endl;
+	}
+
+	cout << "Score for Test Case 26: " << total << " / 4" << endl;
+
+	return 0;
+}
@@ -0,0 +1,217 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cassert>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <sys/stat.h>
+
+#include "pfm.h"
+#include "rbfm.h"
+
+using namespace std;
+
+const int success = 0;
+unsigned total = 0;
+
+const unsigned recordCount = 64;
+const unsigned textLength = 1000;   // 4 records per page
+const unsigned firstHole = 4;       // pages [firstHole, firstHole + holeLength) are emptied
+const unsigned holeLength = 4;
+const unsigned tailLength = 3;      // so are the last pages
+const string fileName = "test27";
+
+// Record: int id, varchar(textLength) text
+void prepareRecord(int id, char *record) {
+	unsigned length = textLength;
+	memcpy(record, &id, sizeof(int));
+	memcpy(record + sizeof(int), &length, sizeof(int));
+	memset(record + 2 * sizeof(int), 'a' + id % 26, length);
+}
+
+bool getFileInfo(struct stat &info) {
+	return stat(fileName.c_str(), &info) == 0;
+}
+
+int RBFTest_27(RecordBasedFileManager *rbfm, PagedFileManager *pfm) {
+	// Functions Tested:
+	// 1. Punch holes over empty pages and truncate trailing ones (reclaimSpace)
+	// 2. Scan without reading the empty pages
+	// 3. Reuse the punched pages before growing the file
+	// 4. Truncate trailing empty pages at close, and all pages in deleteRecords
+	cout << "****In RBF Test Case 27****" << endl;
+
+	RC rc;
+	vector<Attribute> recordDescriptor;
+	Attribute attr;
+	attr.name = "id";
+	attr.type = TypeInt;
+	attr.length = sizeof(int);
+	recordDescriptor.push_back(attr);
+	attr.name = "text";
+	attr.type = TypeVarChar;
+	attr.length = textLength;
+	recordDescriptor.push_back(attr);
+
+	// Blocks are counted page by page
+	PagedFileManager::setExtentSize(0);
+	rc = rbfm->createFile(fileName);
+	assert(rc == success);
+	FileHandle fileHandle;
+	rc = rbfm->openFile(fileName, fileHandle);
+	assert(rc == success);
+
+	char record[2 * sizeof(int) + textLength];
+	vector<RID> rids;
+	for (unsigned i = 0; i < recordCount; i++) {
+		RID rid;
+		prepareRecord(i, record);
+		rc = rbfm->insertRecord(fileHandle, recordDescriptor, record, rid);
+		assert(rc == success);
+		rids.push_back(rid);
+	}
+	unsigned pageCount = fileHandle.getNumberOfPages();
+	assert(pageCount > firstHole + holeLength + tailLength);
+	rc = pfm->flushAllPages();
+	assert(rc == success);
+	struct stat before;
+	assert(getFileInfo(before));
+
+	// Empty a run of pages in the middle and the last pages
+	unsigned deleted = 0;
+	for (unsigned i = 0; i < recordCount; i++) {
+		unsigned pageNum = rids[i].pageNum;
+		if ((pageNum >= firstHole && pageNum < firstHole + holeLength) || pageNum >= pageCount - tailLength) {
+			rc = rbfm->deleteRecord(fileHandle, recordDescriptor, rids[i]);
+			assert(rc == success);
+			deleted++;
+		}
+	}
+	rc = rbfm->reclaimSpace(fileHandle);
+	assert(rc == success);
+	rc = pfm->flushAllPages();
+	assert(rc == success);
+
+	struct stat after;
+	assert(getFileInfo(after));
+	cout << "blocks: " << before.st_blocks << " -> " << after.st_blocks << endl;
+	if (fileHandle.getNumberOfPages() != pageCount - tailLength
+			|| after.st_size != (off_t) (pageCount - tailLength + 1) * PAGE_SIZE) {
+		cout << "The trailing pages have not been truncated: " << fileHandle.getNumberOfPages() << " pages, "
+			 << after.st_size << " bytes." << endl;
+		return -1;
+	}
+	if (after.st_blocks > before.st_blocks - (blkcnt_t) (holeLength + tailLength) * (PAGE_SIZE / 512)) {
+		cout << "The space of the empty pages has not been given back." << endl;
+		return -1;
+	}
+
+	// The scan returns the remaining records and pins none of the empty pages
+	fileHandle.resetIOStats();
+	RBFM_ScanIterator rbfmScanIterator;
+	vector<string> attributeNames;
+	attributeNames.push_back("id");
+	rc = rbfm->scan(fileHandle, recordDescriptor, "", NO_OP, NULL, attributeNames, rbfmScanIterator);
+	assert(rc == success);
+	RID rid;
+	int id;
+	unsigned scanned = 0;
+	while (rbfmScanIterator.getNextRecord(rid, &id) != RBFM_EOF) {
+		if (rids[id] != rid) {
+			cout << "Record " << id << " is returned with a wrong RID." << endl;
+			return -1;
+		}
+		scanned++;
+	}
+	rbfmScanIterator.close();
+	IOStats stats;
+	fileHandle.collectIOStats(stats);
+	unsigned pagesLeft = fileHandle.getNumberOfPages();
+	if (scanned != recordCount - deleted
+			|| stats.opCount[IO_OP_READ] > (unsigned long long) scanned + pagesLeft - holeLength) {
+		cout << scanned << " records scanned with " << stats.opCount[IO_OP_READ] << " page reads." << endl;
+		return -1;
+	}
+
+	// New records go to the punched pages first
+	unsigned holeRecords = deleted * holeLength / (holeLength + tailLength);
+	for (unsigned i = 0; i < holeRecords; i++) {
+		prepareRecord(i, record);
+		rc = rbfm->insertRecord(fileHandle, recordDescriptor, record, rid);
+		assert(rc == success);
+		if (rid.pageNum < firstHole || rid.pageNum >= firstHole + holeLength) {
+			cout << "A record has been inserted into page " << rid.pageNum << "." << endl;
+			return -1;
+		}
+	}
+	if (fileHandle.getNumberOfPages() != pagesLeft) {
+		cout << "The file grew to " << fileHandle.getNumberOfPages() << " pages." << endl;
+		return -1;
+	}
+
+	// Empty the last page: it is cut off at close
+	for (unsigned i = 0; i < recordCount; i++) {
+		if (rids[i].pageNum == pagesLeft - 1) {
+			rc = rbfm->deleteRecord(fileHandle, recordDescriptor, rids[i]);
+			assert(rc == success);
+		}
+	}
+	rc = rbfm->closeFile(fileHandle);
+	assert(rc == success);
+	assert(getFileInfo(after));
+	if (after.st_size != (off_t) pagesLeft * PAGE_SIZE) {
+		cout << "The file has " << after.st_size << " bytes after closing." << endl;
+		return -1;
+	}
+
+	// Deleting all records outside of a transaction truncates the file
+	rc = rbfm->openFile(fileName, fileHandle);
+	assert(rc == success);
+	if (fileHandle.getNumberOfPages() != pagesLeft - 1) {
+		cout << "The reopened file has " << fileHandle.getNumberOfPages() << " pages." << endl;
+		return -1;
+	}
+	rc = rbfm->deleteRecords(fileHandle);
+	assert(rc == success);
+	assert(getFileInfo(after));
+	if (fileHandle.getNumberOfPages() != 0 || after.st_size != PAGE_SIZE) {
+		cout << "The file has " << fileHandle.getNumberOfPages() << " pages and " << after.st_size
+			 << " bytes after deleting all records." << endl;
+		return -1;
+	}
+	prepareRecord(0, record);
+	rc = rbfm->insertRecord(fileHandle, recordDescriptor, record, rid);
+	assert(rc == success);
+	if (rid.pageNum != 0 || rid.slotNum != 0) {
+		cout << "The first record is inserted at (" << rid.pageNum << ", " << rid.slotNum << ")." << endl;
+		return -1;
+	}
+
+	rc = rbfm->closeFile(fileHandle);
+	assert(rc == success);
+	rc = rbfm->destroyFile(fileName);
+	assert(rc == success);
+
+	PagedFileManager::setExtentSize(DEFAULT_EXTENT_SIZE);
+	return 0;
+}
+
+int main() {
+	PagedFileManager *pfm = PagedFileManager::instance();
+	RecordBasedFileManager *rbfm = RecordBasedFileManager::instance();
+
+	remove(fileName.c_str());
+
+	int rc = RBFTest_27(rbfm, pfm);
+	if (rc == 0) {
+		cout << "Test Case 27 Passed!" << endl << endl;
+		total += 4;
+	} else {
+		cout << "Test Case 27 Failed!" << endl << endl;
+	}
+
+	cout << "Score for Test Case 27: " << total << " / 4" << endl;
+
+	return 0;
+}
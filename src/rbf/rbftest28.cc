@@ -0,0 +1,215 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cassert>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <sys/stat.h>
+
+#include "pfm.h"
+#include "rbfm.h"
+
+using namespace std;
+
+const int success = 0;
+unsigned total = 0;
+
+const unsigned recordCount = 2000;
+const unsigned textLength = 300;    // 13 records per page
+const unsigned pageStride = 5;      // every 5th page is emptied
+const string fileName = "test28";
+
+// Record: int id, varchar(textLength) text
+void prepareRecord(int id, char *record) {
+	unsigned length = textLength;
+	memcpy(record, &id, sizeof(int));
+	memcpy(record + sizeof(int), &length, sizeof(int));
+	memset(record + 2 * sizeof(int), 'a' + id % 26, length);
+}
+
+bool fileExists(const string &name) {
+	struct stat info;
+	return stat(name.c_str(), &info) == 0;
+}
+
+// # of pages read by opening the file
+unsigned long long countOpenReads(RecordBasedFileManager *rbfm, FileHandle &fileHandle) {
+	IOStats before, after;
+	PagedFileManager::instance()->collectIOStats(before);
+	RC rc = rbfm->openFile(fileName, fileHandle);
+	assert(rc == success);
+	PagedFileManager::instance()->collectIOStats(after);
+	return after.opCount[IO_OP_READ] - before.opCount[IO_OP_READ];
+}
+
+int RBFTest_28(RecordBasedFileManager *rbfm, PagedFileManager *pfm) {
+	// Functions Tested:
+	// 1. Save the free space map when the file is closed
+	// 2. Load the free space map without reading the pages of the file
+	// 3. Rebuild the free space map when the saved one is missing or stale
+	// 4. Reuse the free space known by a loaded map
+	cout << "****In RBF Test Case 28****" << endl;
+
+	RC rc;
+	vector<Attribute> recordDescriptor;
+	Attribute attr;
+	attr.name = "id";
+	attr.type = TypeInt;
+	attr.length = sizeof(int);
+	recordDescriptor.push_back(attr);
+	attr.name = "text";
+	attr.type = TypeVarChar;
+	attr.length = textLength;
+	recordDescriptor.push_back(attr);
+
+	string mapFileName = SpaceManager::getFreeSpaceFileName(fileName);
+	rc = rbfm->createFile(fileName);
+	assert(rc == success);
+	FileHandle fileHandle;
+	rc = rbfm->openFile(fileName, fileHandle);
+	assert(rc == success);
+
+	char record[2 * sizeof(int) + textLength];
+	vector<RID> rids;
+	for (unsigned i = 0; i < recordCount; i++) {
+		RID rid;
+		prepareRecord(i, record);
+		rc = rbfm->insertRecord(fileHandle, recordDescriptor, record, rid);
+		assert(rc == success);
+		rids.push_back(rid);
+	}
+	unsigned deleted = 0;
+	vector<bool> isDeleted(recordCount, false);
+	for (unsigned i = 0; i < recordCount; i++) {
+		if (rids[i].pageNum % pageStride == 1) {
+			rc = rbfm->deleteRecord(fileHandle, recordDescriptor, rids[i]);
+			assert(rc == success);
+			isDeleted[i] = true;
+			deleted++;
+		}
+	}
+	unsigned pageCount = fileHandle.getNumberOfPages();
+
+	// The map is saved and marked valid by the last close only
+	FileHandle secondHandle;
+	rc = rbfm->openFile(fileName, secondHandle);
+	assert(rc == success);
+	rc = rbfm->closeFile(secondHandle);
+	assert(rc == success);
+	if (fileHandle.getFreeSpaceRoot() != NULL_PAGE) {
+		cout << "The map is marked valid while the file is open." << endl;
+		return -1;
+	}
+	rc = rbfm->closeFile(fileHandle);
+	assert(rc == success);
+	if (!fileExists(mapFileName)) {
+		cout << "The free space map has not been saved." << endl;
+		return -1;
+	}
+
+	// Opening reads the map, not the pages
+	unsigned long long reads = countOpenReads(rbfm, fileHandle);
+	cout << "page reads to open " << pageCount << " pages: " << reads << endl;
+	if (reads >= pageCount / 2) {
+		cout << "The pages have been read to build the map." << endl;
+		return -1;
+	}
+	if (fileHandle.getFreeSpaceRoot() != NULL_PAGE) {
+		cout << "The map is not marked stale when the file is open." << endl;
+		return -1;
+	}
+
+	// Records fill the pages emptied by deletions instead of new pages
+	vector<RID> newRids;
+	for (unsigned i = 0; i < deleted; i++) {
+		RID rid;
+		prepareRecord(recordCount + i, record);
+		rc = rbfm->insertRecord(fileHandle, recordDescriptor, record, rid);
+		assert(rc == success);
+		newRids.push_back(rid);
+	}
+	if (fileHandle.getNumberOfPages() != pageCount) {
+		cout << "The file grew from " << pageCount << " to " << fileHandle.getNumberOfPages() << " pages." << endl;
+		return -1;
+	}
+	for (unsigned i = 0; i < recordCount; i++) {
+		if (isDeleted[i]) {
+			continue;
+		}
+		char returned[2 * sizeof(int) + textLength];
+		prepareRecord(i, record);
+		rc = rbfm->readRecord(fileHandle, recordDescriptor, rids[i], returned);
+		assert(rc == success);
+		if (memcmp(record, returned, sizeof(record)) != 0) {
+			cout << "Record " << i << " has been overwritten." << endl;
+			return -1;
+		}
+	}
+	rc = rbfm->closeFile(fileHandle);
+	assert(rc == success);
+
+	// A file left open (by a crash) or without its map is scanned again
+	rc = pfm->openFile(fileName.c_str(), fileHandle);
+	assert(rc == success);
+	rc = fileHandle.setFreeSpaceRoot(NULL_PAGE);
+	assert(rc == success);
+	rc = pfm->closeFile(fileHandle);
+	assert(rc == success);
+	reads = countOpenReads(rbfm, fileHandle);
+	if (reads < pageCount) {
+		cout << "A stale map has been loaded." << endl;
+		return -1;
+	}
+	rc = rbfm->closeFile(fileHandle);
+	assert(rc == success);
+	remove(mapFileName.c_str());
+	reads = countOpenReads(rbfm, fileHandle);
+	if (reads < pageCount) {
+		cout << "A missing map has not been rebuilt." << endl;
+		return -1;
+	}
+
+	// The rebuilt map knows the pages are full
+	RID rid;
+	prepareRecord(0, record);
+	rc = rbfm->insertRecord(fileHandle, recordDescriptor, record, rid);
+	assert(rc == success);
+	for (unsigned i = 0; i < newRids.size(); i++) {
+		if (newRids[i] == rid) {
+			cout << "A record has been inserted over record " << recordCount + i << "." << endl;
+			return -1;
+		}
+	}
+
+	rc = rbfm->closeFile(fileHandle);
+	assert(rc == success);
+	rc = rbfm->destroyFile(fileName);
+	assert(rc == success);
+	if (fileExists(mapFileName)) {
+		cout << "The free space map has not been destroyed." << endl;
+		return -1;
+	}
+
+	return 0;
+}
+
+int main() {
+	PagedFileManager *pfm = PagedFileManager::instance();
+	RecordBasedFileManager *rbfm = RecordBasedFileManager::instance();
+
+	remove(fileName.c_str());
+	remove(SpaceManager::getFreeSpaceFileName(fileName).c_str());
+
+	int rc = RBFTest_28(rbfm, pfm);
+	if (rc == 0) {
+		cout << "Test Case 28 Passed!" << endl << endl;
+		total += 4;
+	} else {
+		cout << "Test Case 28 Failed!" << endl << endl;
+	}
+
+	cout << "Score for Test Case 28: " << total << " / 4" << endl;
+
+	return 0;
+}
@@ -0,0 +1,176 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cassert>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "pfm.h"
+#include "rbfm.h"
+
+using namespace std;
+
+const int success = 0;
+unsigned total = 0;
+
+const int indexedPages = 1000;
+const int sizeStep = PAGE_SIZE / 256;   // step between two size classes
+const string fileName = "test29";
+
+// Free size given to a page of the map
+int getTestFreeSize(int pageNum) {
+	return 1 + (pageNum * 37) % (PAGE_SIZE - 200);
+}
+
+// Record: int id, varchar text
+unsigned prepareRecord(int id, unsigned length, char *record) {
+	memcpy(record, &id, sizeof(int));
+	memcpy(record + sizeof(int), &length, sizeof(int));
+	memset(record + 2 * sizeof(int), 'a' + id % 26, length);
+	return 2 * sizeof(int) + length;
+}
+
+int RBFTest_29(RecordBasedFileManager *rbfm) {
+	// Functions Tested:
+	// 1. Take the page of the smallest size class fitting a request (allocateSpace)
+	// 2. Replace the free size of a page (insertFreeSpaceMap, removeFreeSpaceMap)
+	// 3. Tell empty pages apart (isFreePage)
+	// 4. Grow records in place with a map loaded at open
+	cout << "****In RBF Test Case 29****" << endl;
+
+	RC rc;
+	SpaceManager *sm = SpaceManager::instance();
+	rc = rbfm->createFile(fileName);
+	assert(rc == success);
+	FileHandle fileHandle;
+	rc = rbfm->openFile(fileName, fileHandle);
+	assert(rc == success);
+
+	// Pages of all free sizes: each request gets a page of the first class which fits
+	for (int i = 0; i < indexedPages; i++) {
+		sm->insertFreeSpaceMap(fileHandle, i, getTestFreeSize(i));
+	}
+	vector<bool> taken(indexedPages, false);
+	for (int size = 8; size < PAGE_SIZE - 300; size += 97) {
+		int pageNum;
+		rc = sm->allocateSpace(fileName, fileHandle, size, pageNum);
+		assert(rc == success);
+		if (pageNum < 0 || pageNum >= indexedPages || taken[pageNum]) {
+			cout << "Page " << pageNum << " has been allocated for " << size << " bytes." << endl;
+			return -1;
+		}
+		taken[pageNum] = true;
+		int freeSize = getTestFreeSize(pageNum);
+		if (freeSize < size || freeSize >= (size / sizeStep + 2) * sizeStep) {
+			cout << "A page with " << freeSize << " bytes free has been allocated for " << size << " bytes." << endl;
+			return -1;
+		}
+	}
+
+	// The last free size of a page is the one which counts
+	sm->clearFreeSpaceMap(fileHandle);
+	sm->insertFreeSpaceMap(fileHandle, 3, 2000);
+	sm->insertFreeSpaceMap(fileHandle, 3, 100);
+	sm->insertFreeSpaceMap(fileHandle, 5, 1000);
+	sm->insertFreeSpaceMap(fileHandle, 7, 1500);
+	sm->removeFreeSpaceMap(fileHandle, 7);
+	int pageNum;
+	rc = sm->allocateSpace(fileName, fileHandle, 1200, pageNum);
+	assert(rc == success);
+	if (pageNum != -1) {
+		cout << "Page " << pageNum << " has been allocated for 1200 bytes." << endl;
+		return -1;
+	}
+	rc = sm->allocateSpace(fileName, fileHandle, 500, pageNum);
+	assert(rc == success);
+	if (pageNum != 5) {
+		cout << "Page " << pageNum << " has been allocated for 500 bytes." << endl;
+		return -1;
+	}
+	rc = sm->allocateSpace(fileName, fileHandle, 100, pageNum);
+	assert(rc == success);
+	if (pageNum != 3) {
+		cout << "Page " << pageNum << " has been allocated for 100 bytes." << endl;
+		return -1;
+	}
+
+	// Only pages with the free size of an empty page are empty
+	int emptySize = sm->getEmptyPageFreeSize(PAGE_SIZE);
+	sm->insertFreeSpaceMap(fileHandle, 2, emptySize);
+	sm->insertFreeSpaceMap(fileHandle, 4, emptySize - 1);
+	if (!sm->isFreePage(fileHandle, 2) || sm->isFreePage(fileHandle, 4) || sm->isFreePage(fileHandle, indexedPages)) {
+		cout << "Empty pages are not told apart." << endl;
+		return -1;
+	}
+	sm->clearFreeSpaceMap(fileHandle);
+	if (sm->isFreePage(fileHandle, 2)) {
+		cout << "The map has not been cleared." << endl;
+		return -1;
+	}
+
+	// Records grow in place on pages whose free size comes from a saved map
+	vector<Attribute> recordDescriptor;
+	Attribute attr;
+	attr.name = "id";
+	attr.type = TypeInt;
+	attr.length = sizeof(int);
+	recordDescriptor.push_back(attr);
+	attr.name = "text";
+	attr.type = TypeVarChar;
+	attr.length = PAGE_SIZE;
+	recordDescriptor.push_back(attr);
+
+	char record[PAGE_SIZE];
+	RID rid;
+	prepareRecord(0, 1000, record);
+	rc = rbfm->insertRecord(fileHandle, recordDescriptor, record, rid);
+	assert(rc == success);
+	rc = rbfm->closeFile(fileHandle);
+	assert(rc == success);
+	rc = rbfm->openFile(fileName, fileHandle);
+	assert(rc == success);
+	unsigned length = prepareRecord(0, 1500, record);
+	rc = rbfm->updateRecord(fileHandle, recordDescriptor, record, rid);
+	assert(rc == success);
+	char returned[PAGE_SIZE];
+	rc = rbfm->readRecord(fileHandle, recordDescriptor, rid, returned);
+	assert(rc == success);
+	if (memcmp(record, returned, length) != 0) {
+		cout << "The record has not been updated." << endl;
+		return -1;
+	}
+	RID next;
+	prepareRecord(1, 1000, record);
+	rc = rbfm->insertRecord(fileHandle, recordDescriptor, record, next);
+	assert(rc == success);
+	if (next.pageNum != rid.pageNum || fileHandle.getNumberOfPages() != 1) {
+		cout << "The free space left by the update has not been reused." << endl;
+		return -1;
+	}
+
+	rc = rbfm->closeFile(fileHandle);
+	assert(rc == success);
+	rc = rbfm->destroyFile(fileName);
+	assert(rc == success);
+	return 0;
+}
+
+int main() {
+	RecordBasedFileManager *rbfm = RecordBasedFileManager::instance();
+
+	remove(fileName.c_str());
+	remove(SpaceManager::getFreeSpaceFileName(fileName).c_str());
+
+	int rc = RBFTest_29(rbfm);
+	if (rc == 0) {
+		cout << "Test Case 29 Passed!" << endl << endl;
+		total += 4;
+	} else {
+		cout << "Test Case 29 Failed!" << endl << endl;
+	}
+
+	cout << "Score for Test Case 29: " << total << " / 4" << endl;
+
+	return 0;
+}
@@ -0,0 +1,205 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cassert>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "pfm.h"
+#include "rbfm.h"
+
+using namespace std;
+
+const int success = 0;
+unsigned total = 0;
+
+const int numRecords = 20000;
+const string fileName = "test30";
+
+// Record: int id, varchar text
+unsigned prepareRecord(int id, unsigned length, char *record) {
+	memcpy(record, &id, sizeof(int));
+	memcpy(record + sizeof(int), &length, sizeof(int));
+	memset(record + 2 * sizeof(int), 'a' + id % 26, length);
+	return 2 * sizeof(int) + length;
+}
+
+unsigned getTestLength(int id) {
+	return 10 + (id * 31) % 200;
+}
+
+int RBFTest_30(RecordBasedFileManager *rbfm) {
+	// Functions Tested:
+	// 1. Insert a batch of records (insertRecords)
+	// 2. Read them back by RID and by scan
+	// 3. Append the pages with few writes
+	// 4. Reuse their free space through insertRecord
+	cout << "****In RBF Test Case 30****" << endl;
+
+	RC rc;
+	rc = rbfm->createFile(fileName);
+	assert(rc == success);
+	FileHandle fileHandle;
+	rc = rbfm->openFile(fileName, fileHandle);
+	assert(rc == success);
+
+	vector<Attribute> recordDescriptor;
+	Attribute attr;
+	attr.name = "id";
+	attr.type = TypeInt;
+	attr.length = sizeof(int);
+	recordDescriptor.push_back(attr);
+	attr.name = "text";
+	attr.type = TypeVarChar;
+	attr.length = PAGE_SIZE;
+	recordDescriptor.push_back(attr);
+
+	// A record is inserted alone first: the batch leaves its page alone
+	char record[PAGE_SIZE];
+	RID firstRid;
+	prepareRecord(-1, 100, record);
+	rc = rbfm->insertRecord(fileHandle, recordDescriptor, record, firstRid);
+	assert(rc == success);
+
+	vector<char *> records;
+	vector<const void *> batch;
+	for (int i = 0; i < numRecords; i++) {
+		char *r = new char[PAGE_SIZE];
+		prepareRecord(i, getTestLength(i), r);
+		records.push_back(r);
+		batch.push_back(r);
+	}
+
+	IOStats before, after;
+	rc = fileHandle.collectIOStats(before);
+	assert(rc == success);
+	vector<RID> rids;
+	rc = rbfm->insertRecords(fileHandle, recordDescriptor, batch, rids);
+	assert(rc == success);
+	rc = fileHandle.collectIOStats(after);
+	assert(rc == success);
+	if (rids.size() != (size_t) numRecords) {
+		cout << "Got " << rids.size() << " RIDs for " << numRecords << " records." << endl;
+		return -1;
+	}
+
+	// Pages are filled in order, one after another
+	unsigned pageCount = fileHandle.getNumberOfPages();
+	for (int i = 0; i < numRecords; i++) {
+		if (rids[i].pageNum == firstRid.pageNum || rids[i].pageNum >= pageCount
+				|| (i > 0 && !(rids[i].pageNum == rids[i - 1].pageNum && rids[i].slotNum == rids[i - 1].slotNum + 1)
+						   && !(rids[i].pageNum == rids[i - 1].pageNum + 1 && rids[i].slotNum == 0))) {
+			cout << "Record " << i << " got page " << rids[i].pageNum << " slot " << rids[i].slotNum << endl;
+			return -1;
+		}
+	}
+	unsigned long long pagesWritten = (after.bytesWritten - before.bytesWritten) / PAGE_SIZE;
+	unsigned long long syscalls = after.syscallCount - before.syscallCount;
+	if (pagesWritten < pageCount - 1 || syscalls > pagesWritten / 16) {
+		cout << syscalls << " system calls wrote " << pagesWritten << " pages." << endl;
+		return -1;
+	}
+
+	char returned[PAGE_SIZE];
+	for (int i = 0; i < numRecords; i++) {
+		rc = rbfm->readRecord(fileHandle, recordDescriptor, rids[i], returned);
+		assert(rc == success);
+		if (memcmp(records[i], returned, 2 * sizeof(int) + getTestLength(i)) != 0) {
+			cout << "Record " << i << " differs." << endl;
+			return -1;
+		}
+	}
+
+	// A scan sees the batch once, after the first record
+	RBFM_ScanIterator iterator;
+	vector<string> names;
+	names.push_back("id");
+	rc = rbfm->scan(fileHandle, recordDescriptor, "", NO_OP, NULL, names, iterator);
+	assert(rc == success);
+	RID rid;
+	int expected = -1;
+	while (iterator.getNextRecord(rid, returned) != RBFM_EOF) {
+		int id;
+		memcpy(&id, returned, sizeof(int));
+		if (id != expected) {
+			cout << "The scan returned record " << id << " instead of " << expected << endl;
+			return -1;
+		}
+		expected++;
+	}
+	iterator.close();
+	if (expected != numRecords) {
+		cout << "The scan stopped at record " << expected << endl;
+		return -1;
+	}
+
+	// Free space left in the batch pages is known to the map
+	unsigned length = prepareRecord(numRecords, 8, record);
+	rc = rbfm->insertRecord(fileHandle, recordDescriptor, record, rid);
+	assert(rc == success);
+	if (fileHandle.getNumberOfPages() != pageCount) {
+		cout << "A page has been appended for a small record." << endl;
+		return -1;
+	}
+
+	// RIDs survive the close
+	rc = rbfm->closeFile(fileHandle);
+	assert(rc == success);
+	rc = rbfm->openFile(fileName, fileHandle);
+	assert(rc == success);
+	rc = rbfm->readRecord(fileHandle, recordDescriptor, rid, returned);
+	assert(rc == success);
+	if (memcmp(record, returned, length) != 0) {
+		cout << "The last record differs." << endl;
+		return -1;
+	}
+	rc = rbfm->readRecord(fileHandle, recordDescriptor, rids[numRecords - 1], returned);
+	assert(rc == success);
+	if (memcmp(records[numRecords - 1], returned, 2 * sizeof(int) + getTestLength(numRecords - 1)) != 0) {
+		cout << "The last record of the batch differs." << endl;
+		return -1;
+	}
+
+	// Too large a record fails the whole batch
+	vector<const void *> bad;
+	bad.push_back(records[0]);
+	char *large = new char[2 * PAGE_SIZE];
+	prepareRecord(0, PAGE_SIZE, large);
+	bad.push_back(large);
+	pageCount = fileHandle.getNumberOfPages();
+	rc = rbfm->insertRecords(fileHandle, recordDescriptor, bad, rids);
+	if (rc == success || fileHandle.getNumberOfPages() != pageCount) {
+		cout << "A batch with a record too large has been inserted." << endl;
+		return -1;
+	}
+	delete[] large;
+
+	for (int i = 0; i < numRecords; i++) {
+		delete[] records[i];
+	}
+	rc = rbfm->closeFile(fileHandle);
+	assert(rc == success);
+	rc = rbfm->destroyFile(fileName);
+	assert(rc == success);
+	return 0;
+}
+
+int main() {
+	RecordBasedFileManager *rbfm = RecordBasedFileManager::instance();
+
+	remove(fileName.c_str());
+	remove(SpaceManager::getFreeSpaceFileName(fileName).c_str());
+
+	int rc = RBFTest_30(rbfm);
+	if (rc == 0) {
+		cout << "Test Case 30 Passed!" << endl << endl;
+		total += 4;
+	} else {
+		cout << "Test Case 30 Failed!" << endl << endl;
+	}
+
+	cout << "Score for Test Case 30: " << total << " / 4" << endl;
+
+	return 0;
+}
@@ -0,0 +1,258 @@
+#include <iostream>
+#include <string>
+#include <cassert>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+#include "pfm.h"
+#include "rbfm.h"
+
+using namespace std;
+
+const int success = 0;
+unsigned total = 0;
+
+const unsigned frameCount = 128;
+const unsigned threadCount = 4;
+const unsigned recordCount = 3000;     // per thread
+const string fileName = "test31";
+
+// Record: int id, varchar text
+unsigned prepareRecord(int id, unsigned length, char *record) {
+	memcpy(record, &id, sizeof(int));
+	memcpy(record + sizeof(int), &length, sizeof(int));
+	memset(record + 2 * sizeof(int), 'a' + id % 26, length);
+	return 2 * sizeof(int) + length;
+}
+
+unsigned getTestLength(int id, bool updated) {
+	return updated ? 300 + id % 500 : 20 + id % 100;
+}
+
+vector<Attribute> getDescriptor() {
+	vector<Attribute> recordDescriptor;
+	Attribute attr;
+	attr.name = "id";
+	attr.type = TypeInt;
+	attr.length = sizeof(int);
+	recordDescriptor.push_back(attr);
+	attr.name = "text";
+	attr.type = TypeVarChar;
+	attr.length = PAGE_SIZE;
+	recordDescriptor.push_back(attr);
+	return recordDescriptor;
+}
+
+// Insert records, grow every other one (they may move), delete every fifth
+// one, and check what is left through the RIDs
+void writeRecords(FileHandle *fileHandle, unsigned seed, vector<RID> *rids, int *result) {
+	RecordBasedFileManager *rbfm = RecordBasedFileManager::instance();
+	vector<Attribute> recordDescriptor = getDescriptor();
+	char record[PAGE_SIZE];
+	char returned[PAGE_SIZE];
+	*result = -1;
+	for (unsigned i = 0; i < recordCount; i++) {
+		int id = seed * recordCount + i;
+		prepareRecord(id, getTestLength(id, false), record);
+		if (rbfm->insertRecord(*fileHandle, recordDescriptor, record, (*rids)[i]) != success) {
+			return;
+		}
+	}
+	for (unsigned i = 0; i < recordCount; i++) {
+		int id = seed * recordCount + i;
+		if (i % 2 == 0) {
+			prepareRecord(id, getTestLength(id, true), record);
+			if (rbfm->updateRecord(*fileHandle, recordDescriptor, record, (*rids)[i]) != success) {
+				return;
+			}
+		}
+		if (i % 5 == 0 && rbfm->deleteRecord(*fileHandle, recordDescriptor, (*rids)[i]) != success) {
+			return;
+		}
+	}
+	for (unsigned i = 0; i < recordCount; i++) {
+		int id = seed * recordCount + i;
+		if (i % 5 == 0) {
+			continue;
+		}
+		unsigned length = prepareRecord(id, getTestLength(id, i % 2 == 0), record);
+		if (rbfm->readRecord(*fileHandle, recordDescriptor, (*rids)[i], returned) != success
+				|| memcmp(record, returned, length) != 0) {
+			return;
+		}
+	}
+	*result = 0;
+}
+
+// Scan the file while it changes: every record seen must be whole
+void scanRecords(FileHandle *fileHandle, int *result) {
+	RecordBasedFileManager *rbfm = RecordBasedFileManager::instance();
+	vector<Attribute> recordDescriptor = getDescriptor();
+	vector<string> names;
+	names.push_back("id");
+	names.push_back("text");
+	char returned[PAGE_SIZE];
+	*result = -1;
+	for (unsigned round = 0; round < 5; round++) {
+		RBFM_ScanIterator iterator;
+		if (rbfm->scan(*fileHandle, recordDescriptor, "", NO_OP, NULL, names, iterator) != success) {
+			return;
+		}
+		RID rid;
+		while (iterator.getNextRecord(rid, returned) != RBFM_EOF) {
+			int id;
+			unsigned length;
+			memcpy(&id, returned, sizeof(int));
+			memcpy(&length, returned + sizeof(int), sizeof(int));
+			if (id < 0 || id >= (int) (threadCount * recordCount)
+					|| (length != getTestLength(id, false) && length != getTestLength(id, true))) {
+				iterator.close();
+				return;
+			}
+			for (unsigned j = 0; j < length; j++) {
+				if (returned[2 * sizeof(int) + j] != 'a' + id % 26) {
+					iterator.close();
+					return;
+				}
+			}
+		}
+		iterator.close();
+	}
+	*result = 0;
+}
+
+int RBFTest_31(RecordBasedFileManager *rbfm) {
+	// Functions Tested:
+	// 1. Insert, update, delete and read records from several threads at once
+	// 2. Scan a file while other threads change it
+	// 3. Scan from several threads at once
+	// 4. Keep the free space map consistent
+	cout << "****In RBF Test Case 31****" << endl;
+
+	RC rc;
+	rc = rbfm->createFile(fileName);
+	assert(rc == success);
+	FileHandle fileHandle;
+	rc = rbfm->openFile(fileName, fileHandle, IO_PREAD);
+	assert(rc == success);
+
+	vector<thread> threads;
+	vector<vector<RID> > rids(threadCount, vector<RID>(recordCount));
+	int results[2 * threadCount];
+	for (unsigned i = 0; i < threadCount; i++) {
+		threads.push_back(thread(writeRecords, &fileHandle, i, &rids[i], &results[i]));
+	}
+	threads.push_back(thread(scanRecords, &fileHandle, &results[threadCount]));
+	for (unsigned i = 0; i < threads.size(); i++) {
+		threads[i].join();
+	}
+	for (unsigned i = 0; i <= threadCount; i++) {
+		if (results[i] != success) {
+			cout << "Thread " << i << " failed." << endl;
+			return -1;
+		}
+	}
+
+	// No two records share a RID (those of deleted ones are reused)
+	vector<vector<bool> > used;
+	for (unsigned t = 0; t < threadCount; t++) {
+		for (unsigned i = 0; i < recordCount; i++) {
+			if (i % 5 == 0) {
+				continue;
+			}
+			RID rid = rids[t][i];
+			if (rid.pageNum >= used.size()) {
+				used.resize(rid.pageNum + 1);
+			}
+			if (rid.slotNum >= used[rid.pageNum].size()) {
+				used[rid.pageNum].resize(rid.slotNum + 1, false);
+			}
+			if (used[rid.pageNum][rid.slotNum]) {
+				cout << "Two records got page " << rid.pageNum << " slot " << rid.slotNum << endl;
+				return -1;
+			}
+			used[rid.pageNum][rid.slotNum] = true;
+		}
+	}
+
+	// Scans of a file which does not change see every record once
+	threads.clear();
+	for (unsigned i = 0; i < threadCount; i++) {
+		threads.push_back(thread(scanRecords, &fileHandle, &results[i]));
+	}
+	for (unsigned i = 0; i < threadCount; i++) {
+		threads[i].join();
+		if (results[i] != success) {
+			cout << "Scan " << i << " failed." << endl;
+			return -1;
+		}
+	}
+	vector<Attribute> recordDescriptor = getDescriptor();
+	vector<string> names;
+	names.push_back("id");
+	RBFM_ScanIterator iterator;
+	rc = rbfm->scan(fileHandle, recordDescriptor, "", NO_OP, NULL, names, iterator);
+	assert(rc == success);
+	vector<bool> seen(threadCount * recordCount, false);
+	RID rid;
+	char returned[PAGE_SIZE];
+	unsigned count = 0;
+	while (iterator.getNextRecord(rid, returned) != RBFM_EOF) {
+		int id;
+		memcpy(&id, returned, sizeof(int));
+		if (seen[id] || (id % recordCount) % 5 == 0) {
+			cout << "The scan returned record " << id << " again or after its deletion." << endl;
+			return -1;
+		}
+		seen[id] = true;
+		count++;
+	}
+	iterator.close();
+	if (count != threadCount * (recordCount - recordCount / 5)) {
+		cout << "The scan returned " << count << " records." << endl;
+		return -1;
+	}
+
+	// The map still leads inserts to pages with room
+	unsigned pageCount = fileHandle.getNumberOfPages();
+	char record[PAGE_SIZE];
+	for (unsigned i = 0; i < 100; i++) {
+		prepareRecord(i, 20, record);
+		rc = rbfm->insertRecord(fileHandle, recordDescriptor, record, rid);
+		assert(rc == success);
+	}
+	if (fileHandle.getNumberOfPages() != pageCount) {
+		cout << "Pages have been appended although some have room." << endl;
+		return -1;
+	}
+
+	rc = rbfm->closeFile(fileHandle);
+	assert(rc == success);
+	rc = rbfm->destroyFile(fileName);
+	assert(rc == success);
+	return 0;
+}
+
+int main() {
+	// Use a small pool so that threads evict each other's pages
+	PagedFileManager::setBufferFrames(frameCount);
+	RecordBasedFileManager *rbfm = RecordBasedFileManager::instance();
+
+	remove(fileName.c_str());
+	remove(SpaceManager::getFreeSpaceFileName(fileName).c_str());
+
+	int rc = RBFTest_31(rbfm);
+	if (rc == 0) {
+		cout << "Test Case 31 Passed!" << endl << endl;
+		total += 4;
+	} else {
+		cout << "Test Case 31 Failed!" << endl << endl;
+	}
+
+	cout << "Score for Test Case 31: " << total << " / 4" << endl;
+
+	return 0;
+}
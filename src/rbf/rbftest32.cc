@@ -0,0 +1,238 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cassert>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "pfm.h"
+#include "rbfm.h"
+
+using namespace std;
+
+const int success = 0;
+unsigned total = 0;
+
+const unsigned frameCount = 8;
+const int numRecords = 5000;
+const string fileName = "test32";
+
+// Record: int id, varchar name, real score
+unsigned prepareRecord(int id, unsigned length, char *record) {
+	float score = id * 0.5f;
+	memcpy(record, &id, sizeof(int));
+	memcpy(record + sizeof(int), &length, sizeof(int));
+	memset(record + 2 * sizeof(int), 'a' + id % 26, length);
+	memcpy(record + 2 * sizeof(int) + length, &score, sizeof(float));
+	return 2 * sizeof(int) + length + sizeof(float);
+}
+
+unsigned getTestLength(int id) {
+	return 10 + (id * 7) % 90;
+}
+
+// Check the fields of a view against the record they came from
+bool checkView(const RecordView &view, int id, unsigned length) {
+	int i;
+	float f;
+	const char *str;
+	unsigned len;
+	if (!view.isValid() || view.length() != 3 * sizeof(int) + length
+			|| view.getInt(0, i) != success || i != id
+			|| view.getVarChar(1, str, len) != success || len != length
+			|| view.getReal(2, f) != success || f != id * 0.5f) {
+		return false;
+	}
+	for (unsigned j = 0; j < len; j++) {
+		if (str[j] != 'a' + id % 26) {
+			return false;
+		}
+	}
+	return true;
+}
+
+int RBFTest_32(RecordBasedFileManager *rbfm) {
+	// Functions Tested:
+	// 1. Read records in place (readRecordView) and through the typed accessors
+	// 2. Scan records in place (getNextRecordView)
+	// 3. Follow a tomb stone to the record moved
+	// 4. Release every page pinned by a view
+	cout << "****In RBF Test Case 32****" << endl;
+
+	RC rc;
+	rc = rbfm->createFile(fileName);
+	assert(rc == success);
+	FileHandle fileHandle;
+	rc = rbfm->openFile(fileName, fileHandle);
+	assert(rc == success);
+
+	vector<Attribute> recordDescriptor;
+	Attribute attr;
+	attr.name = "id";
+	attr.type = TypeInt;
+	attr.length = sizeof(int);
+	recordDescriptor.push_back(attr);
+	attr.name = "name";
+	attr.type = TypeVarChar;
+	attr.length = PAGE_SIZE;
+	recordDescriptor.push_back(attr);
+	attr.name = "score";
+	attr.type = TypeReal;
+	attr.length = sizeof(float);
+	recordDescriptor.push_back(attr);
+
+	char record[PAGE_SIZE];
+	vector<RID> rids(numRecords);
+	for (int i = 0; i < numRecords; i++) {
+		prepareRecord(i, getTestLength(i), record);
+		rc = rbfm->insertRecord(fileHandle, recordDescriptor, record, rids[i]);
+		assert(rc == success);
+	}
+	if (fileHandle.getNumberOfPages() < 10 * frameCount) {
+		cout << "The file is too small for the test." << endl;
+		return -1;
+	}
+
+	// Views match readRecord(), and pins do not pile up over thousands of reads
+	char returned[PAGE_SIZE];
+	for (int i = 0; i < numRecords; i++) {
+		RecordView view;
+		rc = rbfm->readRecordView(fileHandle, recordDescriptor, rids[i], view);
+		if (rc != success || !checkView(view, i, getTestLength(i))) {
+			cout << "The view of record " << i << " differs." << endl;
+			return -1;
+		}
+		rc = rbfm->readRecord(fileHandle, recordDescriptor, rids[i], returned);
+		assert(rc == success);
+		if (memcmp(view.data(), returned, view.length()) != 0) {
+			cout << "The view of record " << i << " differs from readRecord()." << endl;
+			return -1;
+		}
+	}
+
+	// One view reused over the whole file
+	RecordView view;
+	for (int i = numRecords - 1; i >= 0; i--) {
+		rc = rbfm->readRecordView(fileHandle, recordDescriptor, rids[i], view);
+		if (rc != success || !checkView(view, i, getTestLength(i))) {
+			cout << "The reused view of record " << i << " differs." << endl;
+			return -1;
+		}
+	}
+
+	// Bad fields and types are refused
+	int i;
+	float f;
+	const char *field;
+	unsigned size;
+	if (view.getInt(3, i) != ERR_ATTR_NOT_FOUND || view.getReal(0, f) != ERR_FORMAT
+			|| view.getField(1, field, size) != success || size != sizeof(int) + getTestLength(0)) {
+		cout << "A bad field has been read." << endl;
+		return -1;
+	}
+	rc = view.release();
+	assert(rc == success);
+	if (view.isValid() || view.getInt(0, i) == success) {
+		cout << "A released view is still readable." << endl;
+		return -1;
+	}
+
+	// A scan in place returns every record once
+	RBFM_ScanIterator iterator;
+	vector<string> names;
+	rc = rbfm->scan(fileHandle, recordDescriptor, "", NO_OP, NULL, names, iterator);
+	assert(rc == success);
+	RID rid;
+	vector<bool> seen(numRecords, false);
+	unsigned count = 0;
+	while (iterator.getNextRecordView(rid, view) != RBFM_EOF) {
+		if (view.getInt(0, i) != success || i < 0 || i >= numRecords || seen[i]
+				|| !checkView(view, i, getTestLength(i))
+				|| rid.pageNum != rids[i].pageNum || rid.slotNum != rids[i].slotNum) {
+			cout << "The scan returned a bad view after " << count << " records." << endl;
+			return -1;
+		}
+		seen[i] = true;
+		count++;
+	}
+	iterator.close();
+	if (count != (unsigned) numRecords || view.isValid()) {
+		cout << "The scan returned " << count << " records." << endl;
+		return -1;
+	}
+
+	// A filtered scan: the condition still holds over views
+	int value = numRecords - 100;
+	rc = rbfm->scan(fileHandle, recordDescriptor, "id", GE_OP, &value, names, iterator);
+	assert(rc == success);
+	count = 0;
+	while (iterator.getNextRecordView(rid, view) == success) {
+		rc = view.getInt(0, i);
+		if (rc != success || i < value) {
+			cout << "The scan returned record " << i << endl;
+			return -1;
+		}
+		count++;
+	}
+	iterator.close();
+	if (count != 100) {
+		cout << "The scan returned " << count << " records." << endl;
+		return -1;
+	}
+
+	// A record grown out of its page is reached through its tomb stone
+	unsigned length = prepareRecord(7, 3000, record);
+	rc = rbfm->updateRecord(fileHandle, recordDescriptor, record, rids[7]);
+	assert(rc == success);
+	rc = rbfm->readRecordView(fileHandle, recordDescriptor, rids[7], view);
+	if (rc != success || !checkView(view, 7, 3000) || memcmp(view.data(), record, length) != 0) {
+		cout << "The moved record differs." << endl;
+		return -1;
+	}
+	view.release();
+
+	// Every pin has been dropped: the file closes and the pool is free
+	rc = rbfm->closeFile(fileHandle);
+	assert(rc == success);
+	rc = rbfm->openFile(fileName, fileHandle);
+	assert(rc == success);
+	for (unsigned p = 0; p < frameCount; p++) {
+		void *page;
+		rc = fileHandle.pinPage(p, page);
+		if (rc != success) {
+			cout << "A page stayed pinned." << endl;
+			return -1;
+		}
+	}
+	for (unsigned p = 0; p < frameCount; p++) {
+		fileHandle.unpinPage(p, false);
+	}
+
+	rc = rbfm->closeFile(fileHandle);
+	assert(rc == success);
+	rc = rbfm->destroyFile(fileName);
+	assert(rc == success);
+	return 0;
+}
+
+int main() {
+	// Use a small pool so that a pin left behind soon exhausts it
+	PagedFileManager::setBufferFrames(frameCount);
+	RecordBasedFileManager *rbfm = RecordBasedFileManager::instance();
+
+	remove(fileName.c_str());
+	remove(SpaceManager::getFreeSpaceFileName(fileName).c_str());
+
+	int rc = RBFTest_32(rbfm);
+	if (rc == 0) {
+		cout << "Test Case 32 Passed!" << endl << endl;
+		total += 4;
+	} else {
+		cout << "Test Case 32 Failed!" << endl << endl;
+	}
+
+	cout << "Score for Test Case 32: " << total << " / 4" << endl;
+
+	return 0;
+}
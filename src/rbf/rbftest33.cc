@@ -0,0 +1,265 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cassert>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "pfm.h"
+#include "rbfm.h"
+
+using namespace std;
+
+const int success = 0;
+unsigned total = 0;
+
+const string fileName = "test33";
+const unsigned fieldCount = 60;       // # of fields of a wide record
+const int numRecords = 200;
+
+// Record: int id, varchar name, real score
+unsigned prepareRecord(int id, unsigned length, char *record) {
+	float score = id * 0.25f;
+	memcpy(record, &id, sizeof(int));
+	memcpy(record + sizeof(int), &length, sizeof(int));
+	memset(record + 2 * sizeof(int), 'a' + id % 26, length);
+	memcpy(record + 2 * sizeof(int) + length, &score, sizeof(float));
+	return 2 * sizeof(int) + length + sizeof(float);
+}
+
+// Wide record: alternately int and varchar fields
+unsigned prepareWideRecord(int id, char *record) {
+	unsigned offset = 0;
+	for (unsigned i = 0; i < fieldCount; i++) {
+		if (i % 2 == 0) {
+			int value = id * 1000 + i;
+			memcpy(record + offset, &value, sizeof(int));
+			offset += sizeof(int);
+		} else {
+			int length = (id + i) % 7;
+			memcpy(record + offset, &length, sizeof(int));
+			memset(record + offset + sizeof(int), 'a' + i % 26, length);
+			offset += sizeof(int) + length;
+		}
+	}
+	return offset;
+}
+
+int RBFTest_33(RecordBasedFileManager *rbfm) {
+	// Functions Tested:
+	// 1. Read records of pages written without record headers (older files)
+	// 2. Insert and update records in such pages
+	// 3. Give pages left empty the new record format
+	// 4. Read any field of wide records through the field offsets
+	cout << "****In RBF Test Case 33****" << endl;
+
+	RC rc;
+	SpaceManager *sm = SpaceManager::instance();
+	rc = rbfm->createFile(fileName);
+	assert(rc == success);
+	FileHandle fileHandle;
+	rc = rbfm->openFile(fileName, fileHandle);
+	assert(rc == success);
+	unsigned pageSize = fileHandle.getPageSize();
+
+	vector<Attribute> recordDescriptor;
+	Attribute attr;
+	attr.name = "id";
+	attr.type = TypeInt;
+	attr.length = sizeof(int);
+	recordDescriptor.push_back(attr);
+	attr.name = "name";
+	attr.type = TypeVarChar;
+	attr.length = 200;
+	recordDescriptor.push_back(attr);
+	attr.name = "score";
+	attr.type = TypeReal;
+	attr.length = sizeof(float);
+	recordDescriptor.push_back(attr);
+
+	// A page as written before records had headers: records stored as they are passed in
+	char page[PAGE_SIZE];
+	char record[PAGE_SIZE];
+	sm->initCleanPage(page, pageSize);
+	unsigned freePtr = 0;
+	for (unsigned i = 0; i < 3; i++) {
+		unsigned length = prepareRecord(i, 10 + i, record);
+		sm->writeRecord(page, record, freePtr, length);
+		sm->setSlot(page, pageSize, i, freePtr, length);
+		sm->setSlotCount(page, pageSize, i + 1);
+		freePtr += length;
+	}
+	sm->setFreePtr(page, pageSize, freePtr);
+	rc = fileHandle.appendPage(page);
+	assert(rc == success);
+	sm->insertFreeSpaceMap(fileHandle, 0, sm->getPageFreeSize(page, pageSize));
+
+	char returned[PAGE_SIZE];
+	for (unsigned i = 0; i < 3; i++) {
+		RID rid;
+		rid.pageNum = 0;
+		rid.slotNum = i;
+		unsigned length = prepareRecord(i, 10 + i, record);
+		rc = rbfm->readRecord(fileHandle, recordDescriptor, rid, returned);
+		if (rc != success || memcmp(record, returned, length) != 0) {
+			cout << "Old record " << i << " differs." << endl;
+			return -1;
+		}
+		float score;
+		rc = rbfm->readAttribute(fileHandle, recordDescriptor, rid, "score", &score);
+		if (rc != success || score != i * 0.25f) {
+			cout << "The score of old record " << i << " differs." << endl;
+			return -1;
+		}
+		RecordView view;
+		const char *name;
+		unsigned nameLength;
+		rc = rbfm->readRecordView(fileHandle, recordDescriptor, rid, view);
+		if (rc != success || view.length() != length || memcmp(view.data(), record, length) != 0
+				|| view.getVarChar(1, name, nameLength) != success || nameLength != 10 + i) {
+			cout << "The view of old record " << i << " differs." << endl;
+			return -1;
+		}
+	}
+
+	// New records go to the old page, without header; updates stay in place
+	RID rid;
+	unsigned length = prepareRecord(3, 13, record);
+	rc = rbfm->insertRecord(fileHandle, recordDescriptor, record, rid);
+	assert(rc == success);
+	rc = fileHandle.readPage(0, page);
+	assert(rc == success);
+	if (rid.pageNum != 0 || sm->getRecordFormat(page, pageSize) != SpaceManager::RECORD_FORMAT_PLAIN
+			|| sm->getSlotLength(page, pageSize, rid.slotNum) != (int) length) {
+		cout << "The record inserted into the old page has a wrong format." << endl;
+		return -1;
+	}
+	RID first;
+	first.pageNum = 0;
+	first.slotNum = 0;
+	length = prepareRecord(100, 5, record);
+	rc = rbfm->updateRecord(fileHandle, recordDescriptor, record, first);
+	assert(rc == success);
+	rc = rbfm->readRecord(fileHandle, recordDescriptor, first, returned);
+	if (rc != success || memcmp(record, returned, length) != 0) {
+		cout << "The updated old record differs." << endl;
+		return -1;
+	}
+
+	// A filtered and projected scan reads the old page
+	RBFM_ScanIterator iterator;
+	vector<string> names;
+	names.push_back("score");
+	names.push_back("id");
+	int value = 2;
+	rc = rbfm->scan(fileHandle, recordDescriptor, "id", GE_OP, &value, names, iterator);
+	assert(rc == success);
+	unsigned count = 0;
+	while (iterator.getNextRecord(rid, returned) != RBFM_EOF) {
+		float score;
+		int id;
+		memcpy(&score, returned, sizeof(float));
+		memcpy(&id, returned + sizeof(float), sizeof(int));
+		if (id < value || score != id * 0.25f) {
+			cout << "The scan returned record " << id << endl;
+			return -1;
+		}
+		count++;
+	}
+	iterator.close();
+	if (count != 3) {
+		cout << "The scan returned " << count << " records." << endl;
+		return -1;
+	}
+
+	// Once emptied, the old page takes records with headers
+	for (unsigned i = 0; i < 4; i++) {
+		rid.pageNum = 0;
+		rid.slotNum = i;
+		rc = rbfm->deleteRecord(fileHandle, recordDescriptor, rid);
+		assert(rc == success);
+	}
+	length = prepareRecord(4, 20, record);
+	rc = rbfm->insertRecord(fileHandle, recordDescriptor, record, rid);
+	assert(rc == success);
+	rc = fileHandle.readPage(0, page);
+	assert(rc == success);
+	if (rid.pageNum != 0 || sm->getRecordFormat(page, pageSize) != SpaceManager::RECORD_FORMAT_OFFSETS
+			|| sm->getSlotCount(page, pageSize) != 1) {
+		cout << "The emptied page kept the old format." << endl;
+		return -1;
+	}
+	rc = rbfm->readRecord(fileHandle, recordDescriptor, rid, returned);
+	if (rc != success || memcmp(record, returned, length) != 0) {
+		cout << "The record of the emptied page differs." << endl;
+		return -1;
+	}
+
+	// Wide records: any field is reached through the header
+	vector<Attribute> wideDescriptor;
+	for (unsigned i = 0; i < fieldCount; i++) {
+		attr.name = "f" + to_string(i);
+		attr.type = i % 2 == 0 ? TypeInt : TypeVarChar;
+		attr.length = i % 2 == 0 ? sizeof(int) : 10;
+		wideDescriptor.push_back(attr);
+	}
+	vector<RID> rids(numRecords);
+	for (int i = 0; i < numRecords; i++) {
+		prepareWideRecord(i, record);
+		rc = rbfm->insertRecord(fileHandle, wideDescriptor, record, rids[i]);
+		assert(rc == success);
+	}
+	for (int i = 0; i < numRecords; i++) {
+		length = prepareWideRecord(i, record);
+		rc = fileHandle.readPage(rids[i].pageNum, page);
+		assert(rc == success);
+		bool hasHeader = sm->getRecordFormat(page, pageSize) == SpaceManager::RECORD_FORMAT_OFFSETS;
+		int storedLength = sm->getSlotLength(page, pageSize, rids[i].slotNum);
+		if (!hasHeader || storedLength <= (int) length) {
+			cout << "Wide record " << i << " has no header." << endl;
+			return -1;
+		}
+		rc = rbfm->readRecord(fileHandle, wideDescriptor, rids[i], returned);
+		if (rc != success || memcmp(record, returned, length) != 0) {
+			cout << "Wide record " << i << " differs." << endl;
+			return -1;
+		}
+		for (unsigned j = fieldCount - 1; j >= fieldCount - 3; j--) {
+			char field[PAGE_SIZE];
+			rc = rbfm->readAttribute(fileHandle, wideDescriptor, rids[i], "f" + to_string(j), field);
+			int expectedInt = i * 1000 + j;
+			int expectedLength = (i + j) % 7;
+			if (rc != success || (j % 2 == 0 && memcmp(field, &expectedInt, sizeof(int)) != 0)
+					|| (j % 2 == 1 && memcmp(field, &expectedLength, sizeof(int)) != 0)) {
+				cout << "Field " << j << " of wide record " << i << " differs." << endl;
+				return -1;
+			}
+		}
+	}
+
+	rc = rbfm->closeFile(fileHandle);
+	assert(rc == success);
+	rc = rbfm->destroyFile(fileName);
+	assert(rc == success);
+	return 0;
+}
+
+int main() {
+	RecordBasedFileManager *rbfm = RecordBasedFileManager::instance();
+
+	remove(fileName.c_str());
+	remove(SpaceManager::getFreeSpaceFileName(fileName).c_str());
+
+	int rc = RBFTest_33(rbfm);
+	if (rc == 0) {
+		cout << "Test Case 33 Passed!" << endl << endl;
+		total += 4;
+	} else {
+		cout << "Test Case 33 Failed!" << endl << endl;
+	}
+
+	cout << "Score for Test Case 33: " << total << " / 4" << endl;
+
+	return 0;
+}
@@ -0,0 +1,207 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cassert>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "pfm.h"
+#include "rbfm.h"
+
+using namespace std;
+
+const int success = 0;
+unsigned total = 0;
+
+const int numRecords = 1000;
+const string fileName = "test34";
+
+// Record: int id, varchar name, real score
+unsigned prepareRecord(int id, char *record) {
+	string name = string(id % 4, 'a' + id % 3) + (id % 5 == 0 ? "" : "z");
+	unsigned length = name.size();
+	float score = (id % 50) * 0.5f;
+	memcpy(record, &id, sizeof(int));
+	memcpy(record + sizeof(int), &length, sizeof(int));
+	memcpy(record + 2 * sizeof(int), name.data(), length);
+	memcpy(record + 2 * sizeof(int) + length, &score, sizeof(float));
+	return 2 * sizeof(int) + length + sizeof(float);
+}
+
+template <class T>
+bool compare(T a, CompOp op, T b) {
+	switch (op) {
+	case EQ_OP: return a == b;
+	case LT_OP: return a < b;
+	case GT_OP: return a > b;
+	case LE_OP: return a <= b;
+	case GE_OP: return a >= b;
+	case NE_OP: return a != b;
+	default: return true;
+	}
+}
+
+// Scan with a condition and count the records returned, checking each of them
+int countMatches(RecordBasedFileManager *rbfm, FileHandle &fileHandle, const vector<Attribute> &recordDescriptor,
+		const string &attribute, CompOp op, const void *value, int &expected) {
+	vector<string> names;
+	names.push_back("id");
+	RBFM_ScanIterator iterator;
+	if (rbfm->scan(fileHandle, recordDescriptor, attribute, op, value, names, iterator) != success) {
+		return -1;
+	}
+
+	// The constant is copied by scan()
+	char copy[PAGE_SIZE];
+	memcpy(copy, value, PAGE_SIZE / 2);
+	memset((void *) value, 0, PAGE_SIZE / 2);
+
+	expected = 0;
+	for (int i = 0; i < numRecords; i++) {
+		char record[PAGE_SIZE];
+		prepareRecord(i, record);
+		bool match;
+		if (attribute == "id") {
+			match = compare<int>(i, op, *(int *) copy);
+		} else if (attribute == "score") {
+			match = compare<float>((i % 50) * 0.5f, op, *(float *) copy);
+		} else {
+			int len, vlen;
+			memcpy(&len, record + sizeof(int), sizeof(int));
+			memcpy(&vlen, copy, sizeof(int));
+			match = compare<string>(string(record + 2 * sizeof(int), len), op, string(copy + sizeof(int), vlen));
+		}
+		expected += match;
+	}
+
+	RID rid;
+	char returned[PAGE_SIZE];
+	int count = 0;
+	while (iterator.getNextRecord(rid, returned) != RBFM_EOF) {
+		count++;
+	}
+	iterator.close();
+	memcpy((void *) value, copy, PAGE_SIZE / 2);
+	return count;
+}
+
+int RBFTest_34(RecordBasedFileManager *rbfm) {
+	// Functions Tested:
+	// 1. Scan with int conditions of every operator
+	// 2. Scan with real conditions of every operator
+	// 3. Scan with varchar conditions of every operator (prefixes, empty strings)
+	// 4. Scan with bad conditions
+	cout << "****In RBF Test Case 34****" << endl;
+
+	RC rc;
+	rc = rbfm->createFile(fileName);
+	assert(rc == success);
+	FileHandle fileHandle;
+	rc = rbfm->openFile(fileName, fileHandle);
+	assert(rc == success);
+
+	vector<Attribute> recordDescriptor;
+	Attribute attr;
+	attr.name = "id";
+	attr.type = TypeInt;
+	attr.length = sizeof(int);
+	recordDescriptor.push_back(attr);
+	attr.name = "name";
+	attr.type = TypeVarChar;
+	attr.length = 10;
+	recordDescriptor.push_back(attr);
+	attr.name = "score";
+	attr.type = TypeReal;
+	attr.length = sizeof(float);
+	recordDescriptor.push_back(attr);
+
+	char record[PAGE_SIZE];
+	for (int i = 0; i < numRecords; i++) {
+		RID rid;
+		prepareRecord(i, record);
+		rc = rbfm->insertRecord(fileHandle, recordDescriptor, record, rid);
+		assert(rc == success);
+	}
+
+	CompOp ops[] = { EQ_OP, LT_OP, GT_OP, LE_OP, GE_OP, NE_OP };
+	char value[PAGE_SIZE];
+	int expected;
+	for (unsigned o = 0; o < 6; o++) {
+		int intValue = 500;
+		memcpy(value, &intValue, sizeof(int));
+		int count = countMatches(rbfm, fileHandle, recordDescriptor, "id", ops[o], value, expected);
+		if (count != expected) {
+			cout << "Operator " << ops[o] << " on id returned " << count << " records, not " << expected << endl;
+			return -1;
+		}
+
+		float realValue = 12.5f;
+		memcpy(value, &realValue, sizeof(float));
+		count = countMatches(rbfm, fileHandle, recordDescriptor, "score", ops[o], value, expected);
+		if (count != expected) {
+			cout << "Operator " << ops[o] << " on score returned " << count << " records, not " << expected << endl;
+			return -1;
+		}
+
+		const char *strings[] = { "", "bb", "bbz", "b", "c" };
+		for (unsigned s = 0; s < 5; s++) {
+			int len = strlen(strings[s]);
+			memcpy(value, &len, sizeof(int));
+			memcpy(value + sizeof(int), strings[s], len);
+			count = countMatches(rbfm, fileHandle, recordDescriptor, "name", ops[o], value, expected);
+			if (count != expected || (ops[o] == EQ_OP && expected == 0 && len > 0)) {
+				cout << "Operator " << ops[o] << " on name \"" << strings[s] << "\" returned "
+					 << count << " records, not " << expected << endl;
+				return -1;
+			}
+		}
+	}
+
+	// No condition: all records; an unknown attribute: none
+	int count = countMatches(rbfm, fileHandle, recordDescriptor, "", NO_OP, value, expected);
+	if (count != numRecords) {
+		cout << "The scan without condition returned " << count << " records." << endl;
+		return -1;
+	}
+	RBFM_ScanIterator iterator;
+	vector<string> names;
+	names.push_back("id");
+	rc = rbfm->scan(fileHandle, recordDescriptor, "nothing", EQ_OP, value, names, iterator);
+	assert(rc == success);
+	RID rid;
+	if (iterator.getNextRecord(rid, record) != RBFM_EOF) {
+		cout << "A record matched an unknown attribute." << endl;
+		return -1;
+	}
+	iterator.close();
+	if (rbfm->scan(fileHandle, recordDescriptor, "id", EQ_OP, NULL, names, iterator) == success) {
+		cout << "A scan without value has been accepted." << endl;
+		return -1;
+	}
+
+	rc = rbfm->closeFile(fileHandle);
+	assert(rc == success);
+	rc = rbfm->destroyFile(fileName);
+	assert(rc == success);
+	return 0;
+}
+
+int main() {
+	RecordBasedFileManager *rbfm = RecordBasedFileManager::instance();
+
+	remove(fileName.c_str());
+	remove(SpaceManager::getFreeSpaceFileName(fileName).c_str());
+
+	int rc = RBFTest_34(rbfm);
+	if (rc == 0) {
+		cout << "Test Case 34 Passed!" << endl << endl;
+		total += 4;
+	} else {
+		cout << "Test Case 34 Failed!" << endl << endl;
+	}
+
+	cout << "Score for Test Case 34: " << total << " / 4" << endl;
+
+	return 0;
+}
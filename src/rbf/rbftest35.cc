@@ -0,0 +1,205 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cassert>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "pfm.h"
+#include "rbfm.h"
+
+using namespace std;
+
+const int success = 0;
+unsigned total = 0;
+
+const unsigned fieldCount = 12;
+const int numRecords = 500;
+const string fileName = "test35";
+
+// Record: fields alternately int and varchar
+unsigned prepareRecord(int id, char *record) {
+	unsigned offset = 0;
+	for (unsigned i = 0; i < fieldCount; i++) {
+		if (i % 2 == 0) {
+			int value = id * 100 + i;
+			memcpy(record + offset, &value, sizeof(int));
+			offset += sizeof(int);
+		} else {
+			int length = (id * 3 + i) % 11;
+			memcpy(record + offset, &length, sizeof(int));
+			memset(record + offset + sizeof(int), 'a' + (id + i) % 26, length);
+			offset += sizeof(int) + length;
+		}
+	}
+	return offset;
+}
+
+// Build the projection of a record field by field, through readAttribute()
+unsigned project(RecordBasedFileManager *rbfm, FileHandle &fileHandle, const vector<Attribute> &recordDescriptor,
+		const RID &rid, const vector<string> &names, char *data) {
+	unsigned offset = 0;
+	for (size_t i = 0; i < names.size(); i++) {
+		RC rc = rbfm->readAttribute(fileHandle, recordDescriptor, rid, names[i], data + offset);
+		assert(rc == success);
+		int size = sizeof(int);
+		if (names[i][1] % 2 == 1) {     // varchar fields have odd numbers below 10
+			int length;
+			memcpy(&length, data + offset, sizeof(int));
+			size += length;
+		}
+		offset += size;
+	}
+	return offset;
+}
+
+// Scan with a projection and compare each record with its projection field by field
+int checkProjection(RecordBasedFileManager *rbfm, FileHandle &fileHandle,
+		const vector<Attribute> &recordDescriptor, const vector<string> &names) {
+	RBFM_ScanIterator iterator;
+	if (rbfm->scan(fileHandle, recordDescriptor, "", NO_OP, NULL, names, iterator) != success) {
+		return -1;
+	}
+	RID rid;
+	char returned[PAGE_SIZE];
+	char expected[PAGE_SIZE];
+	int count = 0;
+	while (iterator.getNextRecord(rid, returned) != RBFM_EOF) {
+		unsigned size = project(rbfm, fileHandle, recordDescriptor, rid, names, expected);
+		if (memcmp(expected, returned, size) != 0) {
+			iterator.close();
+			return -1;
+		}
+		count++;
+	}
+	iterator.close();
+	return count;
+}
+
+int RBFTest_35(RecordBasedFileManager *rbfm) {
+	// Functions Tested:
+	// 1. Scan with the whole record projected
+	// 2. Scan with some fields projected, reordered or repeated
+	// 3. Scan pages of the plain record format with a projection
+	// 4. Scan with an unknown attribute projected
+	cout << "****In RBF Test Case 35****" << endl;
+
+	RC rc;
+	SpaceManager *sm = SpaceManager::instance();
+	rc = rbfm->createFile(fileName);
+	assert(rc == success);
+	FileHandle fileHandle;
+	rc = rbfm->openFile(fileName, fileHandle);
+	assert(rc == success);
+	unsigned pageSize = fileHandle.getPageSize();
+
+	vector<Attribute> recordDescriptor;
+	vector<string> allNames;
+	for (unsigned i = 0; i < fieldCount; i++) {
+		Attribute attr;
+		attr.name = (char) ('a' + i / 10);
+		attr.name += (char) ('0' + i % 10);
+		attr.type = i % 2 == 0 ? TypeInt : TypeVarChar;
+		attr.length = i % 2 == 0 ? sizeof(int) : 20;
+		recordDescriptor.push_back(attr);
+		allNames.push_back(attr.name);
+	}
+
+	// A page of the plain format first, as older files have
+	char page[PAGE_SIZE];
+	char record[PAGE_SIZE];
+	sm->initCleanPage(page, pageSize);
+	unsigned freePtr = 0;
+	for (unsigned i = 0; i < 5; i++) {
+		unsigned length = prepareRecord(numRecords + i, record);
+		sm->writeRecord(page, record, freePtr, length);
+		sm->setSlot(page, pageSize, i, freePtr, length);
+		sm->setSlotCount(page, pageSize, i + 1);
+		freePtr += length;
+	}
+	sm->setFreePtr(page, pageSize, freePtr);
+	rc = fileHandle.appendPage(page);
+	assert(rc == success);
+
+	for (int i = 0; i < numRecords; i++) {
+		RID rid;
+		prepareRecord(i, record);
+		rc = rbfm->insertRecord(fileHandle, recordDescriptor, record, rid);
+		assert(rc == success);
+	}
+
+	int count = checkProjection(rbfm, fileHandle, recordDescriptor, allNames);
+	if (count != numRecords + 5) {
+		cout << "The whole record projection returned " << count << " records." << endl;
+		return -1;
+	}
+
+	vector<string> names;
+	names.push_back("b1");
+	names.push_back("a0");
+	names.push_back("a7");
+	names.push_back("a7");
+	names.push_back("b0");
+	count = checkProjection(rbfm, fileHandle, recordDescriptor, names);
+	if (count != numRecords + 5) {
+		cout << "The partial projection returned " << count << " records." << endl;
+		return -1;
+	}
+
+	// The whole record, reordered
+	names = allNames;
+	swap(names[0], names[fieldCount - 1]);
+	count = checkProjection(rbfm, fileHandle, recordDescriptor, names);
+	if (count != numRecords + 5) {
+		cout << "The reordered projection returned " << count << " records." << endl;
+		return -1;
+	}
+
+	// Nothing projected: the records are still returned
+	names.clear();
+	count = checkProjection(rbfm, fileHandle, recordDescriptor, names);
+	if (count != numRecords + 5) {
+		cout << "The empty projection returned " << count << " records." << endl;
+		return -1;
+	}
+
+	// An unknown attribute ends the scan
+	names.push_back("a0");
+	names.push_back("zz");
+	RBFM_ScanIterator iterator;
+	rc = rbfm->scan(fileHandle, recordDescriptor, "", NO_OP, NULL, names, iterator);
+	assert(rc == success);
+	RID rid;
+	char returned[PAGE_SIZE];
+	if (iterator.getNextRecord(rid, returned) != RBFM_EOF) {
+		cout << "An unknown attribute has been projected." << endl;
+		return -1;
+	}
+	iterator.close();
+
+	rc = rbfm->closeFile(fileHandle);
+	assert(rc == success);
+	rc = rbfm->destroyFile(fileName);
+	assert(rc == success);
+	return 0;
+}
+
+int main() {
+	RecordBasedFileManager *rbfm = RecordBasedFileManager::instance();
+
+	remove(fileName.c_str());
+	remove(SpaceManager::getFreeSpaceFileName(fileName).c_str());
+
+	int rc = RBFTest_35(rbfm);
+	if (rc == 0) {
+		cout << "Test Case 35 Passed!" << endl << endl;
+		total += 4;
+	} else {
+		cout << "Test Case 35 Failed!" << endl << endl;
+	}
+
+	cout << "Score for Test Case 35: " << total << " / 4" << endl;
+
+	return 0;
+}
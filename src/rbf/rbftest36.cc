@@ -0,0 +1,202 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cassert>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "pfm.h"
+#include "rbfm.h"
+
+using namespace std;
+
+const int success = 0;
+unsigned total = 0;
+
+const int numRecords = 3000;
+const string fileName = "test36";
+
+// Record: int id, varchar text, real score
+unsigned prepareRecord(int id, char *record) {
+	unsigned length = id % 120;
+	float score = id * 1.5f;
+	memcpy(record, &id, sizeof(int));
+	memcpy(record + sizeof(int), &length, sizeof(int));
+	memset(record + 2 * sizeof(int), 'a' + id % 26, length);
+	memcpy(record + 2 * sizeof(int) + length, &score, sizeof(float));
+	return 2 * sizeof(int) + length + sizeof(float);
+}
+
+// Scan record by record and by batches of batchSize: both return the same
+int compareScans(RecordBasedFileManager *rbfm, FileHandle &fileHandle, const vector<Attribute> &recordDescriptor,
+		const string &attribute, CompOp op, const void *value, const vector<string> &names,
+		unsigned batchSize, unsigned &count) {
+	RBFM_ScanIterator iterator, batchIterator;
+	if (rbfm->scan(fileHandle, recordDescriptor, attribute, op, value, names, iterator) != success
+			|| rbfm->scan(fileHandle, recordDescriptor, attribute, op, value, names, batchIterator) != success) {
+		return -1;
+	}
+
+	RID rid;
+	char returned[PAGE_SIZE];
+	RecordBatch batch;
+	count = 0;
+	bool done = false;
+	while (!done) {
+		if (batchIterator.getNextBatch(batchSize, batch) != success) {
+			done = true;
+			if (batch.size() != 0) {
+				return -1;
+			}
+		} else if (batch.size() == 0 || batch.size() > batchSize) {
+			return -1;
+		}
+		for (unsigned i = 0; i < batch.size(); i++) {
+			if (iterator.getNextRecord(rid, returned) != success) {
+				return -1;
+			}
+			const RID &batchRid = batch.getRid(i);
+			if (rid.pageNum != batchRid.pageNum || rid.slotNum != batchRid.slotNum) {
+				return -1;
+			}
+			// The size of the projection is known from the batch only
+			if (memcmp(returned, batch.getRecord(i), batch.getRecordSize(i)) != 0) {
+				return -1;
+			}
+			count++;
+		}
+	}
+	if (iterator.getNextRecord(rid, returned) != RBFM_EOF) {
+		return -1;
+	}
+	iterator.close();
+	batchIterator.close();
+	return 0;
+}
+
+int RBFTest_36(RecordBasedFileManager *rbfm) {
+	// Functions Tested:
+	// 1. Scan whole records by batches of several sizes
+	// 2. Scan by batches with a condition
+	// 3. Scan by batches with a projection
+	// 4. Refill a batch after the end of the scan
+	cout << "****In RBF Test Case 36****" << endl;
+
+	RC rc;
+	rc = rbfm->createFile(fileName);
+	assert(rc == success);
+	FileHandle fileHandle;
+	rc = rbfm->openFile(fileName, fileHandle);
+	assert(rc == success);
+
+	vector<Attribute> recordDescriptor;
+	Attribute attr;
+	attr.name = "id";
+	attr.type = TypeInt;
+	attr.length = sizeof(int);
+	recordDescriptor.push_back(attr);
+	attr.name = "text";
+	attr.type = TypeVarChar;
+	attr.length = 200;
+	recordDescriptor.push_back(attr);
+	attr.name = "score";
+	attr.type = TypeReal;
+	attr.length = sizeof(float);
+	recordDescriptor.push_back(attr);
+
+	char record[PAGE_SIZE];
+	vector<RID> rids(numRecords);
+	for (int i = 0; i < numRecords; i++) {
+		prepareRecord(i, record);
+		rc = rbfm->insertRecord(fileHandle, recordDescriptor, record, rids[i]);
+		assert(rc == success);
+	}
+	// Holes left by deletions are skipped
+	for (int i = 0; i < numRecords; i += 7) {
+		rc = rbfm->deleteRecord(fileHandle, recordDescriptor, rids[i]);
+		assert(rc == success);
+	}
+	unsigned remaining = numRecords - (numRecords + 6) / 7;
+
+	vector<string> allNames;
+	allNames.push_back("id");
+	allNames.push_back("text");
+	allNames.push_back("score");
+	unsigned batchSizes[] = { 1, 7, 100, 1000, 100000 };
+	unsigned count;
+	for (unsigned b = 0; b < 5; b++) {
+		rc = compareScans(rbfm, fileHandle, recordDescriptor, "", NO_OP, NULL, allNames, batchSizes[b], count);
+		if (rc != success || count != remaining) {
+			cout << "Batches of " << batchSizes[b] << " differ from the records (" << count << " records)." << endl;
+			return -1;
+		}
+	}
+
+	float value = 1000.0f;
+	rc = compareScans(rbfm, fileHandle, recordDescriptor, "score", GE_OP, &value, allNames, 64, count);
+	if (rc != success || count == 0 || count >= remaining) {
+		cout << "Batches with a condition differ from the records (" << count << " records)." << endl;
+		return -1;
+	}
+
+	vector<string> names;
+	names.push_back("score");
+	names.push_back("text");
+	names.push_back("score");
+	rc = compareScans(rbfm, fileHandle, recordDescriptor, "", NO_OP, NULL, names, 50, count);
+	if (rc != success || count != remaining) {
+		cout << "Batches with a projection differ from the records (" << count << " records)." << endl;
+		return -1;
+	}
+	names.clear();
+	rc = compareScans(rbfm, fileHandle, recordDescriptor, "", NO_OP, NULL, names, 50, count);
+	if (rc != success || count != remaining) {
+		cout << "Batches without projected fields differ from the records (" << count << " records)." << endl;
+		return -1;
+	}
+
+	// A batch is emptied at the end of a scan, and reused by the next one
+	RBFM_ScanIterator iterator;
+	RecordBatch batch;
+	int id = numRecords - 2;
+	rc = rbfm->scan(fileHandle, recordDescriptor, "id", EQ_OP, &id, allNames, iterator);
+	assert(rc == success);
+	rc = iterator.getNextBatch(10, batch);
+	unsigned length = prepareRecord(id, record);
+	if (rc != success || batch.size() != 1 || batch.getRecordSize(0) != length
+			|| memcmp(batch.getRecord(0), record, length) != 0) {
+		cout << "The batch of record " << id << " differs." << endl;
+		return -1;
+	}
+	if (iterator.getNextBatch(10, batch) != RBFM_EOF || batch.size() != 0) {
+		cout << "The batch is not empty at the end of the scan." << endl;
+		return -1;
+	}
+	iterator.close();
+
+	rc = rbfm->closeFile(fileHandle);
+	assert(rc == success);
+	rc = rbfm->destroyFile(fileName);
+	assert(rc == success);
+	return 0;
+}
+
+int main() {
+	RecordBasedFileManager *rbfm = RecordBasedFileManager::instance();
+
+	remove(fileName.c_str());
+	remove(SpaceManager::getFreeSpaceFileName(fileName).c_str());
+
+	int rc = RBFTest_36(rbfm);
+	if (rc == 0) {
+		cout << "Test Case 36 Passed!" << endl << endl;
+		total += 4;
+	} else {
+		cout << "Test Case 36 Failed!" << endl << endl;
+	}
+
+	cout << "Score for Test Case 36: " << total << " / 4" << endl;
+
+	return 0;
+}
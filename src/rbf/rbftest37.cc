@@ -0,0 +1,275 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <limits>
+#include <cassert>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "pfm.h"
+#include "rbfm.h"
+#include "simd.h"
+
+using namespace std;
+
+const int success = 0;
+unsigned total = 0;
+
+const int numRecords = 2000;
+const string fileName = "test37";
+const CompOp ops[] = { EQ_OP, LT_OP, GT_OP, LE_OP, GE_OP, NE_OP, NO_OP };
+const unsigned numOps = 7;
+
+// Record: int id, varchar text, real score
+unsigned prepareRecord(int id, char *record) {
+	unsigned length = id % 30;
+	float score = (id % 97) * 0.25f;
+	memcpy(record, &id, sizeof(int));
+	memcpy(record + sizeof(int), &length, sizeof(int));
+	memset(record + 2 * sizeof(int), 'a' + id % 26, length);
+	memcpy(record + 2 * sizeof(int) + length, &score, sizeof(float));
+	return 2 * sizeof(int) + length + sizeof(float);
+}
+
+template <class T>
+bool compare(T a, CompOp op, T b) {
+	switch (op) {
+	case EQ_OP: return a == b;
+	case LT_OP: return a < b;
+	case GT_OP: return a > b;
+	case LE_OP: return a <= b;
+	case GE_OP: return a >= b;
+	case NE_OP: return a != b;
+	default: return true;
+	}
+}
+
+// Compare a column with each constant, for every operator and count, and check each bit
+template <class T>
+int checkColumn(const vector<T> &values, const vector<T> &constants) {
+	for (unsigned count = 0; count <= values.size(); count += count < 40 ? 1 : 37) {
+		vector<unsigned long long> selection((count + 63) / 64 + 1, ~0ULL);
+		for (unsigned o = 0; o < numOps; o++) {
+			for (size_t c = 0; c < constants.size(); c++) {
+				compareColumn(&values[0], count, ops[o], constants[c], &selection[0]);
+				for (unsigned i = 0; i < count; i++) {
+					bool bit = (selection[i / 64] >> (i % 64)) & 1;
+					if (bit != compare<T>(values[i], ops[o], constants[c])) {
+						cout << "Value " << i << " of " << count << " with operator " << ops[o]
+							 << " and constant " << constants[c] << " at level " << getSimdLevel() << endl;
+						return -1;
+					}
+				}
+				// Bits past the values are cleared, words past them are left alone
+				if (count % 64 != 0 && (selection[count / 64] >> (count % 64)) != 0) {
+					return -1;
+				}
+				if (selection[(count + 63) / 64] != ~0ULL) {
+					return -1;
+				}
+			}
+		}
+	}
+	return 0;
+}
+
+// Scan with a condition, by records and by batches, and check the records returned
+template <class T>
+int checkScan(RecordBasedFileManager *rbfm, FileHandle &fileHandle, const vector<Attribute> &recordDescriptor,
+		const vector<bool> &deleted, const string &attribute, CompOp op, T value) {
+	vector<string> names;
+	names.push_back("id");
+	names.push_back("score");
+
+	int expected = 0;
+	for (int i = 0; i < numRecords; i++) {
+		T field = attribute == "id" ? (T) i : (T) ((i % 97) * 0.25f);
+		expected += !deleted[i] && compare<T>(field, op, value);
+	}
+
+	RBFM_ScanIterator iterator, batchIterator;
+	if (rbfm->scan(fileHandle, recordDescriptor, attribute, op, &value, names, iterator) != success
+			|| rbfm->scan(fileHandle, recordDescriptor, attribute, op, &value, names, batchIterator) != success) {
+		return -1;
+	}
+	RID rid;
+	char returned[PAGE_SIZE];
+	int count = 0;
+	while (iterator.getNextRecord(rid, returned) != RBFM_EOF) {
+		int id;
+		memcpy(&id, returned, sizeof(int));
+		T field;
+		memcpy(&field, attribute == "id" ? returned : returned + sizeof(int), sizeof(T));
+		if (id < 0 || id >= numRecords || deleted[id] || !compare<T>(field, op, value)) {
+			return -1;
+		}
+		count++;
+	}
+	RecordBatch batch;
+	int batchCount = 0;
+	while (batchIterator.getNextBatch(333, batch) != RBFM_EOF) {
+		batchCount += batch.size();
+	}
+	iterator.close();
+	batchIterator.close();
+	if (count != expected || batchCount != expected) {
+		cout << "Operator " << op << " on " << attribute << " returned " << count << " and "
+			 << batchCount << " records, not " << expected << " at level " << getSimdLevel() << endl;
+		return -1;
+	}
+	return 0;
+}
+
+int RBFTest_37(RecordBasedFileManager *rbfm) {
+	// Functions Tested:
+	// 1. Compare int columns at every instruction set (partial vectors, extreme values)
+	// 2. Compare real columns at every instruction set (NaN, infinities, signed zeros)
+	// 3. Scan with int and real conditions at every instruction set, with deleted records
+	// 4. Scan pages of the plain record format with conditions
+	cout << "****In RBF Test Case 37****" << endl;
+
+	RC rc;
+	SpaceManager *sm = SpaceManager::instance();
+	SimdLevel supported = getSupportedSimdLevel();
+	cout << "Instruction set of the CPU: " << supported << endl;
+
+	vector<int> ints, intConstants;
+	vector<float> reals, realConstants;
+	for (int i = 0; i < 300; i++) {
+		ints.push_back((i * 7919) % 61 - 30);
+		reals.push_back(((i * 7919) % 61 - 30) * 0.5f);
+	}
+	ints[3] = numeric_limits<int>::min();
+	ints[17] = numeric_limits<int>::max();
+	reals[5] = numeric_limits<float>::quiet_NaN();
+	reals[11] = numeric_limits<float>::infinity();
+	reals[12] = -numeric_limits<float>::infinity();
+	reals[13] = -0.0f;
+	intConstants.push_back(0);
+	intConstants.push_back(-30);
+	intConstants.push_back(numeric_limits<int>::min());
+	intConstants.push_back(numeric_limits<int>::max());
+	realConstants.push_back(0.0f);
+	realConstants.push_back(2.5f);
+	realConstants.push_back(numeric_limits<float>::quiet_NaN());
+	realConstants.push_back(numeric_limits<float>::infinity());
+
+	for (int level = SIMD_SCALAR; level <= supported; level++) {
+		setSimdLevel((SimdLevel) level);
+		if (getSimdLevel() != level) {
+			cout << "The instruction set " << level << " has not been selected." << endl;
+			return -1;
+		}
+		if (checkColumn(ints, intConstants) != success) {
+			cout << "The int column comparison failed." << endl;
+			return -1;
+		}
+		if (checkColumn(reals, realConstants) != success) {
+			cout << "The real column comparison failed." << endl;
+			return -1;
+		}
+	}
+	setSimdLevel(SIMD_AVX2);
+	if (getSimdLevel() != supported) {
+		cout << "The instruction set is not capped to the CPU." << endl;
+		return -1;
+	}
+
+	rc = rbfm->createFile(fileName);
+	assert(rc == success);
+	FileHandle fileHandle;
+	rc = rbfm->openFile(fileName, fileHandle);
+	assert(rc == success);
+	unsigned pageSize = fileHandle.getPageSize();
+
+	vector<Attribute> recordDescriptor;
+	Attribute attr;
+	attr.name = "id";
+	attr.type = TypeInt;
+	attr.length = sizeof(int);
+	recordDescriptor.push_back(attr);
+	attr.name = "text";
+	attr.type = TypeVarChar;
+	attr.length = 30;
+	recordDescriptor.push_back(attr);
+	attr.name = "score";
+	attr.type = TypeReal;
+	attr.length = sizeof(float);
+	recordDescriptor.push_back(attr);
+
+	// A page of the plain format first, as older files have
+	char page[PAGE_SIZE];
+	char record[PAGE_SIZE];
+	const int plainRecords = 100;
+	sm->initCleanPage(page, pageSize);
+	unsigned freePtr = 0;
+	for (int i = 0; i < plainRecords; i++) {
+		unsigned length = prepareRecord(i, record);
+		sm->writeRecord(page, record, freePtr, length);
+		sm->setSlot(page, pageSize, i, freePtr, length);
+		sm->setSlotCount(page, pageSize, i + 1);
+		freePtr += length;
+	}
+	sm->setFreePtr(page, pageSize, freePtr);
+	rc = fileHandle.appendPage(page);
+	assert(rc == success);
+
+	vector<RID> rids(numRecords);
+	for (int i = plainRecords; i < numRecords; i++) {
+		prepareRecord(i, record);
+		rc = rbfm->insertRecord(fileHandle, recordDescriptor, record, rids[i]);
+		assert(rc == success);
+	}
+	// Deleted slots are never selected
+	vector<bool> deleted(numRecords, false);
+	for (int i = plainRecords; i < numRecords; i += 5) {
+		rc = rbfm->deleteRecord(fileHandle, recordDescriptor, rids[i]);
+		assert(rc == success);
+		deleted[i] = true;
+	}
+
+	int intValues[] = { 0, 50, 99, 1000, 1999, -1 };
+	float realValues[] = { 0.0f, 12.5f, 24.0f, 30.0f };
+	for (int level = SIMD_SCALAR; level <= supported; level++) {
+		setSimdLevel((SimdLevel) level);
+		for (unsigned o = 0; o < numOps - 1; o++) {
+			for (unsigned v = 0; v < 6; v++) {
+				if (checkScan<int>(rbfm, fileHandle, recordDescriptor, deleted, "id", ops[o], intValues[v]) != success) {
+					return -1;
+				}
+			}
+			for (unsigned v = 0; v < 4; v++) {
+				if (checkScan<float>(rbfm, fileHandle, recordDescriptor, deleted, "score", ops[o], realValues[v]) != success) {
+					return -1;
+				}
+			}
+		}
+	}
+	setSimdLevel(supported);
+
+	rc = rbfm->closeFile(fileHandle);
+	assert(rc == success);
+	rc = rbfm->destroyFile(fileName);
+	assert(rc == success);
+	return 0;
+}
+
+int main() {
+	RecordBasedFileManager *rbfm = RecordBasedFileManager::instance();
+
+	remove(fileName.c_str());
+	remove(SpaceManager::getFreeSpaceFileName(fileName).c_str());
+
+	int rc = RBFTest_37(rbfm);
+	if (rc == 0) {
+		cout << "Test Case 37 Passed!" << endl << endl;
+		total += 4;
+	} else {
+		cout << "Test Case 37 Failed!" << endl << endl;
+	}
+
+	cout << "Score for Test Case 37: " << total << " / 4" << endl;
+
+	return 0;
+}
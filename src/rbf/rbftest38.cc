@@ -0,0 +1,296 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <cassert>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "pfm.h"
+#include "rbfm.h"
+
+using namespace std;
+
+const int success = 0;
+unsigned total = 0;
+
+const int numRecords = 20000;
+const string fileName = "test38";
+
+// Record: int id, varchar text, real score
+unsigned prepareRecord(int id, char *record) {
+	unsigned length = id % 90;
+	float score = (id % 101) * 0.5f;
+	memcpy(record, &id, sizeof(int));
+	memcpy(record + sizeof(int), &length, sizeof(int));
+	memset(record + 2 * sizeof(int), 'a' + id % 26, length);
+	memcpy(record + 2 * sizeof(int) + length, &score, sizeof(float));
+	return 2 * sizeof(int) + length + sizeof(float);
+}
+
+struct ScanResult {
+	vector<RID> rids;
+	vector<string> records;
+};
+
+// Scan the whole file and keep every record returned, with its RID
+int runScan(RecordBasedFileManager *rbfm, FileHandle &fileHandle, const vector<Attribute> &recordDescriptor,
+		const string &attribute, CompOp op, const void *value, const vector<string> &names,
+		ScanMode mode, bool batches, ScanResult &result) {
+	RBFM_ScanIterator iterator;
+	if (rbfm->scan(fileHandle, recordDescriptor, attribute, op, value, names, iterator, mode) != success) {
+		return -1;
+	}
+	result.rids.clear();
+	result.records.clear();
+	if (batches) {
+		RecordBatch batch;
+		while (iterator.getNextBatch(100, batch) != RBFM_EOF) {
+			for (unsigned i = 0; i < batch.size(); i++) {
+				result.rids.push_back(batch.getRid(i));
+				result.records.push_back(string(batch.getRecord(i), batch.getRecordSize(i)));
+			}
+		}
+	} else {
+		RID rid;
+		char returned[PAGE_SIZE];
+		while (iterator.getNextRecord(rid, returned) != RBFM_EOF) {
+			// The records of this test are whole ones or their id
+			int length;
+			memcpy(&length, returned + sizeof(int), sizeof(int));
+			unsigned size = names.size() == 1 ? sizeof(int) : 3 * sizeof(int) + length;
+			result.rids.push_back(rid);
+			result.records.push_back(string(returned, size));
+		}
+	}
+	iterator.close();
+	return 0;
+}
+
+// Whether two scans returned the same records (in the same order if ordered)
+bool sameRecords(const ScanResult &a, const ScanResult &b, bool ordered) {
+	if (a.rids.size() != b.rids.size()) {
+		return false;
+	}
+	map<pair<unsigned, unsigned>, string> records;
+	for (size_t i = 0; i < a.rids.size(); i++) {
+		if (ordered && (a.rids[i] != b.rids[i] || a.records[i] != b.records[i])) {
+			return false;
+		}
+		records[make_pair(a.rids[i].pageNum, a.rids[i].slotNum)] = a.records[i];
+	}
+	for (size_t i = 0; i < b.rids.size(); i++) {
+		map<pair<unsigned, unsigned>, string>::iterator it =
+				records.find(make_pair(b.rids[i].pageNum, b.rids[i].slotNum));
+		if (it == records.end() || it->second != b.records[i]) {
+			return false;
+		}
+		records.erase(it);
+	}
+	return true;
+}
+
+int RBFTest_38(RecordBasedFileManager *rbfm) {
+	// Functions Tested:
+	// 1. Parallel ordered scan, record by record and by batches
+	// 2. Parallel unordered scan, with conditions and projections
+	// 3. Parallel scan of record views
+	// 4. Close a parallel scan early, and scan an empty file
+	cout << "****In RBF Test Case 38****" << endl;
+
+	RC rc;
+	rc = rbfm->createFile(fileName);
+	assert(rc == success);
+	FileHandle fileHandle;
+	rc = rbfm->openFile(fileName, fileHandle);
+	assert(rc == success);
+
+	vector<Attribute> recordDescriptor;
+	Attribute attr;
+	attr.name = "id";
+	attr.type = TypeInt;
+	attr.length = sizeof(int);
+	recordDescriptor.push_back(attr);
+	attr.name = "text";
+	attr.type = TypeVarChar;
+	attr.length = 100;
+	recordDescriptor.push_back(attr);
+	attr.name = "score";
+	attr.type = TypeReal;
+	attr.length = sizeof(float);
+	recordDescriptor.push_back(attr);
+
+	// An empty file: nothing to hand out
+	vector<string> allNames;
+	allNames.push_back("id");
+	allNames.push_back("text");
+	allNames.push_back("score");
+	ScanResult serial, parallel;
+	rc = runScan(rbfm, fileHandle, recordDescriptor, "", NO_OP, NULL, allNames, SCAN_PARALLEL_ORDERED, false, parallel);
+	if (rc != success || parallel.rids.size() != 0) {
+		cout << "The parallel scan of an empty file returned records." << endl;
+		return -1;
+	}
+
+	char record[PAGE_SIZE];
+	vector<RID> rids(numRecords);
+	for (int i = 0; i < numRecords; i++) {
+		prepareRecord(i, record);
+		rc = rbfm->insertRecord(fileHandle, recordDescriptor, record, rids[i]);
+		assert(rc == success);
+	}
+	for (int i = 0; i < numRecords; i += 3) {
+		rc = rbfm->deleteRecord(fileHandle, recordDescriptor, rids[i]);
+		assert(rc == success);
+	}
+	unsigned remaining = numRecords - (numRecords + 2) / 3;
+	cout << "Pages: " << fileHandle.getNumberOfPages() << ", scan threads: "
+		 << RecordBasedFileManager::getScanThreads() << endl;
+
+	// Whole records, in file order
+	rc = runScan(rbfm, fileHandle, recordDescriptor, "", NO_OP, NULL, allNames, SCAN_SERIAL, false, serial);
+	assert(rc == success && serial.rids.size() == remaining);
+	for (unsigned b = 0; b < 2; b++) {
+		rc = runScan(rbfm, fileHandle, recordDescriptor, "", NO_OP, NULL, allNames, SCAN_PARALLEL_ORDERED, b, parallel);
+		if (rc != success || !sameRecords(serial, parallel, true)) {
+			cout << "The parallel ordered scan differs from the serial one (" << parallel.rids.size()
+				 << " records, batches: " << b << ")." << endl;
+			return -1;
+		}
+		rc = runScan(rbfm, fileHandle, recordDescriptor, "", NO_OP, NULL, allNames, SCAN_PARALLEL_UNORDERED, b, parallel);
+		if (rc != success || !sameRecords(serial, parallel, false)) {
+			cout << "The parallel unordered scan differs from the serial one (" << parallel.rids.size()
+				 << " records, batches: " << b << ")." << endl;
+			return -1;
+		}
+	}
+
+	// Conditions and projections are evaluated by the scan threads
+	vector<string> names;
+	names.push_back("id");
+	float score = 20.0f;
+	int id = 12345;
+	rc = runScan(rbfm, fileHandle, recordDescriptor, "score", LT_OP, &score, names, SCAN_SERIAL, false, serial);
+	assert(rc == success && serial.rids.size() > 0);
+	rc = runScan(rbfm, fileHandle, recordDescriptor, "score", LT_OP, &score, names, SCAN_PARALLEL_UNORDERED, false, parallel);
+	if (rc != success || !sameRecords(serial, parallel, false)) {
+		cout << "The parallel scan with a condition differs from the serial one." << endl;
+		return -1;
+	}
+	rc = runScan(rbfm, fileHandle, recordDescriptor, "id", GE_OP, &id, names, SCAN_SERIAL, true, serial);
+	assert(rc == success && serial.rids.size() > 0);
+	rc = runScan(rbfm, fileHandle, recordDescriptor, "id", GE_OP, &id, names, SCAN_PARALLEL_ORDERED, true, parallel);
+	if (rc != success || !sameRecords(serial, parallel, true)) {
+		cout << "The parallel batches with a condition differ from the serial ones." << endl;
+		return -1;
+	}
+
+	// Views point into the pages the scan threads keep pinned
+	RBFM_ScanIterator iterator;
+	rc = rbfm->scan(fileHandle, recordDescriptor, "", NO_OP, NULL, allNames, iterator, SCAN_PARALLEL_ORDERED);
+	assert(rc == success);
+	RecordView view;
+	RID rid;
+	unsigned count = 0;
+	while (iterator.getNextRecordView(rid, view) != RBFM_EOF) {
+		int viewId;
+		if (view.getInt(0, viewId) != success || viewId % 3 == 0 || rids[viewId] != rid) {
+			cout << "The view of record " << rid.pageNum << ":" << rid.slotNum << " differs." << endl;
+			return -1;
+		}
+		unsigned length = prepareRecord(viewId, record);
+		if (view.length() != length || memcmp(view.data(), record, length) != 0) {
+			cout << "The view of record " << viewId << " differs." << endl;
+			return -1;
+		}
+		count++;
+	}
+	iterator.close();
+	if (count != remaining || view.isValid()) {
+		cout << "The parallel scan of views returned " << count << " records." << endl;
+		return -1;
+	}
+
+	// Records left in place can still be copied out
+	rc = rbfm->scan(fileHandle, recordDescriptor, "", NO_OP, NULL, allNames, iterator, SCAN_PARALLEL_ORDERED);
+	assert(rc == success);
+	count = 0;
+	while ((count % 2 == 0 ? iterator.getNextRecordView(rid, view) : iterator.getNextRecord(rid, record)) != RBFM_EOF) {
+		int id;
+		if (count % 2 == 0) {
+			rc = view.getInt(0, id);
+			assert(rc == success);
+		} else {
+			memcpy(&id, record, sizeof(int));
+		}
+		if (rids[id] != rid) {
+			cout << "Record " << rid.pageNum << ":" << rid.slotNum << " differs." << endl;
+			return -1;
+		}
+		count++;
+	}
+	view.release();
+	iterator.close();
+	if (count != remaining) {
+		cout << "The parallel scan of views and records returned " << count << " records." << endl;
+		return -1;
+	}
+
+	// Closing early stops the scan threads; the iterator can scan again
+	for (unsigned i = 0; i < 10; i++) {
+		rc = rbfm->scan(fileHandle, recordDescriptor, "", NO_OP, NULL, allNames, iterator, SCAN_PARALLEL_UNORDERED);
+		assert(rc == success);
+		for (unsigned j = 0; j < i * 50; j++) {
+			if (iterator.getNextRecord(rid, record) != success) {
+				cout << "The parallel scan ended early." << endl;
+				return -1;
+			}
+		}
+		iterator.close();
+		if (iterator.getNextRecord(rid, record) != RBFM_EOF) {
+			cout << "A closed parallel scan returned a record." << endl;
+			return -1;
+		}
+	}
+	rc = rbfm->scan(fileHandle, recordDescriptor, "", NO_OP, NULL, allNames, iterator, SCAN_PARALLEL_ORDERED);
+	assert(rc == success);
+	iterator.getNextRecord(rid, record);
+	rc = rbfm->scan(fileHandle, recordDescriptor, "", NO_OP, NULL, allNames, iterator, SCAN_SERIAL);
+	assert(rc == success);
+	count = 0;
+	while (iterator.getNextRecord(rid, record) != RBFM_EOF) {
+		count++;
+	}
+	iterator.close();
+	if (count != remaining) {
+		cout << "The serial scan after a parallel one returned " << count << " records." << endl;
+		return -1;
+	}
+
+	rc = rbfm->closeFile(fileHandle);
+	assert(rc == success);
+	rc = rbfm->destroyFile(fileName);
+	assert(rc == success);
+	return 0;
+}
+
+int main() {
+	RecordBasedFileManager *rbfm = RecordBasedFileManager::instance();
+	RecordBasedFileManager::setScanThreads(4);
+
+	remove(fileName.c_str());
+	remove(SpaceManager::getFreeSpaceFileName(fileName).c_str());
+
+	int rc = RBFTest_38(rbfm);
+	if (rc == 0) {
+		cout << "Test Case 38 Passed!" << endl << endl;
+		total += 4;
+	} else {
+		cout << "Test Case 38 Failed!" << endl << endl;
+	}
+
+	cout << "Score for Test Case 38: " << total << " / 4" << endl;
+
+	return 0;
+}
@@ -0,0 +1,183 @@
+#include "simd.h"
+#include <atomic>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86
+#endif
+
+// SSE2 is part of x86-64, so its kernels need no particular flags
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Instruction set in use, -1 until the first call
+static std::atomic<int> _simdLevel(-1);
+
+typedef unsigned long long SelectionWord;
+
+/**
+ * Scalar kernel, which also takes the values left over by the vector ones.
+ */
+template <class T>
+static void compareScalar(const T *values, unsigned first, unsigned count, CompOp compOp, T constant,
+        SelectionWord *selection) {
+    for (unsigned i = first; i < count; i++) {
+        bool match;
+        switch (compOp) {
+        case EQ_OP:
+            match = values[i] == constant;
+            break;
+        case LT_OP:
+            match = values[i] < constant;
+            break;
+        case GT_OP:
+            match = values[i] > constant;
+            break;
+        case LE_OP:
+            match = values[i] <= constant;
+            break;
+        case GE_OP:
+            match = values[i] >= constant;
+            break;
+        case NE_OP:
+            match = values[i] != constant;
+            break;
+        case NO_OP:
+        default:
+            match = true;
+            break;
+        }
+        if (match) {
+            selection[i / 64] |= (SelectionWord) 1 << (i % 64);
+        }
+    }
+}
+
+#ifdef __SSE2__
+/**
+ * SSE2 kernels, one per type and operator. Each returns the # of values it
+ * compared (a multiple of 4); the operator is a template argument, so that
+ * the comparison is chosen at compile time. Integer comparisons other than
+ * =, > and < are the complements of those; real ones are not, since NaN
+ * compares false (but for !=) as in C++.
+ */
+template <CompOp OP>
+struct IntsSSE {
+    static unsigned run(const int *values, unsigned count, int constant, SelectionWord *selection) {
+        const __m128i c = _mm_set1_epi32(constant);
+        unsigned i = 0;
+        for (; i + 4 <= count; i += 4) {
+            __m128i v = _mm_loadu_si128((const __m128i *) (values + i));
+            __m128i m;
+            unsigned invert = 0;
+            switch (OP) {
+            case EQ_OP: m = _mm_cmpeq_epi32(v, c); break;
+            case NE_OP: m = _mm_cmpeq_epi32(v, c); invert = 0xF; break;
+            case GT_OP: m = _mm_cmpgt_epi32(v, c); break;
+            case LE_OP: m = _mm_cmpgt_epi32(v, c); invert = 0xF; break;
+            case LT_OP: m = _mm_cmplt_epi32(v, c); break;
+            default:    m = _mm_cmplt_epi32(v, c); invert = 0xF; break;    // GE_OP
+            }
+            unsigned bits = _mm_movemask_ps(_mm_castsi128_ps(m)) ^ invert;
+            selection[i / 64] |= (SelectionWord) bits << (i % 64);
+        }
+        return i;
+    }
+};
+
+template <CompOp OP>
+struct RealsSSE {
+    static unsigned run(const float *values, unsigned count, float constant, SelectionWord *selection) {
+        const __m128 c = _mm_set1_ps(constant);
+        unsigned i = 0;
+        for (; i + 4 <= count; i += 4) {
+            __m128 v = _mm_loadu_ps(values + i);
+            __m128 m;
+            switch (OP) {
+            case EQ_OP: m = _mm_cmpeq_ps(v, c); break;
+            case NE_OP: m = _mm_cmpneq_ps(v, c); break;
+            case GT_OP: m = _mm_cmpgt_ps(v, c); break;
+            case LE_OP: m = _mm_cmple_ps(v, c); break;
+            case LT_OP: m = _mm_cmplt_ps(v, c); break;
+            default:    m = _mm_cmpge_ps(v, c); break;      // GE_OP
+            }
+            unsigned bits = _mm_movemask_ps(m);
+            selection[i / 64] |= (SelectionWord) bits << (i % 64);
+        }
+        return i;
+    }
+};
+#endif
+
+void compareColumn(const int *values, unsigned count, CompOp compOp, int constant,
+        SelectionWord *selection) {
+    memset(selection, 0, (count + 63) / 64 * sizeof(SelectionWord));
+    unsigned done = 0;
+    switch (getSimdLevel()) {
+    case SIMD_AVX2:
+        done = compareColumnAVX2(values, count, compOp, constant, selection);
+        break;
+#ifdef __SSE2__
+    case SIMD_SSE:
+        done = compareVector<IntsSSE>(values, count, compOp, constant, selection);
+        break;
+#endif
+    default:
+        break;
+    }
+    compareScalar(values, done, count, compOp, constant, selection);
+}
+
+void compareColumn(const float *values, unsigned count, CompOp compOp, float constant,
+        SelectionWord *selection) {
+    memset(selection, 0, (count + 63) / 64 * sizeof(SelectionWord));
+    unsigned done = 0;
+    switch (getSimdLevel()) {
+    case SIMD_AVX2:
+        done = compareColumnAVX2(values, count, compOp, constant, selection);
+        break;
+#ifdef __SSE2__
+    case SIMD_SSE:
+        done = compareVector<RealsSSE>(values, count, compOp, constant, selection);
+        break;
+#endif
+    default:
+        break;
+    }
+    compareScalar(values, done, count, compOp, constant, selection);
+}
+
+SimdLevel getSimdLevel() {
+    int level = _simdLevel.load(std::memory_order_relaxed);
+    if (level < 0) {
+        level = getSupportedSimdLevel();
+        _simdLevel.store(level, std::memory_order_relaxed);
+    }
+    return (SimdLevel) level;
+}
+
+SimdLevel getSupportedSimdLevel() {
+    static SimdLevel supported = [] {
+#ifdef SIMD_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            return SIMD_AVX2;
+        }
+#ifdef __SSE2__
+        if (__builtin_cpu_supports("sse2")) {
+            return SIMD_SSE;
+        }
+#endif
+#endif
+        return SIMD_SCALAR;
+    }();
+    return supported;
+}
+
+void setSimdLevel(SimdLevel level) {
+    if (level > getSupportedSimdLevel()) {
+        level = getSupportedSimdLevel();
+    }
+    _simdLevel.store(level, std::memory_order_relaxed);
+}
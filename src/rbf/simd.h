@@ -0,0 +1,54 @@
+#ifndef _simd_h_
+#define _simd_h_
+
+#include "rbfm.h"
+
+// Instruction sets of the comparison kernels, from the narrowest
+typedef enum {
+    SIMD_SCALAR = 0,    // one value at a time
+    SIMD_SSE,           // 4 values at a time (SSE2)
+    SIMD_AVX2,          // 8 values at a time
+} SimdLevel;
+
+// Comparison kernels of scan conditions on int and real attributes: count
+// values are compared with a constant at once, and bit i of selection (an
+// array of (count + 63) / 64 words) is set if value i meets the condition,
+// cleared otherwise. NO_OP selects every value.
+//
+// The widest instruction set the CPU supports is detected at the first
+// call; setSimdLevel() picks a narrower one (used by tests).
+void compareColumn(const int *values, unsigned count, CompOp compOp, int constant,
+                   unsigned long long *selection);
+void compareColumn(const float *values, unsigned count, CompOp compOp, float constant,
+                   unsigned long long *selection);
+
+// AVX2 kernels (simd_avx2.cc, the only file built for AVX2), called only
+// when the CPU supports it. They return the # of values compared, a
+// multiple of 8; the scalar kernel takes the values left over.
+unsigned compareColumnAVX2(const int *values, unsigned count, CompOp compOp, int constant,
+                           unsigned long long *selection);
+unsigned compareColumnAVX2(const float *values, unsigned count, CompOp compOp, float constant,
+                           unsigned long long *selection);
+
+// Run the vector kernel of an operator (NO_OP is left to the scalar kernel)
+template <template <CompOp> class Kernel, class T>
+inline unsigned compareVector(const T *values, unsigned count, CompOp compOp, T constant,
+                              unsigned long long *selection) {
+    switch (compOp) {
+    case EQ_OP: return Kernel<EQ_OP>::run(values, count, constant, selection);
+    case LT_OP: return Kernel<LT_OP>::run(values, count, constant, selection);
+    case GT_OP: return Kernel<GT_OP>::run(values, count, constant, selection);
+    case LE_OP: return Kernel<LE_OP>::run(values, count, constant, selection);
+    case GE_OP: return Kernel<GE_OP>::run(values, count, constant, selection);
+    case NE_OP: return Kernel<NE_OP>::run(values, count, constant, selection);
+    case NO_OP:
+    default:
+        return 0;
+    }
+}
+
+SimdLevel getSimdLevel();                   // Instruction set in use
+SimdLevel getSupportedSimdLevel();          // Widest instruction set of the CPU
+void setSimdLevel(SimdLevel level);         // Use a narrower instruction set (capped to the supported one)
+
+#endif
@@ -0,0 +1,1111 @@
+#include "wal.h"
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Header of every log record, followed by its payload
+struct LogRecordHeader {
+    unsigned length;                // of the whole record
+    unsigned checksum;              // of the payload, to detect a torn end of the log
+    unsigned type;                  // LogRecordType
+    unsigned reserved;
+    unsigned long long txnId;       // 0 for records of no transaction
+};
+
+// Equal bytes between two changed ranges up to which they are logged as one
+static const unsigned DIFF_GAP = 16;
+
+LogManager* LogManager::_log_manager = 0;
+
+thread_local unsigned long long LogManager::_currentTxn = 0;
+
+thread_local unsigned LogManager::_txnDepth = 0;
+
+// FNV-1a
+static unsigned checksum(const char *data, size_t size)
+{
+    unsigned hash = 2166136261u;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ (unsigned char) data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static void putBytes(std::string &out, const void *data, size_t size)
+{
+    out.append((const char *) data, size);
+}
+
+static bool getBytes(const std::string &in, size_t &pos, void *data, size_t size)
+{
+    if (pos + size > in.size()) {
+        return false;
+    }
+    memcpy(data, in.data() + pos, size);
+    pos += size;
+    return true;
+}
+
+// Encode the payload of a LOG_UPDATE / LOG_CREATE record
+static std::string encodeUpdate(const PageUpdate &update)
+{
+    std::string out;
+    unsigned short nameLen = update.fileName.size();
+    putBytes(out, &nameLen, sizeof(nameLen));
+    out += update.fileName;
+    putBytes(out, &update.pageNum, sizeof(PageNum));
+    unsigned short count = update.diffs.size();
+    putBytes(out, &count, sizeof(count));
+    for (size_t i = 0; i < update.diffs.size(); i++) {
+        const PageDiff &diff = update.diffs[i];
+        unsigned length = diff.after.size();
+        putBytes(out, &diff.offset, sizeof(diff.offset));
+        putBytes(out, &length, sizeof(length));
+        out += diff.before;
+        out += diff.after;
+    }
+    return out;
+}
+
+static bool decodeUpdate(const std::string &in, PageUpdate &update)
+{
+    size_t pos = 0;
+    unsigned short nameLen, count;
+    if (!getBytes(in, pos, &nameLen, sizeof(nameLen)) || pos + nameLen > in.size()) {
+        return false;
+    }
+    update.fileName.assign(in, pos, nameLen);
+    pos += nameLen;
+    if (!getBytes(in, pos, &update.pageNum, sizeof(PageNum))
+            || !getBytes(in, pos, &count, sizeof(count))) {
+        return false;
+    }
+    update.diffs.resize(count);
+    for (unsigned i = 0; i < count; i++) {
+        PageDiff &diff = update.diffs[i];
+        unsigned length;
+        if (!getBytes(in, pos, &diff.offset, sizeof(diff.offset))
+                || !getBytes(in, pos, &length, sizeof(length))
+                || pos + 2 * (size_t) length > in.size() || diff.offset + (size_t) length > MAX_PAGE_SIZE) {
+            return false;
+        }
+        diff.before.assign(in, pos, length);
+        diff.after.assign(in, pos + length, length);
+        pos += 2 * length;
+    }
+    return true;
+}
+
+// Collect the byte ranges in which two versions of a page differ
+static void diffPage(const char *before, const char *after, unsigned pageSize, std::vector<PageDiff> &diffs)
+{
+    unsigned i = 0;
+    while (i < pageSize) {
+        if (before[i] == after[i]) {
+            i++;
+            continue;
+        }
+        unsigned end = i + 1;
+        for (unsigned j = end; j < pageSize && j < end + DIFF_GAP; j++) {
+            if (before[j] != after[j]) {
+                end = j + 1;
+            }
+        }
+
+        PageDiff diff;
+        diff.offset = i;
+        diff.before.assign(before + i, end - i);
+        diff.after.assign(after + i, end - i);
+        diffs.push_back(diff);
+        i = end;
+    }
+}
+
+// Get the record at pos of a log read into memory, if it is complete
+static bool readRecord(const std::string &log, size_t pos, LogRecordHeader &header, std::string &payload)
+{
+    if (pos + sizeof(LogRecordHeader) > log.size()) {
+        return false;
+    }
+    memcpy(&header, log.data() + pos, sizeof(LogRecordHeader));
+    if (header.length < sizeof(LogRecordHeader) || pos + header.length > log.size()) {
+        return false;
+    }
+    payload.assign(log, pos + sizeof(LogRecordHeader), header.length - sizeof(LogRecordHeader));
+    return checksum(payload.data(), payload.size()) == header.checksum;
+}
+
+// Apply the before (undo) or after (redo) images of a page change. Files
+// are opened on first use; changes of files which do not exist anymore
+// are skipped.
+static RC applyUpdate(std::unordered_map<std::string, FileHandle> &handles, std::set<std::string> &missing,
+                      const PageUpdate &update, bool redo)
+{
+    PagedFileManager *pfm = PagedFileManager::instance();
+    if (missing.count(update.fileName)) {
+        return SUCCESSFUL;
+    }
+    std::unordered_map<std::string, FileHandle>::iterator it = handles.find(update.fileName);
+    if (it == handles.end()) {
+        FileHandle handle;
+        if (pfm->openFile(update.fileName.c_str(), handle) != SUCCESSFUL) {
+            missing.insert(update.fileName);
+            return SUCCESSFUL;
+        }
+        it = handles.insert(std::make_pair(update.fileName, handle)).first;
+    }
+
+    RC err;
+    FileHandle &handle = it->second;
+    std::vector<char> buffer(handle.getPageSize(), 0);
+    char *page = &buffer[0];
+    if (update.pageNum >= handle.getNumberOfPages()) {
+        if (!redo) {
+            // The page never reached the file
+            return SUCCESSFUL;
+        }
+        while (handle.getNumberOfPages() <= update.pageNum) {
+            if ((err = handle.appendPage(page)) != SUCCESSFUL) {
+                __trace();
+                return err;
+            }
+        }
+    }
+
+    if ((err = handle.readPage(update.pageNum, page)) != SUCCESSFUL) {
+        // Appended pages are written back lazily, after the file header:
+        // a page counted by the header may never have reached the disk
+        if (!redo) {
+            __trace();
+            return err;
+        }
+        memset(page, 0, buffer.size());
+    }
+    for (size_t i = 0; i < update.diffs.size(); i++) {
+        const PageDiff &diff = update.diffs[i];
+        const std::string &image = redo ? diff.after : diff.before;
+        if (diff.offset + image.size() > buffer.size()) {
+            __trace();
+            return ERR_LOG;
+        }
+        memcpy(page + diff.offset, image.data(), image.size());
+    }
+    if ((err = handle.writePage(update.pageNum, page)) != SUCCESSFUL) {
+        __trace();
+        return err;
+    }
+    return SUCCESSFUL;
+}
+
+static RC closeHandles(std::unordered_map<std::string, FileHandle> &handles)
+{
+    RC err = SUCCESSFUL;
+    std::unordered_map<std::string, FileHandle>::iterator it;
+    for (it = handles.begin(); it != handles.end(); it++) {
+        RC rc = PagedFileManager::instance()->closeFile(it->second);
+        if (rc != SUCCESSFUL) {
+            __trace();
+            err = rc;
+        }
+    }
+    handles.clear();
+    return err;
+}
+
+// Pages changed by the process have been written back when it ends, so
+// the log can be emptied.
+static void closeLogAtExit()
+{
+    LogManager::instance()->close();
+}
+
+LogManager* LogManager::instance()
+{
+    static std::mutex creation;
+    std::lock_guard<std::mutex> guard(creation);
+    if (!_log_manager) {
+        _log_manager = new LogManager();
+    }
+    return _log_manager;
+}
+
+LogManager::LogManager()
+    : _fd(-1), _open(false), _baseLSN(0), _nextLSN(0), _flushedLSN(0), _checkpointLSN(0),
+      _flushing(false), _nextTxnId(0), _commitCounter(0), _syncCounter(0)
+{
+}
+
+LogManager::~LogManager()
+{
+}
+
+bool LogManager::isOpen()
+{
+    return _open;
+}
+
+/**
+ * Open the log: recover the files from it, then log the changes of
+ * transactions in it. Without a log, transactions are not logged.
+ *
+ * @param logName
+ *          the name of the log file (created if it does not exist)
+ * @return status
+ */
+RC LogManager::open(const char *logName)
+{
+    if (_open) {
+        return SUCCESSFUL;
+    }
+
+    int fd = ::open(logName, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        __trace();
+        return ERR_LOG;
+    }
+
+    // The log is truncated at checkpoints, so it is small enough to read at once
+    std::string log;
+    char buffer[PAGE_SIZE];
+    ssize_t n;
+    while ((n = pread(fd, buffer, sizeof(buffer), log.size())) > 0 || (n < 0 && errno == EINTR)) {
+        if (n > 0) {
+            log.append(buffer, n);
+        }
+    }
+    if (n < 0) {
+        __trace();
+        ::close(fd);
+        return ERR_LOG;
+    }
+
+    _baseLSN = 0;
+    if (!log.empty()) {
+        unsigned magic, version;
+        size_t pos = 0;
+        if (!getBytes(log, pos, &magic, sizeof(magic)) || !getBytes(log, pos, &version, sizeof(version))
+                || !getBytes(log, pos, &_baseLSN, sizeof(LSN))
+                || magic != LOG_FILE_MAGIC || version != LOG_FILE_VERSION) {
+            __trace();
+            ::close(fd);
+            return ERR_LOG;
+        }
+    }
+
+    _fd = fd;
+    _logName = logName;
+    RC err;
+    if ((err = recover(log)) != SUCCESSFUL) {
+        __trace();
+        ::close(_fd);
+        _fd = -1;
+        return err;
+    }
+
+    _open = true;
+    atexit(closeLogAtExit);
+    return SUCCESSFUL;
+}
+
+/**
+ * Redo the log from its last checkpoint, undo the transactions which did
+ * not finish, finish the file removals and creations undone, write all
+ * pages back and empty the log.
+ *
+ * @param log
+ *          content of the log file (header included, if any)
+ * @return status
+ */
+RC LogManager::recover(const std::string &log)
+{
+    struct Record {
+        LSN lsn;
+        LogRecordHeader header;
+        std::string payload;
+    };
+
+    // Analysis: find the complete records, the unfinished transactions,
+    // the last creation of each file and where redo starts
+    std::vector<Record> records;
+    std::unordered_map<unsigned long long, bool> finished;
+    std::set<unsigned long long> committed;
+    std::unordered_map<std::string, LSN> created;
+    LSN redoLSN = 0;
+    size_t pos = log.empty() ? 0 : LOG_HEADER_SIZE;
+    Record record;
+    while (readRecord(log, pos, record.header, record.payload)) {
+        pos += record.header.length;
+        record.lsn = _baseLSN + (pos - LOG_HEADER_SIZE);
+        switch (record.header.type) {
+        case LOG_BEGIN:
+            finished[record.header.txnId] = false;
+            break;
+        case LOG_COMMIT:
+            committed.insert(record.header.txnId);
+            finished[record.header.txnId] = true;
+            break;
+        case LOG_ABORT:
+            finished[record.header.txnId] = true;
+            break;
+        case LOG_CREATE: {
+            PageUpdate update;
+            if (decodeUpdate(record.payload, update)) {
+                created[update.fileName] = record.lsn;
+            }
+            break;
+        }
+        case LOG_CHECKPOINT:
+            memcpy(&redoLSN, record.payload.data(), std::min(record.payload.size(), sizeof(LSN)));
+            break;
+        }
+        records.push_back(record);
+    }
+    LSN endLSN = records.empty() ? _baseLSN : records.back().lsn;
+
+    // Redo (repeating history), then undo the unfinished transactions
+    RC err;
+    std::unordered_map<std::string, FileHandle> handles;
+    std::set<std::string> missing;
+    for (int pass = 0; pass < 2; pass++) {
+        bool redo = pass == 0;
+        for (size_t i = 0; i < records.size(); i++) {
+            const Record &r = redo ? records[i] : records[records.size() - 1 - i];
+            if (r.header.type != LOG_UPDATE || (redo && r.lsn < redoLSN)) {
+                continue;
+            }
+            if (!redo && (!finished.count(r.header.txnId) || finished[r.header.txnId])) {
+                continue;
+            }
+            PageUpdate update;
+            if (!decodeUpdate(r.payload, update)) {
+                __trace();
+                closeHandles(handles);
+                return ERR_LOG;
+            }
+            if (created.count(update.fileName) && r.lsn < created[update.fileName]) {
+                continue;
+            }
+            if ((err = applyUpdate(handles, missing, update, redo)) != SUCCESSFUL) {
+                __trace();
+                closeHandles(handles);
+                return err;
+            }
+        }
+    }
+
+    if ((err = closeHandles(handles)) != SUCCESSFUL) {
+        __trace();
+        return err;
+    }
+
+    // Files removed by committed transactions may still be there, and the
+    // last creation of a file by one which did not commit is undone
+    for (size_t i = 0; i < records.size(); i++) {
+        const Record &r = records[i];
+        if (r.header.type != LOG_REMOVE && r.header.type != LOG_CREATE) {
+            continue;
+        }
+        PageUpdate update;
+        if (!decodeUpdate(r.payload, update)) {
+            __trace();
+            return ERR_LOG;
+        }
+        bool remove;
+        if (r.header.type == LOG_REMOVE) {
+            remove = committed.count(r.header.txnId) && created[update.fileName] < r.lsn;
+        } else {
+            remove = !committed.count(r.header.txnId) && created[update.fileName] == r.lsn;
+        }
+        if (remove) {
+            PagedFileManager::instance()->destroyFile(update.fileName.c_str());
+        }
+    }
+
+    // The recovered pages must be durable before the log is emptied
+    if ((err = PagedFileManager::instance()->flushAllPages()) != SUCCESSFUL) {
+        __trace();
+        return err;
+    }
+    if (DescriptorCache::instance()->sync() != SUCCESSFUL || ftruncate(_fd, LOG_HEADER_SIZE)
+            || writeLogHeader(_fd, endLSN) != SUCCESSFUL || fdatasync(_fd)) {
+        __trace();
+        return ERR_LOG;
+    }
+
+    _baseLSN = _nextLSN = _flushedLSN = _checkpointLSN = endLSN;
+    return SUCCESSFUL;
+}
+
+/**
+ * Write back all pages and empty the log. The log is kept if
+ * transactions are still running, or if pinned pages could not be
+ * written back.
+ *
+ * @return status
+ */
+RC LogManager::close()
+{
+    if (!_open) {
+        return SUCCESSFUL;
+    }
+
+    RC err;
+    if ((err = runCheckpointHooks()) != SUCCESSFUL
+            || (err = PagedFileManager::instance()->flushAllPages()) != SUCCESSFUL
+            || (err = flush(_nextLSN)) != SUCCESSFUL) {
+        __trace();
+        return err;
+    }
+
+    // Taken before _mutex: the pool may flush the log with its own mutex held
+    LSN recLSN = PagedFileManager::instance()->getBufferManager()->getMinRecLSN();
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (_flushing) {
+        _flushed.wait(lock);
+    }
+    if (_transactions.empty() && !recLSN) {
+        if (DescriptorCache::instance()->sync() != SUCCESSFUL || ftruncate(_fd, LOG_HEADER_SIZE)
+                || writeLogHeader(_fd, _nextLSN) != SUCCESSFUL || fdatasync(_fd)) {
+            __trace();
+            return ERR_LOG;
+        }
+        _baseLSN = _flushedLSN = _checkpointLSN = _nextLSN;
+    }
+    _open = false;
+    ::close(_fd);
+    _fd = -1;
+    return SUCCESSFUL;
+}
+
+/**
+ * Start a transaction for the calling thread. Nested calls join the
+ * running transaction, which ends with the outermost commit.
+ *
+ * @return status
+ */
+RC LogManager::beginTransaction()
+{
+    if (_txnDepth++ > 0 && _currentTxn) {
+        return SUCCESSFUL;
+    }
+    if (!_open) {
+        return SUCCESSFUL;
+    }
+
+    std::lock_guard<std::mutex> guard(_mutex);
+    _currentTxn = ++_nextTxnId;
+    _transactions[_currentTxn].firstLSN = 0;
+    _transactions[_currentTxn].rollbackOnly = false;
+    return SUCCESSFUL;
+}
+
+/**
+ * Commit the transaction of the calling thread, and wait until its
+ * records are durable. Transactions which changed nothing cost nothing.
+ * A transaction one of whose nested operations aborted is rolled back
+ * instead.
+ *
+ * @param undoneFiles
+ *          (return, if not NULL) the files restored by a rollback
+ * @return status (ERR_ABORTED if the transaction was rolled back)
+ */
+RC LogManager::commitTransaction(std::set<std::string> *undoneFiles)
+{
+    if (_txnDepth == 0 || --_txnDepth > 0 || !_currentTxn) {
+        return SUCCESSFUL;
+    }
+    bool rollbackOnly;
+    {
+        std::lock_guard<std::mutex> guard(_mutex);
+        rollbackOnly = _transactions[_currentTxn].rollbackOnly;
+    }
+    if (rollbackOnly) {
+        RC err = rollback(undoneFiles);
+        return err == SUCCESSFUL ? ERR_ABORTED : err;
+    }
+    unsigned long long txnId = _currentTxn;
+    _currentTxn = 0;
+
+    LSN lsn = 0;
+    bool wantCheckpoint = false;
+    std::vector<std::string> removedFiles;
+    {
+        std::lock_guard<std::mutex> guard(_mutex);
+        std::unordered_map<unsigned long long, Transaction>::iterator it = _transactions.find(txnId);
+        bool changed = it->second.firstLSN != 0;
+        removedFiles.swap(it->second.removedFiles);
+        _transactions.erase(it);
+        if (changed) {
+            append(LOG_COMMIT, txnId, std::string(), lsn);
+            _commitCounter++;
+
+            wantCheckpoint = _nextLSN - _checkpointLSN > CHECKPOINT_INTERVAL;
+            if (wantCheckpoint) {
+                _checkpointLSN = _nextLSN;
+            }
+        }
+    }
+    // Changes of the next owners of the pages are logged after the commit,
+    // which is durable before them
+    unlockPages(txnId);
+    if (!lsn) {
+        return SUCCESSFUL;
+    }
+
+    RC err;
+    if ((err = flush(lsn)) != SUCCESSFUL) {
+        __trace();
+        return err;
+    }
+    // The commit is durable: the files can go (recovery removes them again
+    // if this does not finish)
+    for (size_t i = 0; i < removedFiles.size(); i++) {
+        if (PagedFileManager::instance()->destroyFile(removedFiles[i].c_str()) != SUCCESSFUL) {
+            __trace();
+        }
+    }
+    if (wantCheckpoint && (err = checkpoint()) != SUCCESSFUL) {
+        __trace();
+        return err;
+    }
+    return SUCCESSFUL;
+}
+
+/**
+ * Roll back the transaction of the calling thread (including the
+ * transactions it joined). A nested abort only marks the transaction:
+ * the operations around it go on, and the outermost commit or abort
+ * rolls it back.
+ *
+ * @param undoneFiles
+ *          (return, if not NULL) the files restored by the rollback
+ * @return status
+ */
+RC LogManager::abortTransaction(std::set<std::string> *undoneFiles)
+{
+    if (_txnDepth == 0) {
+        return SUCCESSFUL;
+    }
+    if (--_txnDepth > 0) {
+        if (_currentTxn) {
+            std::lock_guard<std::mutex> guard(_mutex);
+            _transactions[_currentTxn].rollbackOnly = true;
+        }
+        return SUCCESSFUL;
+    }
+    if (!_currentTxn) {
+        return SUCCESSFUL;
+    }
+    return rollback(undoneFiles);
+}
+
+/**
+ * Undo the changes of the transaction of the calling thread and end it.
+ * The changes are undone through the buffer pool and logged as well, so
+ * that recovery repeats them. The files the transaction created are
+ * removed once it has ended (and by recovery if this does not finish);
+ * the files it destroyed are kept.
+ *
+ * @param undoneFiles
+ *          (return, if not NULL) the files whose pages were restored, and
+ *          the files removed
+ * @return status
+ */
+RC LogManager::rollback(std::set<std::string> *undoneFiles)
+{
+    std::vector<PageUpdate> updates;
+    std::vector<std::string> createdFiles;
+    {
+        std::lock_guard<std::mutex> guard(_mutex);
+        updates = _transactions[_currentTxn].updates;
+        createdFiles = _transactions[_currentTxn].createdFiles;
+    }
+
+    // Pages of the files being removed are not worth restoring
+    RC err = SUCCESSFUL;
+    std::unordered_map<std::string, FileHandle> handles;
+    std::set<std::string> missing(createdFiles.begin(), createdFiles.end());
+    for (size_t i = updates.size(); i > 0 && err == SUCCESSFUL; i--) {
+        err = applyUpdate(handles, missing, updates[i - 1], false);
+    }
+    std::unordered_map<std::string, FileHandle>::iterator handle;
+    for (handle = handles.begin(); handle != handles.end() && undoneFiles; handle++) {
+        undoneFiles->insert(handle->first);
+    }
+    RC rc = closeHandles(handles);
+    if (err == SUCCESSFUL) {
+        err = rc;
+    }
+
+    unsigned long long txnId = _currentTxn;
+    {
+        std::lock_guard<std::mutex> guard(_mutex);
+        std::unordered_map<unsigned long long, Transaction>::iterator it = _transactions.find(txnId);
+        if (err == SUCCESSFUL && it->second.firstLSN) {
+            LSN lsn;
+            append(LOG_ABORT, txnId, std::string(), lsn);
+        }
+        // If the rollback failed, recovery finishes it
+        _transactions.erase(it);
+        _currentTxn = 0;
+    }
+    unlockPages(txnId);
+
+    for (size_t i = createdFiles.size(); i > 0 && err == SUCCESSFUL; i--) {
+        if (PagedFileManager::instance()->destroyFile(createdFiles[i - 1].c_str()) != SUCCESSFUL) {
+            __trace();
+        }
+        if (undoneFiles) {
+            undoneFiles->insert(createdFiles[i - 1]);
+        }
+    }
+    return err;
+}
+
+/**
+ * Whether the calling thread runs a transaction, i.e. whether its page
+ * changes are logged.
+ */
+bool LogManager::inTransaction()
+{
+    return _currentTxn != 0;
+}
+
+/**
+ * Lock a page for the transaction of the calling thread until it ends.
+ * The undo images of a transaction restore whole byte ranges of its
+ * pages, so no other transaction may change them meanwhile. Without a
+ * transaction nothing is locked.
+ *
+ * @param fileName
+ *          the file of the page
+ * @param pageNum
+ *          the page number
+ * @param wait
+ *          whether to wait until another transaction releases the page
+ *          (never set while holding a page latch)
+ * @return status (ERR_LOCKED if the page belongs to another transaction
+ *         and wait is not set, ERR_DEADLOCK if the wait would never end)
+ */
+RC LogManager::lockPage(const std::string &fileName, PageNum pageNum, bool wait)
+{
+    unsigned long long txnId = _currentTxn;
+    if (!txnId) {
+        return SUCCESSFUL;
+    }
+
+    PageKey key(fileName, pageNum);
+    std::unique_lock<std::mutex> lock(_lockMutex);
+    while (true) {
+        std::map<PageKey, unsigned long long>::iterator it = _pageOwners.find(key);
+        if (it == _pageOwners.end()) {
+            _pageOwners[key] = txnId;
+            _ownedPages[txnId].push_back(key);
+            return SUCCESSFUL;
+        }
+        if (it->second == txnId) {
+            return SUCCESSFUL;
+        }
+        if (!wait) {
+            return ERR_LOCKED;
+        }
+
+        // Owners keep their pages until they end, so a chain of waits
+        // leading back to this transaction is a deadlock
+        unsigned long long owner = it->second;
+        while (owner != txnId && _lockWaits.count(owner)) {
+            owner = _lockWaits[owner];
+        }
+        if (owner == txnId) {
+            return ERR_DEADLOCK;
+        }
+        _lockWaits[txnId] = it->second;
+        _unlocked.wait(lock);
+        _lockWaits.erase(txnId);
+    }
+}
+
+/**
+ * Release the pages locked by a transaction which has ended.
+ */
+void LogManager::unlockPages(unsigned long long txnId)
+{
+    std::lock_guard<std::mutex> guard(_lockMutex);
+    std::unordered_map<unsigned long long, std::vector<PageKey> >::iterator it = _ownedPages.find(txnId);
+    if (it == _ownedPages.end()) {
+        return;
+    }
+    for (size_t i = 0; i < it->second.size(); i++) {
+        _pageOwners.erase(it->second[i]);
+    }
+    _ownedPages.erase(it);
+    _unlocked.notify_all();
+}
+
+/**
+ * Log a page change of the current transaction (its first change also
+ * logs the start of the transaction).
+ *
+ * @param fileName
+ *          the file of the page
+ * @param pageNum
+ *          the page number
+ * @param pageSize
+ *          the page size of the file
+ * @param before
+ *          the page before the change
+ * @param after
+ *          the page after the change
+ * @param lsn
+ *          (return) the end of the record
+ * @return status
+ */
+RC LogManager::logUpdate(const std::string &fileName, PageNum pageNum, unsigned pageSize,
+                         const void *before, const void *after, LSN &lsn)
+{
+    if (!_currentTxn) {
+        lsn = 0;
+        return SUCCESSFUL;
+    }
+
+    // Logged even if nothing changed, so that recovery extends the file
+    PageUpdate update;
+    update.fileName = fileName;
+    update.pageNum = pageNum;
+    diffPage((const char *) before, (const char *) after, pageSize, update.diffs);
+    std::string payload = encodeUpdate(update);
+
+    std::lock_guard<std::mutex> guard(_mutex);
+    Transaction &txn = _transactions[_currentTxn];
+    if (!txn.firstLSN) {
+        append(LOG_BEGIN, _currentTxn, std::string(), txn.firstLSN);
+    }
+    append(LOG_UPDATE, _currentTxn, payload, lsn);
+    txn.updates.push_back(update);
+    return SUCCESSFUL;
+}
+
+/**
+ * Log the creation of a file by the current transaction, so that
+ * recovery does not apply changes of an older file of the same name,
+ * and that the file is removed if the transaction does not commit.
+ *
+ * @param fileName
+ *          the file name
+ * @return status
+ */
+RC LogManager::logCreate(const std::string &fileName)
+{
+    if (!_currentTxn) {
+        return SUCCESSFUL;
+    }
+
+    PageUpdate update;
+    update.fileName = fileName;
+    update.pageNum = 0;
+    LSN lsn;
+    {
+        std::lock_guard<std::mutex> guard(_mutex);
+        Transaction &txn = _transactions[_currentTxn];
+        if (!txn.firstLSN) {
+            append(LOG_BEGIN, _currentTxn, std::string(), txn.firstLSN);
+        }
+        append(LOG_CREATE, _currentTxn, encodeUpdate(update), lsn);
+        txn.createdFiles.push_back(fileName);
+    }
+    // The file exists on the disk already
+    return flush(lsn);
+}
+
+/**
+ * Have the current transaction remove a file once it commits. The file
+ * stays on the disk until then, so that a rollback keeps it.
+ *
+ * @param fileName
+ *          the file name
+ * @return status
+ */
+RC LogManager::logRemove(const std::string &fileName)
+{
+    if (!_currentTxn) {
+        return SUCCESSFUL;
+    }
+
+    PageUpdate update;
+    update.fileName = fileName;
+    update.pageNum = 0;
+    LSN lsn;
+    std::lock_guard<std::mutex> guard(_mutex);
+    Transaction &txn = _transactions[_currentTxn];
+    if (!txn.firstLSN) {
+        append(LOG_BEGIN, _currentTxn, std::string(), txn.firstLSN);
+    }
+    append(LOG_REMOVE, _currentTxn, encodeUpdate(update), lsn);
+    txn.removedFiles.push_back(fileName);
+    return SUCCESSFUL;
+}
+
+/**
+ * Make the log durable up to lsn. The first thread to arrive writes and
+ * syncs everything appended so far; threads arriving meanwhile wait for
+ * it, and the next of them syncs all their records at once.
+ *
+ * @param lsn
+ *          the LSN
+ * @return status
+ */
+RC LogManager::flush(LSN lsn)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (_flushedLSN < lsn) {
+        if (_flushing) {
+            _flushed.wait(lock);
+            continue;
+        }
+
+        _flushing = true;
+        std::string data;
+        data.swap(_buffer);
+        LSN start = _flushedLSN;
+        LSN end = _nextLSN;
+        lock.unlock();
+
+        RC err = SUCCESSFUL;
+        size_t done = 0;
+        while (done < data.size() && err == SUCCESSFUL) {
+            ssize_t n = pwrite(_fd, data.data() + done, data.size() - done,
+                               LOG_HEADER_SIZE + (start - _baseLSN) + done);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                err = ERR_LOG;
+                break;
+            }
+            done += n;
+        }
+        if (err == SUCCESSFUL && fdatasync(_fd)) {
+            err = ERR_LOG;
+        }
+
+        lock.lock();
+        _flushing = false;
+        _flushed.notify_all();
+        if (err != SUCCESSFUL) {
+            __trace();
+            _buffer.insert(0, data);
+            return err;
+        }
+        _flushedLSN = end;
+        _syncCounter++;
+    }
+    return SUCCESSFUL;
+}
+
+/**
+ * Take a fuzzy checkpoint: nothing is written back; the log is truncated
+ * to the oldest change which may not be on the disk, or which belongs to
+ * a running transaction.
+ *
+ * @return status
+ */
+RC LogManager::checkpoint()
+{
+    if (!_open) {
+        return SUCCESSFUL;
+    }
+
+    RC err;
+    if ((err = runCheckpointHooks()) != SUCCESSFUL) {
+        __trace();
+        return err;
+    }
+
+    LSN keepLSN;
+    {
+        std::lock_guard<std::mutex> guard(_mutex);
+        keepLSN = _nextLSN;
+        std::unordered_map<unsigned long long, Transaction>::iterator it;
+        for (it = _transactions.begin(); it != _transactions.end(); it++) {
+            if (it->second.firstLSN && it->second.firstLSN < keepLSN) {
+                keepLSN = it->second.firstLSN;
+            }
+        }
+    }
+    LSN recLSN = PagedFileManager::instance()->getBufferManager()->getMinRecLSN();
+    if (recLSN && recLSN < keepLSN) {
+        keepLSN = recLSN;
+    }
+
+    LSN lsn;
+    std::string payload;
+    putBytes(payload, &keepLSN, sizeof(LSN));
+    {
+        std::lock_guard<std::mutex> guard(_mutex);
+        append(LOG_CHECKPOINT, 0, payload, lsn);
+        _checkpointLSN = lsn;
+    }
+    if ((err = flush(lsn)) != SUCCESSFUL) {
+        __trace();
+        return err;
+    }
+
+    // Pages written back so far must be durable before their records go,
+    // and so must the headers counting them
+    if (PagedFileManager::instance()->flushHeaders() != SUCCESSFUL
+            || DescriptorCache::instance()->sync() != SUCCESSFUL) {
+        __trace();
+        return ERR_LOG;
+    }
+    return truncate(keepLSN);
+}
+
+/**
+ * Have a function run before every checkpoint and when the log is closed.
+ *
+ * @param hook
+ *          the function; its status is the status of the checkpoint
+ */
+void LogManager::addCheckpointHook(const std::function<RC()> &hook)
+{
+    std::lock_guard<std::mutex> guard(_mutex);
+    _checkpointHooks.push_back(hook);
+}
+
+/**
+ * Run the checkpoint hooks, without holding _mutex: they may change pages.
+ *
+ * @return status
+ */
+RC LogManager::runCheckpointHooks()
+{
+    std::vector<std::function<RC()> > hooks;
+    {
+        std::lock_guard<std::mutex> guard(_mutex);
+        hooks = _checkpointHooks;
+    }
+    RC err;
+    for (size_t i = 0; i < hooks.size(); i++) {
+        if ((err = hooks[i]()) != SUCCESSFUL) {
+            __trace();
+            return err;
+        }
+    }
+    return SUCCESSFUL;
+}
+
+/**
+ * Drop the records which end before keepLSN, by copying the rest of the
+ * log to a new file.
+ */
+RC LogManager::truncate(LSN keepLSN)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (_flushing) {
+        _flushed.wait(lock);
+    }
+    // Keep other threads from writing the file meanwhile
+    _flushing = true;
+    LSN end = _flushedLSN;
+    lock.unlock();
+
+    std::string log(end - _baseLSN, '\0');
+    size_t done = 0;
+    RC err = SUCCESSFUL;
+    while (done < log.size()) {
+        ssize_t n = pread(_fd, &log[done], log.size() - done, LOG_HEADER_SIZE + done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            err = ERR_LOG;
+            break;
+        }
+        done += n;
+    }
+
+    // Cut at the first record which ends at keepLSN or later
+    size_t pos = 0;
+    LogRecordHeader header;
+    while (err == SUCCESSFUL && pos + sizeof(LogRecordHeader) <= log.size()) {
+        memcpy(&header, log.data() + pos, sizeof(LogRecordHeader));
+        if (_baseLSN + pos + header.length >= keepLSN) {
+            break;
+        }
+        pos += header.length;
+    }
+
+    if (err == SUCCESSFUL && pos > 0) {
+        std::string tmpName = _logName + ".tmp";
+        int fd = ::open(tmpName.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0 || writeLogHeader(fd, _baseLSN + pos) != SUCCESSFUL
+                || pwrite(fd, log.data() + pos, log.size() - pos, LOG_HEADER_SIZE) != (ssize_t) (log.size() - pos)
+                || fdatasync(fd) || rename(tmpName.c_str(), _logName.c_str())) {
+            __trace();
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            err = ERR_LOG;
+        } else {
+            ::close(_fd);
+            _fd = fd;
+        }
+    }
+
+    lock.lock();
+    if (err == SUCCESSFUL) {
+        _baseLSN += pos;
+    }
+    _flushing = false;
+    _flushed.notify_all();
+    return err;
+}
+
+/**
+ * Append a record to the log buffer. The caller holds _mutex.
+ *
+ * @param lsn
+ *          (return) the end of the record
+ */
+RC LogManager::append(LogRecordType type, unsigned long long txnId, const std::string &payload, LSN &lsn)
+{
+    LogRecordHeader header;
+    header.length = sizeof(LogRecordHeader) + payload.size();
+    header.checksum = checksum(payload.data(), payload.size());
+    header.type = type;
+    header.reserved = 0;
+    header.txnId = txnId;
+    putBytes(_buffer, &header, sizeof(header));
+    _buffer += payload;
+
+    _nextLSN += header.length;
+    lsn = _nextLSN;
+    return SUCCESSFUL;
+}
+
+RC LogManager::writeLogHeader(int fd, LSN baseLSN)
+{
+    char header[LOG_HEADER_SIZE];
+    unsigned magic = LOG_FILE_MAGIC;
+    unsigned version = LOG_FILE_VERSION;
+    memcpy(header, &magic, sizeof(magic));
+    memcpy(header + sizeof(magic), &version, sizeof(version));
+    memcpy(header + sizeof(magic) + sizeof(version), &baseLSN, sizeof(LSN));
+    if (pwrite(fd, header, LOG_HEADER_SIZE, 0) != LOG_HEADER_SIZE) {
+        return ERR_LOG;
+    }
+    return SUCCESSFUL;
+}
+
+/**
+ * Collect statistics of the log.
+ */
+void LogManager::collectCounterValues(unsigned &commitCount, unsigned &syncCount)
+{
+    std::lock_guard<std::mutex> guard(_mutex);
+    commitCount = _commitCounter;
+    syncCount = _syncCounter;
+}
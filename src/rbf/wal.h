@@ -0,0 +1,155 @@
+#ifndef _wal_h_
+#define _wal_h_
+
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+
+#include "pfm.h"
+
+#define LOG_FILE_MAGIC      0x314c575a  // "ZWL1" on disk
+#define LOG_FILE_VERSION    2
+#define LOG_HEADER_SIZE     16          // magic, version and the LSN of the first record
+#define CHECKPOINT_INTERVAL (4 << 20)   // bytes of log between two checkpoints
+
+// Types of log records
+typedef enum {
+    LOG_BEGIN = 1,      // a transaction made its first change
+    LOG_UPDATE,         // byte ranges of a page changed (before and after images)
+    LOG_COMMIT,         // a transaction is durable
+    LOG_ABORT,          // a transaction has been rolled back
+    LOG_CREATE,         // a file has been created; earlier records of its name are stale
+    LOG_CHECKPOINT,     // fuzzy checkpoint: the LSN redo starts from
+    LOG_REMOVE,         // a file is removed once the transaction commits
+} LogRecordType;
+
+// A changed byte range of a page
+struct PageDiff {
+    unsigned offset;
+    std::string before;
+    std::string after;
+};
+
+// The change of a page logged by one LOG_UPDATE record
+struct PageUpdate {
+    std::string fileName;
+    PageNum pageNum;
+    std::vector<PageDiff> diffs;
+};
+
+// Write-ahead log of page changes. Operations of the upper layers run as
+// transactions: every page change made by writePage() / appendPage() inside
+// a transaction is logged with its before and after images, and the buffer
+// pool writes a page back only once the log is durable up to the last change
+// of the page. A commit waits for its records to be durable; concurrent
+// commits share one fsync (group commit).
+//
+// A page changed by a transaction is locked until the transaction ends, so
+// that undoing its page images never overwrites changes of another one.
+// writePage() / appendPage() fail on pages of other transactions; callers
+// able to wait lock the page first, without holding any page latch.
+//
+// Files are created and removed in transactions as well: a rollback removes
+// the files its transaction created, and a file destroyed by a transaction
+// is only removed once the commit is durable.
+//
+// open() first recovers: the log is redone from the last checkpoint, then
+// the transactions which did not finish are undone. Checkpoints are fuzzy:
+// nothing is flushed, the log is only truncated up to the oldest change that
+// may not be on the disk yet.
+class LogManager
+{
+public:
+    static LogManager* instance();                          // Access to the _log_manager instance
+
+    RC open(const char *logName);                           // Recover, then log transactions in the file
+    RC close();                                             // Write back all pages and empty the log
+    bool isOpen();
+
+    RC beginTransaction();                                  // Start (or join) the transaction of this thread
+    // End the transaction of this thread. If it is rolled back, the names
+    // of the files whose pages were restored, or which were removed as the
+    // transaction created them, are put into undoneFiles.
+    RC commitTransaction(std::set<std::string> *undoneFiles = NULL);    // Commit it once its records are durable
+    RC abortTransaction(std::set<std::string> *undoneFiles = NULL);     // Roll it back (or have the outermost end do so)
+    static bool inTransaction();                            // Whether changes of this thread are logged
+
+    // Lock a page for the transaction of this thread until it ends. If wait
+    // is not set, a page of another transaction is not waited for.
+    RC lockPage(const std::string &fileName, PageNum pageNum, bool wait);
+
+    // Log a page change of the current transaction. lsn is the LSN the
+    // log must be flushed to before the page is written back.
+    RC logUpdate(const std::string &fileName, PageNum pageNum, unsigned pageSize,
+                 const void *before, const void *after, LSN &lsn);
+    RC logCreate(const std::string &fileName);              // Log the creation of a file
+    RC logRemove(const std::string &fileName);              // Remove a file once the transaction commits
+    RC flush(LSN lsn);                                      // Make the log durable up to lsn
+    RC checkpoint();                                        // Take a fuzzy checkpoint
+    // Have hook run before every checkpoint and when the log is closed, to
+    // save what is kept in memory only (e.g. the free space maps)
+    void addCheckpointHook(const std::function<RC()> &hook);
+
+    // Put the # of commits and of log syncs into variables
+    void collectCounterValues(unsigned &commitCount, unsigned &syncCount);
+
+protected:
+    LogManager();                                           // Constructor
+    ~LogManager();                                          // Destructor
+
+private:
+    struct Transaction {
+        LSN firstLSN;                       // LSN of its LOG_BEGIN record
+        std::vector<PageUpdate> updates;    // its changes, to roll it back
+        bool rollbackOnly;                  // a nested operation aborted
+        std::vector<std::string> createdFiles;  // removed by a rollback
+        std::vector<std::string> removedFiles;  // removed after the commit
+    };
+
+    RC rollback(std::set<std::string> *undoneFiles);        // Undo the transaction of this thread and end it
+    void unlockPages(unsigned long long txnId);             // Release the pages of an ended transaction
+
+    typedef std::pair<std::string, PageNum> PageKey;
+
+    RC recover(const std::string &log);                     // Redo / undo the records of a log
+    RC append(LogRecordType type, unsigned long long txnId, const std::string &payload, LSN &lsn);
+    RC truncate(LSN keepLSN);                               // Drop the records before keepLSN
+    RC runCheckpointHooks();
+    RC writeLogHeader(int fd, LSN baseLSN);
+
+    static LogManager *_log_manager;
+    static thread_local unsigned long long _currentTxn;     // 0 if the thread runs no transaction
+    static thread_local unsigned _txnDepth;                 // # of nested begins
+
+    std::string _logName;
+    int _fd;
+    std::atomic<bool> _open;                                // whether transactions are logged
+    std::mutex _mutex;                                      // guards all of the below
+    std::condition_variable _flushed;                       // signaled when a log sync completes
+    std::string _buffer;                                    // records not written yet
+    LSN _baseLSN;                                           // LSN of the first record in the file
+    LSN _nextLSN;                                           // end of the log
+    LSN _flushedLSN;                                        // end of the durable log
+    LSN _checkpointLSN;                                     // end of the last checkpoint record
+    bool _flushing;                                         // a thread is syncing the log
+    unsigned long long _nextTxnId;
+    std::unordered_map<unsigned long long, Transaction> _transactions;     // active transactions
+    std::vector<std::function<RC()> > _checkpointHooks;
+
+    std::mutex _lockMutex;                                  // guards the page locks (taken after _mutex)
+    std::condition_variable _unlocked;                      // signaled when a transaction releases its pages
+    std::map<PageKey, unsigned long long> _pageOwners;      // locked pages and their transactions
+    std::unordered_map<unsigned long long, std::vector<PageKey> > _ownedPages;      // pages of each transaction
+    std::unordered_map<unsigned long long, unsigned long long> _lockWaits;          // owner each waiter waits for
+
+    unsigned _commitCounter;
+    unsigned _syncCounter;
+};
+
+#endif
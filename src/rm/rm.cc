@@ -7,6 +7,7 @@
 #define INDEXES_NAME            "Indexes"
 #define TABLE_FILE_SUFFIX       ".tbl"
 #define INDEX_FILE_SUFFIX       ".idx"
+#define LOG_NAME                "Log"
 const int TABLES_ID             = 0;
 const int COLUMNS_ID            = 1;
 const int INDEXES_ID            = 2;
@@ -30,6 +31,10 @@ RelationManager* RelationManager::instance()
 RelationManager::RelationManager()
 {
     RC err;
+    // Recover the files before anything reads them
+    err = LogManager::instance()->open(LOG_NAME);
+    assert(err == SUCCESSFUL);
+
     _rbfm = RecordBasedFileManager::instance();
     _ixm = IndexManager::instance();
 
@@ -83,7 +88,13 @@ RelationManager::~RelationManager()
 {
 }
 
-RC RelationManager::createTable(const string &tableName, const vector<Attribute> &attrs)
+RC RelationManager::createTable(const string &tableName, const vector<Attribute> &attrs, unsigned pageSize)
+{
+    LogManager::instance()->beginTransaction();
+    return endTransaction(__createTable(tableName, attrs, pageSize));
+}
+
+RC RelationManager::__createTable(const string &tableName, const vector<Attribute> &attrs, unsigned pageSize)
 {
     RC err;
     if (!isPrivileged(tableName)) {
@@ -91,7 +102,7 @@ RC RelationManager::createTable(const string &tableName, const vector<Attribute>
     }
 
     // Create new file for the table
-    if ((err = _rbfm->createFile(getTableFileName(tableName))) != SUCCESSFUL) {
+    if ((err = _rbfm->createFile(getTableFileName(tableName), pageSize)) != SUCCESSFUL) {
         __trace();
 //        cout << "table: " << tableName << " err = " << err << endl;
         return err;
@@ -111,6 +122,12 @@ RC RelationManager::createTable(const string &tableName, const vector<Attribute>
 }
 
 RC RelationManager::deleteTable(const string &tableName)
+{
+    LogManager::instance()->beginTransaction();
+    return endTransaction(__deleteTable(tableName));
+}
+
+RC RelationManager::__deleteTable(const string &tableName)
 {
     RC err;
     if (!isPrivileged(tableName)) {
@@ -123,23 +140,9 @@ RC RelationManager::deleteTable(const string &tableName)
         return err;
     }
 
-    // Close file (if opened) and drop the cached file handle
-    FileHandle handle;
-    if ((err = getCachedTableHandle(tableName, handle)) == SUCCESSFUL) {
-        _rbfm->closeFile(handle);
-        dropTableHandle(tableName);
-    }
-
-    // Delete the file of the table
-    if ((err = _rbfm->destroyFile(getTableFileName(tableName))) != SUCCESSFUL) {
-        __trace();
-        cout << "err = " << err << endl;
-        return err;
-    }
-
-    // TODO: delete all existing indexes
+    // Delete all existing indexes
     for (auto it = attrs.begin(); it != attrs.end(); ++it) {
-        err = destroyIndex(tableName, it->name);
+        err = __destroyIndex(tableName, it->name);
         if (err != SUCCESSFUL && err != ERR_NO_SUCH_INDEX) {
             __trace();
             return err;
@@ -153,6 +156,21 @@ RC RelationManager::deleteTable(const string &tableName)
         return err;
     }
 
+    // Close file (if opened) and drop the cached file handle
+    FileHandle handle;
+    if ((err = getCachedTableHandle(tableName, handle)) == SUCCESSFUL) {
+        _rbfm->closeFile(handle);
+        dropTableHandle(tableName);
+    }
+    deletedTuples.erase(tableName);
+
+    // Delete the file of the table last: it goes once the transaction commits
+    if ((err = _rbfm->destroyFile(getTableFileName(tableName))) != SUCCESSFUL) {
+        __trace();
+        cout << "err = " << err << endl;
+        return err;
+    }
+
     return SUCCESSFUL;
 }
 
@@ -180,6 +198,12 @@ RC RelationManager::getAttributes(const string &tableName, vector<Attribute> &at
 }
 
 RC RelationManager::insertTuple(const string &tableName, const void *data, RID &rid)
+{
+    LogManager::instance()->beginTransaction();
+    return endTransaction(__insertTuple(tableName, data, rid));
+}
+
+RC RelationManager::__insertTuple(const string &tableName, const void *data, RID &rid)
 {
 //    __trace();
     RC err;
@@ -221,7 +245,61 @@ RC RelationManager::insertTuple(const string &tableName, const void *data, RID &
     return SUCCESSFUL;
 }
 
+RC RelationManager::insertTuples(const string &tableName, const vector<const void *> &tuples, vector<RID> &rids)
+{
+    LogManager::instance()->beginTransaction();
+    return endTransaction(__insertTuples(tableName, tuples, rids));
+}
+
+RC RelationManager::__insertTuples(const string &tableName, const vector<const void *> &tuples, vector<RID> &rids)
+{
+    RC err;
+
+    if (!isPrivileged(tableName)) {
+        return ERR_NO_PERMISSION;
+    }
+
+    // Get file handle and update handle cache
+    FileHandle fileHandle;
+    if ((err = getTableFileHandle(tableName, fileHandle)) != SUCCESSFUL) {
+        __trace();
+        cout << "err = " << err << endl;
+        return err;
+    }
+    cacheTableHandle(tableName, fileHandle);
+
+    // Get table attribute descriptor
+    vector<Attribute> attrs;
+    if ((err = getAttributes(tableName, attrs)) != SUCCESSFUL) {
+        __trace();
+        cout << "err = " << err << endl;
+        return err;
+    }
+
+    // Call RBFM layer: the tuples are written page by page
+    if ((err = _rbfm->insertRecords(fileHandle, attrs, tuples, rids)) != SUCCESSFUL) {
+        __trace();
+        cout << "err = " << err << endl;
+        return err;
+    }
+
+    for (size_t i = 0; i < rids.size(); i++) {
+        if ((err = insertIndexEntries(tableName, attrs, rids[i])) != SUCCESSFUL) {
+            __trace();
+            return err;
+        }
+    }
+
+    return SUCCESSFUL;
+}
+
 RC RelationManager::deleteTuples(const string &tableName)
+{
+    LogManager::instance()->beginTransaction();
+    return endTransaction(__deleteTuples(tableName));
+}
+
+RC RelationManager::__deleteTuples(const string &tableName)
 {
     __trace();
     RC err;
@@ -245,6 +323,7 @@ RC RelationManager::deleteTuples(const string &tableName)
         cout << "err = " << err << endl;
         return err;
     }
+    deletedTuples[tableName] = RECLAIM_THRESHOLD;
 
     // TODO: Call IX layer: clear all indexes entries
     // Get table attribute descriptor
@@ -285,6 +364,12 @@ RC RelationManager::deleteTuples(const string &tableName)
 }
 
 RC RelationManager::deleteTuple(const string &tableName, const RID &rid)
+{
+    LogManager::instance()->beginTransaction();
+    return endTransaction(__deleteTuple(tableName, rid));
+}
+
+RC RelationManager::__deleteTuple(const string &tableName, const RID &rid)
 {
 //    __trace();
     RC err;
@@ -322,11 +407,18 @@ RC RelationManager::deleteTuple(const string &tableName, const RID &rid)
         cout << "err = " << err << endl;
         return err;
     }
+    deletedTuples[tableName]++;
 
     return SUCCESSFUL;
 }
 
 RC RelationManager::updateTuple(const string &tableName, const void *data, const RID &rid)
+{
+    LogManager::instance()->beginTransaction();
+    return endTransaction(__updateTuple(tableName, data, rid));
+}
+
+RC RelationManager::__updateTuple(const string &tableName, const void *data, const RID &rid)
 {
 //    __trace();
     RC err;
@@ -364,6 +456,7 @@ RC RelationManager::updateTuple(const string &tableName, const void *data, const
         cout << "err = " << err << endl;
         return err;
     }
+    deletedTuples[tableName]++;
 
     // TODO: insert new indices
     if ((err = insertIndexEntries(tableName, attrs, rid)) != SUCCESSFUL) {
@@ -406,6 +499,30 @@ RC RelationManager::readTuple(const string &tableName, const RID &rid, void *dat
     return SUCCESSFUL;
 }
 
+RC RelationManager::prefetchTuples(const string &tableName, const vector<RID> &rids)
+{
+    RC err;
+
+    // Get file handle
+    FileHandle fileHandle;
+    if ((err = getTableFileHandle(tableName, fileHandle)) != SUCCESSFUL) {
+        __trace();
+        return err;
+    }
+    cacheTableHandle(tableName, fileHandle);
+
+    vector<PageNum> pageNums;
+    for (size_t i = 0; i < rids.size(); i++) {
+        pageNums.push_back(rids[i].pageNum);
+    }
+    if ((err = fileHandle.prefetchPages(pageNums)) != SUCCESSFUL) {
+        __trace();
+        return err;
+    }
+
+    return SUCCESSFUL;
+}
+
 RC RelationManager::readAttribute(const string &tableName, const RID &rid, const string &attributeName, void *data)
 {
     RC err;
@@ -477,7 +594,8 @@ RC RelationManager::scan(const string &tableName,
       const CompOp compOp,
       const void *value,
       const vector<string> &attributeNames,
-      RM_ScanIterator &rm_ScanIterator)
+      RM_ScanIterator &rm_ScanIterator,
+      ScanMode scanMode)
 {
     RC err;
 
@@ -515,7 +633,8 @@ RC RelationManager::scan(const string &tableName,
                            conditionAttribute,
                            compOp, value,
                            attributeNames,
-                           rbfm_ScanIterator)) != SUCCESSFUL) {
+                           rbfm_ScanIterator,
+                           scanMode)) != SUCCESSFUL) {
         __trace();
         cout << "err = " << err << endl;
         return err;
@@ -528,6 +647,11 @@ RC RelationManager::scan(const string &tableName,
 // TODO
 // attributeName does not contain table name
 RC RelationManager::createIndex(const string &tableName, const string &attributeName) {
+    LogManager::instance()->beginTransaction();
+    return endTransaction(__createIndex(tableName, attributeName));
+}
+
+RC RelationManager::__createIndex(const string &tableName, const string &attributeName) {
     RC err;
     int tableId;
 
@@ -589,6 +713,11 @@ RC RelationManager::createIndex(const string &tableName, const string &attribute
 // TODO
 // attributeName does not contain table name
 RC RelationManager::destroyIndex(const string &tableName, const string &attributeName) {
+    LogManager::instance()->beginTransaction();
+    return endTransaction(__destroyIndex(tableName, attributeName));
+}
+
+RC RelationManager::__destroyIndex(const string &tableName, const string &attributeName) {
     RC err;
     int tableId;
 
@@ -1499,6 +1628,126 @@ RC RelationManager::getIndexFileHandle(const string &indexName, IXFileHandle &fi
     return SUCCESSFUL;
 }
 
+/**
+ * Commit the transaction of an operation. If the operation failed, roll
+ * it back instead: the handles of the files it created are dropped, the
+ * free space maps of the tables whose pages were restored are rebuilt,
+ * and so are the catalog maps. A commit also rolls back if a nested
+ * operation failed.
+ *
+ * @param err
+ *          the status of the operation
+ * @return err, or the status of the commit
+ */
+RC RelationManager::endTransaction(RC err) {
+    LogManager *logManager = LogManager::instance();
+    set<string> undoneFiles;
+    if (err == SUCCESSFUL) {
+        if ((err = logManager->commitTransaction(&undoneFiles)) != ERR_ABORTED) {
+            if (err == SUCCESSFUL) {
+                reclaimDeletedSpace();
+            }
+            return err;
+        }
+    } else if (logManager->abortTransaction(&undoneFiles) != SUCCESSFUL) {
+        __trace();
+        return err;
+    }
+    unordered_map<string, FileHandle>::iterator it = tableHandles.begin();
+    while (it != tableHandles.end() && !undoneFiles.empty()) {
+        if (!undoneFiles.count(it->second.getFileName())) {
+            it++;
+        } else if (it->second.isRemoved()) {
+            _rbfm->closeFile(it->second);
+            it = tableHandles.erase(it);
+        } else {
+            SpaceManager::instance()->bufferSizeInfo(it->second.getFileName(), it->second);
+            it++;
+        }
+    }
+    unordered_map<string, IXFileHandle>::iterator index = indexHandles.begin();
+    while (index != indexHandles.end() && !undoneFiles.empty()) {
+        if (undoneFiles.count(index->second._primaryHandle.getFileName())
+                && index->second._primaryHandle.isRemoved()) {
+            _ixm->closeFile(index->second);
+            index = indexHandles.erase(index);
+        } else {
+            index++;
+        }
+    }
+
+    if (undoneFiles.count(TABLES_NAME) || undoneFiles.count(COLUMNS_NAME) || undoneFiles.count(INDEXES_NAME)) {
+        tableNameMap.clear();
+        schemaMap.clear();
+        indexMap.clear();
+        if (bufferMappings() != SUCCESSFUL) {
+            __trace();
+        }
+    }
+    return err;
+}
+
+void RelationManager::reclaimDeletedSpace() {
+    if (LogManager::inTransaction()) {
+        return;
+    }
+    vector<string> tableNames;
+    for (auto it = deletedTuples.begin(); it != deletedTuples.end(); ++it) {
+        if (it->second >= RECLAIM_THRESHOLD) {
+            tableNames.push_back(it->first);
+        }
+    }
+    for (size_t i = 0; i < tableNames.size(); i++) {
+        if (reclaimSpace(tableNames[i]) != SUCCESSFUL) {
+            __trace();
+        }
+    }
+}
+
+RC RelationManager::reclaimSpace(const string &tableName) {
+    RC err;
+    // The layers below reclaim nothing within a transaction (it is not logged)
+    if (LogManager::inTransaction()) {
+        return SUCCESSFUL;
+    }
+    deletedTuples.erase(tableName);
+
+    FileHandle fileHandle;
+    if ((err = getTableFileHandle(tableName, fileHandle)) != SUCCESSFUL) {
+        __trace();
+        return err;
+    }
+    cacheTableHandle(tableName, fileHandle);
+    if ((err = _rbfm->reclaimSpace(fileHandle)) != SUCCESSFUL) {
+        __trace();
+        return err;
+    }
+
+    int tableId;
+    if ((err = getTableId(tableName, tableId)) != SUCCESSFUL) {
+        __trace();
+        return err;
+    }
+    if (indexMap.count(tableId) == 0) {
+        return SUCCESSFUL;
+    }
+    vector<pair<Attribute, RID> > &keys = indexMap[tableId];
+    for (auto it = keys.begin(); it != keys.end(); ++it) {
+        string indexName = getIndexName(it->first.name, tableId);
+        IXFileHandle ixfileHandle;
+        if ((err = getIndexFileHandle(indexName, ixfileHandle)) != SUCCESSFUL) {
+            __trace();
+            return err;
+        }
+        cacheIndexHandle(indexName, ixfileHandle);
+        if ((err = _ixm->reclaimSpace(ixfileHandle, it->first)) != SUCCESSFUL) {
+            __trace();
+            return err;
+        }
+    }
+    return SUCCESSFUL;
+}
+
 RC RelationManager::getAttributeFromString(const string &tableName, const string &attributeName, Attribute &attr) {
     RC err;
     vector<Attribute> attrs;
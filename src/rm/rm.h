@@ -15,12 +15,14 @@
 #include <cstddef>
 
 #include "../rbf/rbfm.h"
+#include "../rbf/wal.h"
 #include "../ix/ix.h"
 
 using namespace std;
 
 
 # define RM_EOF (-1)  // end of a scan operator
+# define RECLAIM_THRESHOLD 1024     // # of tuples deleted from a table before its space is reclaimed
 
 // RM_ScanIterator is an iteratr to go through tuples
 // The way to use it is like the following:
@@ -46,6 +48,16 @@ public:
       return rbfm_ScanIterator.getNextRecord(rid, data);
   }
 
+  // The whole tuple, read in place (see RecordView)
+  RC getNextTupleView(RID &rid, RecordView &view) {
+      return rbfm_ScanIterator.getNextRecordView(rid, view);
+  }
+
+  // Up to maxTuples tuples at once (see RecordBatch)
+  RC getNextBatch(unsigned maxTuples, RecordBatch &batch) {
+      return rbfm_ScanIterator.getNextBatch(maxTuples, batch);
+  }
+
   RC close() {
       return rbfm_ScanIterator.close();
   }
@@ -83,7 +95,8 @@ class RelationManager
 public:
   static RelationManager* instance();
 
-  RC createTable(const string &tableName, const vector<Attribute> &attrs);
+  // Tables of wide records (or scanned a lot) may use larger pages
+  RC createTable(const string &tableName, const vector<Attribute> &attrs, unsigned pageSize = PAGE_SIZE);
 
   RC deleteTable(const string &tableName);
 
@@ -91,6 +104,9 @@ public:
 
   RC insertTuple(const string &tableName, const void *data, RID &rid);
 
+  // Insert many tuples at once into new pages of the table (e.g. loads)
+  RC insertTuples(const string &tableName, const vector<const void *> &tuples, vector<RID> &rids);
+
   RC deleteTuples(const string &tableName);
 
   RC deleteTuple(const string &tableName, const RID &rid);
@@ -100,17 +116,25 @@ public:
 
   RC readTuple(const string &tableName, const RID &rid, void *data);
 
+  // Start reading the pages of the given tuples in the background
+  RC prefetchTuples(const string &tableName, const vector<RID> &rids);
+
   RC readAttribute(const string &tableName, const RID &rid, const string &attributeName, void *data);
 
   RC reorganizePage(const string &tableName, const unsigned pageNumber);
 
+  // Give the disk space left by deletions in the table and its indexes back.
+  // Also done after a commit once enough tuples of the table have been deleted.
+  RC reclaimSpace(const string &tableName);
+
   // scan returns an iterator to allow the caller to go through the results one by one.
   RC scan(const string &tableName,
       const string &conditionAttribute,
       const CompOp compOp,                  // comparision type such as "<" and "="
       const void *value,                    // used in the comparison
       const vector<string> &attributeNames, // a list of projected attributes
-      RM_ScanIterator &rm_ScanIterator);
+      RM_ScanIterator &rm_ScanIterator,
+      ScanMode scanMode = SCAN_SERIAL);     // see RecordBasedFileManager::scan()
 
   // Index related functions
 public:
@@ -127,6 +151,21 @@ public:
                         bool highKeyInclusive,
                         RM_IndexScanIterator &rm_IndexScanIterator);
 private:
+  // Bodies of the operations above, each of which runs as one transaction
+  RC __createTable(const string &tableName, const vector<Attribute> &attrs, unsigned pageSize);
+  RC __deleteTable(const string &tableName);
+  RC __insertTuple(const string &tableName, const void *data, RID &rid);
+  RC __insertTuples(const string &tableName, const vector<const void *> &tuples, vector<RID> &rids);
+  RC __deleteTuples(const string &tableName);
+  RC __deleteTuple(const string &tableName, const RID &rid);
+  RC __updateTuple(const string &tableName, const void *data, const RID &rid);
+  RC __createIndex(const string &tableName, const string &attributeName);
+  RC __destroyIndex(const string &tableName, const string &attributeName);
+  // Commit the transaction of an operation, or roll it back if it failed
+  RC endTransaction(RC err);
+  // Reclaim the space of the tables with enough deletions, outside of transactions
+  void reclaimDeletedSpace();
+
   RC insertIndexEntry(const int &tableId, const Attribute &attribute, const void *key, const RID &rid);
   RC deleteIndexEntry(const int &tableId, const Attribute &attribute, const void *key, const RID &rid);
   // Insert/delete all index entries associated with one new/old record content
@@ -252,6 +291,9 @@ private:
   // A map from the table name to its id and its RID in "Tables"
   unordered_map<string, pair<int, RID> > tableNameMap;
 
+  // A map from the table name to the # of its tuples deleted (or moved) since its space was reclaimed
+  unordered_map<string, unsigned> deletedTuples;
+
   // Max table id
   int maxTableId;
 
@@ -0,0 +1,89 @@
+#include "test_util.h"
+
+// Count the records of a catalog table
+int countCatalogRecords(const string &catalogName)
+{
+    vector<Attribute> attrs;
+    RC rc = rm->getAttributes(catalogName, attrs);
+    assert(rc == success);
+
+    vector<string> projected_attrs;
+    for (unsigned i = 0; i < attrs.size(); i++) {
+        projected_attrs.push_back(attrs[i].name);
+    }
+
+    RM_ScanIterator rmsi;
+    rc = rm->scan(catalogName, "", NO_OP, NULL, projected_attrs, rmsi);
+    assert(rc == success);
+
+    RID rid;
+    char returnedData[PAGE_SIZE];
+    int count = 0;
+    while (rmsi.getNextTuple(rid, returnedData) != RM_EOF) {
+        count++;
+    }
+    rmsi.close();
+    return count;
+}
+
+void TEST_RM_17(const string &tableName)
+{
+    // Functions Tested:
+    // 1. Create Index on one attribute of a table
+    // 2. Delete Table with an index (and attributes without one)
+    // 3. Catalog of the tables and indexes after the deletion
+    // 4. Create Table and Index again with the same names
+    cout << "****In Test case 17****" << endl;
+
+    int tables = countCatalogRecords("Tables");
+    int indexes = countCatalogRecords("Indexes");
+
+    createTable(tableName);
+    RC rc = rm->createIndex(tableName, "Age");
+    assert(rc == success);
+    assert(countCatalogRecords("Indexes") == indexes + 1);
+
+    RID rid;
+    int tupleSize = 0;
+    void *tuple = malloc(100);
+    for (int i = 0; i < 100; i++) {
+        prepareTuple(6, "Tester", 20 + i % 30, (float) i, 100 * i, tuple, &tupleSize);
+        rc = rm->insertTuple(tableName, tuple, rid);
+        assert(rc == success);
+    }
+
+    // Only "Age" has an index: the other attributes must not undo the deletion
+    rc = rm->deleteTable(tableName);
+    assert(rc == success);
+    if (countCatalogRecords("Tables") != tables || countCatalogRecords("Indexes") != indexes) {
+        cout << "The catalog still describes the deleted table or its index." << endl;
+        cout << "****Test case 17 failed****" << endl << endl;
+        free(tuple);
+        return;
+    }
+    vector<Attribute> attrs;
+    assert(rm->getAttributes(tableName, attrs) != success);
+
+    // Nothing of the table is left behind
+    createTable(tableName);
+    rc = rm->createIndex(tableName, "Age");
+    assert(rc == success);
+    rc = rm->insertTuple(tableName, tuple, rid);
+    assert(rc == success);
+    rc = rm->deleteTable(tableName);
+    assert(rc == success);
+    assert(countCatalogRecords("Indexes") == indexes);
+
+    free(tuple);
+    cout << "****Test case 17 passed****" << endl << endl;
+}
+
+int main()
+{
+    cout << endl << "Test Delete Table with an Index .." << endl;
+
+    // Delete a table with an index
+    TEST_RM_17("tbl_indexed_employee");
+
+    return 0;
+}